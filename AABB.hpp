@@ -0,0 +1,62 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <limits>
+
+// Axis aligned bounding box.  A default constructed box is empty and absorbs nothing.
+struct AABB {
+	AABB()
+		: min(std::numeric_limits<float>::max()),
+		  max(-std::numeric_limits<float>::max()) { }
+
+	AABB(const glm::vec3 & min, const glm::vec3 & max)
+		: min(min),
+		  max(max) { }
+
+	bool empty() const {
+		return min.x > max.x;
+	}
+
+	void expand(const glm::vec3 & point) {
+		min = glm::min(min, point);
+		max = glm::max(max, point);
+	}
+
+	void expand(const AABB & other) {
+		min = glm::min(min, other.min);
+		max = glm::max(max, other.max);
+	}
+
+	glm::vec3 center() const {
+		return 0.5f * (min + max);
+	}
+
+	glm::vec3 extents() const {
+		return 0.5f * (max - min);
+	}
+
+	glm::vec3 min;
+	glm::vec3 max;
+};
+
+//---------------------------------------------------------------------------------------
+// Returns the smallest box enclosing box after the affine transform m.
+inline AABB transformAABB (
+		const AABB & box,
+		const glm::mat4 & m
+) {
+	if (box.empty()) {
+		return box;
+	}
+	glm::vec3 center = glm::vec3(m * glm::vec4(box.center(), 1.0f));
+	glm::vec3 extents = box.extents();
+	glm::vec3 radius;
+	for (int row = 0; row < 3; ++row) {
+		radius[row] = std::abs(m[0][row]) * extents.x
+			+ std::abs(m[1][row]) * extents.y
+			+ std::abs(m[2][row]) * extents.z;
+	}
+	return AABB(center - radius, center + radius);
+}
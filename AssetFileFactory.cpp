@@ -0,0 +1,88 @@
+#include "AssetFileFactory.hpp"
+
+#include <algorithm>
+#include <string>
+using namespace std;
+using namespace irrklang;
+
+namespace {
+
+//---------------------------------------------------------------------------------------
+// Reads one blob of the mapped pack.  irrKlang positions are 32 bit, which packed
+// sounds never come close to.
+class AssetFileReader : public IFileReader {
+public:
+	AssetFileReader(const char * data, size_t size, const ik_c8 * fileName)
+		: m_data(data),
+		  m_size((ik_s32)size),
+		  m_pos(0),
+		  m_fileName(fileName)
+	{
+
+	}
+
+	virtual ik_s32 read(void * buffer, ik_u32 sizeToRead) override {
+		ik_s32 count = (ik_s32)std::min<ik_u32>(sizeToRead, m_size - m_pos);
+		copy(m_data + m_pos, m_data + m_pos + count, (char *)buffer);
+		m_pos += count;
+		return count;
+	}
+
+	virtual bool seek(ik_s32 finalPos, bool relativeMovement) override {
+		ik_s32 pos = relativeMovement ? m_pos + finalPos : finalPos;
+		if (pos < 0 || pos > m_size) {
+			return false;
+		}
+		m_pos = pos;
+		return true;
+	}
+
+	virtual ik_s32 getSize() override {
+		return m_size;
+	}
+
+	virtual ik_s32 getPos() override {
+		return m_pos;
+	}
+
+	virtual const ik_c8 * getFileName() override {
+		return m_fileName.c_str();
+	}
+
+private:
+	const char * m_data;
+	ik_s32 m_size;
+	ik_s32 m_pos;
+	string m_fileName;
+};
+
+} // namespace
+
+//---------------------------------------------------------------------------------------
+AssetFileFactory::AssetFileFactory(const AssetPack & assets)
+	: m_assets(assets)
+{
+
+}
+
+//---------------------------------------------------------------------------------------
+irrklang::IFileReader * AssetFileFactory::createFileReader(const irrklang::ik_c8 * fileName) {
+	string name = m_assets.nameOf(fileName);
+	const char * data;
+	size_t size;
+	if (name.empty() || !m_assets.find(name, data, size)) {
+		return nullptr;
+	}
+	return new AssetFileReader(data, size, fileName);
+}
+
+//---------------------------------------------------------------------------------------
+void AssetFileFactory::install(irrklang::ISoundEngine * engine, const AssetPack & assets) {
+	if (!engine || !assets.isOpen()) {
+		return;
+	}
+	AssetFileFactory * factory = new AssetFileFactory(assets);
+	engine->addFileFactory(factory);
+	// The engine holds its own reference.
+	factory->drop();
+}
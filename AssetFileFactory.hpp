@@ -0,0 +1,26 @@
+#pragma once
+
+#include "framework/AssetPack.hpp"
+
+#include <irrKlang.h>
+
+/*
+ * Lets irrKlang read sounds straight out of an AssetPack.  A file under the pack's
+ * root that the pack holds is served from the mapping; for anything else it returns
+ * no reader, and irrKlang opens the file itself.
+ *
+ * Reference counts are not thread safe, so every engine gets a factory of its own.
+ * assets must outlive the engine, and every sound or source it created.
+ */
+class AssetFileFactory : public irrklang::IFileFactory {
+public:
+	explicit AssetFileFactory(const AssetPack & assets);
+
+	virtual irrklang::IFileReader * createFileReader(const irrklang::ik_c8 * fileName) override;
+
+	// Registers a new factory over assets with engine, if assets has a pack open.
+	static void install(irrklang::ISoundEngine * engine, const AssetPack & assets);
+
+private:
+	const AssetPack & m_assets;
+};
@@ -1,59 +1,62 @@
 #version 330
 
-struct SpotLight {
-    vec3 position;
-    vec3 rgbIntensity;
-    float cosCutOff;
-    vec3 dir;
-    float exp;
+// Per-frame values shared by every draw, mirrored by FrameUniforms in Project.hpp.
+layout(std140) uniform FrameUniforms {
+	mat4 Perspective;
+	mat4 View;
+	vec4 lightPosition; // Eye-space
+	vec4 lightDir;      // Eye-space
+	vec4 lightRgbIntensity;
+	vec4 ambientIntensity;
+	float lightCosCutOff;
+	int infrared;
+	int useTextureArray;
+	int texturesEnabled;
+};
+
+struct Material {
+    vec4 kd;
+    vec3 ks;
+    float shininess;
 };
 
 in VsOutFsIn {
 	vec3 position_ES; // Eye-space position
 	vec3 normal_ES;   // Eye-space normal
-	SpotLight light;
+	Material material;
 	vec2 tex;
+	flat float texLayer; // texture index, negative when untextured
 } fs_in;
 
 
 out vec4 fragColour;
 
-struct Material {
-    vec4 kd;
-    vec3 ks;
-    float shininess;
-};
-uniform Material material;
-
-// Ambient light intensity for each RGB component.
-uniform vec3 ambientIntensity;
-
 uniform sampler2D ourTexture;
-uniform bool textured;
-uniform bool infrared;
+uniform sampler2DArray textureArray;
 
 vec3 phongModel(vec3 fragPosition, vec3 fragNormal) {
     vec3 tex;
-    if (textured) {
-    	tex = texture(ourTexture, fs_in.tex).xyz;
+    bool sampled = texturesEnabled != 0 && fs_in.texLayer >= 0.0;
+    if (sampled) {
+    	if (useTextureArray != 0) {
+    		tex = texture(textureArray, vec3(fs_in.tex, fs_in.texLayer)).xyz;
+    	} else {
+    		tex = texture(ourTexture, fs_in.tex).xyz;
+    	}
     }
-    SpotLight light = fs_in.light;
+    Material material = fs_in.material;
     // Direction from fragment to light source.
-    vec3 l = normalize(light.position - fragPosition);
-    float spotdot = dot(-l, light.dir);
-    float spotatten;
-    if (spotdot < light.cosCutOff) {
-	spotatten = 0.0;
-    } else {
-	spotatten = pow(spotdot, light.exp);
-    }
+    vec3 l = normalize(lightPosition.xyz - fragPosition);
+    float spotdot = dot(-l, lightDir.xyz);
+    // Hard edged spot: the falloff exponent has never been applied.
+    float spotatten = spotdot < lightCosCutOff ? 0.0 : 1.0;
     // Direction from fragment to viewer (origin - fragPosition).
     vec3 v = normalize(-fragPosition.xyz);
 
     float n_dot_l = max(dot(fragNormal, l), 0.0);
     vec3 diffuse;
     vec3 ambient;
-    if (textured && !infrared) {
+    if (sampled && infrared == 0) {
     	diffuse =  tex * n_dot_l * spotatten;
 	ambient = tex;
     } else {
@@ -69,12 +72,12 @@ vec3 phongModel(vec3 fragPosition, vec3 fragNormal) {
 
         specular = material.ks * pow(n_dot_h, material.shininess) * spotatten;
     }
-    return ambientIntensity*ambient + ambient*light.rgbIntensity * (diffuse + specular);
+    return ambientIntensity.xyz*ambient + ambient*lightRgbIntensity.xyz * (diffuse + specular);
 }
 
 void main() {
 	fragColour = vec4(phongModel(fs_in.position_ES, fs_in.normal_ES), 1.0);
-	if (infrared) {
-		fragColour = vec4(phongModel(fs_in.position_ES, fs_in.normal_ES), material.kd.w);
+	if (infrared != 0) {
+		fragColour = vec4(phongModel(fs_in.position_ES, fs_in.normal_ES), fs_in.material.kd.w);
 	}
 }
@@ -0,0 +1,64 @@
+#version 330
+
+// Model-Space coordinates
+in vec3 position;
+in vec3 normal;
+in vec2 tex;
+
+// Per-instance attributes, advanced once per instance (see glVertexAttribDivisor).
+in mat4 instanceModel;
+in int instanceMaterialIndex;
+in float instanceTexLayer;
+
+// Per-frame values shared by every draw, mirrored by FrameUniforms in Project.hpp.
+layout(std140) uniform FrameUniforms {
+	mat4 Perspective;
+	mat4 View;
+	vec4 lightPosition; // Eye-space
+	vec4 lightDir;      // Eye-space
+	vec4 lightRgbIntensity;
+	vec4 ambientIntensity;
+	float lightCosCutOff;
+	int infrared;
+	int useTextureArray;
+	int texturesEnabled;
+};
+
+struct Material {
+    vec4 kd;
+    vec3 ks;
+    float shininess;
+};
+
+struct MaterialEntry {
+	vec4 kd;
+	vec4 ksShininess; // xyz = ks, w = shininess
+};
+layout(std140) uniform MaterialUniforms {
+	MaterialEntry materials[256];
+};
+
+out VsOutFsIn {
+	vec3 position_ES; // Eye-space position
+	vec3 normal_ES;   // Eye-space normal
+	Material material;
+	vec2 tex;
+	flat float texLayer;
+} vs_out;
+
+
+void main() {
+	vec4 pos4 = vec4(position, 1.0);
+	mat4 modelView = View * instanceModel;
+	mat3 normalMatrix = transpose(inverse(mat3(modelView)));
+
+	//-- Convert position and normal to Eye-Space:
+	vs_out.position_ES = (modelView * pos4).xyz;
+	vs_out.normal_ES = normalize(normalMatrix * normal);
+	vs_out.tex = tex;
+	vs_out.texLayer = instanceTexLayer;
+	vs_out.material.kd = materials[instanceMaterialIndex].kd;
+	vs_out.material.ks = materials[instanceMaterialIndex].ksShininess.xyz;
+	vs_out.material.shininess = materials[instanceMaterialIndex].ksShininess.w;
+	gl_Position = Perspective * modelView * pos4;
+}
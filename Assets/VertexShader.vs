@@ -4,38 +4,61 @@
 in vec3 position;
 in vec3 normal;
 in vec2 tex;
+in float texLayer;
 
-struct SpotLight {
-    vec3 position;
-    vec3 rgbIntensity;
-    float cosCutOff;
-    vec3 dir;
-    float exp;
+// Per-frame values shared by every draw, mirrored by FrameUniforms in Project.hpp.
+layout(std140) uniform FrameUniforms {
+	mat4 Perspective;
+	mat4 View;
+	vec4 lightPosition; // Eye-space
+	vec4 lightDir;      // Eye-space
+	vec4 lightRgbIntensity;
+	vec4 ambientIntensity;
+	float lightCosCutOff;
+	int infrared;
+	int useTextureArray;
+	int texturesEnabled;
 };
-uniform SpotLight light;
 
-uniform mat4 ModelView;
-uniform mat4 Perspective;
+struct Material {
+    vec4 kd;
+    vec3 ks;
+    float shininess;
+};
+
+struct MaterialEntry {
+	vec4 kd;
+	vec4 ksShininess; // xyz = ks, w = shininess
+};
+layout(std140) uniform MaterialUniforms {
+	MaterialEntry materials[256];
+};
 
-// Remember, this is transpose(inverse(ModelView)).  Normals should be
-// transformed using this matrix instead of the ModelView matrix.
-uniform mat3 NormalMatrix;
+uniform mat4 Model;
+uniform int materialIndex;
 
 out VsOutFsIn {
 	vec3 position_ES; // Eye-space position
 	vec3 normal_ES;   // Eye-space normal
-	SpotLight light;
+	Material material;
 	vec2 tex;
+	flat float texLayer;
 } vs_out;
 
 
 void main() {
 	vec4 pos4 = vec4(position, 1.0);
+	mat4 modelView = View * Model;
+	// Normals are transformed by transpose(inverse(ModelView)) rather than ModelView.
+	mat3 normalMatrix = transpose(inverse(mat3(modelView)));
 
 	//-- Convert position and normal to Eye-Space:
-	vs_out.position_ES = (ModelView * pos4).xyz;
-	vs_out.normal_ES = normalize(NormalMatrix * normal);
+	vs_out.position_ES = (modelView * pos4).xyz;
+	vs_out.normal_ES = normalize(normalMatrix * normal);
 	vs_out.tex = tex;
-	vs_out.light = light;
-	gl_Position = Perspective * ModelView * vec4(position, 1.0);
+	vs_out.texLayer = texLayer;
+	vs_out.material.kd = materials[materialIndex].kd;
+	vs_out.material.ks = materials[materialIndex].ksShininess.xyz;
+	vs_out.material.shininess = materials[materialIndex].ksShininess.w;
+	gl_Position = Perspective * modelView * pos4;
 }
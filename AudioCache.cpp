@@ -0,0 +1,188 @@
+#include "AudioCache.hpp"
+
+#include "AssetFileFactory.hpp"
+
+#include <chrono>
+#include <limits>
+#include <mutex>
+using namespace std;
+using namespace irrklang;
+
+namespace {
+
+// What irrKlang reports for a play length it does not know.
+const ik_u32 UNKNOWN_MILLISECONDS = (ik_u32)-1;
+
+// Result of loading one file on a worker.
+struct DecodedClip {
+	DecodedClip() : loaded(false) { }
+
+	bool loaded;
+	// Empty for a clip that streams.
+	vector<char> samples;
+	SAudioStreamFormat format;
+};
+
+//---------------------------------------------------------------------------------------
+// Null driver engines for the workers, created as threads first need one.  irrKlang
+// engines are not meant to be shared across threads, but separate engines are
+// independent.  They read packed files through factories of their own.
+class DecoderEngines {
+public:
+	explicit DecoderEngines(const AssetPack & assets)
+		: m_assets(assets)
+	{
+
+	}
+
+	~DecoderEngines() {
+		for (ISoundEngine * engine : m_idle) {
+			engine->drop();
+		}
+	}
+
+	ISoundEngine * acquire() {
+		{
+			lock_guard<mutex> lock(m_mutex);
+			if (!m_idle.empty()) {
+				ISoundEngine * engine = m_idle.back();
+				m_idle.pop_back();
+				return engine;
+			}
+		}
+		ISoundEngine * engine = createIrrKlangDevice(ESOD_NULL, ESEO_LOAD_PLUGINS);
+		AssetFileFactory::install(engine, m_assets);
+		return engine;
+	}
+
+	void release(ISoundEngine * engine) {
+		lock_guard<mutex> lock(m_mutex);
+		m_idle.push_back(engine);
+	}
+
+private:
+	const AssetPack & m_assets;
+	mutex m_mutex;
+	vector<ISoundEngine *> m_idle;
+};
+
+//---------------------------------------------------------------------------------------
+void decodeClip(ISoundEngine * engine, const string & file, DecodedClip & clip) {
+	// Nothing is read before asking for the length, which is also how a missing file
+	// shows.
+	ISoundSource * probe = engine->addSoundSourceFromFile(file.c_str(), ESM_NO_STREAMING, false);
+	if (!probe) {
+		return;
+	}
+	ik_u32 length = probe->getPlayLength();
+	engine->removeSoundSource(probe);
+	clip.loaded = length != UNKNOWN_MILLISECONDS;
+	if (!clip.loaded || length > AUDIO_DECODE_MAX_SECONDS * 1000.0) {
+		return;
+	}
+
+	// irrKlang streams anything above its threshold however it was asked to load, and
+	// settles that when it first opens the file, hence a second source.
+	ISoundSource * source = engine->addSoundSourceFromFile(file.c_str(), ESM_NO_STREAMING, false);
+	if (!source) {
+		return;
+	}
+	source->setForcedStreamingThreshold(numeric_limits<ik_s32>::max());
+	const char * samples = (const char *)source->getSampleData();
+	clip.format = source->getAudioFormat();
+	if (samples && clip.format.getSampleDataSize() > 0) {
+		clip.samples.assign(samples, samples + clip.format.getSampleDataSize());
+	}
+	engine->removeSoundSource(source);
+}
+
+} // namespace
+
+//---------------------------------------------------------------------------------------
+AudioCache::AudioCache()
+	: m_numDecoded(0),
+	  m_numStreamed(0),
+	  m_decodedBytes(0),
+	  m_preloadMilliseconds(0.0)
+{
+
+}
+
+//---------------------------------------------------------------------------------------
+void AudioCache::preload (
+		irrklang::ISoundEngine * engine,
+		const std::vector<std::string> & files,
+		const AssetPack & assets,
+		WorkerPool & pool
+) {
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	vector<string> pending;
+	for (const string & file : files) {
+		if (m_sources.insert(make_pair(file, nullptr)).second) {
+			pending.push_back(file);
+		}
+	}
+
+	vector<DecodedClip> clips(pending.size());
+	{
+		DecoderEngines decoders(assets);
+		pool.parallelFor(pending.size(), [&](size_t i) {
+			ISoundEngine * decoder = decoders.acquire();
+			if (decoder) {
+				decodeClip(decoder, pending[i], clips[i]);
+				decoders.release(decoder);
+			}
+		});
+	}
+
+	for (size_t i = 0; i < pending.size(); ++i) {
+		DecodedClip & clip = clips[i];
+		ISoundSource * source = nullptr;
+		if (!clip.samples.empty()) {
+			// irrKlang copies the samples.
+			source = engine->addSoundSourceFromPCMData(clip.samples.data(), clip.samples.size(),
+					pending[i].c_str(), clip.format);
+			if (source) {
+				++m_numDecoded;
+				m_decodedBytes += clip.samples.size();
+			}
+		} else if (clip.loaded) {
+			source = engine->addSoundSourceFromFile(pending[i].c_str(), ESM_STREAMING, false);
+			if (source) {
+				++m_numStreamed;
+			}
+		}
+		if (source) {
+			m_sources[pending[i]] = source;
+		} else {
+			m_sources.erase(pending[i]);
+		}
+	}
+	m_preloadMilliseconds += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+//---------------------------------------------------------------------------------------
+irrklang::ISoundSource * AudioCache::source(const std::string & file) const {
+	auto found = m_sources.find(file);
+	return found == m_sources.end() ? nullptr : found->second;
+}
+
+//---------------------------------------------------------------------------------------
+unsigned int AudioCache::numDecoded() const {
+	return m_numDecoded;
+}
+
+//---------------------------------------------------------------------------------------
+unsigned int AudioCache::numStreamed() const {
+	return m_numStreamed;
+}
+
+//---------------------------------------------------------------------------------------
+size_t AudioCache::decodedBytes() const {
+	return m_decodedBytes;
+}
+
+//---------------------------------------------------------------------------------------
+double AudioCache::preloadMilliseconds() const {
+	return m_preloadMilliseconds;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "WorkerPool.hpp"
+#include "framework/AssetPack.hpp"
+
+#include <irrKlang.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Clips up to this long are decoded to PCM once at startup, so their voices mix
+// samples instead of decoding MP3 every time they play.  Longer clips, like the
+// helicopter loop, stream from disk.
+const double AUDIO_DECODE_MAX_SECONDS = 20.0;
+
+/*
+ * One shared irrKlang sound source per sound file, registered with the engine under
+ * its path so every voice playing the file uses it.
+ *
+ * preload() decodes the short clips on a WorkerPool.  Each thread decodes with an
+ * engine of its own on the null driver; the decoded samples are then handed to the
+ * real engine as PCM data on the calling thread.  Files in assets are read from the
+ * pack, by the decoders as well, provided engine has an AssetFileFactory for it.
+ */
+class AudioCache {
+public:
+	AudioCache();
+
+	// Loads every file that is not loaded yet.  Files that fail to load are left out
+	// and fall back to irrKlang loading them on first play.
+	void preload(irrklang::ISoundEngine * engine, const std::vector<std::string> & files,
+			const AssetPack & assets, WorkerPool & pool);
+
+	// Null if file was not preloaded.
+	irrklang::ISoundSource * source(const std::string & file) const;
+
+	unsigned int numDecoded() const;
+	unsigned int numStreamed() const;
+	size_t decodedBytes() const;
+	double preloadMilliseconds() const;
+
+private:
+	AudioCache(const AudioCache &) = delete;
+	AudioCache & operator = (const AudioCache &) = delete;
+
+	std::unordered_map<std::string, irrklang::ISoundSource *> m_sources;
+	unsigned int m_numDecoded;
+	unsigned int m_numStreamed;
+	size_t m_decodedBytes;
+	double m_preloadMilliseconds;
+};
@@ -0,0 +1,183 @@
+#include "Benchmark.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+using namespace std;
+
+namespace {
+
+struct Summary {
+	unsigned int count;
+	double mean;
+	double p50;
+	double p95;
+	double p99;
+};
+
+//---------------------------------------------------------------------------------------
+// Nearest-rank percentiles over the non-negative values; -1 marks a missing value.
+Summary summarise(std::vector<double> values) {
+	values.erase(remove_if(values.begin(), values.end(), [](double v) { return v < 0.0; }), values.end());
+	Summary summary = {(unsigned int)values.size(), 0.0, 0.0, 0.0, 0.0};
+	if (values.empty()) {
+		return summary;
+	}
+	sort(values.begin(), values.end());
+	double total = 0.0;
+	for (double v : values) {
+		total += v;
+	}
+	summary.mean = total / values.size();
+	auto percentile = [&values](double p) {
+		size_t rank = (size_t)ceil(p / 100.0 * values.size());
+		return values[std::max<size_t>(rank, 1) - 1];
+	};
+	summary.p50 = percentile(50.0);
+	summary.p95 = percentile(95.0);
+	summary.p99 = percentile(99.0);
+	return summary;
+}
+
+//---------------------------------------------------------------------------------------
+void printRow(std::ostream & out, const char * name, const Summary & summary) {
+	out << "  " << left << setw(10) << name << right << fixed << setprecision(3)
+		<< " mean " << setw(8) << summary.mean
+		<< "  p50 " << setw(8) << summary.p50
+		<< "  p95 " << setw(8) << summary.p95
+		<< "  p99 " << setw(8) << summary.p99
+		<< "  (" << summary.count << " frames)\n";
+}
+
+//---------------------------------------------------------------------------------------
+void writeJsonSummary(std::ostream & out, const char * name, const Summary & summary) {
+	out << "\"" << name << "\": {\"mean\": " << summary.mean
+		<< ", \"p50\": " << summary.p50
+		<< ", \"p95\": " << summary.p95
+		<< ", \"p99\": " << summary.p99 << "}";
+}
+
+} // namespace
+
+//---------------------------------------------------------------------------------------
+Benchmark::Benchmark()
+	: m_warmupFrames(0)
+{
+
+}
+
+//---------------------------------------------------------------------------------------
+void Benchmark::setWarmupFrames(unsigned int warmupFrames) {
+	m_warmupFrames = warmupFrames;
+}
+
+//---------------------------------------------------------------------------------------
+void Benchmark::beginFrame() {
+	Clock::time_point now = Clock::now();
+	if (!m_samples.empty()) {
+		m_samples.back().frameMs = chrono::duration<double, milli>(now - m_frameStart).count();
+	}
+	m_frameStart = now;
+	FrameSample sample = {-1.0, -1.0, -1.0, -1.0, 0, 0.0};
+	m_samples.push_back(sample);
+}
+
+//---------------------------------------------------------------------------------------
+FrameSample & Benchmark::current() {
+	if (m_samples.empty()) {
+		beginFrame();
+	}
+	return m_samples.back();
+}
+
+//---------------------------------------------------------------------------------------
+void Benchmark::recordAppLogic(double ms) {
+	current().appLogicMs = ms;
+}
+
+//---------------------------------------------------------------------------------------
+void Benchmark::recordTraverse(double ms) {
+	current().traverseMs = ms;
+}
+
+//---------------------------------------------------------------------------------------
+void Benchmark::recordDrawCalls(unsigned int drawCalls) {
+	current().drawCalls = drawCalls;
+}
+
+//---------------------------------------------------------------------------------------
+void Benchmark::recordVertexBytes(double vertexBytes) {
+	current().vertexBytes = vertexBytes;
+}
+
+//---------------------------------------------------------------------------------------
+void Benchmark::recordGpu(unsigned int frame, double ms) {
+	if (frame >= 1 && frame <= m_samples.size()) {
+		m_samples[frame - 1].gpuMs = ms;
+	}
+}
+
+//---------------------------------------------------------------------------------------
+unsigned int Benchmark::numFrames() const {
+	return m_samples.size();
+}
+
+//---------------------------------------------------------------------------------------
+double Benchmark::millisecondsSince(const Clock::time_point & start) {
+	return chrono::duration<double, milli>(Clock::now() - start).count();
+}
+
+//---------------------------------------------------------------------------------------
+// Splits the post warm-up samples into one column per measurement.
+void Benchmark::collectColumns (
+		std::vector<double> & frame,
+		std::vector<double> & appLogic,
+		std::vector<double> & traverse,
+		std::vector<double> & gpu,
+		std::vector<double> & drawCalls,
+		std::vector<double> & vertexBytes
+) const {
+	for (size_t i = m_warmupFrames; i < m_samples.size(); ++i) {
+		const FrameSample & sample = m_samples[i];
+		frame.push_back(sample.frameMs);
+		appLogic.push_back(sample.appLogicMs);
+		traverse.push_back(sample.traverseMs);
+		gpu.push_back(sample.gpuMs);
+		drawCalls.push_back(sample.drawCalls);
+		vertexBytes.push_back(sample.vertexBytes);
+	}
+}
+
+//---------------------------------------------------------------------------------------
+void Benchmark::printSummary(std::ostream & out) const {
+	vector<double> frame, appLogic, traverse, gpu, drawCalls, vertexBytes;
+	collectColumns(frame, appLogic, traverse, gpu, drawCalls, vertexBytes);
+
+	out << "Benchmark results (ms):\n";
+	printRow(out, "frame", summarise(frame));
+	printRow(out, "appLogic", summarise(appLogic));
+	printRow(out, "traverse", summarise(traverse));
+	printRow(out, "gpu", summarise(gpu));
+	out << "  draw calls per frame: " << fixed << setprecision(1) << summarise(drawCalls).mean << "\n";
+	out << "  vertex KiB per frame: " << fixed << setprecision(1) << summarise(vertexBytes).mean / 1024.0 << "\n";
+}
+
+//---------------------------------------------------------------------------------------
+void Benchmark::writeJson(std::ostream & out, unsigned int seed) const {
+	vector<double> frame, appLogic, traverse, gpu, drawCalls, vertexBytes;
+	collectColumns(frame, appLogic, traverse, gpu, drawCalls, vertexBytes);
+
+	out << fixed << setprecision(4) << "{\"seed\": " << seed
+		<< ", \"frames\": " << summarise(frame).count
+		<< ", \"warmupFrames\": " << m_warmupFrames
+		<< ", \"drawCalls\": " << summarise(drawCalls).mean
+		<< ", \"vertexBytes\": " << summarise(vertexBytes).mean << ", ";
+	writeJsonSummary(out, "frameMs", summarise(frame));
+	out << ", ";
+	writeJsonSummary(out, "appLogicMs", summarise(appLogic));
+	out << ", ";
+	writeJsonSummary(out, "traverseMs", summarise(traverse));
+	out << ", ";
+	writeJsonSummary(out, "gpuMs", summarise(gpu));
+	out << "}\n";
+}
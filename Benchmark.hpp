@@ -0,0 +1,62 @@
+#pragma once
+
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Timings of one rendered frame, in milliseconds.
+struct FrameSample {
+	double frameMs;
+	double appLogicMs;
+	double traverseMs;
+	double gpuMs;
+	unsigned int drawCalls;
+	// Vertex attribute bytes the draws fetch, before post-transform cache reuse.
+	double vertexBytes;
+};
+
+/*
+ * Collects per-frame samples during a --bench run and summarises them as
+ * mean / p50 / p95 / p99, both as text and as JSON.
+ */
+class Benchmark {
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	Benchmark();
+
+	// Frames recorded before this many have passed are discarded as warm-up.
+	void setWarmupFrames(unsigned int warmupFrames);
+
+	// Marks the start of a frame, closing the frame time of the previous one.
+	void beginFrame();
+
+	void recordAppLogic(double ms);
+	void recordTraverse(double ms);
+	void recordDrawCalls(unsigned int drawCalls);
+	void recordVertexBytes(double vertexBytes);
+
+	// GPU results arrive a few frames late; frame is the value of numFrames() at the
+	// time the query was issued.
+	void recordGpu(unsigned int frame, double ms);
+
+	// Frames begun so far, including warm-up.
+	unsigned int numFrames() const;
+
+	void printSummary(std::ostream & out) const;
+
+	void writeJson(std::ostream & out, unsigned int seed) const;
+
+	static double millisecondsSince(const Clock::time_point & start);
+
+private:
+	FrameSample & current();
+	void collectColumns(std::vector<double> & frame, std::vector<double> & appLogic,
+			std::vector<double> & traverse, std::vector<double> & gpu,
+			std::vector<double> & drawCalls, std::vector<double> & vertexBytes) const;
+
+	std::vector<FrameSample> m_samples;
+	Clock::time_point m_frameStart;
+	unsigned int m_warmupFrames;
+};
@@ -1,9 +1,12 @@
 #pragma once
 
 #include "SceneNode.hpp"
+#include "CityRandom.hpp"
+#include "FacadeGrammar.hpp"
+#include "VoiceManager.hpp"
 #include <glm/glm.hpp>
 #include <string>
-#include <unordered_map>
+#include <vector>
 using namespace std;
 
 #include <irrKlang.h>
@@ -23,36 +26,47 @@ struct Block {
 
 class Building {
 public:
-    Building(const float width, const float height, int levels, glm::vec3 corner, int doorI = -1, int windowI = -1, int roofI = -1, const float rotate = 0.0f, ISound *sound = NULL);
+    Building(const float width, const float height, int levels, glm::vec3 corner, int doorI = -1, int windowI = -1, int roofI = -1, const float rotate = 0.0f, VoiceHandle sound = NO_VOICE);
 
     virtual ~Building();  
-    virtual void grow();
+    // Picks up the facade program for this type and levels and draws its stochastic
+    // choices, broken windows and roofs, from random.
+    virtual void grow(CityRandom &random);
     virtual SceneNode *create();
     BuildType m_type;
     Block block;
-    string encoding;
     int windowI, doorI, roofI, soundI;
     float rotate;
-    ISound *audio;
-    unordered_map<char, string> rewriteRule;
+    VoiceHandle audio;
+    // Shared by every building of the same type and levels, set by grow().
+    const FacadeProgram *facade;
+    vector<unsigned char> facadeChoices;
+    unsigned int numFacadeEndFloors;
+
+    // Compiled on first use for each (type, levels) and kept; safe to call from
+    // several threads.
+    static const FacadeProgram &facadeProgram(BuildType type, unsigned int levels);
+
+private:
+    void addFace(SceneNode *root, const FacadeOp &op, int face, const glm::vec3 &offset, float incY) const;
+    void addRoof(SceneNode *root, char kind, float y) const;
 };
 
 
 class Skyscraper : public Building {
 public:
-	Skyscraper(const float width, const float height, int levels, glm::vec3 corner, int doorI, int windowI, int roofI, const float rotate = 0.0f, ISound *sound = NULL);
+	Skyscraper(const float width, const float height, int levels, glm::vec3 corner, int doorI, int windowI, int roofI, const float rotate = 0.0f, VoiceHandle sound = NO_VOICE);
 	virtual ~Skyscraper();
 };
 
 class Store : public Building {
 public:
-	Store(const float width, const float height, int levels, glm::vec3 corner, int doorI, int windowI, int roofI, const float rotate = 0.0f, ISound *sound = NULL);
+	Store(const float width, const float height, int levels, glm::vec3 corner, int doorI, int windowI, int roofI, const float rotate = 0.0f, VoiceHandle sound = NO_VOICE);
 	virtual ~Store();
 };
 
 class Apartment : public Building {
 public:
-	Apartment(const float width, const float height, int levels, glm::vec3 corner, int doorI, int windowI, int roofI, const float rotate = 0.0f, ISound *sound = NULL);
+	Apartment(const float width, const float height, int levels, glm::vec3 corner, int doorI, int windowI, int roofI, const float rotate = 0.0f, VoiceHandle sound = NO_VOICE);
 	virtual ~Apartment();
-	void grow();
 };
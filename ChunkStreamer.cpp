@@ -0,0 +1,213 @@
+#include "ChunkStreamer.hpp"
+#include "CityGrid.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+using namespace std;
+using namespace glm;
+
+namespace {
+
+//---------------------------------------------------------------------------------------
+// Distance between two blocks in whole blocks along the longer axis.
+int blockDistance(const ChunkKey & a, const ChunkKey & b) {
+	return std::max(abs(a.blockX - b.blockX), abs(a.blockZ - b.blockZ));
+}
+
+} // namespace
+
+//---------------------------------------------------------------------------------------
+bool ChunkKey::operator < (const ChunkKey & other) const {
+	return blockZ != other.blockZ ? blockZ < other.blockZ : blockX < other.blockX;
+}
+
+//---------------------------------------------------------------------------------------
+bool ChunkKey::operator == (const ChunkKey & other) const {
+	return blockX == other.blockX && blockZ == other.blockZ;
+}
+
+//---------------------------------------------------------------------------------------
+ChunkStreamer::ChunkStreamer()
+	: m_radius(0),
+	  m_stopping(false)
+{
+	m_cameraBlock.blockX = 0;
+	m_cameraBlock.blockZ = 0;
+}
+
+//---------------------------------------------------------------------------------------
+ChunkStreamer::~ChunkStreamer() {
+	stop();
+}
+
+//---------------------------------------------------------------------------------------
+void ChunkStreamer::start (
+		const Generate & generate,
+		int radius,
+		unsigned int numThreads
+) {
+	m_generate = generate;
+	m_radius = radius;
+	m_stopping = false;
+	if (numThreads == 0) {
+		numThreads = std::max(thread::hardware_concurrency(), 3u) - 2;
+	}
+	for (unsigned int i = 0; i < numThreads; ++i) {
+		m_threads.push_back(thread(&ChunkStreamer::workerLoop, this));
+	}
+}
+
+//---------------------------------------------------------------------------------------
+void ChunkStreamer::stop() {
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_wake.notify_all();
+	for (thread & worker : m_threads) {
+		worker.join();
+	}
+	m_threads.clear();
+	m_chunks.clear();
+}
+
+//---------------------------------------------------------------------------------------
+bool ChunkStreamer::isStarted() const {
+	return !m_threads.empty();
+}
+
+//---------------------------------------------------------------------------------------
+/*
+ * Blocks that left the eviction radius are forgotten whatever their state.  A worker
+ * still generating one notices when it is done and throws its result away.
+ */
+void ChunkStreamer::update(const glm::vec2 & camera, std::vector<ChunkKey> & evicted) {
+	ChunkKey cameraBlock = {cityBlockIndex(camera.x), cityBlockIndex(camera.y)};
+	bool queued = false;
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_cameraBlock = cameraBlock;
+		for (ChunkMap::iterator it = m_chunks.begin(); it != m_chunks.end(); ) {
+			if (blockDistance(it->first, cameraBlock) <= m_radius + 1) {
+				++it;
+				continue;
+			}
+			if (it->second.state == ChunkState::Resident) {
+				evicted.push_back(it->first);
+			}
+			it = m_chunks.erase(it);
+		}
+
+		for (int blockZ = cameraBlock.blockZ - m_radius; blockZ <= cameraBlock.blockZ + m_radius; ++blockZ) {
+			for (int blockX = cameraBlock.blockX - m_radius; blockX <= cameraBlock.blockX + m_radius; ++blockX) {
+				ChunkKey key = {blockX, blockZ};
+				if (m_chunks.find(key) == m_chunks.end()) {
+					m_chunks[key].state = ChunkState::Queued;
+					queued = true;
+				}
+			}
+		}
+	}
+	if (queued) {
+		m_wake.notify_all();
+	}
+}
+
+//---------------------------------------------------------------------------------------
+bool ChunkStreamer::takeGenerated (
+		ChunkKey & key,
+		std::unique_ptr<CityBlockResult> & result
+) {
+	lock_guard<mutex> lock(m_mutex);
+	ChunkMap::iterator chunk = nearest(ChunkState::Generated);
+	if (chunk == m_chunks.end()) {
+		return false;
+	}
+	key = chunk->first;
+	result = std::move(chunk->second.result);
+	chunk->second.state = ChunkState::Resident;
+	return true;
+}
+
+//---------------------------------------------------------------------------------------
+void ChunkStreamer::finish() {
+	unique_lock<mutex> lock(m_mutex);
+	m_generated.wait(lock, [this] {
+		for (const ChunkMap::value_type & chunk : m_chunks) {
+			if (chunk.second.state == ChunkState::Queued || chunk.second.state == ChunkState::Generating) {
+				return false;
+			}
+		}
+		return true;
+	});
+}
+
+//---------------------------------------------------------------------------------------
+unsigned int ChunkStreamer::numThreads() const {
+	return m_threads.size();
+}
+
+//---------------------------------------------------------------------------------------
+unsigned int ChunkStreamer::numResident() const {
+	lock_guard<mutex> lock(m_mutex);
+	unsigned int count = 0;
+	for (const ChunkMap::value_type & chunk : m_chunks) {
+		count += chunk.second.state == ChunkState::Resident ? 1 : 0;
+	}
+	return count;
+}
+
+//---------------------------------------------------------------------------------------
+unsigned int ChunkStreamer::numPending() const {
+	lock_guard<mutex> lock(m_mutex);
+	unsigned int count = 0;
+	for (const ChunkMap::value_type & chunk : m_chunks) {
+		count += chunk.second.state != ChunkState::Resident ? 1 : 0;
+	}
+	return count;
+}
+
+//---------------------------------------------------------------------------------------
+// m_mutex must be held.
+ChunkStreamer::ChunkMap::iterator ChunkStreamer::nearest(ChunkState state) {
+	ChunkMap::iterator best = m_chunks.end();
+	int bestDistance = 0;
+	for (ChunkMap::iterator it = m_chunks.begin(); it != m_chunks.end(); ++it) {
+		int distance = blockDistance(it->first, m_cameraBlock);
+		if (it->second.state == state && (best == m_chunks.end() || distance < bestDistance)) {
+			best = it;
+			bestDistance = distance;
+		}
+	}
+	return best;
+}
+
+//---------------------------------------------------------------------------------------
+void ChunkStreamer::workerLoop() {
+	unique_lock<mutex> lock(m_mutex);
+	for (;;) {
+		ChunkMap::iterator chunk;
+		m_wake.wait(lock, [&] {
+			chunk = nearest(ChunkState::Queued);
+			return m_stopping || chunk != m_chunks.end();
+		});
+		if (m_stopping) {
+			return;
+		}
+		ChunkKey key = chunk->first;
+		chunk->second.state = ChunkState::Generating;
+
+		lock.unlock();
+		unique_ptr<CityBlockResult> result(new CityBlockResult());
+		m_generate(key.blockX, key.blockZ, *result);
+		lock.lock();
+
+		// Evicted, and maybe queued again, while it was being generated.
+		chunk = m_chunks.find(key);
+		if (chunk != m_chunks.end() && chunk->second.state == ChunkState::Generating) {
+			chunk->second.state = ChunkState::Generated;
+			chunk->second.result = std::move(result);
+		}
+		m_generated.notify_all();
+	}
+}
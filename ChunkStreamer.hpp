@@ -0,0 +1,103 @@
+#pragma once
+
+#include "CityBlock.hpp"
+
+#include <glm/glm.hpp>
+
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A streamed chunk is one city block, named by its indices on the CITY_BLOCK_SIZE grid.
+struct ChunkKey {
+	int blockX;
+	int blockZ;
+
+	bool operator < (const ChunkKey & other) const;
+	bool operator == (const ChunkKey & other) const;
+};
+
+/*
+ * Keeps the city blocks around the camera generated, on background threads of its
+ * own, so the city has no edge and holds a constant number of blocks wherever the
+ * camera goes.
+ *
+ * Blocks within radius blocks of the camera's block, on either axis, are wanted and
+ * queued nearest first.  Once generated, the caller takes them with takeGenerated()
+ * and owns them from then on; such a block is resident until update() reports it
+ * evicted, once it lies more than radius + 1 blocks away.  The extra block keeps a
+ * camera hovering over a block edge from evicting and regenerating the same row.
+ *
+ * Only update(), takeGenerated() and finish() may be called, from one thread.
+ */
+class ChunkStreamer {
+public:
+	// Fills result for the block on a background thread.  Called for different blocks
+	// at once.
+	typedef std::function<void(int blockX, int blockZ, CityBlockResult & result)> Generate;
+
+	ChunkStreamer();
+	~ChunkStreamer();
+
+	// numThreads 0 leaves one hardware thread each for rendering and the simulation.
+	void start(const Generate & generate, int radius, unsigned int numThreads);
+
+	// Joins the threads, discarding every block not yet taken.
+	void stop();
+
+	bool isStarted() const;
+
+	// Moves the wanted blocks to around camera, a position on the ground, and appends
+	// every resident block that is now too far away to evicted.  The caller frees those.
+	void update(const glm::vec2 & camera, std::vector<ChunkKey> & evicted);
+
+	// Hands out the generated block nearest the camera, which becomes resident.
+	// Returns false if none is ready.
+	bool takeGenerated(ChunkKey & key, std::unique_ptr<CityBlockResult> & result);
+
+	// Blocks until every wanted block has been generated.
+	void finish();
+
+	unsigned int numThreads() const;
+	unsigned int numResident() const;
+	// Blocks queued, being generated, or generated but not yet taken.
+	unsigned int numPending() const;
+
+private:
+	ChunkStreamer(const ChunkStreamer &) = delete;
+	ChunkStreamer & operator = (const ChunkStreamer &) = delete;
+
+	enum class ChunkState {
+		Queued,
+		Generating,
+		Generated,
+		Resident
+	};
+
+	struct Chunk {
+		ChunkState state;
+		std::unique_ptr<CityBlockResult> result;
+	};
+
+	typedef std::map<ChunkKey, Chunk> ChunkMap;
+
+	void workerLoop();
+	// Nearest the camera block among the chunks in state, or m_chunks.end().
+	ChunkMap::iterator nearest(ChunkState state);
+
+	Generate m_generate;
+	int m_radius;
+	std::vector<std::thread> m_threads;
+
+	// Guards everything below.
+	mutable std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_generated;
+	bool m_stopping;
+	ChunkKey m_cameraBlock;
+	ChunkMap m_chunks;
+};
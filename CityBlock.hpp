@@ -0,0 +1,41 @@
+#pragma once
+
+#include "SceneArena.hpp"
+#include "SceneNode.hpp"
+#include "StaticGeometry.hpp"
+#include "TriangleBvh.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// A looping sound a city generation job wants started, by index into soundPaths.
+struct PendingSound {
+	int soundIndex;
+	glm::vec3 position;
+	float minDistance;
+};
+
+// A person placed by a city generation job, by index into materials and soundPaths.
+// soundIndex is -1 for a silent person.
+struct PendingPerson {
+	int x, z, rotated;
+	int hairI, shirtI, pantsI, skinI;
+	int soundIndex, panicSoundIndex;
+};
+
+// Everything generated for one city block.  Jobs fill these on worker threads without
+// touching the scene or the sound engine; the main thread merges them in block order.
+struct CityBlockResult {
+	// Baked buildings, when bakeStatic is set.
+	StaticGeometry staticGeometry;
+	// Building subtrees otherwise, allocated from arena.
+	std::vector<SceneNode *> nodes;
+	SceneArena arena;
+	std::vector<PendingSound> sounds;
+	std::vector<PendingPerson> people;
+	// Nodes of the people, parallel to people, when the job built them too.
+	std::vector<SceneNode *> personNodes;
+	// Over staticGeometry, for the spotlight, when the job built it too.
+	TriangleBvh bvh;
+};
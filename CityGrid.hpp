@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cmath>
+
+// The city is laid out on 50 unit blocks bounded by the roads Assets/scene.lua
+// places at x, z = -100, -50, ..., 100.  The ground plane spans +-125.
+const float CITY_BLOCK_SIZE = 50.0f;
+const float CITY_BLOCK_ORIGIN = -100.0f;
+const float CITY_HALF_EXTENT = 125.0f;
+
+//---------------------------------------------------------------------------------------
+// Returns the index of the city block containing the given world x or z coordinate.
+inline int cityBlockIndex (
+		float coordinate
+) {
+	return (int)std::floor((coordinate - CITY_BLOCK_ORIGIN) / CITY_BLOCK_SIZE);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+
+// Independent kinds of random decisions, so e.g. the people of a block never shift
+// when its buildings change.
+enum class CityStream {
+	Buildings,
+	People,
+	Landmarks
+};
+
+/*
+ * Counter-based random stream: the n-th value is a pure hash of (key, n), so a stream
+ * depends only on the seed and the block it was created for, never on which thread
+ * draws from it or in what order other streams are used.
+ */
+class CityRandom {
+public:
+	CityRandom(unsigned int seed, int blockX, int blockZ, CityStream stream)
+		: m_key(mix(mix(mix(seed) ^ (uint32_t)blockX) ^ ((uint64_t)(uint32_t)blockZ << 32)
+				^ (uint64_t)stream)),
+		  m_counter(0) { }
+
+	// Uniform in [0, bound), bound > 0.
+	int nextInt(int bound) {
+		return (int)(next() % (uint32_t)bound);
+	}
+
+	uint32_t next() {
+		return (uint32_t)(mix(m_key + 0x9E3779B97F4A7C15ull * ++m_counter) >> 32);
+	}
+
+private:
+	// SplitMix64 finaliser.
+	static uint64_t mix(uint64_t x) {
+		x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+		x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+		return x ^ (x >> 31);
+	}
+
+	uint64_t m_key;
+	uint64_t m_counter;
+};
@@ -0,0 +1,549 @@
+#include "CitySnapshot.hpp"
+
+#include "GeometryNode.hpp"
+#include "SceneRegistry.hpp"
+#include "framework/Exception.hpp"
+#include "framework/MathUtils.hpp"
+
+#include <glm/gtx/transform.hpp>
+
+#include <sys/stat.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+using namespace glm;
+
+namespace {
+
+const char CITY_SNAPSHOT_MAGIC[8] = {'C', 'I', 'T', 'Y', 'S', 'N', 'A', 'P'};
+
+// Sections start at multiples of this, so every record is aligned in the mapping.
+const size_t SECTION_ALIGNMENT = 16;
+
+enum Section {
+	// Characters of every name below.
+	STRINGS,
+	// StringRefs of node names, mesh ids and sound files.
+	NODE_NAMES,
+	MESH_IDS,
+	SOUND_FILES,
+	MATERIALS,
+	NODES,
+	EMITTERS,
+	PEOPLE,
+	BATCHES,
+	POSITIONS,
+	NORMALS,
+	UV_COORDS,
+	LAYERS,
+	INDICES,
+	NUM_SECTIONS
+};
+
+struct SectionRange {
+	uint64_t offset;
+	// In records of the section's type.
+	uint64_t count;
+};
+
+struct SnapshotHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t padding;
+	CitySnapshotKey key;
+	uint64_t numBakedNodes;
+	SectionRange sections[NUM_SECTIONS];
+};
+
+struct StringRef {
+	uint32_t offset;
+	uint32_t size;
+};
+
+struct MaterialRecord {
+	vec4 kd;
+	vec3 ks;
+	float shininess;
+};
+
+// Nodes are in preorder, so every parent precedes its children, and siblings keep
+// their order.  A person's node holds its transform from before Crowd::add().
+struct NodeRecord {
+	mat4 transform;
+	// Index of the parent node, -1 for the root.
+	int32_t parent;
+	uint32_t name;
+	int32_t textureIndex;
+	uint16_t type;
+	// GeometryNodes only, indices into MESH_IDS and MATERIALS.
+	uint16_t mesh;
+	uint16_t material;
+	uint16_t padding;
+};
+
+// In VoiceHandle order.
+struct EmitterRecord {
+	vec3 position;
+	float minDistance;
+	uint32_t file;
+	uint32_t paused;
+};
+
+// In agent id order.
+struct PersonRecord {
+	uint32_t node;
+	float x;
+	float z;
+	float heading;
+	uint32_t audio;
+	uint32_t panicAudio;
+	uint32_t follower;
+};
+
+struct BatchRecord {
+	int32_t blockX;
+	int32_t blockZ;
+	int32_t textureIndex;
+	uint32_t material;
+	uint32_t startIndex;
+	uint32_t numIndices;
+	uint32_t baseVertex;
+	vec3 boundsMin;
+	vec3 boundsMax;
+};
+
+//---------------------------------------------------------------------------------------
+template <typename T>
+const T * section(const char * data, Section id) {
+	const SnapshotHeader * header = reinterpret_cast<const SnapshotHeader *>(data);
+	return reinterpret_cast<const T *>(data + header->sections[id].offset);
+}
+
+//---------------------------------------------------------------------------------------
+// Collects the flattened city while write() walks it.
+struct SnapshotWriter {
+	vector<char> strings;
+	vector<StringRef> nodeNames;
+	vector<StringRef> soundFiles;
+	vector<NodeRecord> nodes;
+	vector<PersonRecord> people;
+	// Name index by interned name, and agent id by person node.
+	unordered_map<const std::string *, uint32_t> nameIndices;
+	unordered_map<const SceneNode *, unsigned int> agents;
+
+	StringRef addString(const std::string & value) {
+		StringRef ref = {(uint32_t)strings.size(), (uint32_t)value.size()};
+		strings.insert(strings.end(), value.begin(), value.end());
+		return ref;
+	}
+
+	uint32_t addName(const NodeName & name) {
+		auto inserted = nameIndices.insert(make_pair(&name.str(), (uint32_t)nodeNames.size()));
+		if (inserted.second) {
+			nodeNames.push_back(addString(name.str()));
+		}
+		return inserted.first->second;
+	}
+
+	void addNode(const SceneNode & node, int32_t parent, const Crowd & crowd) {
+		NodeRecord record = {};
+		record.transform = node.get_transform();
+		record.parent = parent;
+		record.name = addName(node.m_name);
+		record.textureIndex = node.textureIndex;
+		record.type = (uint16_t)node.m_nodeType;
+		if (node.m_nodeType == NodeType::GeometryNode) {
+			const GeometryNode & geometryNode = static_cast<const GeometryNode &>(node);
+			record.mesh = geometryNode.mesh;
+			record.material = geometryNode.material;
+		}
+
+		uint32_t index = nodes.size();
+		auto agent = agents.find(&node);
+		if (agent != agents.end()) {
+			// Undo Crowd::add(): back to the origin, then turned back.
+			unsigned int id = agent->second;
+			record.transform[3] = vec4(crowd.nodeOffset(id), 1.0f);
+			record.transform = rotate(degreesToRadians(-crowd.headings()[id]), vec3(0.0f, 1.0f, 0.0f)) * record.transform;
+			people[id].node = index;
+		}
+		nodes.push_back(record);
+
+		for (const SceneNode * child : node.children) {
+			addNode(*child, index, crowd);
+		}
+	}
+};
+
+//---------------------------------------------------------------------------------------
+// Appends count records at data as the next section, aligned.
+void writeSection (
+		ofstream & out,
+		SnapshotHeader & header,
+		Section id,
+		const void * data,
+		size_t recordSize,
+		size_t count
+) {
+	static const char padding[SECTION_ALIGNMENT] = {0};
+	uint64_t offset = out.tellp();
+	uint64_t aligned = (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+	out.write(padding, aligned - offset);
+	out.write(static_cast<const char *>(data), recordSize * count);
+	header.sections[id].offset = aligned;
+	header.sections[id].count = count;
+}
+
+//---------------------------------------------------------------------------------------
+template <typename T>
+void writeSection(ofstream & out, SnapshotHeader & header, Section id, const vector<T> & records) {
+	writeSection(out, header, id, records.data(), sizeof(T), records.size());
+}
+
+//---------------------------------------------------------------------------------------
+void throwSnapshotError(const std::string & path, const char * problem) {
+	throw Exception("Unable to read city snapshot " + path + ": " + problem);
+}
+
+} // namespace
+
+//---------------------------------------------------------------------------------------
+bool CitySnapshotKey::operator == (const CitySnapshotKey & other) const {
+	return seed == other.seed && crowdDensity == other.crowdDensity && bakeStatic == other.bakeStatic
+		&& textureArray == other.textureArray && sceneHash == other.sceneHash
+		&& meshHash == other.meshHash;
+}
+
+//---------------------------------------------------------------------------------------
+uint64_t CitySnapshotKey::hashBytes(const char * data, size_t size, uint64_t hash) {
+	for (size_t i = 0; i < size; ++i) {
+		hash = (hash ^ (unsigned char)data[i]) * 1099511628211ull;
+	}
+	return hash;
+}
+
+//---------------------------------------------------------------------------------------
+CitySnapshot::CitySnapshot() {
+
+}
+
+//---------------------------------------------------------------------------------------
+void CitySnapshot::write (
+		const std::string & path,
+		const CitySnapshotKey & key,
+		const SceneNode & root,
+		const StaticGeometry & staticGeometry,
+		const VoiceManager & voices,
+		const Crowd & crowd
+) {
+	SnapshotWriter writer;
+	writer.people.resize(crowd.size());
+	for (unsigned int agent = 0; agent < crowd.size(); ++agent) {
+		PersonRecord & person = writer.people[agent];
+		person.node = ~0u;
+		person.x = crowd.positionsX()[agent];
+		person.z = crowd.positionsZ()[agent];
+		person.heading = crowd.headings()[agent];
+		person.audio = crowd.audio(agent);
+		person.panicAudio = crowd.panicAudio(agent);
+		person.follower = crowd.follower(agent);
+		writer.agents[crowd.node(agent)] = agent;
+	}
+	writer.addNode(root, -1, crowd);
+	for (const PersonRecord & person : writer.people) {
+		if (person.node == ~0u) {
+			throw Exception("Unable to write city snapshot " + path + ": a person is not in the scene");
+		}
+	}
+
+	vector<StringRef> meshIds;
+	for (unsigned int mesh = 0; mesh < SceneRegistry::numMeshes(); ++mesh) {
+		meshIds.push_back(writer.addString(SceneRegistry::meshId(mesh)));
+	}
+	vector<MaterialRecord> materials;
+	for (unsigned int handle = 0; handle < SceneRegistry::numMaterials(); ++handle) {
+		const Material & material = SceneRegistry::material(handle);
+		MaterialRecord record = {material.kd, material.ks, material.shininess};
+		materials.push_back(record);
+	}
+
+	vector<EmitterRecord> emitters;
+	unordered_map<std::string, uint32_t> fileIndices;
+	for (VoiceHandle voice = 0; voice < voices.size(); ++voice) {
+		auto inserted = fileIndices.insert(make_pair(voices.file(voice), (uint32_t)writer.soundFiles.size()));
+		if (inserted.second) {
+			writer.soundFiles.push_back(writer.addString(voices.file(voice)));
+		}
+		EmitterRecord record = {voices.position(voice), voices.minDistance(voice), inserted.first->second,
+				voices.isPaused(voice) ? 1u : 0u};
+		emitters.push_back(record);
+	}
+
+	vector<BatchRecord> batches;
+	for (const StaticBatch & batch : staticGeometry.getBatches()) {
+		BatchRecord record = {batch.blockX, batch.blockZ, batch.textureIndex, batch.material,
+				batch.startIndex, batch.numIndices, batch.baseVertex, batch.bounds.min, batch.bounds.max};
+		batches.push_back(record);
+	}
+	size_t numVertices = staticGeometry.getNumVertexPositionBytes() / sizeof(vec3);
+	size_t numIndices = staticGeometry.getNumIndexBytes() / sizeof(unsigned int);
+	bool hasVertices = numVertices > 0;
+
+	SnapshotHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CITY_SNAPSHOT_MAGIC, sizeof(header.magic));
+	header.version = CITY_SNAPSHOT_VERSION;
+	header.key = key;
+	header.numBakedNodes = staticGeometry.getNumBakedNodes();
+
+	string temporaryPath = path + ".tmp";
+	ofstream out(temporaryPath.c_str(), ios::binary | ios::trunc);
+	if (!out) {
+		throw Exception("Unable to create city snapshot " + temporaryPath);
+	}
+	out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+	writeSection(out, header, STRINGS, writer.strings);
+	writeSection(out, header, NODE_NAMES, writer.nodeNames);
+	writeSection(out, header, MESH_IDS, meshIds);
+	writeSection(out, header, SOUND_FILES, writer.soundFiles);
+	writeSection(out, header, MATERIALS, materials);
+	writeSection(out, header, NODES, writer.nodes);
+	writeSection(out, header, EMITTERS, emitters);
+	writeSection(out, header, PEOPLE, writer.people);
+	writeSection(out, header, BATCHES, batches);
+	writeSection(out, header, POSITIONS, hasVertices ? staticGeometry.getVertexPositionDataPtr() : nullptr,
+			sizeof(vec3), numVertices);
+	writeSection(out, header, NORMALS, hasVertices ? staticGeometry.getVertexNormalDataPtr() : nullptr,
+			sizeof(vec3), numVertices);
+	writeSection(out, header, UV_COORDS, hasVertices ? staticGeometry.getVertexUVPtr() : nullptr,
+			sizeof(vec2), numVertices);
+	writeSection(out, header, LAYERS, hasVertices ? staticGeometry.getVertexLayerPtr() : nullptr,
+			sizeof(float), numVertices);
+	writeSection(out, header, INDICES, numIndices > 0 ? staticGeometry.getIndexDataPtr() : nullptr,
+			sizeof(unsigned int), numIndices);
+	out.seekp(0);
+	out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+	out.close();
+	if (!out || rename(temporaryPath.c_str(), path.c_str()) != 0) {
+		remove(temporaryPath.c_str());
+		throw Exception("Unable to write city snapshot " + path);
+	}
+}
+
+//---------------------------------------------------------------------------------------
+/*
+ * Every index in the file is checked here, so restore() can follow them blindly.
+ */
+bool CitySnapshot::open(const std::string & path, const CitySnapshotKey & key) {
+	struct stat status;
+	if (stat(path.c_str(), &status) != 0 && errno == ENOENT) {
+		return false;
+	}
+	unique_ptr<MappedFile> file(new MappedFile(path.c_str()));
+	const char * data = file->data();
+	uint64_t fileSize = file->size();
+
+	if (fileSize < sizeof(SnapshotHeader)) {
+		throwSnapshotError(path, "truncated header");
+	}
+	const SnapshotHeader & header = *reinterpret_cast<const SnapshotHeader *>(data);
+	if (memcmp(header.magic, CITY_SNAPSHOT_MAGIC, sizeof(header.magic)) != 0) {
+		throwSnapshotError(path, "not a city snapshot");
+	}
+	if (header.version != CITY_SNAPSHOT_VERSION || !(header.key == key)) {
+		return false;
+	}
+	// Restoring reads nearly all of it.
+	file->prefetch();
+
+	const size_t recordSizes[NUM_SECTIONS] = {
+		sizeof(char), sizeof(StringRef), sizeof(StringRef), sizeof(StringRef), sizeof(MaterialRecord),
+		sizeof(NodeRecord), sizeof(EmitterRecord), sizeof(PersonRecord), sizeof(BatchRecord),
+		sizeof(vec3), sizeof(vec3), sizeof(vec2), sizeof(float), sizeof(unsigned int)
+	};
+	for (unsigned int id = 0; id < NUM_SECTIONS; ++id) {
+		const SectionRange & range = header.sections[id];
+		if (range.offset % SECTION_ALIGNMENT != 0 || range.offset > fileSize
+				|| range.count > (fileSize - range.offset) / recordSizes[id]) {
+			throwSnapshotError(path, "section out of bounds");
+		}
+	}
+	const SectionRange * sections = header.sections;
+
+	for (Section id : {NODE_NAMES, MESH_IDS, SOUND_FILES}) {
+		const StringRef * refs = section<StringRef>(data, id);
+		for (uint64_t i = 0; i < sections[id].count; ++i) {
+			if (refs[i].offset > sections[STRINGS].count || refs[i].size > sections[STRINGS].count - refs[i].offset) {
+				throwSnapshotError(path, "bad string");
+			}
+		}
+	}
+
+	const NodeRecord * nodes = section<NodeRecord>(data, NODES);
+	for (uint64_t i = 0; i < sections[NODES].count; ++i) {
+		const NodeRecord & node = nodes[i];
+		bool isGeometry = node.type == (uint16_t)NodeType::GeometryNode;
+		if ((i == 0 ? node.parent != -1 : node.parent < 0 || (uint64_t)node.parent >= i)
+				|| node.name >= sections[NODE_NAMES].count
+				|| (!isGeometry && node.type != (uint16_t)NodeType::SceneNode)
+				|| (isGeometry && (node.mesh >= sections[MESH_IDS].count || node.material >= sections[MATERIALS].count))) {
+			throwSnapshotError(path, "bad node");
+		}
+	}
+
+	const EmitterRecord * emitters = section<EmitterRecord>(data, EMITTERS);
+	uint64_t numEmitters = sections[EMITTERS].count;
+	for (uint64_t i = 0; i < numEmitters; ++i) {
+		if (emitters[i].file >= sections[SOUND_FILES].count) {
+			throwSnapshotError(path, "bad sound emitter");
+		}
+	}
+
+	const PersonRecord * people = section<PersonRecord>(data, PEOPLE);
+	for (uint64_t i = 0; i < sections[PEOPLE].count; ++i) {
+		const PersonRecord & person = people[i];
+		if (person.node == 0 || person.node >= sections[NODES].count || person.follower >= sections[PEOPLE].count
+				|| (person.audio != NO_VOICE && person.audio >= numEmitters)
+				|| (person.panicAudio != NO_VOICE && person.panicAudio >= numEmitters)) {
+			throwSnapshotError(path, "bad person");
+		}
+	}
+
+	uint64_t numVertices = sections[POSITIONS].count;
+	if (sections[NORMALS].count != numVertices || sections[UV_COORDS].count != numVertices
+			|| sections[LAYERS].count != numVertices) {
+		throwSnapshotError(path, "vertex arrays differ in length");
+	}
+	const BatchRecord * batches = section<BatchRecord>(data, BATCHES);
+	for (uint64_t i = 0; i < sections[BATCHES].count; ++i) {
+		const BatchRecord & batch = batches[i];
+		if (batch.material >= sections[MATERIALS].count || batch.baseVertex > numVertices
+				|| batch.startIndex > sections[INDICES].count
+				|| batch.numIndices > sections[INDICES].count - batch.startIndex) {
+			throwSnapshotError(path, "bad batch");
+		}
+	}
+
+	m_file = std::move(file);
+	return true;
+}
+
+//---------------------------------------------------------------------------------------
+SceneNode * CitySnapshot::restore (
+		StaticGeometry & staticGeometry,
+		VoiceManager & voices,
+		Crowd & crowd
+) const {
+	const char * data = m_file->data();
+	const SnapshotHeader & header = *reinterpret_cast<const SnapshotHeader *>(data);
+	const SectionRange * sections = header.sections;
+	const char * strings = section<char>(data, STRINGS);
+
+	// Names are interned once each rather than once per node.
+	const StringRef * nameRefs = section<StringRef>(data, NODE_NAMES);
+	vector<NodeName> names;
+	names.reserve(sections[NODE_NAMES].count);
+	for (uint64_t i = 0; i < sections[NODE_NAMES].count; ++i) {
+		names.push_back(NodeName(string(strings + nameRefs[i].offset, nameRefs[i].size)));
+	}
+	const StringRef * meshRefs = section<StringRef>(data, MESH_IDS);
+	vector<MeshHandle> meshes;
+	for (uint64_t i = 0; i < sections[MESH_IDS].count; ++i) {
+		meshes.push_back(SceneRegistry::meshHandle(string(strings + meshRefs[i].offset, meshRefs[i].size)));
+	}
+	const MaterialRecord * materialRecords = section<MaterialRecord>(data, MATERIALS);
+	vector<MaterialHandle> materials;
+	for (uint64_t i = 0; i < sections[MATERIALS].count; ++i) {
+		const MaterialRecord & record = materialRecords[i];
+		materials.push_back(SceneRegistry::materialHandle(Material(record.kd, record.ks, record.shininess)));
+	}
+
+	const NodeRecord * nodeRecords = section<NodeRecord>(data, NODES);
+	vector<SceneNode *> nodes(sections[NODES].count);
+	for (size_t i = 0; i < nodes.size(); ++i) {
+		const NodeRecord & record = nodeRecords[i];
+		SceneNode * node;
+		if (record.type == (uint16_t)NodeType::GeometryNode) {
+			GeometryNode * geometryNode = new GeometryNode(meshes[record.mesh], names[record.name]);
+			geometryNode->material = materials[record.material];
+			node = geometryNode;
+		} else {
+			node = new SceneNode(names[record.name]);
+		}
+		node->set_transform(record.transform);
+		node->textureIndex = record.textureIndex;
+		if (record.parent >= 0) {
+			nodes[record.parent]->add_child(node);
+		}
+		nodes[i] = node;
+	}
+
+	const StringRef * fileRefs = section<StringRef>(data, SOUND_FILES);
+	vector<string> files;
+	for (uint64_t i = 0; i < sections[SOUND_FILES].count; ++i) {
+		files.push_back(string(strings + fileRefs[i].offset, fileRefs[i].size));
+	}
+	const EmitterRecord * emitters = section<EmitterRecord>(data, EMITTERS);
+	for (uint64_t i = 0; i < sections[EMITTERS].count; ++i) {
+		const EmitterRecord & emitter = emitters[i];
+		voices.add(files[emitter.file], emitter.position, emitter.minDistance, emitter.paused != 0);
+	}
+
+	const PersonRecord * people = section<PersonRecord>(data, PEOPLE);
+	for (uint64_t i = 0; i < sections[PEOPLE].count; ++i) {
+		const PersonRecord & person = people[i];
+		crowd.add(nodes[person.node], person.x, person.z, person.heading, person.audio, person.panicAudio);
+	}
+	for (uint64_t i = 0; i < sections[PEOPLE].count; ++i) {
+		if (people[i].follower != i) {
+			crowd.pair(i, people[i].follower);
+		}
+	}
+
+	const BatchRecord * batchRecords = section<BatchRecord>(data, BATCHES);
+	vector<StaticBatch> batches;
+	for (uint64_t i = 0; i < sections[BATCHES].count; ++i) {
+		const BatchRecord & record = batchRecords[i];
+		StaticBatch batch;
+		batch.blockX = record.blockX;
+		batch.blockZ = record.blockZ;
+		batch.textureIndex = record.textureIndex;
+		batch.material = materials[record.material];
+		batch.startIndex = record.startIndex;
+		batch.numIndices = record.numIndices;
+		batch.baseVertex = record.baseVertex;
+		batch.bounds = AABB(record.boundsMin, record.boundsMax);
+		batches.push_back(batch);
+	}
+	StaticVertexArrays arrays;
+	arrays.positions = section<vec3>(data, POSITIONS);
+	arrays.normals = section<vec3>(data, NORMALS);
+	arrays.uvCoords = section<vec2>(data, UV_COORDS);
+	arrays.layers = section<float>(data, LAYERS);
+	arrays.numVertices = sections[POSITIONS].count;
+	arrays.indices = section<unsigned int>(data, INDICES);
+	arrays.numIndices = sections[INDICES].count;
+	staticGeometry.useConsolidated(arrays, std::move(batches), header.numBakedNodes);
+
+	return nodes.empty() ? nullptr : nodes[0];
+}
+
+//---------------------------------------------------------------------------------------
+bool CitySnapshot::isOpen() const {
+	return m_file != nullptr;
+}
+
+//---------------------------------------------------------------------------------------
+unsigned int CitySnapshot::numNodes() const {
+	return m_file ? reinterpret_cast<const SnapshotHeader *>(m_file->data())->sections[NODES].count : 0;
+}
+
+//---------------------------------------------------------------------------------------
+unsigned int CitySnapshot::numPeople() const {
+	return m_file ? reinterpret_cast<const SnapshotHeader *>(m_file->data())->sections[PEOPLE].count : 0;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "Crowd.hpp"
+#include "SceneNode.hpp"
+#include "StaticGeometry.hpp"
+#include "VoiceManager.hpp"
+#include "framework/MappedFile.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Bumped whenever the layout changes, and whenever the generator builds a different
+// city from the same seed, so older snapshots are regenerated rather than trusted.
+const uint32_t CITY_SNAPSHOT_VERSION = 1;
+
+// Everything a generated city depends on besides the generator itself.  A snapshot
+// only stands in for a city with the same key.
+struct CitySnapshotKey {
+	uint32_t seed;
+	uint32_t crowdDensity;
+	uint32_t bakeStatic;
+	uint32_t textureArray;
+	// hashBytes() of the Lua scene the city is built on.
+	uint64_t sceneHash;
+	// hashBytes() of the .obj files of every mesh, chained in the order they load.
+	uint64_t meshHash;
+
+	bool operator == (const CitySnapshotKey & other) const;
+
+	// 64 bit FNV-1a.  Passing the hash of earlier bytes as hash continues it over data.
+	static uint64_t hashBytes(const char * data, size_t size, uint64_t hash = 14695981039346656037ull);
+};
+
+/*
+ * A generated city written out as flat arrays, so a later run on the same key can
+ * map it and skip both the Lua scene and the grammar expansion.  It holds every
+ * node below the root with its transform, mesh, material and texture, the baked
+ * static geometry, every sound emitter and every person.
+ *
+ * Meshes and materials are stored by value and registered again on restore, so
+ * their handles need not match between runs.  The baked vertex arrays are not even
+ * copied: StaticGeometry uses them straight from the mapping.
+ *
+ * The scene graph is not used in place, though: restore() allocates every node
+ * again, just as generating the city does.  So restoring beats generating by a
+ * wide margin for a sparse crowd, but by little once people make up most nodes.
+ */
+class CitySnapshot {
+public:
+	CitySnapshot();
+
+	// Writes the city rooted at root, whose people in crowd must all lie below root.
+	// Goes through a temporary file, so an interrupted write leaves no damaged
+	// snapshot behind.  Throws Exception if the file cannot be written.
+	static void write(const std::string & path, const CitySnapshotKey & key, const SceneNode & root,
+			const StaticGeometry & staticGeometry, const VoiceManager & voices, const Crowd & crowd);
+
+	// Maps the snapshot at path.  Returns false if there is none, or it was written
+	// for another key or version, and throws Exception if it is damaged.
+	bool open(const std::string & path, const CitySnapshotKey & key);
+
+	// Rebuilds the city, allocating nodes from the current SceneArena, and returns its
+	// root.  voices and crowd must be empty.  staticGeometry reads its vertex data from
+	// this snapshot, which must stay open for as long as that is used.
+	SceneNode * restore(StaticGeometry & staticGeometry, VoiceManager & voices, Crowd & crowd) const;
+
+	bool isOpen() const;
+	unsigned int numNodes() const;
+	unsigned int numPeople() const;
+
+private:
+	CitySnapshot(const CitySnapshot &) = delete;
+	CitySnapshot & operator = (const CitySnapshot &) = delete;
+
+	std::unique_ptr<MappedFile> m_file;
+};
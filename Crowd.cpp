@@ -0,0 +1,421 @@
+#include "Crowd.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+using namespace std;
+using namespace glm;
+
+namespace {
+
+//---------------------------------------------------------------------------------------
+// Writes the x and z of a step of length speed straight away from light, for each of
+// count points (x[i], 0, z[i]).
+void fleeSteps (
+		const float * x,
+		const float * z,
+		size_t count,
+		const glm::vec3 & light,
+		float speed,
+		float * stepX,
+		float * stepZ
+) {
+	size_t i = 0;
+#if defined(__SSE__)
+	__m128 lightX = _mm_set1_ps(light.x);
+	__m128 lightZ = _mm_set1_ps(light.z);
+	__m128 lightYSquared = _mm_set1_ps(light.y * light.y);
+	__m128 speeds = _mm_set1_ps(speed);
+	for (; i + 4 <= count; i += 4) {
+		__m128 dx = _mm_sub_ps(_mm_loadu_ps(x + i), lightX);
+		__m128 dz = _mm_sub_ps(_mm_loadu_ps(z + i), lightZ);
+		__m128 lengthSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dz, dz)), lightYSquared);
+		__m128 scale = _mm_div_ps(speeds, _mm_sqrt_ps(lengthSquared));
+		_mm_storeu_ps(stepX + i, _mm_mul_ps(dx, scale));
+		_mm_storeu_ps(stepZ + i, _mm_mul_ps(dz, scale));
+	}
+#endif
+	for (; i < count; ++i) {
+		float dx = x[i] - light.x;
+		float dz = z[i] - light.z;
+		float scale = speed / std::sqrt(dx * dx + dz * dz + light.y * light.y);
+		stepX[i] = dx * scale;
+		stepZ[i] = dz * scale;
+	}
+}
+
+} // namespace
+
+//---------------------------------------------------------------------------------------
+Crowd::Crowd(VoiceManager * voices)
+	: m_now(0.0),
+	  m_voices(voices),
+	  m_numRemoved(0)
+{
+
+}
+
+//---------------------------------------------------------------------------------------
+unsigned int Crowd::add (
+		SceneNode * node,
+		float x,
+		float z,
+		float heading,
+		VoiceHandle audio,
+		VoiceHandle panicAudio
+) {
+	unsigned int agent = m_grid.insert(vec2(x, z));
+	if (agent == m_x.size()) {
+		m_x.push_back(0.0f);
+		m_z.push_back(0.0f);
+		m_heading.push_back(0.0f);
+		m_flags.push_back(0);
+		m_startTime.push_back(0.0);
+		m_follower.push_back(agent);
+		m_nodes.push_back(nullptr);
+		m_nodeOffsets.push_back(vec3());
+		m_audio.push_back(NO_VOICE);
+		m_panicAudio.push_back(NO_VOICE);
+		m_queued.push_back(0);
+	}
+	node->rotate('y', heading);
+	m_x[agent] = x;
+	m_z[agent] = z;
+	m_heading[agent] = heading;
+	m_startTime[agent] = 0.0;
+	m_follower[agent] = agent;
+	m_nodes[agent] = node;
+	m_nodeOffsets[agent] = vec3(node->get_transform()[3]);
+	m_audio[agent] = audio;
+	m_panicAudio[agent] = panicAudio;
+	placeNode(agent, x, z);
+	if (m_flags[agent] & REMOVED) {
+		// The renderer may still hold positions of whoever had the id before, until
+		// it hears that this person moved.
+		m_flags[agent] = MOVED;
+		m_moved.push_back(agent);
+		--m_numRemoved;
+	}
+	if (audio != NO_VOICE) {
+		m_voices->setPosition(audio, vec3(x, 0.0f, z));
+	}
+	if (panicAudio != NO_VOICE) {
+		m_voices->setPosition(panicAudio, vec3(x, 0.0f, z));
+		m_voices->setPaused(panicAudio, true);
+	}
+	return agent;
+}
+
+//---------------------------------------------------------------------------------------
+void Crowd::pair(unsigned int leader, unsigned int follower) {
+	m_follower[leader] = follower;
+	m_flags[follower] |= FOLLOWER;
+}
+
+//---------------------------------------------------------------------------------------
+/*
+ * The node is left alone, and the sounds are only forgotten: both belong to the
+ * caller again.  The agent id is handed out again by a later add().
+ */
+void Crowd::remove(unsigned int agent) {
+	m_grid.remove(agent);
+	if (m_flags[agent] & RUNNING) {
+		m_running.erase(find(m_running.begin(), m_running.end(), agent));
+	}
+	if (m_flags[agent] & MOVED) {
+		m_moved.erase(find(m_moved.begin(), m_moved.end(), agent));
+	}
+	m_flags[agent] = REMOVED;
+	m_follower[agent] = agent;
+	m_nodes[agent] = nullptr;
+	m_audio[agent] = NO_VOICE;
+	m_panicAudio[agent] = NO_VOICE;
+	if (m_queued[agent]) {
+		m_inMotion.erase(find(m_inMotion.begin(), m_inMotion.end(), agent));
+		m_queued[agent] = 0;
+	}
+	++m_numRemoved;
+}
+
+//---------------------------------------------------------------------------------------
+void Crowd::panic(unsigned int agent) {
+	if (!(m_flags[agent] & (RUNNING | FOLLOWER))) {
+		startRunning(agent);
+	}
+}
+
+//---------------------------------------------------------------------------------------
+/*
+ * Only the 3 x 3 grid cells around the light and the running people are visited.
+ * The query is not bounded, though: it tests everyone in those cells, so its cost
+ * grows with how densely people crowd the light, not with the size of the city.
+ */
+void Crowd::update(const glm::vec3 & light, float radius, double now) {
+	m_now = now;
+	m_grid.query(vec2(light.x, light.z), radius, [&](unsigned int agent) {
+		trigger(agent);
+	});
+	stepRunning(light);
+	stopRunning();
+	moveSounds();
+}
+
+//---------------------------------------------------------------------------------------
+void Crowd::publish (
+		CrowdPositions & positions,
+		std::vector<unsigned int> & moved
+) {
+	positions.x = m_x;
+	positions.z = m_z;
+	// The running people and their followers moved on every update, so they are
+	// only listed here, skipping those already in m_moved.
+	for (unsigned int agent : m_running) {
+		if (!(m_flags[agent] & MOVED)) {
+			moved.push_back(agent);
+		}
+		unsigned int follower = m_follower[agent];
+		if (follower != agent && !(m_flags[follower] & MOVED)) {
+			moved.push_back(follower);
+		}
+	}
+	for (unsigned int agent : m_moved) {
+		m_flags[agent] &= ~MOVED;
+	}
+	moved.insert(moved.end(), m_moved.begin(), m_moved.end());
+	m_moved.clear();
+}
+
+//---------------------------------------------------------------------------------------
+/*
+ * Only reads the nodes, offsets and the positions handed in, never what update()
+ * writes.  A person whose published positions differ is left in motion and placed
+ * again next call, until a call reaches alpha 1 or the positions agree.
+ */
+void Crowd::place (
+		const std::vector<unsigned int> & agents,
+		const CrowdPositions & previous,
+		const CrowdPositions & current,
+		float alpha
+) {
+	m_placing.swap(m_inMotion);
+	for (unsigned int agent : agents) {
+		if (!m_nodes[agent]) {
+			continue;
+		}
+		if (!m_queued[agent]) {
+			m_queued[agent] = 1;
+			m_placing.push_back(agent);
+		}
+	}
+	m_inMotion.clear();
+	for (unsigned int agent : m_placing) {
+		float toX = current.x[agent];
+		float toZ = current.z[agent];
+		// Added after the previous tick.
+		bool wasThere = agent < previous.x.size();
+		float fromX = wasThere ? previous.x[agent] : toX;
+		float fromZ = wasThere ? previous.z[agent] : toZ;
+		placeNode(agent, fromX + alpha * (toX - fromX), fromZ + alpha * (toZ - fromZ));
+		if (alpha < 1.0f && (fromX != toX || fromZ != toZ)) {
+			m_inMotion.push_back(agent);
+		} else {
+			m_queued[agent] = 0;
+		}
+	}
+	m_placing.clear();
+}
+
+//---------------------------------------------------------------------------------------
+void Crowd::trigger(unsigned int agent) {
+	unsigned char & flags = m_flags[agent];
+	if (flags & (RUNNING | FOLLOWER)) {
+		return;
+	}
+	if (!(flags & NERVOUS)) {
+		flags |= NERVOUS;
+		m_startTime[agent] = m_now;
+	} else if (m_now - m_startTime[agent] > PANIC_SECONDS) {
+		startRunning(agent);
+	}
+}
+
+//---------------------------------------------------------------------------------------
+void Crowd::startRunning(unsigned int agent) {
+	m_flags[agent] |= NERVOUS | RUNNING;
+	m_startTime[agent] = m_now;
+	if (m_audio[agent] != NO_VOICE) {
+		m_voices->setPaused(m_audio[agent], true);
+	}
+	if (m_panicAudio[agent] != NO_VOICE) {
+		m_voices->setPaused(m_panicAudio[agent], false);
+	}
+	m_running.push_back(agent);
+}
+
+//---------------------------------------------------------------------------------------
+// Gathers the running people into contiguous arrays, steps them all at once and
+// scatters the steps back, followers included.
+void Crowd::stepRunning(const glm::vec3 & light) {
+	size_t count = m_running.size();
+	m_runX.resize(count);
+	m_runZ.resize(count);
+	m_stepX.resize(count);
+	m_stepZ.resize(count);
+	for (size_t i = 0; i < count; ++i) {
+		m_runX[i] = m_x[m_running[i]];
+		m_runZ[i] = m_z[m_running[i]];
+	}
+
+	fleeSteps(m_runX.data(), m_runZ.data(), count, light, RUN_STEP, m_stepX.data(), m_stepZ.data());
+
+	for (size_t i = 0; i < count; ++i) {
+		unsigned int agent = m_running[i];
+		moveBy(agent, m_stepX[i], m_stepZ[i]);
+		if (m_follower[agent] != agent) {
+			moveBy(m_follower[agent], m_stepX[i], m_stepZ[i]);
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------
+/*
+ * Leaves the grid and publish() to stopRunning(): the spotlight cannot trigger a
+ * person who runs or follows, so the grid only has to know where they stopped, and
+ * publish() lists everyone still running anyway.
+ */
+void Crowd::moveBy(unsigned int agent, float dx, float dz) {
+	m_x[agent] += dx;
+	m_z[agent] += dz;
+}
+
+//---------------------------------------------------------------------------------------
+// Bins a person who ran into the grid where they stopped, and lists them for the next
+// publish().
+void Crowd::stopMoving(unsigned int agent) {
+	m_grid.move(agent, vec2(m_x[agent], m_z[agent]));
+	if (!(m_flags[agent] & MOVED)) {
+		m_flags[agent] |= MOVED;
+		m_moved.push_back(agent);
+	}
+}
+
+//---------------------------------------------------------------------------------------
+// People who have run for PANIC_SECONDS calm down and go back to their ambient sound.
+void Crowd::stopRunning() {
+	for (size_t i = 0; i < m_running.size(); ) {
+		unsigned int agent = m_running[i];
+		if (m_now - m_startTime[agent] <= PANIC_SECONDS) {
+			++i;
+			continue;
+		}
+		m_flags[agent] &= ~(NERVOUS | RUNNING);
+		stopMoving(agent);
+		if (m_follower[agent] != agent) {
+			stopMoving(m_follower[agent]);
+		}
+		if (m_audio[agent] != NO_VOICE) {
+			m_voices->setPaused(m_audio[agent], false);
+		}
+		if (m_panicAudio[agent] != NO_VOICE) {
+			m_voices->setPaused(m_panicAudio[agent], true);
+		}
+		m_running[i] = m_running.back();
+		m_running.pop_back();
+	}
+}
+
+//---------------------------------------------------------------------------------------
+// Those who stopped running are in m_moved, those still running are not.
+void Crowd::moveSounds() {
+	if (!m_voices) {
+		return;
+	}
+	for (unsigned int agent : m_running) {
+		moveSounds(agent);
+		if (m_follower[agent] != agent) {
+			moveSounds(m_follower[agent]);
+		}
+	}
+	for (unsigned int agent : m_moved) {
+		moveSounds(agent);
+	}
+}
+
+//---------------------------------------------------------------------------------------
+void Crowd::moveSounds(unsigned int agent) {
+	vec3 position(m_x[agent], 0.0f, m_z[agent]);
+	if (m_audio[agent] != NO_VOICE) {
+		m_voices->setPosition(m_audio[agent], position);
+	}
+	if (m_panicAudio[agent] != NO_VOICE) {
+		m_voices->setPosition(m_panicAudio[agent], position);
+	}
+}
+
+//---------------------------------------------------------------------------------------
+// A person's node only ever translates, so only the translation column of its
+// transform is written, in place.
+void Crowd::placeNode(unsigned int agent, float x, float z) {
+	SceneNode * node = m_nodes[agent];
+	node->trans[3] = vec4(m_nodeOffsets[agent] + vec3(x, 0.0f, z), 1.0f);
+	node->markDirty();
+}
+
+//---------------------------------------------------------------------------------------
+unsigned int Crowd::size() const {
+	return m_x.size();
+}
+
+//---------------------------------------------------------------------------------------
+unsigned int Crowd::numPeople() const {
+	return m_x.size() - m_numRemoved;
+}
+
+//---------------------------------------------------------------------------------------
+unsigned int Crowd::numRunning() const {
+	return m_running.size();
+}
+
+//---------------------------------------------------------------------------------------
+const std::vector<float> & Crowd::positionsX() const {
+	return m_x;
+}
+
+//---------------------------------------------------------------------------------------
+const std::vector<float> & Crowd::positionsZ() const {
+	return m_z;
+}
+
+//---------------------------------------------------------------------------------------
+const std::vector<float> & Crowd::headings() const {
+	return m_heading;
+}
+
+//---------------------------------------------------------------------------------------
+SceneNode * Crowd::node(unsigned int agent) const {
+	return m_nodes[agent];
+}
+
+//---------------------------------------------------------------------------------------
+const glm::vec3 & Crowd::nodeOffset(unsigned int agent) const {
+	return m_nodeOffsets[agent];
+}
+
+//---------------------------------------------------------------------------------------
+VoiceHandle Crowd::audio(unsigned int agent) const {
+	return m_audio[agent];
+}
+
+//---------------------------------------------------------------------------------------
+VoiceHandle Crowd::panicAudio(unsigned int agent) const {
+	return m_panicAudio[agent];
+}
+
+//---------------------------------------------------------------------------------------
+unsigned int Crowd::follower(unsigned int agent) const {
+	return m_follower[agent];
+}
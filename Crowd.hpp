@@ -0,0 +1,144 @@
+#pragma once
+
+#include "CrowdGrid.hpp"
+#include "SceneNode.hpp"
+
+#include <glm/glm.hpp>
+#include "VoiceManager.hpp"
+
+#include <vector>
+
+// Simulated seconds a person stays nervous under the spotlight before panicking, and
+// then runs.
+const double PANIC_SECONDS = 20.0;
+// Distance a running person covers per update.
+const float RUN_STEP = 0.2f;
+
+// Where every person stood at one update, by agent id.
+struct CrowdPositions {
+	std::vector<float> x;
+	std::vector<float> z;
+};
+
+/*
+ * Every person in the city, held as parallel arrays indexed by agent id, the same id
+ * the CrowdGrid uses.  A person the spotlight finds gets nervous; one it finds again
+ * after PANIC_SECONDS panics, trades their ambient sound for a panic sound and runs
+ * straight away from the light for PANIC_SECONDS.  A follower never panics on its
+ * own but runs along with its leader.
+ *
+ * update() steps all running people with one vectorised kernel.  It never touches
+ * the SceneNodes, so it can run on a simulation thread: the renderer receives the
+ * positions through publish() and moves the nodes of the people who moved with
+ * place().  add(), pair() and remove() may only be called between updates, e.g.
+ * through Simulation::edit().
+ */
+class Crowd {
+public:
+	// People carry their sounds as emitters of voices, if any.
+	explicit Crowd(VoiceManager * voices = nullptr);
+
+	// node is the person as built at the origin by createPerson().  It is turned
+	// heading degrees about y and placed at (x, z).  Returns the new agent id.
+	unsigned int add(SceneNode * node, float x, float z, float heading,
+			VoiceHandle audio = NO_VOICE, VoiceHandle panicAudio = NO_VOICE);
+
+	// follower runs along with leader from now on, and never panics on its own.
+	void pair(unsigned int leader, unsigned int follower);
+
+	// Takes a person out of the city.  Their node and sounds are the caller's to
+	// free, and a pair has to go together.  The agent id is reused by a later add().
+	void remove(unsigned int agent);
+
+	// Makes a person panic at the time of the last update, wherever the spotlight is.
+	void panic(unsigned int agent);
+
+	// Advances to simulated time now, in seconds, with the spotlight hitting the
+	// ground at light.  Sounds follow the people who moved.
+	void update(const glm::vec3 & light, float radius, double now);
+
+	// Copies out every position and appends the agents that moved since the last
+	// publish() to moved.
+	void publish(CrowdPositions & positions, std::vector<unsigned int> & moved);
+
+	// Render side.  Moves the nodes of agents, and of everyone left between two
+	// positions by earlier calls, alpha of the way from previous to current.
+	void place(const std::vector<unsigned int> & agents, const CrowdPositions & previous,
+			const CrowdPositions & current, float alpha);
+
+	// One past the highest agent id, removed people included.
+	unsigned int size() const;
+	unsigned int numPeople() const;
+	unsigned int numRunning() const;
+
+	// Ground positions, and headings in degrees about y, by agent id.
+	const std::vector<float> & positionsX() const;
+	const std::vector<float> & positionsZ() const;
+	const std::vector<float> & headings() const;
+
+	// As given to add(), with the node's translation while it stood at the origin.
+	SceneNode * node(unsigned int agent) const;
+	const glm::vec3 & nodeOffset(unsigned int agent) const;
+	VoiceHandle audio(unsigned int agent) const;
+	VoiceHandle panicAudio(unsigned int agent) const;
+
+	// The follower paired with a leader, or agent itself if it leads nobody.
+	unsigned int follower(unsigned int agent) const;
+
+private:
+	enum Flag : unsigned char {
+		NERVOUS = 1,
+		RUNNING = 2,
+		FOLLOWER = 4,
+		MOVED = 8,
+		// The id is free; set alone.
+		REMOVED = 16
+	};
+
+	void trigger(unsigned int agent);
+	void startRunning(unsigned int agent);
+	void stepRunning(const glm::vec3 & light);
+	void moveBy(unsigned int agent, float dx, float dz);
+	void stopMoving(unsigned int agent);
+	void stopRunning();
+	void moveSounds();
+	void moveSounds(unsigned int agent);
+	void placeNode(unsigned int agent, float x, float z);
+
+	CrowdGrid m_grid;
+
+	std::vector<float> m_x;
+	std::vector<float> m_z;
+	std::vector<float> m_heading;
+	std::vector<unsigned char> m_flags;
+	// When a person got nervous, or started running.
+	std::vector<double> m_startTime;
+	double m_now;
+	// Agent id of a leader's follower, or the leader's own id if it has none.
+	std::vector<unsigned int> m_follower;
+
+	// nullptr for removed people.
+	std::vector<SceneNode *> m_nodes;
+	// Translation of each node while it stood at the origin.
+	std::vector<glm::vec3> m_nodeOffsets;
+	VoiceManager * m_voices;
+	std::vector<VoiceHandle> m_audio;
+	std::vector<VoiceHandle> m_panicAudio;
+	unsigned int m_numRemoved;
+
+	std::vector<unsigned int> m_running;
+	// Positions of the running people gathered for the flee kernel, and their steps.
+	std::vector<float> m_runX;
+	std::vector<float> m_runZ;
+	std::vector<float> m_stepX;
+	std::vector<float> m_stepZ;
+	// People who moved since the last publish(), flagged MOVED, other than those
+	// still running.
+	std::vector<unsigned int> m_moved;
+
+	//-- Render side:
+	// People whose nodes stand between two published positions, flagged in m_queued.
+	std::vector<unsigned int> m_inMotion;
+	std::vector<unsigned int> m_placing;
+	std::vector<unsigned char> m_queued;
+};
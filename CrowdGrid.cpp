@@ -0,0 +1,102 @@
+#include "CrowdGrid.hpp"
+
+#include <algorithm>
+#include <cmath>
+using namespace std;
+using namespace glm;
+
+//---------------------------------------------------------------------------------------
+CrowdGrid::CrowdGrid (
+		float halfExtent,
+		float cellSize
+)
+	: m_halfExtent(halfExtent),
+	  m_inverseCellSize(1.0f / cellSize),
+	  m_cellsPerSide(std::max((int)std::ceil(2.0f * halfExtent / cellSize), 1))
+{
+	m_cells.resize(m_cellsPerSide * m_cellsPerSide);
+}
+
+//---------------------------------------------------------------------------------------
+unsigned int CrowdGrid::insert(const glm::vec2 & position) {
+	unsigned int agent;
+	if (m_freeAgents.empty()) {
+		agent = m_agents.size();
+		m_agents.push_back(Agent());
+	} else {
+		agent = m_freeAgents.back();
+		m_freeAgents.pop_back();
+	}
+	Agent & entry = m_agents[agent];
+	entry.position = position;
+	entry.cell = cellIndex(position);
+	entry.slot = m_cells[entry.cell].size();
+	m_cells[entry.cell].push_back(agent);
+	return agent;
+}
+
+//---------------------------------------------------------------------------------------
+void CrowdGrid::remove(unsigned int agent) {
+	unlink(m_agents[agent]);
+	m_freeAgents.push_back(agent);
+}
+
+//---------------------------------------------------------------------------------------
+void CrowdGrid::move(unsigned int agent, const glm::vec2 & position) {
+	Agent & entry = m_agents[agent];
+	entry.position = position;
+	unsigned int cell = cellIndex(position);
+	if (cell == entry.cell) {
+		return;
+	}
+
+	unlink(entry);
+	entry.cell = cell;
+	entry.slot = m_cells[cell].size();
+	m_cells[cell].push_back(agent);
+}
+
+//---------------------------------------------------------------------------------------
+// Swaps the last agent of entry's cell into the slot entry vacates.
+void CrowdGrid::unlink(const Agent & entry) {
+	vector<unsigned int> & cell = m_cells[entry.cell];
+	unsigned int last = cell.back();
+	cell[entry.slot] = last;
+	m_agents[last].slot = entry.slot;
+	cell.pop_back();
+}
+
+//---------------------------------------------------------------------------------------
+const glm::vec2 & CrowdGrid::position(unsigned int agent) const {
+	return m_agents[agent].position;
+}
+
+//---------------------------------------------------------------------------------------
+unsigned int CrowdGrid::numAgents() const {
+	return m_agents.size() - m_freeAgents.size();
+}
+
+//---------------------------------------------------------------------------------------
+unsigned int CrowdGrid::numCells() const {
+	return m_cells.size();
+}
+
+//---------------------------------------------------------------------------------------
+int CrowdGrid::cellCoordinate(float coordinate) const {
+	return (int)std::floor((coordinate + m_halfExtent) * m_inverseCellSize);
+}
+
+//---------------------------------------------------------------------------------------
+int CrowdGrid::wrap(int cellCoordinate) const {
+	// Saves the division for the ground plane itself.
+	if (cellCoordinate >= 0 && cellCoordinate < m_cellsPerSide) {
+		return cellCoordinate;
+	}
+	int cell = cellCoordinate % m_cellsPerSide;
+	return cell < 0 ? cell + m_cellsPerSide : cell;
+}
+
+//---------------------------------------------------------------------------------------
+unsigned int CrowdGrid::cellIndex(const glm::vec2 & position) const {
+	return wrap(cellCoordinate(position.y)) * m_cellsPerSide + wrap(cellCoordinate(position.x));
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "CityGrid.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// Edge length of a CrowdGrid cell: the spotlight's reach, so a query at any point
+// touches at most 3 x 3 cells.
+const float CROWD_CELL_SIZE = 4.0f;
+
+/*
+ * Uniform grid over the ground plane binning agents by their x, z position, so
+ * radius queries only look at the agents in nearby cells instead of all of them.
+ * Agents are dense ids 0, 1, ... in insertion order, except that insert() hands out
+ * the ids of removed agents again first.  Moving one only touches the two cells
+ * involved, in O(1).  Past the ground plane the grid repeats, so a streamed city
+ * of any size still bins into it; agents a whole grid apart share cells, which
+ * only costs queries the time to reject them.
+ */
+class CrowdGrid {
+public:
+	CrowdGrid(float halfExtent = CITY_HALF_EXTENT, float cellSize = CROWD_CELL_SIZE);
+
+	// Returns the new agent's id.
+	unsigned int insert(const glm::vec2 & position);
+
+	// Takes an agent out of its cell, freeing its id for reuse.
+	void remove(unsigned int agent);
+
+	// Records an agent's new position, rebinning it if it left its cell.
+	void move(unsigned int agent, const glm::vec2 & position);
+
+	// Calls visit(agent) for every agent closer than radius to center, cell by cell.
+	template <typename Visitor>
+	void query(const glm::vec2 & center, float radius, Visitor visit) const {
+		int minX = cellCoordinate(center.x - radius);
+		int maxX = cellCoordinate(center.x + radius);
+		int minZ = cellCoordinate(center.y - radius);
+		int maxZ = cellCoordinate(center.y + radius);
+		float radiusSquared = radius * radius;
+		for (int z = minZ; z <= maxZ; ++z) {
+			int row = wrap(z) * m_cellsPerSide;
+			for (int x = minX; x <= maxX; ++x) {
+				for (unsigned int agent : m_cells[row + wrap(x)]) {
+					glm::vec2 offset = m_agents[agent].position - center;
+					if (glm::dot(offset, offset) < radiusSquared) {
+						visit(agent);
+					}
+				}
+			}
+		}
+	}
+
+	const glm::vec2 & position(unsigned int agent) const;
+
+	unsigned int numAgents() const;
+	unsigned int numCells() const;
+
+private:
+	struct Agent {
+		glm::vec2 position;
+		unsigned int cell;
+		// Position within m_cells[cell].
+		unsigned int slot;
+	};
+
+	// Cell coordinates are unbounded; wrap() maps one into the grid.
+	int cellCoordinate(float coordinate) const;
+	int wrap(int cellCoordinate) const;
+	unsigned int cellIndex(const glm::vec2 & position) const;
+	void unlink(const Agent & entry);
+
+	float m_halfExtent;
+	float m_inverseCellSize;
+	int m_cellsPerSide;
+	std::vector<std::vector<unsigned int>> m_cells;
+	std::vector<Agent> m_agents;
+	std::vector<unsigned int> m_freeAgents;
+};
@@ -0,0 +1,213 @@
+#include "CullingGrid.hpp"
+#include "CityGrid.hpp"
+
+#include <algorithm>
+using namespace std;
+using namespace glm;
+
+//---------------------------------------------------------------------------------------
+CullingGrid::CullingGrid()
+	: m_numVisibleItems(0),
+	  m_numVisibleCells(0),
+	  m_numVisibleStaticBatches(0)
+{
+
+}
+
+//---------------------------------------------------------------------------------------
+// Blocks past the grid edge wrap around it; cell bounds cover whatever shares a cell.
+int CullingGrid::cellIndex(int blockX, int blockZ) const {
+	int x = (blockX + 1) % CULLING_GRID_CELLS;
+	int z = (blockZ + 1) % CULLING_GRID_CELLS;
+	x = x < 0 ? x + CULLING_GRID_CELLS : x;
+	z = z < 0 ? z + CULLING_GRID_CELLS : z;
+	return z * CULLING_GRID_CELLS + x;
+}
+
+//---------------------------------------------------------------------------------------
+void CullingGrid::bin(unsigned int item, const AABB & box) {
+	if (box.empty()) {
+		m_itemCells[item] = NO_CELL;
+		return;
+	}
+	vec3 size = box.max - box.min;
+	if (size.x > CITY_BLOCK_SIZE || size.z > CITY_BLOCK_SIZE) {
+		m_itemCells[item] = OVERSIZED;
+		m_itemSlots[item] = m_oversizedItems.size();
+		m_oversizedItems.push_back(item);
+		return;
+	}
+	vec3 center = box.center();
+	int index = cellIndex(cityBlockIndex(center.x), cityBlockIndex(center.z));
+	Cell & cell = m_cells[index];
+	cell.bounds.expand(box);
+	m_itemCells[item] = index;
+	m_itemSlots[item] = cell.items.size();
+	cell.items.push_back(item);
+}
+
+//---------------------------------------------------------------------------------------
+// Swaps the last item of the cell into the slot item vacates.
+void CullingGrid::unbin(unsigned int item) {
+	int index = m_itemCells[item];
+	if (index == NO_CELL) {
+		return;
+	}
+	std::vector<unsigned int> & items = index == OVERSIZED ? m_oversizedItems : m_cells[index].items;
+	unsigned int last = items.back();
+	items[m_itemSlots[item]] = last;
+	m_itemSlots[last] = m_itemSlots[item];
+	items.pop_back();
+	m_itemCells[item] = NO_CELL;
+}
+
+//---------------------------------------------------------------------------------------
+void CullingGrid::setStaticBatches(const std::vector<StaticBatch> & batches) {
+	m_staticBounds.clear();
+	for (Cell & cell : m_cells) {
+		cell.staticBounds = AABB();
+		cell.staticBatches.clear();
+	}
+	for (unsigned int i = 0; i < batches.size(); ++i) {
+		const StaticBatch & batch = batches[i];
+		Cell & cell = m_cells[cellIndex(batch.blockX, batch.blockZ)];
+		cell.staticBounds.expand(batch.bounds);
+		cell.staticBatches.push_back(i);
+		m_staticBounds.push_back(batch.bounds);
+	}
+}
+
+//---------------------------------------------------------------------------------------
+void CullingGrid::build(const SceneCache & sceneCache) {
+	const std::vector<FlatNode> & nodes = sceneCache.nodes();
+	const std::vector<AABB> & bounds = sceneCache.worldBounds();
+
+	for (Cell & cell : m_cells) {
+		cell.bounds = AABB();
+		cell.items.clear();
+	}
+	m_oversizedItems.clear();
+	m_items.clear();
+	if (nodes.empty()) {
+		m_itemCells.clear();
+		m_itemSlots.clear();
+		return;
+	}
+
+	for (unsigned int child = 1; child < nodes[0].end; child = nodes[child].end) {
+		m_items.push_back(child);
+	}
+	m_itemCells.resize(m_items.size());
+	m_itemSlots.resize(m_items.size());
+	for (unsigned int item = 0; item < m_items.size(); ++item) {
+		bin(item, bounds[m_items[item]]);
+	}
+}
+
+//---------------------------------------------------------------------------------------
+void CullingGrid::rebin(const SceneCache & sceneCache) {
+	const std::vector<AABB> & bounds = sceneCache.worldBounds();
+	for (unsigned int child : sceneCache.movedChildren()) {
+		unsigned int item = lower_bound(m_items.begin(), m_items.end(), child) - m_items.begin();
+		unbin(item);
+		bin(item, bounds[child]);
+	}
+}
+
+//---------------------------------------------------------------------------------------
+void CullingGrid::cull (
+		const SceneCache & sceneCache,
+		const Frustum & frustum,
+		std::vector<unsigned int> & visibleGeometry
+) {
+	const std::vector<FlatNode> & nodes = sceneCache.nodes();
+	const std::vector<AABB> & bounds = sceneCache.worldBounds();
+	const std::vector<unsigned int> & geometryNodes = sceneCache.geometryNodes();
+
+	m_itemVisible.assign(m_items.size(), 0);
+	m_numVisibleCells = 0;
+	for (const Cell & cell : m_cells) {
+		Containment containment = frustum.classify(cell.bounds);
+		if (containment == Containment::Outside) {
+			continue;
+		}
+		++m_numVisibleCells;
+		for (unsigned int item : cell.items) {
+			if (containment == Containment::Inside || frustum.intersects(bounds[m_items[item]])) {
+				m_itemVisible[item] = 1;
+			}
+		}
+	}
+	for (unsigned int item : m_oversizedItems) {
+		if (frustum.intersects(bounds[m_items[item]])) {
+			m_itemVisible[item] = 1;
+		}
+	}
+
+	// Walking the items in order keeps the draw order, which blending depends on.
+	visibleGeometry.clear();
+	m_numVisibleItems = 0;
+	if (!geometryNodes.empty() && geometryNodes[0] == 0) {
+		visibleGeometry.push_back(0);
+	}
+	for (unsigned int item = 0; item < m_items.size(); ++item) {
+		if (!m_itemVisible[item]) {
+			continue;
+		}
+		++m_numVisibleItems;
+		unsigned int begin = m_items[item];
+		unsigned int end = nodes[begin].end;
+		auto first = lower_bound(geometryNodes.begin(), geometryNodes.end(), begin);
+		auto last = lower_bound(first, geometryNodes.end(), end);
+		for (auto it = first; it != last; ++it) {
+			visibleGeometry.push_back(it - geometryNodes.begin());
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------
+void CullingGrid::cullStatic (
+		const Frustum & frustum,
+		std::vector<unsigned int> & visibleBatches
+) {
+	visibleBatches.clear();
+	for (const Cell & cell : m_cells) {
+		Containment containment = frustum.classify(cell.staticBounds);
+		if (containment == Containment::Outside) {
+			continue;
+		}
+		for (unsigned int batch : cell.staticBatches) {
+			if (containment == Containment::Inside || frustum.intersects(m_staticBounds[batch])) {
+				visibleBatches.push_back(batch);
+			}
+		}
+	}
+	// Batches are sorted by block, texture and material; keep that order for state changes.
+	sort(visibleBatches.begin(), visibleBatches.end());
+	m_numVisibleStaticBatches = visibleBatches.size();
+}
+
+//---------------------------------------------------------------------------------------
+unsigned int CullingGrid::numItems() const {
+	return m_items.size();
+}
+
+//---------------------------------------------------------------------------------------
+unsigned int CullingGrid::numVisibleItems() const {
+	return m_numVisibleItems;
+}
+
+//---------------------------------------------------------------------------------------
+unsigned int CullingGrid::numVisibleCells() const {
+	return m_numVisibleCells;
+}
+
+//---------------------------------------------------------------------------------------
+unsigned int CullingGrid::numStaticBatches() const {
+	return m_staticBounds.size();
+}
+
+//---------------------------------------------------------------------------------------
+unsigned int CullingGrid::numVisibleStaticBatches() const {
+	return m_numVisibleStaticBatches;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "AABB.hpp"
+#include "Frustum.hpp"
+#include "SceneCache.hpp"
+#include "StaticGeometry.hpp"
+
+#include <vector>
+
+// Blocks -1 .. 4 cover the ground plane, including the half blocks past the outer roads.
+const int CULLING_GRID_CELLS = 6;
+
+/*
+ * Uniform grid over the city blocks used to frustum cull the root's children
+ * (people, unbaked buildings, intersections) and the baked StaticBatches.  Whole
+ * cells are rejected or accepted first; only items in cells straddling the frustum
+ * are tested on their own.  Past the ground plane the grid repeats, so streamed
+ * blocks a whole grid apart share a cell instead of piling up in the edge cells.
+ *
+ * build() bins every item and is only needed when the scene's structure changed;
+ * rebin() moves just the items SceneCache::update() recomputed.  A cell's bounds only
+ * grow between builds, which never culls too much.
+ */
+class CullingGrid {
+public:
+	CullingGrid();
+
+	// Bins the baked batches, which never move.  Call once after consolidate().
+	void setStaticBatches(const std::vector<StaticBatch> & batches);
+
+	// Bins the root's children by the block containing the centre of their bounds.
+	void build(const SceneCache & sceneCache);
+
+	// Bins the children in sceneCache.movedChildren() again, after an update() that
+	// did not change the structure.
+	void rebin(const SceneCache & sceneCache);
+
+	// Fills visibleGeometry with the positions, within sceneCache.geometryNodes(), of
+	// every GeometryNode whose top-level subtree survives the frustum, in traversal order.
+	void cull(const SceneCache & sceneCache, const Frustum & frustum,
+			std::vector<unsigned int> & visibleGeometry);
+
+	// Fills visibleBatches with the indices of the static batches inside the frustum.
+	void cullStatic(const Frustum & frustum, std::vector<unsigned int> & visibleBatches);
+
+	unsigned int numItems() const;
+	unsigned int numVisibleItems() const;
+	unsigned int numVisibleCells() const;
+	unsigned int numStaticBatches() const;
+	unsigned int numVisibleStaticBatches() const;
+
+private:
+	struct Cell {
+		AABB bounds;
+		std::vector<unsigned int> items;
+		AABB staticBounds;
+		std::vector<unsigned int> staticBatches;
+	};
+
+	// m_itemCells entries for items in no cell.
+	enum : int {
+		NO_CELL = -1,
+		OVERSIZED = -2
+	};
+
+	int cellIndex(int blockX, int blockZ) const;
+	void bin(unsigned int item, const AABB & box);
+	void unbin(unsigned int item);
+
+	Cell m_cells[CULLING_GRID_CELLS * CULLING_GRID_CELLS];
+	// Items wider than a block would swell whichever cell they landed in.
+	std::vector<unsigned int> m_oversizedItems;
+
+	// Flat indices of the root's children and their visibility, in traversal order.
+	std::vector<unsigned int> m_items;
+	std::vector<char> m_itemVisible;
+	// Where each item is binned: its cell, or NO_CELL or OVERSIZED, and its position
+	// within that cell's items or m_oversizedItems.
+	std::vector<int> m_itemCells;
+	std::vector<unsigned int> m_itemSlots;
+	std::vector<AABB> m_staticBounds;
+
+	unsigned int m_numVisibleItems;
+	unsigned int m_numVisibleCells;
+	unsigned int m_numVisibleStaticBatches;
+};
@@ -0,0 +1,200 @@
+#include "FacadeGrammar.hpp"
+
+#include "framework/Exception.hpp"
+
+#include <sstream>
+using namespace std;
+
+namespace {
+
+// Symbols are 7 bit characters.
+const unsigned int NUM_SYMBOLS = 128;
+
+// Stands for an occurrence of stochastic rule r in an expanded string.  Control
+// characters never appear in the rules themselves.
+char choicePlaceholder(unsigned int rule) {
+	return (char)(1 + rule);
+}
+
+bool isChoicePlaceholder(char ch, unsigned int numRules) {
+	return ch >= 1 && (unsigned char)ch <= numRules;
+}
+
+//---------------------------------------------------------------------------------------
+void throwGrammarError(const string & what, const string & terminals) {
+	stringstream errorMessage;
+	errorMessage << what << " in facade \"" << terminals << "\"";
+	throw Exception(errorMessage.str());
+}
+
+} // namespace
+
+//---------------------------------------------------------------------------------------
+FacadeProgram::FacadeProgram()
+	: m_bodyEnd(0),
+	  m_numEndFloors(0)
+{
+
+}
+
+//---------------------------------------------------------------------------------------
+unsigned int FacadeProgram::draw (
+		CityRandom & random,
+		std::vector<unsigned char> & choices
+) const {
+	choices.clear();
+	unsigned int numEndFloors = m_numEndFloors;
+	for (unsigned int i = 0; i < m_bodyEnd; ++i) {
+		if (m_ops[i].code != FacadeOpCode::Choice) {
+			continue;
+		}
+		const vector<Alternative> & alternatives = m_alternatives[m_ops[i].rule];
+		int chance = random.nextInt(100);
+		unsigned char drawn = 0;
+		for (int bound = alternatives[0].chancePercent; chance >= bound && drawn + 1u < alternatives.size();
+				bound += alternatives[drawn].chancePercent) {
+			++drawn;
+		}
+		choices.push_back(drawn);
+		numEndFloors += alternatives[drawn].numEndFloors;
+	}
+	return numEndFloors;
+}
+
+//---------------------------------------------------------------------------------------
+FacadeGrammar::FacadeGrammar (
+		const std::string & axiom,
+		const std::string & levelSymbols
+)
+	: m_axiom(axiom),
+	  m_levelSymbols(levelSymbols),
+	  m_rules(NUM_SYMBOLS),
+	  m_hasRule(NUM_SYMBOLS, false),
+	  m_stochasticRule(NUM_SYMBOLS, 0)
+{
+
+}
+
+//---------------------------------------------------------------------------------------
+void FacadeGrammar::setRule (
+		char symbol,
+		const std::string & rewrite
+) {
+	m_rules[symbol & 0x7f] = rewrite;
+	m_hasRule[symbol & 0x7f] = true;
+	m_stochasticRule[symbol & 0x7f] = 0;
+}
+
+//---------------------------------------------------------------------------------------
+void FacadeGrammar::setStochasticRule (
+		char symbol,
+		const std::vector<RewriteAlternative> & alternatives
+) {
+	m_stochasticRules.push_back(alternatives);
+	m_rules[symbol & 0x7f] = string(1, choicePlaceholder(m_stochasticRules.size() - 1));
+	m_hasRule[symbol & 0x7f] = true;
+	m_stochasticRule[symbol & 0x7f] = m_stochasticRules.size();
+}
+
+//---------------------------------------------------------------------------------------
+FacadeProgram FacadeGrammar::compile (
+		unsigned int levels
+) const {
+	FacadeProgram program;
+	string terminals = expand(m_axiom, levels);
+	program.m_numEndFloors = decode(terminals, program);
+	program.m_bodyEnd = program.m_ops.size();
+
+	// Alternatives are expanded on their own, with no levels to spend.
+	for (const vector<RewriteAlternative> & rule : m_stochasticRules) {
+		program.m_alternatives.push_back(vector<FacadeProgram::Alternative>());
+		for (const RewriteAlternative & alternative : rule) {
+			string expanded = expand(alternative.rewrite, 0);
+			FacadeProgram::Alternative compiled;
+			compiled.chancePercent = alternative.chancePercent;
+			compiled.begin = program.m_ops.size();
+			compiled.numEndFloors = decode(expanded, program);
+			compiled.end = program.m_ops.size();
+			for (unsigned int i = compiled.begin; i < compiled.end; ++i) {
+				if (program.m_ops[i].code == FacadeOpCode::Choice) {
+					throwGrammarError("Nested stochastic rule", expanded);
+				}
+			}
+			program.m_alternatives.back().push_back(compiled);
+		}
+	}
+	return program;
+}
+
+//---------------------------------------------------------------------------------------
+// Stochastic rules rewrite to their placeholder, a terminal, so the outcome can be
+// drawn per building while the expansion itself is shared.
+std::string FacadeGrammar::expand (
+		const std::string & axiom,
+		unsigned int levels
+) const {
+	string encoding = axiom;
+	string rewrite;
+	unsigned int levelsUsed = 0;
+	bool rewritten = true;
+	while (rewritten) {
+		rewritten = false;
+		rewrite.clear();
+		for (char ch : encoding) {
+			if (m_levelSymbols.find(ch) != string::npos) {
+				if (levelsUsed < levels) {
+					++levelsUsed;
+				} else {
+					rewritten = true;
+					continue;
+				}
+			}
+			if (ch > 0 && m_hasRule[ch]) {
+				rewrite += m_rules[ch];
+				rewritten = true;
+			} else {
+				rewrite += ch;
+			}
+		}
+		encoding.swap(rewrite);
+	}
+	return encoding;
+}
+
+//---------------------------------------------------------------------------------------
+// Appends the ops for terminals to program and returns how many EndFloor ops they hold.
+unsigned int FacadeGrammar::decode (
+		const std::string & terminals,
+		FacadeProgram & program
+) const {
+	unsigned int numEndFloors = 0;
+	for (size_t i = 0; i < terminals.size(); ++i) {
+		char ch = terminals[i];
+		FacadeOp op = {FacadeOpCode::Face, 0, 0, 0};
+		if (ch == '[') {
+			// "[n r]k"
+			size_t close = terminals.find(']', i);
+			if (close == string::npos || close + 1 >= terminals.size() || i + 1 >= close
+					|| terminals[i + 1] < '1' || terminals[i + 1] > '9') {
+				throwGrammarError("Malformed face", terminals);
+			}
+			op.tileWidth = terminals[i + 1] - '0';
+			op.kind = terminals[close + 1];
+			i = close + 1;
+		} else if (ch == '/') {
+			op.code = FacadeOpCode::EndFloor;
+			++numEndFloors;
+		} else if (ch >= 'a' && ch <= 'z') {
+			op.code = FacadeOpCode::Roof;
+			op.kind = ch;
+		} else if (isChoicePlaceholder(ch, m_stochasticRules.size())) {
+			op.code = FacadeOpCode::Choice;
+			op.rule = ch - 1;
+		} else {
+			// '|' and anything else carry no geometry.
+			continue;
+		}
+		program.m_ops.push_back(op);
+	}
+	return numEndFloors;
+}
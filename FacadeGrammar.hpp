@@ -0,0 +1,119 @@
+#pragma once
+
+#include "CityRandom.hpp"
+
+#include <string>
+#include <vector>
+
+// One outcome of a stochastic rule, taken chancePercent percent of the time.
+struct RewriteAlternative {
+	int chancePercent;
+	std::string rewrite;
+};
+
+enum class FacadeOpCode : unsigned char {
+	// One face of the current floor: a row of tileWidth wide tiles of one kind,
+	// 'w' window, 'd' door or 'b' broken window.
+	Face,
+	// A '/': closes the current floor, if any faces were placed since the last one.
+	EndFloor,
+	// Roof of kind 'c' cylinder, 'f' flat or 's' sphere.
+	Roof,
+	// An occurrence of a stochastic rule; stands for the ops of the drawn alternative.
+	Choice
+};
+
+struct FacadeOp {
+	FacadeOpCode code;
+	char kind;
+	unsigned char tileWidth;
+	// Index of the stochastic rule, for Choice.
+	unsigned char rule;
+};
+
+/*
+ * A facade grammar expanded for one number of levels, with every deterministic rule
+ * already applied and the terminal string decoded into ops.  Buildings of the same
+ * type and levels share one program and differ only in the outcomes they draw for
+ * its Choice ops.
+ */
+class FacadeProgram {
+public:
+	FacadeProgram();
+
+	// Draws an alternative for every Choice op, in output order.  Returns the number
+	// of EndFloor ops the facade runs with those choices.
+	unsigned int draw(CityRandom & random, std::vector<unsigned char> & choices) const;
+
+	// Calls visit(op) for every Face, EndFloor and Roof op, substituting the drawn
+	// alternative for each Choice op.
+	template <typename Visitor>
+	void run(const std::vector<unsigned char> & choices, Visitor visit) const {
+		size_t choice = 0;
+		for (unsigned int i = 0; i < m_bodyEnd; ++i) {
+			const FacadeOp & op = m_ops[i];
+			if (op.code != FacadeOpCode::Choice) {
+				visit(op);
+				continue;
+			}
+			const Alternative & alternative = m_alternatives[op.rule][choices[choice++]];
+			for (unsigned int j = alternative.begin; j < alternative.end; ++j) {
+				visit(m_ops[j]);
+			}
+		}
+	}
+
+private:
+	friend class FacadeGrammar;
+
+	struct Alternative {
+		int chancePercent;
+		// Range of m_ops past m_bodyEnd.
+		unsigned int begin;
+		unsigned int end;
+		unsigned int numEndFloors;
+	};
+
+	// The body, followed by the ops of every alternative.
+	std::vector<FacadeOp> m_ops;
+	unsigned int m_bodyEnd;
+	unsigned int m_numEndFloors;
+	// Alternatives of each stochastic rule.
+	std::vector<std::vector<Alternative>> m_alternatives;
+};
+
+/*
+ * Rewriting rules for a building's facade, compiled once per number of levels.
+ *
+ * Expansion follows the string rewriting Building::grow used to do: every pass
+ * rewrites each symbol of the previous pass once, left to right, and each level
+ * symbol rewritten uses up one level.  Level symbols met after the levels are used
+ * up are dropped.  Terminals are "[n r]k" faces, '|' face separators, '/' floor
+ * ends and roof letters.
+ */
+class FacadeGrammar {
+public:
+	FacadeGrammar(const std::string & axiom, const std::string & levelSymbols);
+
+	void setRule(char symbol, const std::string & rewrite);
+
+	// A rule whose rewrite is drawn per occurrence.  The chances must add up to 100
+	// and the alternatives may not use other stochastic rules.
+	void setStochasticRule(char symbol, const std::vector<RewriteAlternative> & alternatives);
+
+	// Throws Exception if the expansion does not decode into facade ops.
+	FacadeProgram compile(unsigned int levels) const;
+
+private:
+	std::string expand(const std::string & axiom, unsigned int levels) const;
+	unsigned int decode(const std::string & terminals, FacadeProgram & program) const;
+
+	std::string m_axiom;
+	std::string m_levelSymbols;
+	// Indexed by symbol; a symbol without a rule is a terminal.
+	std::vector<std::string> m_rules;
+	std::vector<bool> m_hasRule;
+	// Stochastic rule index + 1 by symbol, 0 for none.
+	std::vector<unsigned char> m_stochasticRule;
+	std::vector<std::vector<RewriteAlternative>> m_stochasticRules;
+};
@@ -0,0 +1,60 @@
+#include "Frustum.hpp"
+
+using namespace glm;
+
+//---------------------------------------------------------------------------------------
+Frustum::Frustum() {
+
+}
+
+//---------------------------------------------------------------------------------------
+// Gribb-Hartmann plane extraction.  glm is column major, so row i of the matrix is
+// (m[0][i], m[1][i], m[2][i], m[3][i]).
+Frustum::Frustum (
+		const glm::mat4 & m
+) {
+	vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+	vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+	vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+	vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+	m_planes[0] = row3 + row0; // left
+	m_planes[1] = row3 - row0; // right
+	m_planes[2] = row3 + row1; // bottom
+	m_planes[3] = row3 - row1; // top
+	m_planes[4] = row3 + row2; // near
+	m_planes[5] = row3 - row2; // far
+	for (vec4 & plane : m_planes) {
+		plane /= length(vec3(plane));
+	}
+}
+
+//---------------------------------------------------------------------------------------
+Containment Frustum::classify (
+		const AABB & box
+) const {
+	if (box.empty()) {
+		return Containment::Outside;
+	}
+	vec3 center = box.center();
+	vec3 extents = box.extents();
+	Containment result = Containment::Inside;
+	for (const vec4 & plane : m_planes) {
+		float distance = dot(vec3(plane), center) + plane.w;
+		float radius = dot(abs(vec3(plane)), extents);
+		if (distance < -radius) {
+			return Containment::Outside;
+		}
+		if (distance < radius) {
+			result = Containment::Intersects;
+		}
+	}
+	return result;
+}
+
+//---------------------------------------------------------------------------------------
+bool Frustum::intersects (
+		const AABB & box
+) const {
+	return classify(box) != Containment::Outside;
+}
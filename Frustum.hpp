@@ -0,0 +1,30 @@
+#pragma once
+
+#include "AABB.hpp"
+
+#include <glm/glm.hpp>
+
+enum class Containment {
+	Outside,
+	Intersects,
+	Inside,
+};
+
+/*
+ * The six clip planes of a perspective * view matrix, in world space.  The far plane
+ * doubles as the distance cull.
+ */
+class Frustum {
+public:
+	Frustum();
+
+	explicit Frustum(const glm::mat4 & viewProjection);
+
+	Containment classify(const AABB & box) const;
+
+	bool intersects(const AABB & box) const;
+
+private:
+	// (normal, d) with the normal pointing into the frustum.
+	glm::vec4 m_planes[6];
+};
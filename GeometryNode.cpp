@@ -2,11 +2,12 @@
 
 //---------------------------------------------------------------------------------------
 GeometryNode::GeometryNode(
-		const std::string & meshId,
-		const std::string & name
+		MeshHandle mesh,
+		const NodeName & name
 )
 	: SceneNode(name),
-	  meshId(meshId)
+	  material(DEFAULT_MATERIAL),
+	  mesh(mesh)
 {
 	m_nodeType = NodeType::GeometryNode;
 }
@@ -3,17 +3,18 @@
 #pragma once
 
 #include "SceneNode.hpp"
+#include "SceneRegistry.hpp"
 
 class GeometryNode : public SceneNode {
 public:
 	GeometryNode(
-		const std::string & meshId,
-		const std::string & name
+		MeshHandle mesh,
+		const NodeName & name
 	);
 
-	Material material;
+	MaterialHandle material;
 
-	// Mesh Identifier. This must correspond to an object name of
+	// Mesh handle. Its SceneRegistry::meshId() must correspond to an object name of
 	// a loaded .obj file.
-	std::string meshId;
+	MeshHandle mesh;
 };
@@ -0,0 +1,45 @@
+#include "ImageResize.hpp"
+
+#include <algorithm>
+#include <cmath>
+using namespace std;
+
+//---------------------------------------------------------------------------------------
+void resizeImage (
+		const unsigned char *src,
+		int srcWidth,
+		int srcHeight,
+		int channels,
+		unsigned char *dst,
+		int dstWidth,
+		int dstHeight
+) {
+	float scaleX = (float)srcWidth / dstWidth;
+	float scaleY = (float)srcHeight / dstHeight;
+
+	for (int y = 0; y < dstHeight; ++y) {
+		// Sample at pixel centres so the image is not shifted by half a texel.
+		float sy = min(max((y + 0.5f) * scaleY - 0.5f, 0.0f), (float)(srcHeight - 1));
+		int y0 = (int)sy;
+		int y1 = min(y0 + 1, srcHeight - 1);
+		float fy = sy - y0;
+
+		for (int x = 0; x < dstWidth; ++x) {
+			float sx = min(max((x + 0.5f) * scaleX - 0.5f, 0.0f), (float)(srcWidth - 1));
+			int x0 = (int)sx;
+			int x1 = min(x0 + 1, srcWidth - 1);
+			float fx = sx - x0;
+
+			const unsigned char *p00 = src + (y0 * srcWidth + x0) * channels;
+			const unsigned char *p01 = src + (y0 * srcWidth + x1) * channels;
+			const unsigned char *p10 = src + (y1 * srcWidth + x0) * channels;
+			const unsigned char *p11 = src + (y1 * srcWidth + x1) * channels;
+			unsigned char *out = dst + (y * dstWidth + x) * channels;
+			for (int c = 0; c < channels; ++c) {
+				float top = p00[c] + (p01[c] - p00[c]) * fx;
+				float bottom = p10[c] + (p11[c] - p10[c]) * fx;
+				out[c] = (unsigned char)lround(top + (bottom - top) * fy);
+			}
+		}
+	}
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+/*
+ * Bilinearly resamples a tightly packed 8 bit per channel image of
+ * srcWidth x srcHeight pixels into dst, which must hold dstWidth x dstHeight pixels.
+ */
+void resizeImage(const unsigned char *src, int srcWidth, int srcHeight, int channels,
+		unsigned char *dst, int dstWidth, int dstHeight);
@@ -2,9 +2,15 @@
 
 #include "Project.hpp"
 
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
+#include <memory>
 using namespace std;
 
+// Seed used by --bench unless --seed is given, so runs are comparable.
+const unsigned int BENCH_DEFAULT_SEED = 1;
+
 int main( int argc, char **argv )
 {
 	if (argc > 1) {
@@ -13,12 +19,86 @@ int main( int argc, char **argv )
 		title += luaSceneFile;
 		title += "]";
 
-		Window::launch(argc, argv, new Project(luaSceneFile), 1024, 768, title);
+		ProjectOptions options;
+		bool seedGiven = false;
+		for (int i = 2; i < argc; ++i) {
+			std::string option(argv[i]);
+			bool hasValue = i + 1 < argc;
+			if (option == "--no-bake") {
+				options.bakeStatic = false;
+			} else if (option == "--no-texture-array") {
+				options.textureArray = false;
+			} else if (option == "--no-packed-vertices") {
+				options.packedVertices = false;
+			} else if (option == "--bench") {
+				options.bench = true;
+			} else if (option == "--frames" && hasValue) {
+				options.benchFrames = strtoul(argv[++i], nullptr, 10);
+			} else if (option == "--json" && hasValue) {
+				options.benchJson = argv[++i];
+			} else if (option == "--seed" && hasValue) {
+				options.seed = strtoul(argv[++i], nullptr, 10);
+				seedGiven = true;
+			} else if (option == "--threads" && hasValue) {
+				options.threads = strtoul(argv[++i], nullptr, 10);
+			} else if (option == "--crowd" && hasValue) {
+				options.crowdDensity = std::min(strtoul(argv[++i], nullptr, 10), 200ul);
+			} else if (option == "--voices" && hasValue) {
+				options.maxVoices = strtoul(argv[++i], nullptr, 10);
+			} else if (option == "--pack" && hasValue) {
+				options.assetPack = argv[++i];
+			} else if (option == "--no-pack") {
+				options.assetPack.clear();
+			} else if (option == "--city" && hasValue) {
+				options.citySnapshot = argv[++i];
+			} else if (option == "--stream" && hasValue) {
+				options.streamRadius = strtoul(argv[++i], nullptr, 10);
+			} else if (option == "--poster" && hasValue) {
+				options.posterFile = argv[++i];
+			} else if (option == "--poster-samples" && hasValue) {
+				options.posterSamples = strtoul(argv[++i], nullptr, 10);
+			} else {
+				cout << "Ignoring unknown option " << option << endl;
+			}
+		}
+		if (options.bench && !seedGiven) {
+			options.seed = BENCH_DEFAULT_SEED;
+		}
+
+		if (options.posterFile.empty()) {
+			Window::launch(argc, argv, new Project(luaSceneFile, options), 1024, 768, title);
+		} else {
+			// Traced on the CPU alone, so no window or GL context is ever created.
+			try {
+				unique_ptr<Project> project(new Project(luaSceneFile, options));
+				project->makePoster();
+			} catch (const std::exception & e) {
+				cerr << "Exception Thrown: " << e.what() << endl;
+				return 1;
+			}
+		}
 
 	} else {
 		cout << "Must supply Lua file as First argument to program.\n";
         cout << "For example:\n";
         cout << "./Project Assets/simpleScene.lua\n";
+        cout << "Options:\n";
+        cout << "  --no-bake             keep buildings as individual scene nodes\n";
+        cout << "  --no-texture-array    bind one GL_TEXTURE_2D per draw instead of a texture array\n";
+        cout << "  --no-packed-vertices  upload mesh vertices as three float streams\n";
+        cout << "  --bench               fly a fixed camera path offscreen and report frame timings\n";
+        cout << "  --frames N            number of measured --bench frames (default 1000)\n";
+        cout << "  --json FILE           also write the --bench report to FILE\n";
+        cout << "  --seed N              seed for the city layout (--bench defaults to 1)\n";
+        cout << "  --threads N           threads generating the city (default: all cores)\n";
+        cout << "  --crowd N             people per 200 ground cells, up to 200 (default 1)\n";
+        cout << "  --voices N            sounds mixed at once, the nearest win (default 32)\n";
+        cout << "  --pack FILE           asset pack built by AssetCook (default Assets.pack)\n";
+        cout << "  --no-pack             load loose files from Assets/ even if a pack exists\n";
+        cout << "  --city FILE           restore the city from a snapshot, or save one after generating\n";
+        cout << "  --stream N            endless city: keep the blocks within N blocks of the camera\n";
+        cout << "  --poster FILE         path trace the starting view on the CPU into a PNG, without a window, and exit\n";
+        cout << "  --poster-samples N    paths per --poster pixel (default 16)\n";
 	}
 
 	return 0;
@@ -12,11 +12,8 @@ struct Material {
 			  ks(glm::vec3(0.0f)),
 			  shininess(0.0f) { }
 	Material(glm::vec4 kd, glm::vec3 ks, float shininess) : kd(kd), ks(ks), shininess(shininess) {}
-	Material(const Material &other) {
-		kd = glm::vec4(other.kd);
-		ks = glm::vec3(other.ks);
-		shininess = other.shininess;
-	}
+	Material(const Material &other) = default;
+	Material & operator = (const Material &other) = default;
 	// Diffuse reflection coefficient
 	glm::vec4 kd;
 
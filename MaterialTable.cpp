@@ -0,0 +1,48 @@
+#include "MaterialTable.hpp"
+
+#include "framework/Exception.hpp"
+
+#include <sstream>
+using namespace std;
+
+//---------------------------------------------------------------------------------------
+MaterialTable::MaterialTable()
+	: m_version(0)
+{
+
+}
+
+//---------------------------------------------------------------------------------------
+unsigned int MaterialTable::intern (
+		const Material & material
+) {
+	MaterialKey key(material.kd.x, material.kd.y, material.kd.z, material.kd.w,
+			material.ks.x, material.ks.y, material.ks.z, material.shininess);
+	auto it = m_indices.find(key);
+	if (it != m_indices.end()) {
+		return it->second;
+	}
+
+	if (m_materials.size() == MAX_MATERIALS) {
+		stringstream errorMessage;
+		errorMessage << "Error within MaterialTable: more than " << MAX_MATERIALS
+			<< " distinct materials\n";
+		throw Exception(errorMessage.str());
+	}
+
+	unsigned int index = m_materials.size();
+	m_indices[key] = index;
+	m_materials.push_back(material);
+	++m_version;
+	return index;
+}
+
+//---------------------------------------------------------------------------------------
+const std::vector<Material> & MaterialTable::materials() const {
+	return m_materials;
+}
+
+//---------------------------------------------------------------------------------------
+unsigned int MaterialTable::version() const {
+	return m_version;
+}
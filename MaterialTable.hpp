@@ -0,0 +1,34 @@
+#pragma once
+
+#include "Material.hpp"
+
+#include <map>
+#include <tuple>
+#include <vector>
+
+// Capacity of the MaterialUniforms block in the shaders.
+const unsigned int MAX_MATERIALS = 256;
+
+/*
+ * Deduplicates Materials into a dense table so draws can refer to a material by
+ * index into the MaterialUniforms uniform buffer.
+ */
+class MaterialTable {
+public:
+	MaterialTable();
+
+	// Returns the index of material, adding it to the table if it is new.
+	unsigned int intern(const Material & material);
+
+	const std::vector<Material> & materials() const;
+
+	// Bumped whenever intern() adds a material.
+	unsigned int version() const;
+
+private:
+	typedef std::tuple<float, float, float, float, float, float, float, float> MaterialKey;
+
+	std::map<MaterialKey, unsigned int> m_indices;
+	std::vector<Material> m_materials;
+	unsigned int m_version;
+};
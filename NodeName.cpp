@@ -0,0 +1,53 @@
+#include "NodeName.hpp"
+
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+using namespace std;
+
+//---------------------------------------------------------------------------------------
+NodeName::NodeName()
+	: m_name(intern(string()))
+{
+
+}
+
+//---------------------------------------------------------------------------------------
+NodeName::NodeName(const char * name)
+	: m_name(intern(name))
+{
+
+}
+
+//---------------------------------------------------------------------------------------
+NodeName::NodeName(const std::string & name)
+	: m_name(intern(name))
+{
+
+}
+
+//---------------------------------------------------------------------------------------
+// Elements of an unordered_set keep their address through rehashing, and names are
+// never removed, so the returned pointers stay valid for the life of the program.
+const std::string * NodeName::intern(const std::string & name) {
+	thread_local unordered_map<string, const string *> threadCache;
+	auto cached = threadCache.find(name);
+	if (cached != threadCache.end()) {
+		return cached->second;
+	}
+
+	static mutex namesMutex;
+	static unordered_set<string> names;
+	const string * interned;
+	{
+		lock_guard<mutex> lock(namesMutex);
+		interned = &*names.insert(name).first;
+	}
+	threadCache.emplace(name, interned);
+	return interned;
+}
+
+//---------------------------------------------------------------------------------------
+std::ostream & operator << (std::ostream & os, const NodeName & name) {
+	return os << name.str();
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+
+/*
+ * Interned node or mesh name.  Equal names share one string, so a NodeName is a
+ * single pointer, compares in O(1) and never needs destroying.  Interning is safe
+ * from any thread; repeat lookups of a name on the same thread take no lock.
+ */
+class NodeName {
+public:
+	NodeName();
+	NodeName(const char * name);
+	NodeName(const std::string & name);
+
+	const std::string & str() const {
+		return *m_name;
+	}
+
+	bool operator == (const NodeName & other) const {
+		return m_name == other.m_name;
+	}
+
+	bool operator != (const NodeName & other) const {
+		return m_name != other.m_name;
+	}
+
+private:
+	static const std::string * intern(const std::string & name);
+
+	const std::string * m_name;
+};
+
+std::ostream & operator << (std::ostream & os, const NodeName & name);
@@ -0,0 +1,325 @@
+#include "PosterRenderer.hpp"
+#include "WorkerPool.hpp"
+
+#include "framework/Exception.hpp"
+#include "lodepng/lodepng.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+using namespace std;
+using namespace glm;
+
+namespace {
+
+// How far rays leaving a surface start off it, so they don't hit it again.
+const float POSTER_RAY_OFFSET = 1e-3f;
+// Bounces before a path may end early, with a chance that shrinks with what it still
+// carries.
+const unsigned int POSTER_ROULETTE_BOUNCES = 2;
+
+//---------------------------------------------------------------------------------------
+unsigned int hashInt(unsigned int x) {
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+//---------------------------------------------------------------------------------------
+// Uniform in [0, 1), from a PCG step of state.
+float nextFloat(unsigned int & state) {
+	state = state * 747796405u + 2891336453u;
+	unsigned int word = ((state >> ((state >> 28) + 4)) ^ state) * 277803737u;
+	word = (word >> 22) ^ word;
+	return (word >> 8) * (1.0f / 16777216.0f);
+}
+
+//---------------------------------------------------------------------------------------
+// A direction about normal, more likely the closer it is to normal, as a diffuse
+// surface scatters light.
+vec3 cosineDirection(const vec3 & normal, unsigned int & random) {
+	float radius = std::sqrt(nextFloat(random));
+	float angle = 6.2831853f * nextFloat(random);
+	vec3 helper = std::abs(normal.x) > 0.9f ? vec3(0.0f, 1.0f, 0.0f) : vec3(1.0f, 0.0f, 0.0f);
+	vec3 tangent = normalize(cross(helper, normal));
+	vec3 bitangent = cross(normal, tangent);
+	float height = std::sqrt(std::max(0.0f, 1.0f - radius * radius));
+	return normalize(radius * std::cos(angle) * tangent + radius * std::sin(angle) * bitangent + height * normal);
+}
+
+//---------------------------------------------------------------------------------------
+unsigned char toByte(float value) {
+	return (unsigned char)(clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+} // namespace
+
+//---------------------------------------------------------------------------------------
+PosterRenderer::PosterRenderer() {
+
+}
+
+//---------------------------------------------------------------------------------------
+void PosterRenderer::addGeometry(const StaticGeometry & geometry) {
+	const vector<StaticBatch> & batches = geometry.getBatches();
+	if (batches.empty()) {
+		return;
+	}
+	const vec3 * positions = reinterpret_cast<const vec3 *>(geometry.getVertexPositionDataPtr());
+	const vec3 * normals = reinterpret_cast<const vec3 *>(geometry.getVertexNormalDataPtr());
+	const vec2 * uvCoords = reinterpret_cast<const vec2 *>(geometry.getVertexUVPtr());
+	const float * layers = geometry.getVertexLayerPtr();
+	const unsigned int * indices = geometry.getIndexDataPtr();
+	for (const StaticBatch & batch : batches) {
+		const unsigned int * batchIndices = indices + batch.startIndex;
+		m_bvh.addTriangles(positions + batch.baseVertex, batchIndices, batch.numIndices);
+		for (unsigned int i = 0; i + 2 < batch.numIndices; i += 3) {
+			Surface surface;
+			for (unsigned int corner = 0; corner < 3; ++corner) {
+				unsigned int vertex = batch.baseVertex + batchIndices[i + corner];
+				surface.normals[corner] = normals[vertex];
+				surface.uvCoords[corner] = uvCoords[vertex];
+			}
+			// Layers hold the texture index whether or not the batch merged textures.
+			surface.textureIndex = (int)std::floor(layers[batch.baseVertex + batchIndices[i]] + 0.5f);
+			surface.material = batch.material;
+			m_surfaces.push_back(surface);
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------
+void PosterRenderer::setTextures(std::vector<PosterTexture> textures) {
+	m_textures = std::move(textures);
+}
+
+//---------------------------------------------------------------------------------------
+void PosterRenderer::build(WorkerPool & pool) {
+	m_bvh.build(&pool);
+}
+
+//---------------------------------------------------------------------------------------
+void PosterRenderer::render (
+		const PosterView & view,
+		WorkerPool & pool,
+		std::vector<unsigned char> & rgb
+) const {
+	rgb.assign(view.width * view.height * 3, 0);
+	unsigned int tilesX = (view.width + POSTER_TILE_SIZE - 1) / POSTER_TILE_SIZE;
+	unsigned int tilesY = (view.height + POSTER_TILE_SIZE - 1) / POSTER_TILE_SIZE;
+	// Tiles differ a lot in cost, sky against street, so they are many and small and
+	// go to whichever thread asks next.
+	pool.parallelFor(tilesX * tilesY, [&](size_t tile) {
+		renderTile(view, tile, rgb);
+	});
+}
+
+//---------------------------------------------------------------------------------------
+/*
+ * Every sample traces the 2x2 blocks of the tile one packet at a time.  A block
+ * hanging over the image edge repeats its pixels inside and drops their extra results.
+ */
+void PosterRenderer::renderTile (
+		const PosterView & view,
+		unsigned int tile,
+		std::vector<unsigned char> & rgb
+) const {
+	unsigned int tilesX = (view.width + POSTER_TILE_SIZE - 1) / POSTER_TILE_SIZE;
+	unsigned int startX = (tile % tilesX) * POSTER_TILE_SIZE;
+	unsigned int startY = (tile / tilesX) * POSTER_TILE_SIZE;
+	unsigned int endX = std::min(startX + POSTER_TILE_SIZE, view.width);
+	unsigned int endY = std::min(startY + POSTER_TILE_SIZE, view.height);
+
+	vec3 forward = normalize(view.direction);
+	vec3 right = normalize(cross(forward, view.up));
+	vec3 up = cross(right, forward);
+	float halfHeight = std::tan(0.5f * view.fovy);
+	float halfWidth = halfHeight * view.width / view.height;
+
+	vec3 sums[POSTER_TILE_SIZE * POSTER_TILE_SIZE];
+	unsigned int randoms[POSTER_TILE_SIZE * POSTER_TILE_SIZE];
+	for (unsigned int y = startY; y < endY; ++y) {
+		for (unsigned int x = startX; x < endX; ++x) {
+			unsigned int local = (y - startY) * POSTER_TILE_SIZE + (x - startX);
+			sums[local] = vec3(0.0f);
+			randoms[local] = hashInt(view.seed ^ hashInt(y * view.width + x));
+		}
+	}
+
+	for (unsigned int sample = 0; sample < view.samplesPerPixel; ++sample) {
+		for (unsigned int blockY = startY; blockY < endY; blockY += 2) {
+			for (unsigned int blockX = startX; blockX < endX; blockX += 2) {
+				RayPacket packet;
+				unsigned int locals[BVH_PACKET_SIZE];
+				bool inside[BVH_PACKET_SIZE];
+				for (unsigned int ray = 0; ray < BVH_PACKET_SIZE; ++ray) {
+					unsigned int x = blockX + (ray & 1);
+					unsigned int y = blockY + (ray >> 1);
+					inside[ray] = x < endX && y < endY;
+					x = std::min(x, endX - 1);
+					y = std::min(y, endY - 1);
+					locals[ray] = (y - startY) * POSTER_TILE_SIZE + (x - startX);
+					unsigned int & random = randoms[locals[ray]];
+					float pixelX = (x + nextFloat(random)) / view.width;
+					float pixelY = (y + nextFloat(random)) / view.height;
+					packet.origin[ray] = view.eye;
+					packet.direction[ray] = normalize(forward + (2.0f * pixelX - 1.0f) * halfWidth * right
+							+ (1.0f - 2.0f * pixelY) * halfHeight * up);
+					packet.distance[ray] = FLT_MAX;
+				}
+				int hits = m_bvh.intersectPacket(packet);
+				for (unsigned int ray = 0; ray < BVH_PACKET_SIZE; ++ray) {
+					if (inside[ray]) {
+						sums[locals[ray]] += tracePath(view, packet.origin[ray], packet.direction[ray],
+								packet.distance[ray], packet.hit[ray], (hits & (1 << ray)) != 0,
+								randoms[locals[ray]]);
+					}
+				}
+			}
+		}
+	}
+
+	// Written as the rasterizer writes its colours, without gamma.
+	for (unsigned int y = startY; y < endY; ++y) {
+		for (unsigned int x = startX; x < endX; ++x) {
+			vec3 colour = sums[(y - startY) * POSTER_TILE_SIZE + (x - startX)] / (float)view.samplesPerPixel;
+			unsigned char * pixel = &rgb[3 * (y * view.width + x)];
+			pixel[0] = toByte(colour.r);
+			pixel[1] = toByte(colour.g);
+			pixel[2] = toByte(colour.b);
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------
+/*
+ * Light arriving at origin from along direction, whose first hit, if isHit, is hit at
+ * distance.  Bounces diffusely, with directions as likely as a diffuse surface sends
+ * light along them, so every bounce only weighs the path by the albedo.
+ */
+glm::vec3 PosterRenderer::tracePath (
+		const PosterView & view,
+		glm::vec3 origin,
+		glm::vec3 direction,
+		float distance,
+		TriangleHit hit,
+		bool isHit,
+		unsigned int & random
+) const {
+	vec3 radiance(0.0f);
+	vec3 throughput(1.0f);
+	for (unsigned int bounce = 0; ; ++bounce) {
+		if (!isHit) {
+			radiance += throughput * view.ambientIntensity;
+			break;
+		}
+		SurfacePoint point = surfaceAt(origin + distance * direction, direction, hit);
+		radiance += throughput * directLight(view, point, -direction);
+		if (bounce == view.maxBounces) {
+			break;
+		}
+		throughput *= point.albedo;
+		if (bounce >= POSTER_ROULETTE_BOUNCES) {
+			float survival = clamp(std::max(throughput.r, std::max(throughput.g, throughput.b)), 0.05f, 1.0f);
+			if (nextFloat(random) >= survival) {
+				break;
+			}
+			throughput /= survival;
+		}
+		origin = point.position + POSTER_RAY_OFFSET * point.normal;
+		direction = cosineDirection(point.normal, random);
+		distance = FLT_MAX;
+		isHit = m_bvh.intersect(origin, direction, distance, hit);
+	}
+	return radiance;
+}
+
+//---------------------------------------------------------------------------------------
+PosterRenderer::SurfacePoint PosterRenderer::surfaceAt (
+		const glm::vec3 & position,
+		const glm::vec3 & direction,
+		const TriangleHit & hit
+) const {
+	const Surface & surface = m_surfaces[hit.triangle];
+	float w = 1.0f - hit.u - hit.v;
+	SurfacePoint point;
+	point.position = position;
+	point.normal = normalize(w * surface.normals[0] + hit.u * surface.normals[1] + hit.v * surface.normals[2]);
+	if (dot(point.normal, direction) > 0.0f) {
+		point.normal = -point.normal;
+	}
+	point.material = &SceneRegistry::material(surface.material);
+	bool textured = surface.textureIndex >= 0 && surface.textureIndex < (int)m_textures.size() &&
+			!m_textures[surface.textureIndex].pixels.empty();
+	if (textured) {
+		vec2 uv = w * surface.uvCoords[0] + hit.u * surface.uvCoords[1] + hit.v * surface.uvCoords[2];
+		point.albedo = sampleTexture(surface.textureIndex, uv);
+	} else {
+		point.albedo = vec3(point.material->kd);
+	}
+	return point;
+}
+
+//---------------------------------------------------------------------------------------
+// The spotlight reaching point and reflected towards toViewer, if nothing is between.
+glm::vec3 PosterRenderer::directLight (
+		const PosterView & view,
+		const SurfacePoint & point,
+		const glm::vec3 & toViewer
+) const {
+	vec3 toLight = view.lightPosition - point.position;
+	float lightDistance = length(toLight);
+	vec3 l = toLight / lightDistance;
+	float nDotL = dot(point.normal, l);
+	if (nDotL <= 0.0f || dot(-l, view.lightDirection) < view.lightCosCutOff) {
+		return vec3(0.0f);
+	}
+	float unoccluded = lightDistance - 2.0f * POSTER_RAY_OFFSET;
+	if (m_bvh.intersect(point.position + POSTER_RAY_OFFSET * point.normal, l, unoccluded)) {
+		return vec3(0.0f);
+	}
+	vec3 h = normalize(toViewer + l);
+	vec3 specular = point.material->ks * std::pow(std::max(dot(point.normal, h), 0.0f), point.material->shininess);
+	return view.lightRgbIntensity * (point.albedo * nDotL + specular);
+}
+
+//---------------------------------------------------------------------------------------
+// Bilinear and repeating, as the GL_TEXTURE_2D objects sample.
+glm::vec3 PosterRenderer::sampleTexture(int textureIndex, const glm::vec2 & uv) const {
+	const PosterTexture & texture = m_textures[textureIndex];
+	float x = (uv.x - std::floor(uv.x)) * texture.width - 0.5f;
+	float y = (uv.y - std::floor(uv.y)) * texture.height - 0.5f;
+	int x0 = (int)std::floor(x);
+	int y0 = (int)std::floor(y);
+	float fx = x - x0;
+	float fy = y - y0;
+	vec3 corners[4];
+	for (int i = 0; i < 4; ++i) {
+		int tx = (x0 + (i & 1) + texture.width) % texture.width;
+		int ty = (y0 + (i >> 1) + texture.height) % texture.height;
+		const unsigned char * texel = &texture.pixels[3 * (ty * texture.width + tx)];
+		corners[i] = vec3(texel[0], texel[1], texel[2]) * (1.0f / 255.0f);
+	}
+	return mix(mix(corners[0], corners[1], fx), mix(corners[2], corners[3], fx), fy);
+}
+
+//---------------------------------------------------------------------------------------
+size_t PosterRenderer::numTriangles() const {
+	return m_bvh.numTriangles();
+}
+
+//---------------------------------------------------------------------------------------
+void PosterRenderer::writePng (
+		const std::string & path,
+		unsigned int width,
+		unsigned int height,
+		const std::vector<unsigned char> & rgb
+) {
+	unsigned int error = lodepng::encode(path, rgb, width, height, LCT_RGB);
+	if (error) {
+		throw Exception("Unable to write poster " + path + ": " + lodepng_error_text(error));
+	}
+}
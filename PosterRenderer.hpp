@@ -0,0 +1,126 @@
+#pragma once
+
+#include "StaticGeometry.hpp"
+#include "TriangleBvh.hpp"
+#include "SceneRegistry.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class WorkerPool;
+
+// Edge length, in pixels, of the square tiles threads take the poster in.  Even, so
+// every 2x2 block of camera rays lies within one tile.
+const unsigned int POSTER_TILE_SIZE = 16;
+
+// Everything about a poster other than the scene.
+struct PosterView {
+	PosterView()
+		: fovy(1.0f),
+		  lightCosCutOff(1.0f),
+		  width(0),
+		  height(0),
+		  samplesPerPixel(1),
+		  maxBounces(0),
+		  seed(0) { }
+
+	// Camera in world space, with the vertical field of view in radians.
+	glm::vec3 eye;
+	glm::vec3 direction;
+	glm::vec3 up;
+	float fovy;
+
+	// Spotlight in world space, as hard edged as the fragment shader's.
+	glm::vec3 lightPosition;
+	glm::vec3 lightDirection;
+	float lightCosCutOff;
+	glm::vec3 lightRgbIntensity;
+	// Light of the sky that every path leaving the city sees.
+	glm::vec3 ambientIntensity;
+
+	unsigned int width;
+	unsigned int height;
+	unsigned int samplesPerPixel;
+	// Diffuse bounces after the first hit.
+	unsigned int maxBounces;
+	// Every pixel draws its random numbers from this, so the same view renders the same
+	// image whatever the number of threads.
+	unsigned int seed;
+};
+
+// A decoded texture, RGB rows from the bottom up as OpenGL samples them.
+struct PosterTexture {
+	PosterTexture() : width(0), height(0) { }
+
+	int width;
+	int height;
+	std::vector<unsigned char> pixels;
+};
+
+/*
+ * Path tracer over baked geometry, for stills of the city without a GPU.
+ *
+ * Surfaces reflect diffusely, with the fragment shader's Blinn-Phong highlight added
+ * to the spotlight.  Every hit of a path gathers the spotlight through a shadow ray,
+ * and a path that leaves the city gathers the sky, so unlike in the rasterizer the
+ * ambient light is shadowed and bounces.
+ *
+ * render() cuts the image into POSTER_TILE_SIZE tiles that the threads of a WorkerPool
+ * take one after another as they come free, and traces the camera rays of every 2x2
+ * block of pixels as one RayPacket.
+ */
+class PosterRenderer {
+public:
+	PosterRenderer();
+
+	// Adds every triangle of geometry's batches.
+	void addGeometry(const StaticGeometry & geometry);
+
+	// Indexed by texture index.  Textures left empty fall back to the material colour.
+	void setTextures(std::vector<PosterTexture> textures);
+
+	// Builds the BVH over everything added.  Called once, before render().
+	void build(WorkerPool & pool);
+
+	// Renders view into rgb, 8 bits a channel, rows from the top down as PNG stores them.
+	void render(const PosterView & view, WorkerPool & pool, std::vector<unsigned char> & rgb) const;
+
+	size_t numTriangles() const;
+
+	// Throws Exception if the file can't be written.
+	static void writePng(const std::string & path, unsigned int width, unsigned int height,
+			const std::vector<unsigned char> & rgb);
+
+private:
+	// What shading needs of a triangle beyond its corners.
+	struct Surface {
+		glm::vec3 normals[3];
+		glm::vec2 uvCoords[3];
+		// -1 when untextured.
+		int textureIndex;
+		MaterialHandle material;
+	};
+
+	// A hit, facing the ray that found it.
+	struct SurfacePoint {
+		glm::vec3 position;
+		glm::vec3 normal;
+		glm::vec3 albedo;
+		const Material * material;
+	};
+
+	void renderTile(const PosterView & view, unsigned int tile, std::vector<unsigned char> & rgb) const;
+	glm::vec3 tracePath(const PosterView & view, glm::vec3 origin, glm::vec3 direction, float distance,
+			TriangleHit hit, bool isHit, unsigned int & random) const;
+	SurfacePoint surfaceAt(const glm::vec3 & position, const glm::vec3 & direction, const TriangleHit & hit) const;
+	glm::vec3 directLight(const PosterView & view, const SurfacePoint & point, const glm::vec3 & toViewer) const;
+	glm::vec3 sampleTexture(int textureIndex, const glm::vec2 & uv) const;
+
+	TriangleBvh m_bvh;
+	// By TriangleHit::triangle.
+	std::vector<Surface> m_surfaces;
+	std::vector<PosterTexture> m_textures;
+};
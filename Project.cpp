@@ -3,13 +3,28 @@
 #include "Project.hpp"
 #include "scene_lua.hpp"
 
+#include <algorithm>
+#include <cfloat>
+#include <climits>
 #include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <unordered_set>
 using namespace std;
 #include "framework/GlErrorCheck.hpp"
+#include "framework/Exception.hpp"
 #include "framework/MathUtils.hpp"
+#include "framework/MappedFile.hpp"
 #include <imgui/imgui.h>
 #include "stb_image.h"
 #include "Material.hpp"
+#include "ImageResize.hpp"
+#include "CityGrid.hpp"
+#include "WorkerPool.hpp"
+#include "AssetFileFactory.hpp"
+#include "PosterRenderer.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/io.hpp>
@@ -20,8 +35,19 @@ using namespace glm;
 #pragma comment(lib, "irrKlang.lib") // link with irrKlang.dll
 
 static bool show_gui = true;
+// Entry of m_handleMaterials for a material no node has used yet.
+static const unsigned int UNRESOLVED_MATERIAL = ~0u;
+// Every mesh the scene can use.  You may add additional .obj files to this list in
+// order to support rendering additional mesh types.
+static const std::initializer_list<ObjFilePath> MESH_FILES = {
+		"cube.obj",
+		"scube.obj",
+		"sphere.obj",
+		"cone.obj",
+		"cylinder.obj"
+};
 const float soundSpeed = 343.0f; //speed of sound in air m/s
-ISoundEngine *SoundEngine = createIrrKlangDevice();
+ISoundEngine *SoundEngine = nullptr;
 
 std::ostream &operator<< (std::ostream &out, const glm::vec3 &vec) {
     out << "{"
@@ -33,19 +59,65 @@ std::ostream &operator<< (std::ostream &out, const glm::vec3 &vec) {
 
 //----------------------------------------------------------------------------------------
 // Constructor
-Project::Project(const std::string & luaSceneFile)
-	: m_luaSceneFile(luaSceneFile),
-	  m_positionAttribLocation(0),
-	  m_normalAttribLocation(0),
-	  m_texAttribLocation(0),
-	  m_vao_meshData(0),
+Project::Project(const std::string & luaSceneFile, const ProjectOptions & options)
+	: m_vao_meshData(0),
 	  m_vbo_vertexPositions(0),
 	  m_vbo_vertexNormals(0),
 	  m_vbo_vertexUVs(0),
-	  isPerson(false), infraredMode(false), freeMode(false), lookMode(false), textureMode(true), wPressed(false), aPressed(false), sPressed(false), dPressed(false), ePressed(false), qPressed(false), yaw(0.0), pitch(0.0)
+	  m_vbo_vertexInterleaved(0),
+	  m_meshVertexStride(0),
+	  m_ibo_meshIndices(0),
+	  m_meshIndexType(GL_UNSIGNED_INT),
+	  m_meshIndexSize(sizeof(GLuint)),
+	  m_positionAttribLocation(0),
+	  m_normalAttribLocation(0),
+	  m_texAttribLocation(0),
+	  m_texLayerAttribLocation(0),
+	  m_modelUniformLocation(0),
+	  m_materialIndexUniformLocation(0),
+	  m_uploadedMaterialVersion(0),
+	  m_vao_instanced(0),
+	  m_vbo_instanceData(0),
+	  m_instanceModelAttribLocation(0),
+	  m_instanceMaterialAttribLocation(0),
+	  m_instanceLayerAttribLocation(0),
+	  m_luaSceneFile(luaSceneFile),
+	  m_options(options),
+	  m_assets(ASSET_ROOT),
+	  m_cityGenerationMs(0.0),
+	  m_cityGenerationThreads(0),
+	  m_cityBuildMs(0.0),
+	  m_bvhBuildMs(0.0),
+	  m_vao_staticData(0),
+	  m_vbo_staticPositions(0),
+	  m_vbo_staticNormals(0),
+	  m_vbo_staticUVs(0),
+	  m_vbo_staticLayers(0),
+	  m_ibo_staticIndices(0),
+	  m_textureArray(0),
+	  m_benchFramebuffer(0),
+	  m_benchColorBuffer(0),
+	  m_benchDepthBuffer(0),
+	  m_drawCalls(0),
+	  m_vertexBytes(0.0),
+	  infraredMode(false), instancedMode(true), cullingMode(true), lookMode(false), freeMode(false), textureMode(true), wPressed(false), aPressed(false), sPressed(false), dPressed(false), ePressed(false), qPressed(false), yaw(0.0), pitch(0.0),
+	  m_placeholderTexture(0),
+	  m_nextTexturePbo(0),
+	  m_textureLoadMs(0.0),
+	  m_voices(options.maxVoices),
+	  m_crowd(&m_voices),
+	  background(nullptr),
+	  m_groundMaterial(0),
+	  m_roadMaterial(0),
+	  m_streamedBytes(0.0)
 {
 	m_dir = vec3(0.0f, 0.0f, -1.0f);
 	camPos = vec3(0.0f, 2.0f, 0.0f);
+	for (unsigned int i = 0; i < TEXTURE_PBO_COUNT; ++i) {
+		m_texturePbos[i] = 0;
+		m_texturePboBytes[i] = 0;
+		m_texturePboFences[i] = nullptr;
+	}
 	camUp = vec3(0.0f, 1.0f, 0.0f);
     velocity = vec3(0.0f, 0.0f, 0.0f);
 
@@ -53,12 +125,33 @@ Project::Project(const std::string & luaSceneFile)
 	ground1 = vec3(-125, 0, 125);
 	ground2 = vec3(125, 0, 125);
 	ground3 = vec3(125, 0, -125);
+
+	for (unsigned int i = 0; i < BENCH_QUERY_COUNT; ++i) {
+		m_gpuTimerQueries[i] = 0;
+		m_gpuQueryFrames[i] = 0;
+	}
+	if (m_options.bench) {
+		m_visible = false;
+		m_swapInterval = 0;
+		show_gui = false;
+		m_benchmark.setWarmupFrames(BENCH_WARMUP_FRAMES);
+	}
+	// Benchmarks and posters run on machines without sound hardware, and must not
+	// depend on it.
+	SoundEngine = createIrrKlangDevice(m_options.bench || !m_options.posterFile.empty() ? ESOD_NULL
+			: ESOD_AUTO_DETECT);
+	m_voices.setEngine(SoundEngine);
 }
 
 //----------------------------------------------------------------------------------------
 // Destructor
 Project::~Project()
 {
+	m_streamer.stop();
+	m_simulation.stop();
+	m_voices.stopAll();
+	// The nodes die with m_sceneArena; forget any still queued for SceneCache.
+	SceneNode::dirtyNodes.clear();
 	if (background) {
 		background->drop();
 	}
@@ -74,27 +167,26 @@ void Project::init()
 {
 	// Set the background colour.
 	glClearColor(0.0, 0.0, 0.0, 1.0);
+	if (m_options.bench) {
+		initBenchFramebuffer();
+	}
 	createShaderProgram();
 
 	glGenVertexArrays(1, &m_vao_meshData);
 	enableVertexShaderInputSlots();
 
-	processLuaSceneFile(m_luaSceneFile);
-	// Load and decode all .obj files at once here.  You may add additional .obj files to
-	// this list in order to support rendering additional mesh types.  All vertex
-	// positions, and normals will be extracted and stored within the MeshConsolidator
-	// class.
-	unique_ptr<MeshConsolidator> meshConsolidator (new MeshConsolidator{
-			getAssetFilePath("cube.obj"),
-			getAssetFilePath("scube.obj"),
-			getAssetFilePath("sphere.obj"),
-			getAssetFilePath("cone.obj"),
-			getAssetFilePath("cylinder.obj")
-	});
+	glGenVertexArrays(1, &m_vao_instanced);
+	enableInstancedInputSlots();
 
+	// Every node built from here to the end of init() lands in m_sceneArena.
+	SceneArena::Scope sceneArenaScope(m_sceneArena);
+	unique_ptr<MeshConsolidator> meshConsolidator = loadScene();
 
-	// Acquire the BatchInfoMap from the MeshConsolidator.
-	meshConsolidator->getBatchInfoMap(m_batchInfoMap);
+	// Acquire the BatchInfoMap from the MeshConsolidator, resolved to mesh handles.
+	BatchInfoMap batchInfoMap;
+	meshConsolidator->getBatchInfoMap(batchInfoMap);
+	m_meshBatches = SceneRegistry::batchInfos(batchInfoMap);
+	initMeshBounds(*meshConsolidator);
 
 	// Take all vertex data within the MeshConsolidator and upload it to VBOs on the GPU.
 	uploadVertexDataToVbos(*meshConsolidator);
@@ -107,15 +199,95 @@ void Project::init()
 
 	initLightSources();
 	// Exiting the current scope calls delete automatically on meshConsolidator freeing
-	// all vertex data resources.  This is fine since we already copied this data to
-	// VBOs on the GPU.  We have no use for storing vertex data on the CPU side beyond
-	// this point.
+	// all vertex data resources.  The VBOs hold their own copy for drawing; the only
+	// other reader is the static geometry baked below, before the scope ends.
 	glCullFace(GL_BACK);
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
 	initAudio();
+
 	initModels();
+	buildScene(*meshConsolidator);
+	uploadStaticGeometry();
+	m_cullingGrid.setStaticBatches(m_staticGeometry.getBatches());
+	buildStaticBvh();
+	if (m_options.streamRadius > 0) {
+		startStreaming();
+	}
+
+	// The benchmark ticks in step with its frames instead of on a thread.
+	m_simulation.start([this](const SimInput & input, SimSnapshot & snapshot, vector<unsigned int> & crowdMoved) {
+		simulate(input, snapshot, crowdMoved);
+	}, !m_options.bench);
+}
+
+//----------------------------------------------------------------------------------------
+/*
+ * Traces m_options.posterFile in place of running the program, instead of init().
+ * Only the scene is built, with no window, GL context, shaders or sound hardware: the
+ * poster is path traced on the CPU alone from the starting camera.
+ */
+void Project::makePoster()
+{
+	// Every node built from here on lands in m_sceneArena.
+	SceneArena::Scope sceneArenaScope(m_sceneArena);
+	unique_ptr<MeshConsolidator> meshConsolidator = loadScene();
+	initLightSources();
+	initSoundPaths();
+	initMaterials();
+	buildScene(*meshConsolidator);
+	m_view = glm::lookAt(camPos, camPos + m_dir, camUp);
+	renderPoster();
+}
+
+//----------------------------------------------------------------------------------------
+/*
+ * Opens the asset pack and reads the Lua scene, unless a snapshot of this very city is
+ * at hand, then decodes the meshes.  Needs no GL context.
+ */
+unique_ptr<MeshConsolidator> Project::loadScene()
+{
+	if (!m_options.assetPack.empty() && !m_assets.open(m_options.assetPack)) {
+		cout << "No asset pack " << m_options.assetPack << ", loading loose files" << endl;
+	}
+	if (m_options.streamRadius > 0 && !m_options.citySnapshot.empty()) {
+		cout << "A streamed city is never the same twice, ignoring " << m_options.citySnapshot << endl;
+		m_options.citySnapshot.clear();
+	}
+
+	// With a snapshot of this very city at hand, neither Lua nor the generator run.
+	Benchmark::Clock::time_point cityStart = Benchmark::Clock::now();
+	if (!openCitySnapshot()) {
+		processLuaSceneFile(m_luaSceneFile);
+	}
+	m_cityBuildMs = Benchmark::millisecondsSince(cityStart);
+	// Load and decode all .obj files at once here.  All vertex positions, and normals
+	// will be extracted and stored within the MeshConsolidator class.
+	return unique_ptr<MeshConsolidator>(new MeshConsolidator(m_assets, MESH_FILES));
+}
+
+//----------------------------------------------------------------------------------------
+// Generates or restores the city on top of the Lua scene and bakes its static
+// geometry.  Needs no GL context.
+void Project::buildScene(const MeshConsolidator & meshConsolidator)
+{
+	// Baking reads the source meshes, so it has to happen while meshConsolidator lives.
+	m_staticGeometry.setSourceMeshes(meshConsolidator);
+	m_staticGeometry.setMergeTextures(m_options.textureArray);
+	m_blockGeometry = m_staticGeometry;
+	Benchmark::Clock::time_point cityStart = Benchmark::Clock::now();
+	if (m_citySnapshot.isOpen()) {
+		m_rootNode = std::shared_ptr<SceneNode>(m_citySnapshot.restore(m_staticGeometry, m_voices, m_crowd),
+				[](SceneNode *) { });
+	} else {
+		buildCity();
+		m_staticGeometry.consolidate();
+	}
+	m_cityBuildMs += Benchmark::millisecondsSince(cityStart);
+	if (!m_citySnapshot.isOpen() && !m_options.citySnapshot.empty()) {
+		saveCitySnapshot();
+	}
 }
 
 //----------------------------------------------------------------------------------------
@@ -128,41 +300,268 @@ void Project::processLuaSceneFile(const std::string & filename) {
 
 	// This version of the code treats the main program argument
 	// as a straightforward pathname.
-	m_rootNode = std::shared_ptr<SceneNode>(import_lua(filename));
+	// Read from the asset pack when it holds the file.
+	const char * data;
+	size_t size;
+	std::string name = m_assets.nameOf(filename);
+	SceneNode * root = !name.empty() && m_assets.find(name, data, size) ? import_lua(data, size, filename)
+			: import_lua(filename);
+	m_rootNode = std::shared_ptr<SceneNode>(root, [](SceneNode *) { });
 	if (!m_rootNode) {
 		std::cerr << "Could Not Open " << filename << std::endl;
 	}
 }
 
-void Project::fillStreet(float startx, float startz, int leftoverSpace, const char axis, const char facing) {
-	SceneNode *node;
+//----------------------------------------------------------------------------------------
+// Everything the generated city depends on, see CitySnapshot.
+CitySnapshotKey Project::citySnapshotKey() const {
+	CitySnapshotKey key;
+	key.seed = m_options.seed;
+	key.crowdDensity = m_options.crowdDensity;
+	key.bakeStatic = m_options.bakeStatic ? 1 : 0;
+	key.textureArray = m_options.textureArray ? 1 : 0;
+	const char * data;
+	size_t size;
+	std::string name = m_assets.nameOf(m_luaSceneFile);
+	if (!name.empty() && m_assets.find(name, data, size)) {
+		key.sceneHash = CitySnapshotKey::hashBytes(data, size);
+	} else {
+		MappedFile scene(m_luaSceneFile.c_str());
+		key.sceneHash = CitySnapshotKey::hashBytes(scene.data(), scene.size());
+	}
+	// The snapshot keeps each mesh's bounds and baked vertices, so a changed mesh
+	// outdates it as much as a changed scene does.
+	key.meshHash = CitySnapshotKey::hashBytes(nullptr, 0);
+	for (const ObjFilePath & meshFile : MESH_FILES) {
+		if (m_assets.find(meshFile, data, size)) {
+			key.meshHash = CitySnapshotKey::hashBytes(data, size, key.meshHash);
+		} else {
+			MappedFile mesh(m_assets.looseFilePath(meshFile).c_str());
+			key.meshHash = CitySnapshotKey::hashBytes(mesh.data(), mesh.size(), key.meshHash);
+		}
+	}
+	return key;
+}
+
+//----------------------------------------------------------------------------------------
+// Returns true if the --city snapshot holds this city, which init() then restores.
+bool Project::openCitySnapshot() {
+	if (m_options.citySnapshot.empty()) {
+		return false;
+	}
+	try {
+		if (m_citySnapshot.open(m_options.citySnapshot, citySnapshotKey())) {
+			return true;
+		}
+		cout << "No snapshot of this city in " << m_options.citySnapshot << ", generating it" << endl;
+	} catch (const Exception & e) {
+		cout << e.what() << ", generating the city" << endl;
+	}
+	return false;
+}
+
+//----------------------------------------------------------------------------------------
+// A snapshot that cannot be written only costs the next run its head start.
+void Project::saveCitySnapshot() {
+	try {
+		CitySnapshot::write(m_options.citySnapshot, citySnapshotKey(), *m_rootNode, m_staticGeometry,
+				m_voices, m_crowd);
+	} catch (const Exception & e) {
+		cout << e.what() << endl;
+	}
+}
+
+//----------------------------------------------------------------------------------------
+// Blocks whose streets are lined with generated shops and apartments.  The rest of the
+// fourth row is the landmark district buildCity() lays out by hand.
+static bool isResidentialBlock(int blockX, int blockZ) {
+	return blockX >= 0 && blockZ >= 0 && (blockZ < 3 ? blockX < 4 : blockZ == 3 && blockX < 2);
+}
+
+//----------------------------------------------------------------------------------------
+// The two blocks of the landmark district, which the streamed city leaves to buildCity().
+static bool isLandmarkBlock(int blockX, int blockZ) {
+	return blockZ == 3 && (blockX == 2 || blockX == 3);
+}
+
+//----------------------------------------------------------------------------------------
+/*
+ * Generates every block of the city as an independent job on a worker pool, then
+ * merges the results in block order.  Each block draws from its own CityRandom
+ * streams, so the city depends on the seed alone, not on the number of threads.
+ */
+void Project::generateCity() {
+	int firstBlock = cityBlockIndex(-CITY_HALF_EXTENT);
+	int blocksPerSide = cityBlockIndex(CITY_HALF_EXTENT - 1.0f) - firstBlock + 1;
+	generateBlocks(firstBlock, firstBlock, blocksPerSide);
+}
+
+//----------------------------------------------------------------------------------------
+// Generates the square of blocks from (firstX, firstZ) on the pool's threads, then
+// merges them in order, so the city never depends on the number of threads.
+void Project::generateBlocks(int firstX, int firstZ, int blocksPerSide) {
+	Benchmark::Clock::time_point start = Benchmark::Clock::now();
+	WorkerPool pool(m_options.threads);
+
+	vector<CityBlockResult> results(blocksPerSide * blocksPerSide);
+	pool.parallelFor(results.size(), [&](size_t i) {
+		generateCityBlock(firstX + i % blocksPerSide, firstZ + i / blocksPerSide, results[i]);
+	});
+	for (CityBlockResult & result : results) {
+		mergeCityBlock(result);
+	}
+
+	m_cityGenerationMs = Benchmark::millisecondsSince(start);
+	m_cityGenerationThreads = pool.numThreads();
+}
+
+//----------------------------------------------------------------------------------------
+// Runs on a worker thread: may only read the project and write to result.
+void Project::generateCityBlock(int blockX, int blockZ, CityBlockResult & result) const {
+	SceneArena::Scope arenaScope(result.arena);
+	result.staticGeometry = m_blockGeometry;
+
+	int minX = CITY_BLOCK_ORIGIN + blockX * CITY_BLOCK_SIZE;
+	int minZ = CITY_BLOCK_ORIGIN + blockZ * CITY_BLOCK_SIZE;
+	// The fixed city ends with the ground plane, the streamed one never does.
+	bool streamed = m_options.streamRadius > 0;
+	int halfExtent = streamed ? INT_MAX / 2 : (int)CITY_HALF_EXTENT;
+	CityRandom peopleRandom(m_options.seed, blockX, blockZ, CityStream::People);
+	placePeople(peopleRandom, result, std::max(minX, -halfExtent), std::min(minX + (int)CITY_BLOCK_SIZE, halfExtent),
+			std::min(minZ + (int)CITY_BLOCK_SIZE, halfExtent), std::max(minZ, -halfExtent));
+
+	if (streamed) {
+		addBlockStreets(blockX, blockZ, result);
+	}
+	if (streamed ? !isLandmarkBlock(blockX, blockZ) : isResidentialBlock(blockX, blockZ)) {
+		CityRandom random(m_options.seed, blockX, blockZ, CityStream::Buildings);
+		//fill on street near road
+		int x = minX + 3;
+		int z = minZ + 47;
+		fillStreet(random, result, x, z, 44, 'x');
+		fillStreet(random, result, x+38, z-7, 36, 'z', 'E');
+		fillStreet(random, result, x, z-38, 36, 'x', 'N');
+		fillStreet(random, result, x, z-7, 30, 'z', 'W');
+	}
+}
+
+//----------------------------------------------------------------------------------------
+/*
+ * Extends the ground and the roads of Assets/scene.lua under a streamed block: its
+ * own ground tile, and the intersection at its lower corner.  Both are left out where
+ * the Lua scene already has them, and sit a little lower, so that it wins wherever
+ * the two still overlap.
+ */
+void Project::addBlockStreets(int blockX, int blockZ, CityBlockResult & result) const {
+	static const MeshHandle cubeMesh = SceneRegistry::meshHandle("cube");
+	static const MeshHandle scubeMesh = SceneRegistry::meshHandle("scube");
+	const float drop = 0.1f;
+	float minX = CITY_BLOCK_ORIGIN + blockX * CITY_BLOCK_SIZE;
+	float minZ = CITY_BLOCK_ORIGIN + blockZ * CITY_BLOCK_SIZE;
+	int luaBlocks = cityBlockIndex(CITY_HALF_EXTENT) - cityBlockIndex(-CITY_HALF_EXTENT) - 1;
+
+	std::vector<GeometryNode *> streets;
+	if (blockX < 0 || blockX >= luaBlocks || blockZ < 0 || blockZ >= luaBlocks) {
+		GeometryNode * ground = new GeometryNode(scubeMesh, "ground");
+		ground->scale(vec3(CITY_BLOCK_SIZE, 1.01f, CITY_BLOCK_SIZE));
+		ground->translate(vec3(minX + 0.5f * CITY_BLOCK_SIZE, -0.5f - drop, minZ + 0.5f * CITY_BLOCK_SIZE));
+		ground->material = m_groundMaterial;
+		ground->textureIndex = 2;
+		streets.push_back(ground);
+	}
+	if (blockX < 0 || blockX > luaBlocks || blockZ < 0 || blockZ > luaBlocks) {
+		//four roads meeting at the corner, as createInter() builds them
+		float width = CITY_BLOCK_SIZE;
+		const vec3 centres[] = {vec3(width/4, 0.05f, 0), vec3(0, 0, -width/4), vec3(0, 0, width/4), vec3(-width/4, 0.05f, 0)};
+		const float rotations[] = {0, 90, 90, 0};
+		for (unsigned int i = 0; i < 4; ++i) {
+			GeometryNode * road = new GeometryNode(cubeMesh, "road");
+			road->scale(vec3(width/2, 1.05f, 6));
+			road->rotate('y', rotations[i]);
+			road->translate(vec3(minX, -0.5f - drop, minZ) + centres[i]);
+			road->material = m_roadMaterial;
+			road->textureIndex = 0;
+			streets.push_back(road);
+		}
+	}
+
+	for (GeometryNode * street : streets) {
+		if (m_options.bakeStatic) {
+			result.staticGeometry.bake(*street);
+		} else {
+			result.nodes.push_back(street);
+		}
+	}
+}
+
+//----------------------------------------------------------------------------------------
+// Runs on a worker thread, like generateCityBlock(), which placed the people.
+void Project::createPersonNodes(CityBlockResult & result) const {
+	SceneArena::Scope arenaScope(result.arena);
+	for (const PendingPerson & person : result.people) {
+		result.personNodes.push_back(createPerson(materials[person.hairI], materials[person.shirtI],
+				materials[person.pantsI], materials[person.skinI]));
+	}
+}
+
+//----------------------------------------------------------------------------------------
+void Project::mergeCityBlock(CityBlockResult & result) {
+	m_staticGeometry.append(result.staticGeometry);
+	m_sceneArena.adopt(result.arena);
+	for (SceneNode * node : result.nodes) {
+		m_rootNode->add_child(node);
+	}
+	for (const PendingSound & sound : result.sounds) {
+		playSound(sound.soundIndex, sound.position, sound.minDistance);
+	}
+	for (const PendingPerson & person : result.people) {
+		VoiceHandle audio = NO_VOICE;
+		VoiceHandle panicAudio = NO_VOICE;
+		if (person.soundIndex >= 0) {
+			audio = playSound(person.soundIndex, vec3(person.x, 0, person.z), 0.3f);
+			panicAudio = playSound(person.panicSoundIndex, vec3(person.x, 0, person.z), 0.5f);
+		}
+		SceneNode *node = createPerson(materials[person.hairI], materials[person.shirtI],
+				materials[person.pantsI], materials[person.skinI]);
+		addPerson(node, person.x, person.z, person.rotated, audio, panicAudio);
+	}
+}
+
+//----------------------------------------------------------------------------------------
+// Starts a looping 3D sound from soundPaths, audible whenever it is among the loudest.
+VoiceHandle Project::playSound(int soundIndex, const glm::vec3 & position, float minDistance) {
+	return m_voices.add("Assets/sounds/"+ soundPaths[soundIndex], position, minDistance);
+}
+
+void Project::fillStreet(CityRandom & random, CityBlockResult & result, float startx, float startz, int leftoverSpace, const char axis, const char facing) const {
+	SceneArena scratch;
 	while (leftoverSpace != 0) {
 		//we want space to be even, around 2-6 units, but also depend on how much leftover space we have on the street
-		int space = clamp((rand() % leftoverSpace/2 + 1)*2, 2, 8);
+		int space = clamp((random.nextInt(leftoverSpace)/2 + 1)*2, 2, 8);
 		leftoverSpace -= space;
-		if ( (rand() % 100) < 50) {
+		if (random.nextInt(100) < 50) {
 			(axis == 'x' ? startx+=space : startz-=space);
 			continue;
 		}
 
 		//try to get some space between this building and the previous
 		int width = clamp( space - 2, 2, 6);
-		int delta = rand() % (space - width + 1);
+		int delta = random.nextInt(space - width + 1);
 		//we place our building at x = startx + delta
 
-		int poorDoorI = rand() % 9 + 15;
-		int poorWindowI = rand() % 10 + 24;
-		int poorRoofI = rand() % 10 + 34;
+		int poorDoorI = random.nextInt(9) + 15;
+		int poorWindowI = random.nextInt(10) + 24;
+		int poorRoofI = random.nextInt(10) + 34;
 		int height;
 		bool apartment = false;
-		if (rand() % 100 < 5) {
+		if (random.nextInt(100) < 5) {
 			apartment = true;
-			height = rand() % 5 + 10;
+			height = random.nextInt(5) + 10;
 		} else {
-			height = rand() % 3 + 3;
+			height = random.nextInt(3) + 3;
 		}
 		int rotate = 0, perturb;
-		perturb = rand() % 2; //shift on the axis that buildings aren't filling along
+		perturb = random.nextInt(2); //shift on the axis that buildings aren't filling along
 
 		if (facing == 'N') {
 			rotate = 180;
@@ -174,74 +573,121 @@ void Project::fillStreet(float startx, float startz, int leftoverSpace, const ch
 			perturb *= -1;
 		}
 
-		Building *building;
+		unique_ptr<Building> building;
 		if (axis == 'x') {
 			if (apartment) {
-				building = new Apartment(width, height, height, vec3(startx + delta, 0.0, startz - perturb), poorDoorI, poorWindowI, poorRoofI, rotate);
+				building.reset(new Apartment(width, height, height, vec3(startx + delta, 0.0, startz - perturb), poorDoorI, poorWindowI, poorRoofI, rotate));
 			} else {
-				building = new Store(width, height, height, vec3(startx + delta, 0.0, startz - perturb), poorDoorI, poorWindowI, poorRoofI, rotate);
-				int achance = rand() % 100; //audio chance
+				building.reset(new Store(width, height, height, vec3(startx + delta, 0.0, startz - perturb), poorDoorI, poorWindowI, poorRoofI, rotate));
+				int achance = random.nextInt(100); //audio chance
 				if (achance < 2) {
-					int index = rand() % 6 + 5;
-					building->audio = SoundEngine->play3D(("Assets/sounds/"+ soundPaths[index]).c_str(), vec3df( (startx + delta) + width/2, 0, startz - perturb - width/2), true, false, true);
-					building->audio->setMinDistance(0.5);
+					PendingSound sound = {random.nextInt(6) + 5, vec3( (startx + delta) + width/2, 0, startz - perturb - width/2), 0.5f};
+					result.sounds.push_back(sound);
 				}
 			}
 			startx += space;
 		} else {
 			if (apartment) {
-				building = new Apartment(width, height, height, vec3(startx - perturb, 0.0, startz - delta), poorDoorI, poorWindowI, poorRoofI, rotate);
+				building.reset(new Apartment(width, height, height, vec3(startx - perturb, 0.0, startz - delta), poorDoorI, poorWindowI, poorRoofI, rotate));
 			} else {
-				building = new Store(width, height, height, vec3(startx - perturb, 0.0, startz - delta), poorDoorI, poorWindowI, poorRoofI, rotate);
-				int achance = rand() % 100; //audio chance
+				building.reset(new Store(width, height, height, vec3(startx - perturb, 0.0, startz - delta), poorDoorI, poorWindowI, poorRoofI, rotate));
+				int achance = random.nextInt(100); //audio chance
 				if (achance < 2) {
-					int index = rand() % 6 + 5;
-					building->audio = SoundEngine->play3D(("Assets/sounds/"+ soundPaths[index]).c_str(), vec3df( (startx - perturb) + width/2, 0, startz - delta - width/2), true, false, true);
-					building->audio->setMinDistance(0.5);
+					PendingSound sound = {random.nextInt(6) + 5, vec3( (startx - perturb) + width/2, 0, startz - delta - width/2), 0.5f};
+					result.sounds.push_back(sound);
 				}
 			}
 			startz -= space;
 		}
-		building->grow();
-		node = building->create();
-		m_rootNode->add_child(node);
+		building->grow(random);
+		if (m_options.bakeStatic) {
+			// Only the baked vertices outlive the nodes.
+			SceneArena::Scope scratchScope(scratch);
+			result.staticGeometry.bake(*building->create());
+			scratch.rewind();
+		} else {
+			result.nodes.push_back(building->create());
+		}
 	}
 }
 
-void Project::placePeople(int startx, int endx, int startz, int endz) {
+void Project::placePeople(CityRandom & random, CityBlockResult & result, int startx, int endx, int startz, int endz) const {
 	for (int x = startx; x < endx; ++x) {
 		for (int z = startz; z > endz; --z) {
-			int chance = rand() % 200;
-			if (chance < 1) {
-				int rotated = rand() % 359;
-				int hairI = rand() % 9;
-				int pantsI = rand() % 9;
-				int shirtI = rand() % 9;
-				int skinI = rand() % 4 + 9;
-				int achance = rand() % 100; // now see if we assign audio to person
-				ISound* audio = NULL;
-				ISound* panicAudio = NULL;
+			int chance = random.nextInt(200);
+			if (chance < (int)m_options.crowdDensity) {
+				PendingPerson person;
+				person.x = x;
+				person.z = z;
+				person.rotated = random.nextInt(359);
+				person.hairI = random.nextInt(9);
+				person.pantsI = random.nextInt(9);
+				person.shirtI = random.nextInt(9);
+				person.skinI = random.nextInt(4) + 9;
+				person.soundIndex = -1;
+				person.panicSoundIndex = -1;
+				int achance = random.nextInt(100); // now see if we assign audio to person
 				if (achance < 5) {
-					int index = rand() % 9 + 11;
-					audio = SoundEngine->play3D(("Assets/sounds/"+ soundPaths[index]).c_str(), vec3df(x,0,z), true, false, true);
-					audio->setMinDistance(0.3);
+					int index = random.nextInt(9) + 11;
 					int pindex = 29;
 					if (index == 11) pindex = 25;
 					if (index == 16) pindex = 26;
 					if (index == 19) pindex = 27;
 					if (index == 14) pindex = 28;
-					panicAudio = SoundEngine->play3D(("Assets/sounds/"+ soundPaths[pindex]).c_str(), vec3df(x,0,z), true, false, true);
-					panicAudio->setMinDistance(0.5);
+					person.soundIndex = index;
+					person.panicSoundIndex = pindex;
 				}
-				Person *p = new Person(x, z, rotated, materials[hairI], materials[shirtI], materials[pantsI], materials[skinI], audio, panicAudio);
-				m_rootNode->add_child(p->node);
-				people.push_back(p);
+				result.people.push_back(person);
 			}
 		}
 	}
 }
 
+//----------------------------------------------------------------------------------------
+/*
+ * Adds a subtree that never moves once created.  With bakeStatic set its geometry is
+ * folded into m_staticGeometry and the nodes themselves are freed.
+ */
+void Project::addStaticSubtree(SceneNode *node) {
+	if (m_options.bakeStatic) {
+		m_staticGeometry.bake(*node);
+		delete node;
+	} else {
+		m_rootNode->add_child(node);
+	}
+}
+
+//----------------------------------------------------------------------------------------
+// Returns the person's agent id within m_crowd.
+unsigned int Project::addPerson(SceneNode *node, float x, float z, float heading, VoiceHandle audio, VoiceHandle panicAudio) {
+	m_rootNode->add_child(node);
+	return m_crowd.add(node, x, z, heading, audio, panicAudio);
+}
+
 void Project::initModels() {
+	initMaterials();
+	m_textureLoadStart = Benchmark::Clock::now();
+	glGenBuffers(TEXTURE_PBO_COUNT, m_texturePbos);
+	for (unsigned int i = 0; i < TEXTURE_PBO_COUNT; ++i) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_texturePbos[i]);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, TEXTURE_LAYER_BYTES, nullptr, GL_STREAM_DRAW);
+		m_texturePboBytes[i] = TEXTURE_LAYER_BYTES;
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	if (m_options.textureArray) {
+		initTextureArray(m_texturePaths);
+	} else {
+		initTextures(m_texturePaths);
+	}
+	stbi_set_flip_vertically_on_load(true);
+	m_textureLoader.start(m_texturePaths.size(), [this](size_t index, DecodedImage & image) {
+		decodeTexture(index, image);
+	}, m_options.threads);
+}
+
+//----------------------------------------------------------------------------------------
+// The materials and texture files the generator picks from.  Needs no GL context.
+void Project::initMaterials() {
 	Material gray = Material(vec4(0.2, 0.2, 0.2, 1.0), vec3(0.1, 0.1, 0.1), 10.0f);
 	Material purple = Material(vec4(0.3, 0.21, 0.34, 1.0), vec3(0.1, 0.1, 0.1), 10.0f);
 	Material wine = Material(vec4(0.33, 0.02, 0.15, 1.0), vec3(0.1, 0.1, 0.1), 10.0f);
@@ -256,9 +702,14 @@ void Project::initModels() {
 	Material tanned = Material(vec4(0.28, 0.23, 0.2, 1.0), vec3(0.1, 0.1, 0.1), 10.0f);
 	Material dark = Material(vec4(0.145, 0.1137, 0.086, 1.0), vec3(0.1, 0.1, 0.1), 10.0f);
 
-	materials = {gray, purple, wine, red, blue, green, yellow, white, black, pale, beige, tanned, dark};
+	for (const Material & material : {gray, purple, wine, red, blue, green, yellow, white, black, pale, beige, tanned, dark}) {
+		materials.push_back(SceneRegistry::materialHandle(material));
+	}
+	//the ground and roads of Assets/scene.lua, for the streamed city to extend
+	m_groundMaterial = SceneRegistry::materialHandle(Material(vec4(0.0, 0.0, 0.0, 0.1), vec3(0.1, 0.1, 0.1), 10.0f));
+	m_roadMaterial = SceneRegistry::materialHandle(Material(vec4(0.0, 0.0, 0.0, 0.0), vec3(0.1, 0.1, 0.1), 10.0f));
 
-	std::vector<std::string> texturePaths = {"road.jpg", "broken.jpg", "ground.jpg",
+	m_texturePaths = {"road.jpg", "broken.jpg", "ground.jpg",
 		"door1.jpg", "door2.jpg", "door3.jpg", "door4.jpg", //nice buildings' doors index 3-6
 		"window1.jpg", "window2.jpg", "window3.jpg", "window4.jpg", //index 7-10
 		"roof1.jpg","roof2.jpg","roof3.jpg","roof4.jpg", //11-14
@@ -266,154 +717,345 @@ void Project::initModels() {
 		"window100.jpg", "window101.jpg", "window102.jpg", "window103.jpg", "window104.jpg", "window105.jpg", "window106.jpg", "window107.jpg", "window108.jpg", "window109.jpg", //24-33
 		"roof100.jpg", "roof101.jpg", "roof102.jpg", "roof103.jpg", "roof104.jpg", "roof105.jpg", "roof106.jpg", "roof107.jpg", "roof108.jpg", "roof109.jpg", //34-43
 		"ad1.jpg", "ad2.jpg", "ad3.jpg"}; //44-46
-	soundPaths = {"b1.mp3", "b2.mp3", "b3.mp3", "b4.mp3", "b5.mp3", "b6.mp3", "b7.mp3", "b8.mp3", "b9.mp3", "b10.mp3", "b11.mp3", //0-4 for fancy buildings' audio snippets, 5-10 for poor buildings'
-			"f1.mp3",
-			"m1.mp3", "m2.mp3", "m3.mp3", "m4.mp3", "m5.mp3", "m6.mp3", "m7.mp3", "m8.mp3", //12-19
-			"p1.mp3", "p2.mp3", "p3.mp3", "p4.mp3", //20-23
-			"r1.mp3", "r2.mp3", "r3.mp3", "r4.mp3", "r5.mp3", "r6.mp3"}; //24-29
-	for (auto it = texturePaths.begin(); it!=texturePaths.end(); ++it) {
-		unsigned int texture;
-		glGenTextures(1, &texture);
-		glBindTexture(GL_TEXTURE_2D, texture);
-		//do stuff to avoid crashing when texture isn't a dimensions power of 2
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-		glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
-		glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
-		glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
-		int width, height, nChannels;
-		stbi_set_flip_vertically_on_load(true);
-		unsigned char *data = stbi_load(("Assets/images/"+ *it).c_str(), &width, &height, &nChannels, 0);
-		if (data) {
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-			glGenerateMipmap(GL_TEXTURE_2D);
-		} else {
-			std::cout << "invalid texture filepath" << *it << std::endl;
-		}
-		stbi_image_free(data);
-		textures.push_back(texture);
-	}
-	texturePaths.clear(); //done with the path names, now we just work with textures vector
-
-	//actually get reasonable random values after initiating srand
-	srand(time(NULL));
-	placePeople(-125, 125, 125, -125);
-	int z = -53;
-	while (z < 97) {
-		int x = -97;
-		while (x < 75) {
-			//fill on street near road
-			fillStreet(x, z, 44, 'x');
-			fillStreet(x+38, z-7, 36, 'z', 'E');
-			fillStreet(x, z-38, 36, 'x', 'N');
-			fillStreet(x, z-7, 30, 'z', 'W');
-			x+=50;
-		}
-		z+=50;
-	}
-
-
-	//fill just two more streets with buildings, the last two streets are for rich people
-	int x = -97;
-	fillStreet(x, z, 44, 'x');
-	fillStreet(x+38, z-7, 36, 'z', 'E');
-	fillStreet(x, z-38, 36, 'x', 'N');
-	fillStreet(x, z-7, 30, 'z', 'W');
-	x+=50;
 
-	fillStreet(x, z, 44, 'x');
-	fillStreet(x+38, z-7, 36, 'z', 'E');
-	fillStreet(x, z-38, 36, 'x', 'N');
-	fillStreet(x, z-7, 30, 'z', 'W');
-	x+=50;
+	//rand() still drives the helicopter and the crowd at run time
+	srand(m_options.seed);
+}
+
+//----------------------------------------------------------------------------------------
+// Generates the streets, then lays out the landmark district by hand.
+void Project::buildCity() {
+	// The streamed city generates its streets as the camera comes near them.  A poster
+	// has no later frames to stream them in, so it takes the blocks in reach at once.
+	if (m_options.streamRadius == 0) {
+		generateCity();
+	} else if (!m_options.posterFile.empty()) {
+		int radius = m_options.streamRadius;
+		generateBlocks(cityBlockIndex(camPos.x) - radius, cityBlockIndex(camPos.z) - radius, 2 * radius + 1);
+	}
+
+	//the last two blocks of the top row are for rich people
+	int z = 97;
+	int x = 3;
+	CityRandom landmarkRandom(m_options.seed, cityBlockIndex(x), cityBlockIndex(z), CityStream::Landmarks);
 
 	//manually add in the rich people skyscrapers
 	Skyscraper sky1 = Skyscraper(6, 25, 18, vec3(11 + x, 0.0, -16 + z), 3, 7, 11, 0);
-	sky1.grow();
-	m_rootNode->add_child(sky1.create());
+	sky1.grow(landmarkRandom);
+	addStaticSubtree(sky1.create());
 	//pass sound clip and position of sound, +3 since we want sound to be at center of building, not min corner
-	sky1.audio = SoundEngine->play3D(("Assets/sounds/"+ soundPaths[0]).c_str(), vec3df(11 + x + 3, 0, -16 + z - 3), true, false, true);
-	sky1.audio->setMinDistance(0.5);
+	sky1.audio = playSound(0, vec3(11 + x + 3, 0, -16 + z - 3), 0.5f);
 
 	Skyscraper sky2 = Skyscraper(4, 22, 15, vec3(32 + x, 0.0, -16 + z), 4, 8, 12, 90);
-	sky2.grow();
-        sky2.audio = SoundEngine->play3D(("Assets/sounds/"+ soundPaths[1]).c_str(), vec3df(32 + x + 2, 0, -16 + z - 2), true, false, true);
-        sky2.audio->setMinDistance(0.5);
-	m_rootNode->add_child(sky2.create());
+	sky2.grow(landmarkRandom);
+        sky2.audio = playSound(1, vec3(32 + x + 2, 0, -16 + z - 2), 0.5f);
+	addStaticSubtree(sky2.create());
 
 	//put some billboards up
-	GeometryNode *bb = new GeometryNode("cube", "bb1");
+	GeometryNode *bb = new GeometryNode(SceneRegistry::meshHandle("cube"), "bb1");
 	bb->textureIndex = 44;
 	bb->scale(vec3(10, 10, 0.5));
 	bb->translate(vec3(x + 5, 5, z -43));
-	m_rootNode->add_child(bb);
+	addStaticSubtree(bb);
 
-        bb = new GeometryNode("cube", "bb2");
+        bb = new GeometryNode(SceneRegistry::meshHandle("cube"), "bb2");
         bb->textureIndex = 45;
         bb->scale(vec3(0.5, 12, 20));
         bb->translate(vec3(x + 43, 6, z -34));
-        m_rootNode->add_child(bb);
+        addStaticSubtree(bb);
 
 	x+=50;
 
-        bb = new GeometryNode("cube", "bb3");
+        bb = new GeometryNode(SceneRegistry::meshHandle("cube"), "bb3");
         bb->textureIndex = 46;
         bb->scale(vec3(20, 15, 0.5));
         bb->translate(vec3(x + 22, 7.5, z - 0.25));
-        m_rootNode->add_child(bb);
+        addStaticSubtree(bb);
 
         Skyscraper sky3 = Skyscraper(8, 15, 10, vec3(11 + x, 0.0, -10 + z), 5, 9, 13, 180);
-        sky3.grow();
-        m_rootNode->add_child(sky3.create());
-        sky3.audio = SoundEngine->play3D(("Assets/sounds/"+ soundPaths[2]).c_str(), vec3df(11 + x + 4, 0, -10 + z - 4), true, false, true);
-        sky3.audio->setMinDistance(0.5);
+        sky3.grow(landmarkRandom);
+        addStaticSubtree(sky3.create());
+        sky3.audio = playSound(2, vec3(11 + x + 4, 0, -10 + z - 4), 0.5f);
 
         Skyscraper sky4 = Skyscraper(4, 22, 15, vec3(36 + x, 0.0, -26 + z), 6, 10, 14, 90);
-        sky4.grow();
-        sky4.audio = SoundEngine->play3D(("Assets/sounds/"+ soundPaths[3]).c_str(), vec3df(36 + x + 2, 0, -26 + z - 2), true, false, true);
-        sky4.audio->setMinDistance(0.5);
-        m_rootNode->add_child(sky4.create());
+        sky4.grow(landmarkRandom);
+        sky4.audio = playSound(3, vec3(36 + x + 2, 0, -26 + z - 2), 0.5f);
+        addStaticSubtree(sky4.create());
         Skyscraper sky5 = Skyscraper(4, 22, 15, vec3(36 + x, 0.0, -20 + z), 6, 10, 14, 90);
-        sky5.grow();
-        sky5.audio = SoundEngine->play3D(("Assets/sounds/"+ soundPaths[4]).c_str(), vec3df(36 + x + 2, 0, -20 + z - 2), true, false, true);
-        sky5.audio->setMinDistance(0.5);
-        m_rootNode->add_child(sky5.create());
+        sky5.grow(landmarkRandom);
+        sky5.audio = playSound(4, vec3(36 + x + 2, 0, -20 + z - 2), 0.5f);
+        addStaticSubtree(sky5.create());
 
 	//manually place a few pairs of people to demo sound and their panic modes (move together)
 	x = 0;
 	z = 0;
-	ISound *audio = SoundEngine->play3D(("Assets/sounds/"+ soundPaths[23]).c_str(), vec3df(x,0,z), true, false, true);
-	audio->setMinDistance(0.5);
-	ISound *panicAudio = SoundEngine->play3D(("Assets/sounds/"+ soundPaths[24]).c_str(), vec3df(x,0,z), true, false, true);
-	panicAudio->setMinDistance(0.5);
-	Person *p1 = new Person(x, z, 0, materials[7], materials[0], materials[5], materials[9], audio, panicAudio);
-	m_rootNode->add_child(p1->node);
-	Person *p2 = new Person(x + 1, z, 0, materials[7], materials[1], materials[7], materials[9]);
-	m_rootNode->add_child(p2->node);
-	Pair *pairing = new Pair{p1, p2};
-	p1->pairing = pairing;
-	p2->pairing = pairing;
-	people.push_back(p1);
-	people.push_back(p2);
+	VoiceHandle audio = playSound(23, vec3(x,0,z), 0.5f);
+	VoiceHandle panicAudio = playSound(24, vec3(x,0,z), 0.5f);
+	unsigned int leader = addPerson(createPerson(materials[7], materials[0], materials[5], materials[9]), x, z, 0, audio, panicAudio);
+	unsigned int follower = addPerson(createPerson(materials[7], materials[1], materials[7], materials[9]), x + 1, z, 0);
+	m_crowd.pair(leader, follower);
 
 	x = 52;
 	z = 50;
-	audio = SoundEngine->play3D(("Assets/sounds/"+ soundPaths[21]).c_str(), vec3df(x,0,z), true, false, true);
-	audio->setMinDistance(0.5);
-	panicAudio = SoundEngine->play3D(("Assets/sounds/"+ soundPaths[26]).c_str(), vec3df(x,0,z), true, false, true);
-	panicAudio->setMinDistance(0.5);
-	p1 = new Person(x, z, 180, materials[7], materials[0], materials[5], materials[9], audio, panicAudio);
-	m_rootNode->add_child(p1->node);
-	p2 = new Person(x + 1, z, 180, materials[7], materials[1], materials[7], materials[9]);
-	m_rootNode->add_child(p2->node);
-	pairing = new Pair{p1, p2};
-	p1->pairing = pairing;
-	p2->pairing = pairing;
-	people.push_back(p1);
-	people.push_back(p2);
+	audio = playSound(21, vec3(x,0,z), 0.5f);
+	panicAudio = playSound(26, vec3(x,0,z), 0.5f);
+	leader = addPerson(createPerson(materials[7], materials[0], materials[5], materials[9]), x, z, 180, audio, panicAudio);
+	follower = addPerson(createPerson(materials[7], materials[1], materials[7], materials[9]), x + 1, z, 180);
+	m_crowd.pair(leader, follower);
+}
+
+//----------------------------------------------------------------------------------------
+// Decodes images/file with stb_image, in place from the asset pack when it is packed.
+unsigned char * Project::loadImage (
+		const std::string & file,
+		int & width,
+		int & height,
+		int & nChannels,
+		int desiredChannels
+) const {
+	const char * data;
+	size_t size;
+	if (m_assets.find("images/" + file, data, size)) {
+		return stbi_load_from_memory((const stbi_uc *)data, size, &width, &height, &nChannels, desiredChannels);
+	}
+	return stbi_load(m_assets.looseFilePath("images/" + file).c_str(), &width, &height, &nChannels, desiredChannels);
+}
+
+//----------------------------------------------------------------------------------------
+// Points every texture index at one grey GL_TEXTURE_2D until uploadTexture() gives it
+// its own.
+void Project::initTextures(const std::vector<std::string> & texturePaths) {
+	glGenTextures(1, &m_placeholderTexture);
+	glBindTexture(GL_TEXTURE_2D, m_placeholderTexture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+	glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+	glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+	const unsigned char grey[3] = {TEXTURE_PLACEHOLDER_GREY, TEXTURE_PLACEHOLDER_GREY, TEXTURE_PLACEHOLDER_GREY};
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, grey);
+	textures.assign(texturePaths.size(), m_placeholderTexture);
+	CHECK_GL_ERRORS;
+}
+
+//----------------------------------------------------------------------------------------
+/*
+ * Allocates m_textureArray with a grey layer per texture, which uploadTexture() replaces
+ * with the texture resampled to TEXTURE_ARRAY_SIZE squared.  The layer of a texture is
+ * its texture index.  Mipmaps wait for the last layer, so until then the array is
+ * sampled without them.
+ */
+void Project::initTextureArray(const std::vector<std::string> & texturePaths) {
+	glGenTextures(1, &m_textureArray);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, m_textureArray);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+	glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+	glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGB8, TEXTURE_ARRAY_SIZE, TEXTURE_ARRAY_SIZE,
+			texturePaths.size(), 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+
+	// One grey layer in a pixel buffer, copied into every layer without coming back
+	// through the CPU.  If the buffer cannot be mapped the layer comes from client memory.
+	vector<unsigned char> clientGrey;
+	const void * grey = nullptr;
+	void * mapped = mapTexturePbo(TEXTURE_LAYER_BYTES);
+	if (mapped) {
+		memset(mapped, TEXTURE_PLACEHOLDER_GREY, TEXTURE_LAYER_BYTES);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	} else {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		clientGrey.assign(TEXTURE_LAYER_BYTES, TEXTURE_PLACEHOLDER_GREY);
+		grey = clientGrey.data();
+	}
+	for (size_t layer = 0; layer < texturePaths.size(); ++layer) {
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, TEXTURE_ARRAY_SIZE, TEXTURE_ARRAY_SIZE, 1,
+				GL_RGB, GL_UNSIGNED_BYTE, grey);
+	}
+	if (mapped) {
+		fenceTexturePbo();
+	}
+
+	// Leave the array bound to unit 1 for the rest of the program.
+	glActiveTexture(GL_TEXTURE0);
+	CHECK_GL_ERRORS;
+}
+
+//----------------------------------------------------------------------------------------
+/*
+ * Runs on a TextureLoader thread.  Layers of the array share its format and size, so
+ * for it the image is forced to RGB and resampled here; a GL_TEXTURE_2D takes RGB or
+ * RGBA as the file has it.
+ */
+void Project::decodeTexture(size_t index, DecodedImage & image) const {
+	int width, height, nChannels;
+	unsigned char *data = loadImage(m_texturePaths[index], width, height, nChannels,
+			m_options.textureArray ? 3 : 0);
+	if (data && !m_options.textureArray && nChannels != 3 && nChannels != 4) {
+		stbi_image_free(data);
+		data = loadImage(m_texturePaths[index], width, height, nChannels, 3);
+		nChannels = 3;
+	}
+	if (!data) {
+		std::cout << "invalid texture filepath" << m_texturePaths[index] << std::endl;
+		return;
+	}
+	if (m_options.textureArray) {
+		image.width = TEXTURE_ARRAY_SIZE;
+		image.height = TEXTURE_ARRAY_SIZE;
+		image.channels = 3;
+		image.pixels.resize(TEXTURE_ARRAY_SIZE * TEXTURE_ARRAY_SIZE * 3);
+		if (width != TEXTURE_ARRAY_SIZE || height != TEXTURE_ARRAY_SIZE) {
+			resizeImage(data, width, height, 3, image.pixels.data(), TEXTURE_ARRAY_SIZE, TEXTURE_ARRAY_SIZE);
+		} else {
+			memcpy(image.pixels.data(), data, image.pixels.size());
+		}
+	} else {
+		image.width = width;
+		image.height = height;
+		image.channels = nChannels;
+		image.pixels.assign(data, data + width * height * nChannels);
+	}
+	stbi_image_free(data);
+}
+
+//----------------------------------------------------------------------------------------
+/*
+ * Called every frame while textures load.  Uploads the images decoded so far, up to
+ * TEXTURE_UPLOAD_BYTES_PER_FRAME of them, and finishes the array once the last is in.
+ * The benchmark waits for all of them in its first frame instead, so every run
+ * renders the same textures.
+ */
+void Project::uploadTextures()
+{
+	if (m_options.bench) {
+		m_textureLoader.finish();
+	}
+	size_t uploaded = 0;
+	size_t index;
+	DecodedImage image;
+	while ((m_options.bench || uploaded < TEXTURE_UPLOAD_BYTES_PER_FRAME) && m_textureLoader.takeDecoded(index, image)) {
+		uploadTexture(index, image);
+		uploaded += image.pixels.size();
+	}
+	if (m_textureLoader.numPending() > 0) {
+		return;
+	}
+
+	m_textureLoader.stop();
+	if (m_options.textureArray) {
+		glActiveTexture(GL_TEXTURE1);
+		glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glActiveTexture(GL_TEXTURE0);
+	}
+	for (unsigned int i = 0; i < TEXTURE_PBO_COUNT; ++i) {
+		glDeleteSync(m_texturePboFences[i]);
+		m_texturePboFences[i] = nullptr;
+	}
+	glDeleteBuffers(TEXTURE_PBO_COUNT, m_texturePbos);
+	m_textureLoadMs = Benchmark::millisecondsSince(m_textureLoadStart);
+	CHECK_GL_ERRORS;
+}
+
+//----------------------------------------------------------------------------------------
+/*
+ * Copies image into the next pixel buffer of the ring and has GL take the texture from
+ * there, so the copy into the texture needn't finish before this returns.  If the
+ * buffer cannot be mapped, GL takes the image straight from client memory instead.
+ */
+void Project::uploadTexture(size_t index, const DecodedImage & image)
+{
+	if (image.pixels.empty()) {
+		return;
+	}
+	// An offset into the bound pixel buffer, or the image itself.
+	const void * pixels = nullptr;
+	void * mapped = mapTexturePbo(image.pixels.size());
+	if (mapped) {
+		memcpy(mapped, image.pixels.data(), image.pixels.size());
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	} else {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		pixels = image.pixels.data();
+	}
+
+	if (m_options.textureArray) {
+		glActiveTexture(GL_TEXTURE1);
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, index, TEXTURE_ARRAY_SIZE, TEXTURE_ARRAY_SIZE, 1,
+				GL_RGB, GL_UNSIGNED_BYTE, pixels);
+		glActiveTexture(GL_TEXTURE0);
+	} else {
+		GLenum format = image.channels == 4 ? GL_RGBA : GL_RGB;
+		unsigned int texture;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexImage2D(GL_TEXTURE_2D, 0, image.channels == 4 ? GL_RGBA8 : GL_RGB8, image.width, image.height, 0,
+				format, GL_UNSIGNED_BYTE, pixels);
+		glGenerateMipmap(GL_TEXTURE_2D);
+		textures[index] = texture;
+	}
+	if (mapped) {
+		fenceTexturePbo();
+	}
+	CHECK_GL_ERRORS;
+}
+
+//----------------------------------------------------------------------------------------
+/*
+ * Binds the next pixel buffer of the ring and maps its first bytes for writing.  The
+ * buffers are allocated once, so instead of orphaning one this waits on the fence
+ * fenceTexturePbo() left, which with TEXTURE_PBO_COUNT buffers has long passed.  Only
+ * a GL_TEXTURE_2D larger than an array layer grows its buffer.  Returns nullptr if GL
+ * fails to map it, leaving it bound and GL's error flags clear.
+ */
+void * Project::mapTexturePbo(size_t bytes)
+{
+	GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT;
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_texturePbos[m_nextTexturePbo]);
+	GLsync & fence = m_texturePboFences[m_nextTexturePbo];
+	if (fence) {
+		GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, TEXTURE_PBO_WAIT_NS);
+		glDeleteSync(fence);
+		fence = nullptr;
+		// Past the wait, GL has to order the write after its read itself.
+		if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+			access |= GL_MAP_UNSYNCHRONIZED_BIT;
+		}
+	} else {
+		access |= GL_MAP_UNSYNCHRONIZED_BIT;
+	}
+	if (bytes > m_texturePboBytes[m_nextTexturePbo]) {
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+		m_texturePboBytes[m_nextTexturePbo] = bytes;
+	}
+	void * mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, access);
+	if (!mapped) {
+		// The caller falls back to client memory, so the failure isn't an error for
+		// CHECK_GL_ERRORS to throw on.
+		while (glGetError() != GL_NO_ERROR) {}
+	}
+	return mapped;
+}
+
+//----------------------------------------------------------------------------------------
+// Fences off the buffer mapTexturePbo() bound until GL has read the texture commands
+// just issued from it, and moves on to the next one.
+void Project::fenceTexturePbo()
+{
+	m_texturePboFences[m_nextTexturePbo] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	m_nextTexturePbo = (m_nextTexturePbo + 1) % TEXTURE_PBO_COUNT;
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
 }
 
 //----------------------------------------------------------------------------------------
@@ -424,6 +1066,27 @@ void Project::createShaderProgram()
 	m_shader.attachFragmentShader( getAssetFilePath("FragmentShader.fs").c_str() );
 	m_shader.link();
 
+	m_instancedShader.generateProgramObject();
+	m_instancedShader.attachVertexShader( getAssetFilePath("InstancedVertexShader.vs").c_str() );
+	m_instancedShader.attachFragmentShader( getAssetFilePath("FragmentShader.fs").c_str() );
+	m_instancedShader.link();
+
+	for (const ShaderProgram * shader : {&m_shader, &m_instancedShader}) {
+		shader->bindUniformBlock("FrameUniforms", FRAME_UNIFORMS_BINDING);
+		shader->bindUniformBlock("MaterialUniforms", MATERIAL_UNIFORMS_BINDING);
+
+		// Both samplers are declared, so they must not share a texture unit.
+		shader->enable();
+		glUniform1i(shader->getUniformLocation("ourTexture"), 0);
+		glUniform1i(shader->getUniformLocation("textureArray"), 1);
+		shader->disable();
+	}
+	m_frameUniforms.create(sizeof(FrameUniforms), FRAME_UNIFORMS_BINDING);
+	m_materialUniforms.create(MAX_MATERIALS * sizeof(MaterialUniform), MATERIAL_UNIFORMS_BINDING);
+
+	// The only uniforms still written per draw, by the per node path.
+	m_modelUniformLocation = m_shader.getUniformLocation("Model");
+	m_materialIndexUniformLocation = m_shader.getUniformLocation("materialIndex");
 }
 
 //----------------------------------------------------------------------------------------
@@ -443,6 +1106,9 @@ void Project::enableVertexShaderInputSlots()
 
                 m_texAttribLocation = m_shader.getAttribLocation("tex");
                 glEnableVertexAttribArray(m_texAttribLocation);
+
+		// Left disabled: per node draws supply the layer with glVertexAttrib1f.
+		m_texLayerAttribLocation = m_shader.getAttribLocation("texLayer");
 		CHECK_GL_ERRORS;
 	}
 
@@ -450,25 +1116,63 @@ void Project::enableVertexShaderInputSlots()
 	glBindVertexArray(0);
 }
 
+//----------------------------------------------------------------------------------------
+void Project::enableInstancedInputSlots()
+{
+	glBindVertexArray(m_vao_instanced);
+
+	glEnableVertexAttribArray(m_instancedShader.getAttribLocation("position"));
+	glEnableVertexAttribArray(m_instancedShader.getAttribLocation("normal"));
+	glEnableVertexAttribArray(m_instancedShader.getAttribLocation("tex"));
+
+	m_instanceModelAttribLocation = m_instancedShader.getAttribLocation("instanceModel");
+	m_instanceMaterialAttribLocation = m_instancedShader.getAttribLocation("instanceMaterialIndex");
+
+	// A mat4 attribute occupies four consecutive vec4 locations.
+	for (GLint i = 0; i < 4; ++i) {
+		glEnableVertexAttribArray(m_instanceModelAttribLocation + i);
+		glVertexAttribDivisor(m_instanceModelAttribLocation + i, 1);
+	}
+	glEnableVertexAttribArray(m_instanceMaterialAttribLocation);
+	glVertexAttribDivisor(m_instanceMaterialAttribLocation, 1);
+	m_instanceLayerAttribLocation = m_instancedShader.getAttribLocation("instanceTexLayer");
+	glEnableVertexAttribArray(m_instanceLayerAttribLocation);
+	glVertexAttribDivisor(m_instanceLayerAttribLocation, 1);
+
+	glGenBuffers(1, &m_vbo_instanceData);
+	CHECK_GL_ERRORS;
+
+	glBindVertexArray(0);
+}
+
 //----------------------------------------------------------------------------------------
 void Project::uploadVertexDataToVbos (
 		const MeshConsolidator & meshConsolidator
 ) {
-	// Generate VBO to store all vertex position data
-	{
-		glGenBuffers(1, &m_vbo_vertexPositions);
+	if (m_options.packedVertices) {
+		// Generate one VBO holding every vertex as an interleaved PackedVertex
+		std::vector<PackedVertex> vertices;
+		meshConsolidator.getPackedVertexData(vertices);
 
-		glBindBuffer(GL_ARRAY_BUFFER, m_vbo_vertexPositions);
+		glGenBuffers(1, &m_vbo_vertexInterleaved);
 
-		glBufferData(GL_ARRAY_BUFFER, meshConsolidator.getNumVertexPositionBytes(),
-				meshConsolidator.getVertexPositionDataPtr(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, m_vbo_vertexInterleaved);
+		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(PackedVertex),
+				vertices.data(), GL_STATIC_DRAW);
 
 		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		m_meshVertexStride = sizeof(PackedVertex);
 		CHECK_GL_ERRORS;
-	}
+	} else {
+		// Generate VBO to store all vertex position data
+		glGenBuffers(1, &m_vbo_vertexPositions);
 
-	// Generate VBO to store all vertex normal data
-	{
+		glBindBuffer(GL_ARRAY_BUFFER, m_vbo_vertexPositions);
+
+		glBufferData(GL_ARRAY_BUFFER, meshConsolidator.getNumVertexPositionBytes(),
+				meshConsolidator.getVertexPositionDataPtr(), GL_STATIC_DRAW);
+
+		// Generate VBO to store all vertex normal data
 		glGenBuffers(1, &m_vbo_vertexNormals);
 
 		glBindBuffer(GL_ARRAY_BUFFER, m_vbo_vertexNormals);
@@ -476,46 +1180,375 @@ void Project::uploadVertexDataToVbos (
 		glBufferData(GL_ARRAY_BUFFER, meshConsolidator.getNumVertexNormalBytes(),
 				meshConsolidator.getVertexNormalDataPtr(), GL_STATIC_DRAW);
 
+		// Generate VBO to store all vertex uv data
+		glGenBuffers(1, &m_vbo_vertexUVs);
+
+		glBindBuffer(GL_ARRAY_BUFFER, m_vbo_vertexUVs);
+		glBufferData(GL_ARRAY_BUFFER, meshConsolidator.getNumVertexUVBytes(),
+				meshConsolidator.getVertexUVPtr(), GL_STATIC_DRAW);
+
 		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		m_meshVertexStride = sizeof(vec3) + sizeof(vec3) + sizeof(vec2);
 		CHECK_GL_ERRORS;
 	}
 
-        // Generate VBO to store all vertex uv data
-        {
-                glGenBuffers(1, &m_vbo_vertexUVs);
+	// Generate IBO to store the welded meshes' indices, 16 bit when they fit.
+	{
+		glGenBuffers(1, &m_ibo_meshIndices);
 
-                glBindBuffer(GL_ARRAY_BUFFER, m_vbo_vertexUVs);
-                glBufferData(GL_ARRAY_BUFFER, meshConsolidator.getNumVertexUVBytes(),
-                                meshConsolidator.getVertexUVPtr(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo_meshIndices);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, meshConsolidator.getNumIndexBytes(),
+				meshConsolidator.getIndexDataPtr(), GL_STATIC_DRAW);
 
-                glBindBuffer(GL_ARRAY_BUFFER, 0);
-                CHECK_GL_ERRORS;
-        }
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+		m_meshIndexSize = meshConsolidator.getIndexSize();
+		m_meshIndexType = m_meshIndexSize == sizeof(GLushort) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+		CHECK_GL_ERRORS;
+	}
 }
 
 //----------------------------------------------------------------------------------------
-void Project::mapVboDataToVertexShaderInputLocations()
+// Model-space bounds of every mesh, which SceneCache turns into world-space subtree bounds.
+void Project::initMeshBounds(const MeshConsolidator & meshConsolidator) {
+	const vec3 * positions = (const vec3 *)meshConsolidator.getVertexPositionDataPtr();
+	std::vector<AABB> meshBounds(m_meshBatches.size());
+	for (size_t mesh = 0; mesh < m_meshBatches.size(); ++mesh) {
+		const BatchInfo & batchInfo = m_meshBatches[mesh];
+		for (unsigned int i = batchInfo.baseVertex; i < batchInfo.baseVertex + batchInfo.numVertices; ++i) {
+			meshBounds[mesh].expand(positions[i]);
+		}
+	}
+	m_sceneCache.setMeshBounds(meshBounds);
+}
+
+//----------------------------------------------------------------------------------------
+void Project::uploadStaticGeometry()
 {
-	// Bind VAO in order to record the data mapping.
-	glBindVertexArray(m_vao_meshData);
+	if (m_staticGeometry.getBatches().empty()) {
+		return;
+	}
+
+	for (const StaticBatch & batch : m_staticGeometry.getBatches()) {
+		m_staticBatchMaterials.push_back(m_materialTable.intern(SceneRegistry::material(batch.material)));
+	}
 
-	// Tell GL how to map data from the vertex buffer "m_vbo_vertexPositions" into the
-	// "position" vertex attribute location for any bound vertex shader program.
-	glBindBuffer(GL_ARRAY_BUFFER, m_vbo_vertexPositions);
+	glGenVertexArrays(1, &m_vao_staticData);
+	glBindVertexArray(m_vao_staticData);
+
+	glGenBuffers(1, &m_vbo_staticPositions);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo_staticPositions);
+	glBufferData(GL_ARRAY_BUFFER, m_staticGeometry.getNumVertexPositionBytes(),
+			m_staticGeometry.getVertexPositionDataPtr(), GL_STATIC_DRAW);
+	glEnableVertexAttribArray(m_positionAttribLocation);
 	glVertexAttribPointer(m_positionAttribLocation, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
 
-	// Tell GL how to map data from the vertex buffer "m_vbo_vertexNormals" into the
-	// "normal" vertex attribute location for any bound vertex shader program.
-	glBindBuffer(GL_ARRAY_BUFFER, m_vbo_vertexNormals);
+	glGenBuffers(1, &m_vbo_staticNormals);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo_staticNormals);
+	glBufferData(GL_ARRAY_BUFFER, m_staticGeometry.getNumVertexNormalBytes(),
+			m_staticGeometry.getVertexNormalDataPtr(), GL_STATIC_DRAW);
+	glEnableVertexAttribArray(m_normalAttribLocation);
 	glVertexAttribPointer(m_normalAttribLocation, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
 
-	glBindBuffer(GL_ARRAY_BUFFER, m_vbo_vertexUVs);
+	glGenBuffers(1, &m_vbo_staticUVs);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo_staticUVs);
+	glBufferData(GL_ARRAY_BUFFER, m_staticGeometry.getNumVertexUVBytes(),
+			m_staticGeometry.getVertexUVPtr(), GL_STATIC_DRAW);
+	glEnableVertexAttribArray(m_texAttribLocation);
 	glVertexAttribPointer(m_texAttribLocation, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+
+	glGenBuffers(1, &m_vbo_staticLayers);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo_staticLayers);
+	glBufferData(GL_ARRAY_BUFFER, m_staticGeometry.getNumVertexLayerBytes(),
+			m_staticGeometry.getVertexLayerPtr(), GL_STATIC_DRAW);
+	glEnableVertexAttribArray(m_texLayerAttribLocation);
+	glVertexAttribPointer(m_texLayerAttribLocation, 1, GL_FLOAT, GL_FALSE, 0, nullptr);
+
+	// The element array binding is VAO state, so it stays with m_vao_staticData.
+	glGenBuffers(1, &m_ibo_staticIndices);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo_staticIndices);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_staticGeometry.getNumIndexBytes(),
+			m_staticGeometry.getIndexDataPtr(), GL_STATIC_DRAW);
+
 	//-- Unbind target, and restore default values:
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	glBindVertexArray(0);
-
 	CHECK_GL_ERRORS;
+}
+
+//----------------------------------------------------------------------------------------
+// Adds every baked triangle of geometry to bvh.
+static void addStaticTriangles(TriangleBvh & bvh, const StaticGeometry & geometry) {
+	const vec3 * positions = reinterpret_cast<const vec3 *>(geometry.getVertexPositionDataPtr());
+	for (const StaticBatch & batch : geometry.getBatches()) {
+		bvh.addTriangles(positions + batch.baseVertex, geometry.getIndexDataPtr() + batch.startIndex,
+				batch.numIndices);
+	}
+}
+
+//----------------------------------------------------------------------------------------
+// Adds the triangles of subtrees left in the scene graph to bvh, baked into a copy of
+// blockGeometry that only lives for this.
+static void addSubtreeTriangles(TriangleBvh & bvh, const StaticGeometry & blockGeometry,
+		const vector<SceneNode *> & nodes) {
+	StaticGeometry geometry = blockGeometry;
+	for (const SceneNode * node : nodes) {
+		geometry.bake(*node);
+	}
+	geometry.consolidate();
+	addStaticTriangles(bvh, geometry);
+}
+
+//----------------------------------------------------------------------------------------
+/*
+ * The baked buildings and billboards catch the spotlight.  With bakeStatic unset they
+ * are still nodes, so everything under the root but the people, which move, is baked
+ * for the BVH alone; that also covers a city restored from a snapshot.
+ */
+void Project::buildStaticBvh()
+{
+	Benchmark::Clock::time_point start = Benchmark::Clock::now();
+	addStaticTriangles(m_staticBvh, m_staticGeometry);
+	if (!m_options.bakeStatic) {
+		unordered_set<const SceneNode *> people;
+		for (unsigned int agent = 0; agent < m_crowd.size(); ++agent) {
+			people.insert(m_crowd.node(agent));
+		}
+		vector<SceneNode *> nodes;
+		for (SceneNode * child : m_rootNode->children) {
+			if (!people.count(child)) {
+				nodes.push_back(child);
+			}
+		}
+		addSubtreeTriangles(m_staticBvh, m_blockGeometry, nodes);
+	}
+	WorkerPool pool(m_options.threads);
+	m_staticBvh.build(&pool);
+	m_bvhBuildMs = Benchmark::millisecondsSince(start);
+}
+
+//----------------------------------------------------------------------------------------
+// Generates the blocks around the camera before the first frame, then keeps
+// streamCity() busy with the rest.
+void Project::startStreaming()
+{
+	m_streamer.start([this](int blockX, int blockZ, CityBlockResult & result) {
+		generateCityBlock(blockX, blockZ, result);
+		result.staticGeometry.consolidate();
+		addStaticTriangles(result.bvh, result.staticGeometry);
+		if (!m_options.bakeStatic) {
+			addSubtreeTriangles(result.bvh, m_blockGeometry, result.nodes);
+		}
+		result.bvh.build();
+		createPersonNodes(result);
+	}, m_options.streamRadius, m_options.threads);
+	streamCity(vec2(camPos.x, camPos.z), true);
+}
+
+//----------------------------------------------------------------------------------------
+// The arrays a streamed block uploads, in StreamedBlock::buffers order.
+static void streamedArrays(const StaticGeometry & geometry, const void * data[], size_t bytes[]) {
+	data[0] = geometry.getVertexPositionDataPtr();
+	bytes[0] = geometry.getNumVertexPositionBytes();
+	data[1] = geometry.getVertexNormalDataPtr();
+	bytes[1] = geometry.getNumVertexNormalBytes();
+	data[2] = geometry.getVertexUVPtr();
+	bytes[2] = geometry.getNumVertexUVBytes();
+	data[3] = geometry.getVertexLayerPtr();
+	bytes[3] = geometry.getNumVertexLayerBytes();
+	data[STREAMED_INDEX_BUFFER] = geometry.getIndexDataPtr();
+	bytes[STREAMED_INDEX_BUFFER] = geometry.getNumIndexBytes();
+}
+
+//----------------------------------------------------------------------------------------
+/*
+ * Called at the start of every frame.  Evicts the blocks the camera left behind, takes
+ * newly generated ones into the scene and the simulation, and uploads their baked
+ * vertices, all within a per frame budget unless unbudgeted is set.  Nothing here
+ * waits for the generation threads, except in the benchmark, which has to render the
+ * same city on every run.
+ */
+void Project::streamCity(const glm::vec2 & camera, bool unbudgeted)
+{
+	m_evictedBlocks.clear();
+	m_streamer.update(camera, m_evictedBlocks);
+	if (!m_evictedBlocks.empty()) {
+		m_simulation.edit([this] {
+			for (const ChunkKey & key : m_evictedBlocks) {
+				const StreamedBlock & block = *m_streamedBlocks.at(key);
+				for (unsigned int agent : block.agents) {
+					m_crowd.remove(agent);
+				}
+				for (VoiceHandle voice : block.voices) {
+					m_voices.remove(voice);
+				}
+				m_streamedBvhs.erase(std::find(m_streamedBvhs.begin(), m_streamedBvhs.end(), &block.result->bvh));
+			}
+		});
+		for (const ChunkKey & key : m_evictedBlocks) {
+			evictStreamedBlock(*m_streamedBlocks.at(key));
+			m_streamedBlocks.erase(key);
+		}
+	}
+
+	if (unbudgeted || m_options.bench) {
+		m_streamer.finish();
+	}
+	ChunkKey key;
+	unique_ptr<CityBlockResult> result;
+	for (unsigned int i = 0; (unbudgeted || i < STREAM_BLOCKS_PER_FRAME) && m_streamer.takeGenerated(key, result); ++i) {
+		unique_ptr<StreamedBlock> & block = m_streamedBlocks[key];
+		block.reset(new StreamedBlock());
+		activateStreamedBlock(std::move(result), *block);
+	}
+
+	size_t budget = unbudgeted ? SIZE_MAX : STREAM_UPLOAD_BYTES_PER_FRAME;
+	for (auto & entry : m_streamedBlocks) {
+		if (budget == 0) {
+			break;
+		}
+		if (!entry.second->drawable) {
+			budget -= uploadStreamedBlock(*entry.second, budget);
+		}
+	}
+}
+
+//----------------------------------------------------------------------------------------
+// Hangs a generated block below the root, adds its people and sounds, and allocates
+// the buffers uploadStreamedBlock() fills.
+void Project::activateStreamedBlock(std::unique_ptr<CityBlockResult> result, StreamedBlock & block)
+{
+	{
+		SceneArena::Scope arenaScope(result->arena);
+		block.node = new SceneNode("block");
+	}
+	for (SceneNode * node : result->nodes) {
+		block.node->add_child(node);
+	}
+	for (SceneNode * node : result->personNodes) {
+		block.node->add_child(node);
+	}
+	m_simulation.edit([&] {
+		for (const PendingSound & sound : result->sounds) {
+			block.voices.push_back(playSound(sound.soundIndex, sound.position, sound.minDistance));
+		}
+		for (size_t i = 0; i < result->people.size(); ++i) {
+			const PendingPerson & person = result->people[i];
+			VoiceHandle audio = NO_VOICE;
+			VoiceHandle panicAudio = NO_VOICE;
+			if (person.soundIndex >= 0) {
+				audio = playSound(person.soundIndex, vec3(person.x, 0, person.z), 0.3f);
+				panicAudio = playSound(person.panicSoundIndex, vec3(person.x, 0, person.z), 0.5f);
+				block.voices.push_back(audio);
+				block.voices.push_back(panicAudio);
+			}
+			block.agents.push_back(m_crowd.add(result->personNodes[i], person.x, person.z, person.rotated,
+					audio, panicAudio));
+		}
+		m_streamedBvhs.push_back(&result->bvh);
+	});
+	m_rootNode->add_child(block.node);
+	m_sceneCache.attach(*block.node);
+
+	const StaticGeometry & geometry = result->staticGeometry;
+	block.batches = geometry.getBatches();
+	for (const StaticBatch & batch : block.batches) {
+		block.batchMaterials.push_back(m_materialTable.intern(SceneRegistry::material(batch.material)));
+	}
+	if (!block.batches.empty()) {
+		const void * data[STREAMED_BUFFERS];
+		size_t bytes[STREAMED_BUFFERS];
+		streamedArrays(geometry, data, bytes);
+		const GLint locations[] = {m_positionAttribLocation, m_normalAttribLocation, m_texAttribLocation,
+				m_texLayerAttribLocation};
+		const GLint components[] = {3, 3, 2, 1};
+
+		glGenVertexArrays(1, &block.vao);
+		glBindVertexArray(block.vao);
+		glGenBuffers(STREAMED_BUFFERS, block.buffers);
+		for (unsigned int i = 0; i < STREAMED_INDEX_BUFFER; ++i) {
+			glBindBuffer(GL_ARRAY_BUFFER, block.buffers[i]);
+			glBufferData(GL_ARRAY_BUFFER, bytes[i], nullptr, GL_STATIC_DRAW);
+			glEnableVertexAttribArray(locations[i]);
+			glVertexAttribPointer(locations[i], components[i], GL_FLOAT, GL_FALSE, 0, nullptr);
+		}
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, block.buffers[STREAMED_INDEX_BUFFER]);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, bytes[STREAMED_INDEX_BUFFER], nullptr, GL_STATIC_DRAW);
+
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindVertexArray(0);
+		CHECK_GL_ERRORS;
+	}
+	block.result = std::move(result);
+}
+
+//----------------------------------------------------------------------------------------
+/*
+ * Copies at most budget more bytes of a block's baked vertices into its buffers and
+ * returns how many it copied.  The block becomes drawable with the last byte, and
+ * its copy of the vertices is dropped.
+ */
+size_t Project::uploadStreamedBlock(StreamedBlock & block, size_t budget)
+{
+	StaticGeometry & geometry = block.result->staticGeometry;
+	size_t uploaded = 0;
+	size_t start = 0;
+	if (!block.batches.empty()) {
+		const void * data[STREAMED_BUFFERS];
+		size_t bytes[STREAMED_BUFFERS];
+		streamedArrays(geometry, data, bytes);
+		for (unsigned int i = 0; i < STREAMED_BUFFERS; ++i) {
+			size_t end = start + bytes[i];
+			if (block.uploadedBytes < end && uploaded < budget) {
+				size_t offset = block.uploadedBytes - start;
+				size_t size = std::min(end - block.uploadedBytes, budget - uploaded);
+				// Not an element array binding, which would need the block's vertex array.
+				glBindBuffer(GL_COPY_WRITE_BUFFER, block.buffers[i]);
+				glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, static_cast<const char *>(data[i]) + offset);
+				block.uploadedBytes += size;
+				uploaded += size;
+			}
+			start = end;
+		}
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		CHECK_GL_ERRORS;
+	}
+	if (block.uploadedBytes == start) {
+		block.drawable = true;
+		geometry = StaticGeometry();
+	}
+	m_streamedBytes += uploaded;
+	return uploaded;
+}
+
+//----------------------------------------------------------------------------------------
+// Frees a block once its people and sounds have left the simulation.
+void Project::evictStreamedBlock(StreamedBlock & block)
+{
+	m_rootNode->remove_child(block.node);
+	m_sceneCache.detach(*block.node);
+	// Runs the destructors, which also forget any node still queued for SceneCache;
+	// the memory goes with the arena.
+	delete block.node;
+	block.result.reset();
+	if (block.vao) {
+		glDeleteVertexArrays(1, &block.vao);
+		glDeleteBuffers(STREAMED_BUFFERS, block.buffers);
+	}
+}
+
+//----------------------------------------------------------------------------------------
+void Project::mapVboDataToVertexShaderInputLocations()
+{
+	// Bind VAO in order to record the data mapping.
+	glBindVertexArray(m_vao_meshData);
+	setMeshAttribPointers(m_positionAttribLocation, m_normalAttribLocation, m_texAttribLocation);
+
+	// The instanced VAO reads the same mesh VBOs, but through the attribute
+	// locations of the instanced shader program.
+	glBindVertexArray(m_vao_instanced);
+	setMeshAttribPointers(m_instancedShader.getAttribLocation("position"),
+			m_instancedShader.getAttribLocation("normal"),
+			m_instancedShader.getAttribLocation("tex"));
 
 	//-- Unbind target, and restore default values:
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -524,6 +1557,40 @@ void Project::mapVboDataToVertexShaderInputLocations()
 	CHECK_GL_ERRORS;
 }
 
+//----------------------------------------------------------------------------------------
+/*
+ * Tells GL how to map the mesh vertex buffers into the given attribute locations of
+ * the bound VAO, for either the interleaved packed layout or the three float streams.
+ */
+void Project::setMeshAttribPointers (
+		GLint positionLocation,
+		GLint normalLocation,
+		GLint texLocation
+) {
+	if (m_options.packedVertices) {
+		const GLsizei stride = sizeof(PackedVertex);
+		glBindBuffer(GL_ARRAY_BUFFER, m_vbo_vertexInterleaved);
+		glVertexAttribPointer(positionLocation, 3, GL_FLOAT, GL_FALSE, stride,
+				(const GLvoid *)offsetof(PackedVertex, position));
+		glVertexAttribPointer(normalLocation, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride,
+				(const GLvoid *)offsetof(PackedVertex, normal));
+		glVertexAttribPointer(texLocation, 2, GL_HALF_FLOAT, GL_FALSE, stride,
+				(const GLvoid *)offsetof(PackedVertex, uvCoord));
+	} else {
+		glBindBuffer(GL_ARRAY_BUFFER, m_vbo_vertexPositions);
+		glVertexAttribPointer(positionLocation, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+
+		glBindBuffer(GL_ARRAY_BUFFER, m_vbo_vertexNormals);
+		glVertexAttribPointer(normalLocation, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+
+		glBindBuffer(GL_ARRAY_BUFFER, m_vbo_vertexUVs);
+		glVertexAttribPointer(texLocation, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+	}
+
+	// The element array binding is recorded by the bound VAO.
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo_meshIndices);
+}
+
 //----------------------------------------------------------------------------------------
 void Project::initPerspectiveMatrix()
 {
@@ -550,35 +1617,132 @@ void Project::initLightSources() {
 }
 
 void Project::initAudio() {
-	background = SoundEngine->play2D("Assets/sounds/fan.mp3", true, false, true);
-	background->setVolume(0.1);
+	initSoundPaths();
+
+	// Loaded once and shared by every voice, see AudioCache.
+	vector<string> files;
+	for (const string & path : soundPaths) {
+		files.push_back("Assets/sounds/" + path);
+	}
+	files.push_back("Assets/sounds/fan.mp3");
+	AssetFileFactory::install(SoundEngine, m_assets);
+	WorkerPool pool(m_options.threads);
+	m_audioCache.preload(SoundEngine, files, m_assets, pool);
+
+	if (ISoundSource *fan = m_audioCache.source("Assets/sounds/fan.mp3")) {
+		background = SoundEngine->play2D(fan, true, false, true);
+	}
+	if (background) {
+		background->setVolume(0.1);
+	}
+}
+
+//----------------------------------------------------------------------------------------
+// The sound files playSound() indexes.  Needs no sound hardware.
+void Project::initSoundPaths() {
+	soundPaths = {"b1.mp3", "b2.mp3", "b3.mp3", "b4.mp3", "b5.mp3", "b6.mp3", "b7.mp3", "b8.mp3", "b9.mp3", "b10.mp3", "b11.mp3", //0-4 for fancy buildings' audio snippets, 5-10 for poor buildings'
+			"f1.mp3",
+			"m1.mp3", "m2.mp3", "m3.mp3", "m4.mp3", "m5.mp3", "m6.mp3", "m7.mp3", "m8.mp3", //12-19
+			"p1.mp3", "p2.mp3", "p3.mp3", "p4.mp3", //20-23
+			"r1.mp3", "r2.mp3", "r3.mp3", "r4.mp3", "r5.mp3", "r6.mp3"}; //24-29
 }
 
 //----------------------------------------------------------------------------------------
 void Project::uploadCommonSceneUniforms() {
-	m_shader.enable();
-	{
-		//-- Set Perpsective matrix uniform for the scene:
-		GLint location = m_shader.getUniformLocation("Perspective");
-		glUniformMatrix4fv(location, 1, GL_FALSE, value_ptr(m_perpsective));
-		CHECK_GL_ERRORS;
-			location = m_shader.getUniformLocation("light.dir");
-			glUniform3fv(location, 1, value_ptr(m_light.dir));
-			location = m_shader.getUniformLocation("light.cosCutOff");
-			glUniform1f(location, m_light.cosCutOff);
-			location = m_shader.getUniformLocation("light.position");
-			glUniform3fv(location, 1, value_ptr(m_light.pos));
-			location = m_shader.getUniformLocation("light.rgbIntensity");
-			glUniform3fv(location, 1, value_ptr(m_light.rgbIntensity));
-			CHECK_GL_ERRORS;
-
-		//-- Set background light ambient intensity
-			location = m_shader.getUniformLocation("ambientIntensity");
-			vec3 ambientIntensity(0.1f);
-			glUniform3fv(location, 1, value_ptr(ambientIntensity));
-			CHECK_GL_ERRORS;
+	FrameUniforms frame;
+	frame.perspective = m_perpsective;
+	frame.view = m_view;
+	frame.lightPosition = m_light.pos;
+	frame.lightDir = m_light.dir;
+	frame.lightRgbIntensity = vec4(m_light.rgbIntensity, 0.0f);
+	//-- Set background light ambient intensity
+	frame.ambientIntensity = vec4(vec3(AMBIENT_INTENSITY), 0.0f);
+	frame.lightCosCutOff = m_light.cosCutOff;
+	frame.infrared = infraredMode ? 1 : 0;
+	frame.useTextureArray = m_options.textureArray ? 1 : 0;
+	frame.texturesEnabled = textureMode ? 1 : 0;
+	m_frameUniforms.update(&frame, sizeof(frame));
+}
+
+//----------------------------------------------------------------------------------------
+// Refreshes the flattened scene, resolving node materials and binning the culling grid
+// whenever it is rebuilt.  Otherwise only the nodes that moved are binned again.
+void Project::updateSceneCache(SceneNode & root) {
+	if (m_sceneCache.update(root)) {
+		// New nodes may hold mesh handles registered after m_meshBatches was built.
+		m_meshBatches.resize(SceneRegistry::numMeshes(), BatchInfo());
+		resolveSceneMaterials();
+		m_cullingGrid.build(m_sceneCache);
+	} else {
+		m_cullingGrid.rebin(m_sceneCache);
+	}
+	if (m_materialTable.version() != m_uploadedMaterialVersion) {
+		uploadMaterialTable();
+	}
+}
+
+//----------------------------------------------------------------------------------------
+// Collects the GeometryNodes and static batches inside the view frustum.
+void Project::cullScene() {
+	const std::vector<unsigned int> & geometryNodes = m_sceneCache.geometryNodes();
+	if (!cullingMode) {
+		m_visibleGeometry.resize(geometryNodes.size());
+		for (unsigned int i = 0; i < geometryNodes.size(); ++i) {
+			m_visibleGeometry[i] = i;
+		}
+		m_visibleStaticBatches.resize(m_staticGeometry.getBatches().size());
+		for (unsigned int i = 0; i < m_visibleStaticBatches.size(); ++i) {
+			m_visibleStaticBatches[i] = i;
+		}
+		return;
+	}
+
+	Frustum frustum(m_perpsective * m_view);
+	m_cullingGrid.cull(m_sceneCache, frustum, m_visibleGeometry);
+	m_cullingGrid.cullStatic(frustum, m_visibleStaticBatches);
+}
+
+//----------------------------------------------------------------------------------------
+void Project::resolveSceneMaterials() {
+	const std::vector<FlatNode> & nodes = m_sceneCache.nodes();
+	const std::vector<unsigned int> & geometryNodes = m_sceneCache.geometryNodes();
+	m_geometryMaterials.resize(geometryNodes.size());
+	NodeMaterials unresolved = {UNRESOLVED_MATERIAL, UNRESOLVED_MATERIAL};
+	m_handleMaterials.resize(SceneRegistry::numMaterials(), unresolved);
+	for (size_t i = 0; i < geometryNodes.size(); ++i) {
+		const FlatNode & flatNode = nodes[geometryNodes[i]];
+		MaterialHandle handle = static_cast<const GeometryNode *>(flatNode.node)->material;
+		NodeMaterials & resolved = m_handleMaterials[handle];
+		if (resolved.normal == UNRESOLVED_MATERIAL) {
+			resolved.normal = m_materialTable.intern(SceneRegistry::material(handle));
+		}
+		NodeMaterials & entry = m_geometryMaterials[i];
+		entry.normal = resolved.normal;
+		entry.infrared = entry.normal;
+		//make people white translucent in infrared
+		if (flatNode.isPerson) {
+			if (resolved.infrared == UNRESOLVED_MATERIAL) {
+				Material white(SceneRegistry::material(handle));
+				white.kd = vec4(1.0f, 1.0f, 1.0f, white.kd.w);
+				resolved.infrared = m_materialTable.intern(white);
+			}
+			entry.infrared = resolved.infrared;
+		}
 	}
-	m_shader.disable();
+}
+
+//----------------------------------------------------------------------------------------
+void Project::uploadMaterialTable() {
+	const std::vector<Material> & materials = m_materialTable.materials();
+	std::vector<MaterialUniform> entries(materials.size());
+	for (size_t i = 0; i < materials.size(); ++i) {
+		entries[i].kd = materials[i].kd;
+		entries[i].ksShininess = vec4(materials[i].ks, materials[i].shininess);
+	}
+	if (!entries.empty()) {
+		m_materialUniforms.update(entries.data(), entries.size() * sizeof(MaterialUniform));
+	}
+	m_uploadedMaterialVersion = m_materialTable.version();
 }
 
 bool intersectGround(const vec3 A, const vec3 B, vec3 &point, vec3 v1, vec3 v2, vec3 v3) {
@@ -597,18 +1761,73 @@ bool intersectGround(const vec3 A, const vec3 B, vec3 &point, vec3 v1, vec3 v2,
  */
 void Project::appLogic()
 {
-	if (lookMode) {
-                if (wPressed) pitch+=0.05f;
-                if (sPressed) pitch-=0.05f;
-                if (aPressed) yaw-=0.05f;
-                if (dPressed) yaw+=0.05f;
+	Benchmark::Clock::time_point appLogicStart = Benchmark::Clock::now();
+	if (m_options.bench) {
+		// The scripted path takes exactly one tick per frame, so every run renders the
+		// same frames whatever the frame rate.
+		updateBenchCamera();
+		m_simulation.tick();
+	} else {
+		SimInput input;
+		input.forward = wPressed;
+		input.backward = sPressed;
+		input.left = aPressed;
+		input.right = dPressed;
+		input.ascend = ePressed;
+		input.descend = qPressed;
+		input.look = lookMode;
+		input.freeFly = freeMode;
+		double posx, posy;
+		glfwGetCursorPos(m_window, &posx, &posy);
+		input.cursor = vec2((posx/m_windowWidth) * 2.0 - 1.0, -((posy/m_windowHeight) * 2.0 - 1.0)); //convert to opengl coords
+		m_simulation.setInput(input);
+	}
+
+	const SimSnapshot & previous = m_previousSnapshot;
+	const SimSnapshot & current = m_currentSnapshot;
+	float alpha = m_simulation.latest(m_previousSnapshot, m_currentSnapshot, m_crowdMoved);
+	vec3 camPos = mix(previous.camPos, current.camPos, alpha);
+	vec3 camDir = normalize(mix(previous.camDir, current.camDir, alpha));
+	vec3 camUp = normalize(mix(previous.camUp, current.camUp, alpha));
+	m_view = glm::lookAt(camPos, camPos + camDir, camUp);
+	m_light.dir = normalize(mix(previous.lightDir, current.lightDir, alpha));
+	m_crowd.place(m_crowdMoved, previous.crowd, current.crowd, alpha);
+	m_crowdMoved.clear();
+	if (m_streamer.isStarted()) {
+		streamCity(vec2(camPos.x, camPos.z), false);
+	}
+	if (m_textureLoader.isStarted()) {
+		uploadTextures();
+	}
+	uploadCommonSceneUniforms();
+
+	if (m_options.bench) {
+		m_benchmark.recordAppLogic(Benchmark::millisecondsSince(appLogicStart));
+	}
+}
+
+//----------------------------------------------------------------------------------------
+/*
+ * One fixed timestep of the helicopter, the spotlight, the crowd and the sounds, on the
+ * simulation thread.  Nothing else touches the camera state or the sounds once the
+ * simulation has started; the renderer only sees the snapshots.
+ */
+void Project::simulate(const SimInput & input, SimSnapshot & snapshot, std::vector<unsigned int> & crowdMoved)
+{
+	if (m_options.bench) {
+		// updateBenchCamera() placed the camera.
+	} else if (input.look) {
+                if (input.forward) pitch+=0.05f;
+                if (input.backward) pitch-=0.05f;
+                if (input.left) yaw-=0.05f;
+                if (input.right) yaw+=0.05f;
 	} else {
-		if (wPressed) velocity += 0.2f* m_dir;
-		if (sPressed) velocity -= 0.2f* m_dir;
-		if (aPressed) velocity -= 0.2f*normalize(cross(m_dir, camUp));
-		if (dPressed) velocity += 0.2f*normalize(cross(m_dir, camUp));
-		if (ePressed) velocity += 0.2f*camUp;
-		if (qPressed) velocity -= 0.2f*camUp;
+		if (input.forward) velocity += 0.2f* m_dir;
+		if (input.backward) velocity -= 0.2f* m_dir;
+		if (input.left) velocity -= 0.2f*normalize(cross(m_dir, camUp));
+		if (input.right) velocity += 0.2f*normalize(cross(m_dir, camUp));
+		if (input.ascend) velocity += 0.2f*camUp;
+		if (input.descend) velocity -= 0.2f*camUp;
 	}
 	pitch = clamp(pitch, -1.57, 1.57);
 	m_dir.x = sin(yaw) * cos(pitch);
@@ -621,36 +1840,45 @@ void Project::appLogic()
 	camUp = normalize(camUp);
 	velocity = clamp(velocity, -5.0f, 5.0f);
 	camPos += velocity;
-	if (!freeMode) camPos.y = clamp(camPos.y, 45.0f, 60.0f);
-	camPos.x = clamp(camPos.x, -125.0f, 125.0f);
-	camPos.z = clamp(camPos.z, -125.0f, 125.0f);
+	if (!input.freeFly) camPos.y = clamp(camPos.y, 45.0f, 60.0f);
+	if (m_options.streamRadius == 0) {
+		camPos.x = clamp(camPos.x, -125.0f, 125.0f);
+		camPos.z = clamp(camPos.z, -125.0f, 125.0f);
+	}
 
 	velocity *= 0.95;
-	//add some perturbations to helicopter
-	velocity.z += (rand() % 3)*0.03 - 0.03f;
-	velocity.x += (rand() % 3)*0.03 - 0.03f;
-	velocity.y += (rand() % 3)*0.05 - 0.05f;
+	//add some perturbations to helicopter, except along the scripted benchmark path
+	if (!m_options.bench) {
+		velocity.z += (rand() % 3)*0.03 - 0.03f;
+		velocity.x += (rand() % 3)*0.03 - 0.03f;
+		velocity.y += (rand() % 3)*0.05 - 0.05f;
+	}
 
+	mat4 view = glm::lookAt(camPos, camPos + m_dir, camUp);
+	vec4 lightDir = vec4(normalize(vec3(input.cursor, -1.0)), 0);
 
-	m_view = glm::lookAt(camPos, camPos + m_dir, camUp);
-	double posx, posy;
-	glfwGetCursorPos(m_window, &posx, &posy);
-	posx = ((posx/m_windowWidth) * 2.0 - 1.0); //convert to opengl coords
-	posy = -((posy/m_windowHeight) * 2.0 - 1.0);
-	m_light.dir = vec4(normalize(vec3(posx, posy, -1.0)), 0);
-
-	light_dir_model = vec3(inverse(m_view) * m_light.dir);
-	light_pos_model = vec3(inverse(m_view)*m_light.pos);
-	if (!intersectGround(light_pos_model, light_dir_model, light_intersect, ground1, ground2, ground3)) {
-		light_intersect = vec3(0, -10000, 0);
+	light_dir_model = vec3(inverse(view) * lightDir);
+	light_pos_model = vec3(inverse(view)*m_light.pos);
+	Benchmark::Clock::time_point spotlightStart = Benchmark::Clock::now();
+	float distance = FLT_MAX;
+	if (intersectGround(light_pos_model, light_dir_model, light_intersect, ground1, ground2, ground3)) {
+		distance = length(light_intersect - light_pos_model) / length(light_dir_model);
+	}
+	// The nearest rooftop or facade in front of the ground takes the light instead.
+	bool hit = m_staticBvh.intersect(light_pos_model, light_dir_model, distance);
+	for (const TriangleBvh * bvh : m_streamedBvhs) {
+		hit = bvh->intersect(light_pos_model, light_dir_model, distance) || hit;
 	}
-	for (auto it = people.begin(); it!=people.end(); ++it) {
-		float dx = (*it)->pos.x - light_intersect.x;
-		float dz = (*it)->pos.z - light_intersect.z;
-		float distance = sqrt(dx * dx + dz * dz);
-		if (distance < 4) (*it)->trigger();
-		(*it)->run(light_intersect);
+	if (hit) {
+		light_intersect = light_pos_model + distance * light_dir_model;
+	} else if (distance == FLT_MAX) {
+		light_intersect = vec3(0, -10000, 0);
 	}
+	snapshot.spotlightMs = Benchmark::millisecondsSince(spotlightStart);
+	m_crowd.update(light_intersect, light_intersect.y < SPOTLIGHT_GROUND_HEIGHT ? SPOTLIGHT_RADIUS : 0.0f,
+			snapshot.tick * SIM_TIMESTEP);
+	m_crowd.publish(snapshot.crowd, crowdMoved);
+	m_voices.update(light_intersect, SIM_TIMESTEP);
 
 	//need position in model coordinates, since sound files were defined there
 	SoundEngine->setListenerPosition(
@@ -658,8 +1886,15 @@ void Project::appLogic()
 		vec3df(camUp.x, camUp.y, camUp.z));
 	//relative frequency, velocity is us the observer
 	float frequency = (soundSpeed + length(20.0f*velocity)) / soundSpeed;
-	background->setPlaybackSpeed(frequency);
-	uploadCommonSceneUniforms();
+	if (background) background->setPlaybackSpeed(frequency);
+
+	snapshot.camPos = camPos;
+	snapshot.camDir = m_dir;
+	snapshot.camUp = camUp;
+	snapshot.lightDir = lightDir;
+	snapshot.crowdRunning = m_crowd.numRunning();
+	snapshot.realVoices = m_voices.numReal();
+	snapshot.virtualVoices = m_voices.numVirtual();
 }
 
 //----------------------------------------------------------------------------------------
@@ -694,6 +1929,45 @@ void Project::guiLogic()
                         ImGui::Text( "key E: ascend");
                         ImGui::Text( "hold Shift: Look mode - WASD keys become looking instead of moving");
 			ImGui::Text( "Framerate: %.1f FPS", ImGui::GetIO().Framerate );
+			if (m_citySnapshot.isOpen()) {
+				ImGui::Text( "City loaded from snapshot in %.1f ms", m_cityBuildMs );
+			} else if (m_streamer.isStarted()) {
+				ImGui::Text( "City built in %.1f ms, streets streamed on %u threads", m_cityBuildMs,
+						m_streamer.numThreads() );
+				ImGui::Text( "Streamed blocks: %u resident, %u pending, %.1f MiB uploaded",
+						m_streamer.numResident(), m_streamer.numPending(), m_streamedBytes / (1024.0 * 1024.0) );
+			} else {
+				ImGui::Text( "City built in %.1f ms, streets generated in %.1f ms on %u threads", m_cityBuildMs,
+						m_cityGenerationMs, m_cityGenerationThreads );
+			}
+			if (m_textureLoader.isStarted()) {
+				ImGui::Text( "Textures: %u of %u uploaded", (unsigned int)(m_textureLoader.numImages() -
+						m_textureLoader.numPending()), (unsigned int)m_textureLoader.numImages() );
+			} else {
+				ImGui::Text( "Textures: %u loaded in %.1f ms", (unsigned int)m_texturePaths.size(), m_textureLoadMs );
+			}
+			ImGui::Text( "Scene nodes: %.0f KiB", m_sceneArena.bytesAllocated() / 1024.0 );
+			ImGui::Text( "Spotlight BVH: %u triangles, built in %.1f ms, ray %.2f us",
+					(unsigned int)m_staticBvh.numTriangles(), m_bvhBuildMs, 1000.0 * m_currentSnapshot.spotlightMs );
+			ImGui::Text( "People: %u, %u running", m_crowd.numPeople(), m_currentSnapshot.crowdRunning );
+			ImGui::Text( "Audio: %u clips decoded (%.1f MiB), %u streamed, loaded in %.0f ms",
+					m_audioCache.numDecoded(), m_audioCache.decodedBytes() / (1024.0 * 1024.0),
+					m_audioCache.numStreamed(), m_audioCache.preloadMilliseconds() );
+			ImGui::Text( "Voices: %u real, %u virtual", m_currentSnapshot.realVoices, m_currentSnapshot.virtualVoices );
+			ImGui::Text( "Simulation: %llu ticks at %u Hz, %llu dropped", m_simulation.numTicks(),
+					SIM_TICKS_PER_SECOND, m_simulation.numDroppedTicks() );
+			ImGui::Text( "Transforms recomputed: %u / %u", m_sceneCache.numRecomputed(),
+					(unsigned int)m_sceneCache.nodes().size() );
+			ImGui::Text( "Baked nodes: %u in %u batches", (unsigned int)m_staticGeometry.getNumBakedNodes(),
+					(unsigned int)m_staticGeometry.getBatches().size() );
+			ImGui::Text( "Visible nodes: %u (%u culled)", m_cullingGrid.numVisibleItems(),
+					m_cullingGrid.numItems() - m_cullingGrid.numVisibleItems() );
+			ImGui::Text( "Visible static batches: %u (%u culled)", m_cullingGrid.numVisibleStaticBatches(),
+					m_cullingGrid.numStaticBatches() - m_cullingGrid.numVisibleStaticBatches() );
+			ImGui::Text( "Draw calls: %u", m_drawCalls );
+			ImGui::Text( "Vertex data: %.1f KiB per frame", m_vertexBytes / 1024.0 );
+			ImGui::Text( "Visible grid cells: %u / %u", m_cullingGrid.numVisibleCells(),
+					(unsigned int)(CULLING_GRID_CELLS * CULLING_GRID_CELLS) );
 			ImGui::EndMenu();
 		}
 		if (ImGui::BeginMenu("Toggles"))
@@ -704,6 +1978,12 @@ void Project::guiLogic()
 			if (ImGui::MenuItem("Free Look Mode")) {
                                 freeMode = !freeMode;
                         }
+			if (ImGui::MenuItem("Toggle Instancing")) {
+				instancedMode = !instancedMode;
+			}
+			if (ImGui::MenuItem("Toggle Culling")) {
+				cullingMode = !cullingMode;
+			}
 			ImGui::EndMenu();
 		}
 		ImGui::EndMenuBar();
@@ -712,51 +1992,20 @@ void Project::guiLogic()
 }
 
 //----------------------------------------------------------------------------------------
-// Update mesh specific shader uniforms:
+// Update mesh specific shader uniforms.  m_shader must be enabled.
 void Project::updateShaderUniforms(
-		const ShaderProgram & shader,
 		const GeometryNode & node,
-		const glm::mat4 & modelMatrix
+		const glm::mat4 & modelMatrix,
+		unsigned int materialIndex
 ) {
-	shader.enable();
-		//-- Set ModelView matrix:
-		GLint location = shader.getUniformLocation("ModelView");
-		mat4 modelView = mat4(m_view*modelMatrix);
-		glUniformMatrix4fv(location, 1, GL_FALSE, value_ptr(modelView));
-		CHECK_GL_ERRORS;
-		//-- Set NormMatrix:
-		location = shader.getUniformLocation("NormalMatrix");
-		mat3 normalMatrix = glm::transpose(glm::inverse(mat3(modelView)));
-		glUniformMatrix3fv(location, 1, GL_FALSE, value_ptr(normalMatrix));
-		CHECK_GL_ERRORS;
-		//-- Set Material values:
-		location = shader.getUniformLocation("material.kd");
-		vec4 kd = node.material.kd;
-
-		//make people white translucent in infrared
-		if (infraredMode && isPerson) {
-			kd.x = 1.0;
-			kd.y = 1.0;
-			kd.z = 1.0;
-		}
-		glUniform4fv(location, 1, value_ptr(kd));
-		CHECK_GL_ERRORS;
-		location = shader.getUniformLocation("material.ks");
-		vec3 ks = node.material.ks;
-		glUniform3fv(location, 1, value_ptr(ks));
-		CHECK_GL_ERRORS;
-		location = shader.getUniformLocation("material.shininess");
-		glUniform1f(location, node.material.shininess);
-		CHECK_GL_ERRORS;
-		location = shader.getUniformLocation("textured");
-		glUniform1i(location, (node.textureIndex != -1 && textureMode) ? 1 : 0);
-		location = shader.getUniformLocation("infrared");
-		glUniform1i(location, infraredMode ? 1 : 0);
-		if (node.textureIndex != -1) {
-			unsigned int texture = textures[node.textureIndex];
-			glBindTexture(GL_TEXTURE_2D, texture);
-		}
-	shader.disable();
+	glUniformMatrix4fv(m_modelUniformLocation, 1, GL_FALSE, value_ptr(modelMatrix));
+	glUniform1i(m_materialIndexUniformLocation, materialIndex);
+	glVertexAttrib1f(m_texLayerAttribLocation, node.textureIndex);
+	if (node.textureIndex != -1 && !m_options.textureArray) {
+		unsigned int texture = textures[node.textureIndex];
+		glBindTexture(GL_TEXTURE_2D, texture);
+	}
+	CHECK_GL_ERRORS;
 }
 
 //----------------------------------------------------------------------------------------
@@ -764,47 +2013,248 @@ void Project::updateShaderUniforms(
  * Called once per frame, after guiLogic().
  */
 void Project::draw() {
+	Benchmark::Clock::time_point traverseStart = Benchmark::Clock::now();
+	unsigned int query = m_benchmark.numFrames() % BENCH_QUERY_COUNT;
+	if (m_options.bench) {
+		collectGpuTiming(query);
+		glBeginQuery(GL_TIME_ELAPSED, m_gpuTimerQueries[query]);
+		m_gpuQueryFrames[query] = m_benchmark.numFrames();
+	}
+	m_drawCalls = 0;
+	m_vertexBytes = 0.0;
 
 	glEnable( GL_DEPTH_TEST );
 	glEnable(GL_CULL_FACE);
-	renderSceneGraph(*m_rootNode);
+	if (instancedMode) {
+		renderSceneGraphInstanced(*m_rootNode);
+	} else {
+		renderSceneGraph(*m_rootNode);
+	}
+	renderStaticGeometry();
+	renderStreamedGeometry();
 
 
 	glDisable( GL_DEPTH_TEST );
 	glDisable( GL_CULL_FACE);
+
+	if (m_options.bench) {
+		glEndQuery(GL_TIME_ELAPSED);
+		m_benchmark.recordTraverse(Benchmark::millisecondsSince(traverseStart));
+		m_benchmark.recordDrawCalls(m_drawCalls);
+		m_benchmark.recordVertexBytes(m_vertexBytes);
+	}
 }
 
 //----------------------------------------------------------------------------------------
 void Project::renderSceneGraph(SceneNode & root) {
+	updateSceneCache(root);
+	cullScene();
+	const std::vector<FlatNode> & nodes = m_sceneCache.nodes();
+	const std::vector<mat4> & world = m_sceneCache.worldTransforms();
+	const std::vector<unsigned int> & geometryNodes = m_sceneCache.geometryNodes();
+
 	glBindVertexArray(m_vao_meshData);
-	m_model = mat4();
-	traverse(root);
+	m_shader.enable();
+	for (unsigned int i : m_visibleGeometry) {
+		unsigned int index = geometryNodes[i];
+		const NodeMaterials & materials = m_geometryMaterials[i];
+		drawGeometryNode(static_cast<const GeometryNode &>(*nodes[index].node), world[index],
+				infraredMode ? materials.infrared : materials.normal);
+	}
+	m_shader.disable();
+	glBindVertexArray(0);
+	CHECK_GL_ERRORS;
+}
+
+void Project::drawGeometryNode(const GeometryNode & geometryNode, const mat4 & modelMatrix, unsigned int materialIndex) {
+	updateShaderUniforms(geometryNode, modelMatrix, materialIndex);
+	const BatchInfo & batchInfo = m_meshBatches[geometryNode.mesh];
+	glDrawElementsBaseVertex(GL_TRIANGLES, batchInfo.numIndices, m_meshIndexType,
+			meshIndexOffset(batchInfo), batchInfo.baseVertex);
+	++m_drawCalls;
+	m_vertexBytes += batchInfo.numIndices * m_meshVertexStride;
+}
+
+//----------------------------------------------------------------------------------------
+// Byte offset of a mesh's first index within m_ibo_meshIndices.
+const GLvoid * Project::meshIndexOffset(const BatchInfo & batchInfo) const {
+	return (const GLvoid *)(batchInfo.startIndex * m_meshIndexSize);
+}
+
+//----------------------------------------------------------------------------------------
+/*
+ * Draws the baked buildings and billboards, one indexed draw per StaticBatch.
+ * Their vertices are already in world space, so the model matrix is the identity.
+ */
+void Project::renderStaticGeometry() {
+	const std::vector<StaticBatch> & batches = m_staticGeometry.getBatches();
+	if (batches.empty()) {
+		return;
+	}
+
+	glBindVertexArray(m_vao_staticData);
+	m_shader.enable();
+	glUniformMatrix4fv(m_modelUniformLocation, 1, GL_FALSE, value_ptr(mat4()));
+	for (unsigned int i : m_visibleStaticBatches) {
+		const StaticBatch & batch = batches[i];
+		glUniform1i(m_materialIndexUniformLocation, m_staticBatchMaterials[i]);
+		if (batch.textureIndex >= 0 && !m_options.textureArray) {
+			glBindTexture(GL_TEXTURE_2D, textures[batch.textureIndex]);
+		}
+		glDrawElementsBaseVertex(GL_TRIANGLES, batch.numIndices, GL_UNSIGNED_INT,
+				(const GLvoid *)(batch.startIndex * sizeof(GLuint)), batch.baseVertex);
+		++m_drawCalls;
+		m_vertexBytes += batch.numIndices * STATIC_VERTEX_STRIDE;
+	}
+	m_shader.disable();
+	glBindVertexArray(0);
+	CHECK_GL_ERRORS;
+}
+
+//----------------------------------------------------------------------------------------
+/*
+ * Draws the baked streets of the streamed blocks uploaded so far, like
+ * renderStaticGeometry() but from each block's own buffers.  They are not binned in
+ * m_cullingGrid, whose cells never move, so each batch is tested on its own.
+ */
+void Project::renderStreamedGeometry() {
+	if (m_streamedBlocks.empty()) {
+		return;
+	}
+
+	Frustum frustum(m_perpsective * m_view);
+	m_shader.enable();
+	glUniformMatrix4fv(m_modelUniformLocation, 1, GL_FALSE, value_ptr(mat4()));
+	for (const auto & entry : m_streamedBlocks) {
+		const StreamedBlock & block = *entry.second;
+		if (!block.drawable || block.batches.empty()) {
+			continue;
+		}
+		glBindVertexArray(block.vao);
+		for (unsigned int i = 0; i < block.batches.size(); ++i) {
+			const StaticBatch & batch = block.batches[i];
+			if (cullingMode && !frustum.intersects(batch.bounds)) {
+				continue;
+			}
+			glUniform1i(m_materialIndexUniformLocation, block.batchMaterials[i]);
+			if (batch.textureIndex >= 0 && !m_options.textureArray) {
+				glBindTexture(GL_TEXTURE_2D, textures[batch.textureIndex]);
+			}
+			glDrawElementsBaseVertex(GL_TRIANGLES, batch.numIndices, GL_UNSIGNED_INT,
+					(const GLvoid *)(batch.startIndex * sizeof(GLuint)), batch.baseVertex);
+			++m_drawCalls;
+			m_vertexBytes += batch.numIndices * STATIC_VERTEX_STRIDE;
+		}
+	}
+	m_shader.disable();
 	glBindVertexArray(0);
 	CHECK_GL_ERRORS;
 }
 
-void Project::traverse(SceneNode & curr) {
-	matStack.push(m_model);
-	m_model *= curr.get_transform();
-	//person flag for infraredMode
-	if (curr.m_name == "torso") isPerson = true;
+//----------------------------------------------------------------------------------------
+/*
+ * Renders the scene with one instanced draw per (mesh, textureIndex) group
+ * instead of one draw per GeometryNode.
+ */
+void Project::renderSceneGraphInstanced(SceneNode & root) {
+	updateSceneCache(root);
+	cullScene();
+	collectInstances();
+
+	// Pack every group back to back so the whole frame is a single buffer upload.
+	m_instanceData.clear();
+	for (const std::vector<InstanceData> & group : m_instanceGroups) {
+		m_instanceData.insert(m_instanceData.end(), group.begin(), group.end());
+	}
+	if (m_instanceData.empty()) {
+		return;
+	}
+
+	glBindVertexArray(m_vao_instanced);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo_instanceData);
+	// Orphan last frame's storage so the driver does not stall on it.
+	glBufferData(GL_ARRAY_BUFFER, m_instanceData.size() * sizeof(InstanceData), nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, m_instanceData.size() * sizeof(InstanceData), m_instanceData.data());
+
+	m_instancedShader.enable();
+
+	size_t first = 0;
+	unsigned int textureSlots = numInstanceTextureSlots();
+	for (size_t group = 0; group < m_instanceGroups.size(); ++group) {
+		GLsizei count = m_instanceGroups[group].size();
+		if (count == 0) {
+			continue;
+		}
+		const BatchInfo & batchInfo = m_meshBatches[group / textureSlots];
+		int textureIndex = (int)(group % textureSlots) + MIXED_TEXTURE_INDEX;
+		if (textureIndex >= 0 && !m_options.textureArray) {
+			glBindTexture(GL_TEXTURE_2D, textures[textureIndex]);
+		}
+		setInstanceAttribOffset(first * sizeof(InstanceData));
+		glDrawElementsInstancedBaseVertex(GL_TRIANGLES, batchInfo.numIndices, m_meshIndexType,
+				meshIndexOffset(batchInfo), count, batchInfo.baseVertex);
+		++m_drawCalls;
+		m_vertexBytes += (double)batchInfo.numIndices * m_meshVertexStride * count + count * sizeof(InstanceData);
+		first += count;
+	}
+	m_instancedShader.disable();
 
-	if (curr.m_nodeType == NodeType::GeometryNode) {
-		GeometryNode & geometryNode = static_cast<GeometryNode &>(curr);
-		updateShaderUniforms(m_shader, geometryNode, m_model);
-                BatchInfo batchInfo = m_batchInfoMap[geometryNode.meshId];
-                m_shader.enable();
-                glDrawArrays(GL_TRIANGLES, batchInfo.startIndex, batchInfo.numIndices);
-                m_shader.disable();
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+	CHECK_GL_ERRORS;
+}
+
+//----------------------------------------------------------------------------------------
+void Project::collectInstances() {
+	for (std::vector<InstanceData> & group : m_instanceGroups) {
+		group.clear();
 	}
-	for (SceneNode * child : curr.children) {
-		traverse(*child);
+	m_instanceGroups.resize(m_meshBatches.size() * numInstanceTextureSlots());
+
+	const std::vector<FlatNode> & nodes = m_sceneCache.nodes();
+	const std::vector<mat4> & world = m_sceneCache.worldTransforms();
+	const std::vector<unsigned int> & geometryNodes = m_sceneCache.geometryNodes();
+	for (unsigned int i : m_visibleGeometry) {
+		unsigned int index = geometryNodes[i];
+		const GeometryNode & geometryNode = static_cast<const GeometryNode &>(*nodes[index].node);
+		const NodeMaterials & materials = m_geometryMaterials[i];
+		InstanceData instance;
+		instance.model = world[index];
+		instance.materialIndex = infraredMode ? materials.infrared : materials.normal;
+		instance.texLayer = geometryNode.textureIndex;
+		// With a texture array the layer travels with the instance, so only the mesh splits groups.
+		int textureIndex = m_options.textureArray ? MIXED_TEXTURE_INDEX : geometryNode.textureIndex;
+		m_instanceGroups[instanceGroup(geometryNode.mesh, textureIndex)].push_back(instance);
 	}
+}
 
-	if (curr.m_name == "torso") isPerson = false;
+//----------------------------------------------------------------------------------------
+// Texture indices an instance group can have: MIXED_TEXTURE_INDEX, -1 for none, then
+// every texture.
+unsigned int Project::numInstanceTextureSlots() const {
+	return textures.size() - MIXED_TEXTURE_INDEX;
+}
+
+//----------------------------------------------------------------------------------------
+// Groups of one mesh are adjacent and ordered by texture index, so drawing them in
+// index order sorts draws by mesh, then texture.
+unsigned int Project::instanceGroup(MeshHandle mesh, int textureIndex) const {
+	return mesh * numInstanceTextureSlots() + (textureIndex - MIXED_TEXTURE_INDEX);
+}
 
-	m_model = mat4(matStack.top());
-	matStack.pop();
+//----------------------------------------------------------------------------------------
+// Points the per-instance attributes at the group starting byteOffset bytes into
+// m_vbo_instanceData, which must be bound to GL_ARRAY_BUFFER.
+void Project::setInstanceAttribOffset(size_t byteOffset) {
+	const GLsizei stride = sizeof(InstanceData);
+	for (GLint i = 0; i < 4; ++i) {
+		glVertexAttribPointer(m_instanceModelAttribLocation + i, 4, GL_FLOAT, GL_FALSE, stride,
+				(const GLvoid *)(byteOffset + offsetof(InstanceData, model) + i * sizeof(vec4)));
+	}
+	glVertexAttribIPointer(m_instanceMaterialAttribLocation, 1, GL_INT, stride,
+			(const GLvoid *)(byteOffset + offsetof(InstanceData, materialIndex)));
+	glVertexAttribPointer(m_instanceLayerAttribLocation, 1, GL_FLOAT, GL_FALSE, stride,
+			(const GLvoid *)(byteOffset + offsetof(InstanceData, texLayer)));
 }
 
 //----------------------------------------------------------------------------------------
@@ -813,7 +2263,189 @@ void Project::traverse(SceneNode & curr) {
  */
 void Project::cleanup()
 {
+	m_simulation.stop();
+	if (m_options.bench) {
+		reportBenchmark();
+	}
+	m_streamer.stop();
+	m_textureLoader.stop();
+}
 
+//----------------------------------------------------------------------------------------
+/*
+ * Benchmarks render into an offscreen framebuffer the size of the hidden window, so
+ * results do not depend on the window being mapped or composited.
+ */
+void Project::initBenchFramebuffer()
+{
+	glGenRenderbuffers(1, &m_benchColorBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, m_benchColorBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, m_framebufferWidth, m_framebufferHeight);
+
+	glGenRenderbuffers(1, &m_benchDepthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, m_benchDepthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, m_framebufferWidth, m_framebufferHeight);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &m_benchFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_benchFramebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_benchColorBuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_benchDepthBuffer);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		throw Exception("Benchmark framebuffer is incomplete.");
+	}
+	// Left bound for the whole run; Window::run clears whatever is bound.
+	glViewport(0, 0, m_framebufferWidth, m_framebufferHeight);
+
+	glGenQueries(BENCH_QUERY_COUNT, m_gpuTimerQueries);
+	CHECK_GL_ERRORS;
+}
+
+//----------------------------------------------------------------------------------------
+/*
+ * One lap around the city at helicopter height over the whole run, looking along the
+ * path and down at the streets.  Ends the run after the last frame.
+ */
+void Project::updateBenchCamera()
+{
+	m_benchmark.beginFrame();
+	unsigned int totalFrames = BENCH_WARMUP_FRAMES + m_options.benchFrames;
+	unsigned int frame = m_benchmark.numFrames();
+	// The frame past the last one only closes the final frame time.
+	if (frame > totalFrames) {
+		glfwSetWindowShouldClose(m_window, GL_TRUE);
+	}
+
+	float angle = 2.0f * PI * frame / totalFrames;
+	camPos = vec3(80.0f * sin(angle), 50.0f, -80.0f * cos(angle));
+	yaw = angle + 0.5 * PI;
+	pitch = -0.5;
+	velocity = vec3(0.0f);
+}
+
+//----------------------------------------------------------------------------------------
+// Reads back the result of a GL_TIME_ELAPSED query issued BENCH_QUERY_COUNT frames ago.
+void Project::collectGpuTiming(unsigned int query)
+{
+	if (m_gpuQueryFrames[query] == 0) {
+		return;
+	}
+	GLuint64 elapsed = 0;
+	glGetQueryObjectui64v(m_gpuTimerQueries[query], GL_QUERY_RESULT, &elapsed);
+	m_benchmark.recordGpu(m_gpuQueryFrames[query], elapsed / 1.0e6);
+	m_gpuQueryFrames[query] = 0;
+}
+
+//----------------------------------------------------------------------------------------
+void Project::reportBenchmark()
+{
+	for (unsigned int i = 0; i < BENCH_QUERY_COUNT; ++i) {
+		collectGpuTiming(i);
+	}
+	glDeleteQueries(BENCH_QUERY_COUNT, m_gpuTimerQueries);
+
+	cout << "Benchmark: seed " << m_options.seed << ", " << m_options.benchFrames << " frames at "
+		<< m_framebufferWidth << "x" << m_framebufferHeight << ", "
+		<< (instancedMode ? "instanced" : "per node") << (m_options.bakeStatic ? ", baked" : "")
+		<< (m_options.textureArray ? ", texture array" : "")
+		<< (m_options.packedVertices ? ", packed vertices" : "") << endl;
+	if (m_citySnapshot.isOpen()) {
+		cout << "City loaded from snapshot in " << m_cityBuildMs << " ms" << endl;
+	} else if (m_streamer.isStarted()) {
+		cout << "City built in " << m_cityBuildMs << " ms, streets streamed on " << m_streamer.numThreads()
+			<< " threads" << endl;
+		cout << "Streamed blocks: " << m_streamer.numResident() << " resident, "
+			<< m_streamedBytes / (1024 * 1024) << " MiB uploaded" << endl;
+	} else {
+		cout << "City built in " << m_cityBuildMs << " ms, streets generated in " << m_cityGenerationMs
+			<< " ms on " << m_cityGenerationThreads << " threads" << endl;
+	}
+	cout << "Textures: " << m_texturePaths.size() << " loaded in " << m_textureLoadMs << " ms" << endl;
+	cout << "Scene nodes: " << m_sceneArena.bytesAllocated() / 1024 << " KiB" << endl;
+	cout << "Spotlight BVH: " << m_staticBvh.numTriangles() << " triangles, built in " << m_bvhBuildMs
+		<< " ms" << endl;
+	cout << "People: " << m_crowd.numPeople() << endl;
+	cout << "Assets: " << m_assets.size() << " packed" << endl;
+	cout << "Audio: " << m_audioCache.numDecoded() << " clips decoded, " << m_audioCache.numStreamed()
+		<< " streamed, loaded in " << m_audioCache.preloadMilliseconds() << " ms" << endl;
+	cout << "Sound emitters: " << m_voices.size() << ", at most " << m_options.maxVoices << " real" << endl;
+	m_benchmark.printSummary(cout);
+	m_benchmark.writeJson(cout, m_options.seed);
+
+	if (!m_options.benchJson.empty()) {
+		ofstream json(m_options.benchJson.c_str());
+		if (json) {
+			m_benchmark.writeJson(json, m_options.seed);
+		} else {
+			cerr << "Could not write benchmark report to " << m_options.benchJson << endl;
+		}
+	}
+}
+
+//----------------------------------------------------------------------------------------
+/*
+ * Path traces the view into m_options.posterFile.  The nodes still in the scene graph
+ * are baked like the buildings, so the poster sees the people and, with bakeStatic
+ * unset, everything else too.
+ */
+void Project::renderPoster()
+{
+	Benchmark::Clock::time_point start = Benchmark::Clock::now();
+	WorkerPool pool(m_options.threads);
+
+	StaticGeometry sceneGeometry = m_blockGeometry;
+	sceneGeometry.bake(*m_rootNode);
+	sceneGeometry.consolidate();
+	PosterRenderer poster;
+	poster.addGeometry(m_staticGeometry);
+	poster.addGeometry(sceneGeometry);
+	poster.build(pool);
+
+	vector<PosterTexture> posterTextures(m_texturePaths.size());
+	stbi_set_flip_vertically_on_load(true);
+	pool.parallelFor(m_texturePaths.size(), [&](size_t i) {
+		PosterTexture & texture = posterTextures[i];
+		int nChannels;
+		unsigned char * data = loadImage(m_texturePaths[i], texture.width, texture.height, nChannels, 3);
+		if (data) {
+			texture.pixels.assign(data, data + texture.width * texture.height * 3);
+		}
+		stbi_image_free(data);
+	});
+	poster.setTextures(std::move(posterTextures));
+	double sceneMs = Benchmark::millisecondsSince(start);
+
+	mat4 cameraToWorld = inverse(m_view);
+	PosterView view;
+	view.eye = vec3(cameraToWorld[3]);
+	view.direction = -vec3(cameraToWorld[2]);
+	view.up = vec3(cameraToWorld[1]);
+	view.fovy = degreesToRadians(60.0f);
+	view.lightPosition = vec3(cameraToWorld * m_light.pos);
+	view.lightDirection = normalize(vec3(cameraToWorld * m_light.dir));
+	view.lightCosCutOff = m_light.cosCutOff;
+	view.lightRgbIntensity = m_light.rgbIntensity;
+	view.ambientIntensity = vec3(AMBIENT_INTENSITY);
+	view.width = POSTER_WIDTH;
+	view.height = POSTER_HEIGHT;
+	view.samplesPerPixel = std::max(m_options.posterSamples, 1u);
+	view.maxBounces = POSTER_BOUNCES;
+	view.seed = m_options.seed;
+
+	start = Benchmark::Clock::now();
+	vector<unsigned char> rgb;
+	poster.render(view, pool, rgb);
+	double renderMs = Benchmark::millisecondsSince(start);
+
+	cout << "Poster: " << poster.numTriangles() << " triangles gathered in " << sceneMs << " ms, "
+		<< view.width << "x" << view.height << " at " << view.samplesPerPixel << " samples rendered in "
+		<< renderMs << " ms on " << pool.numThreads() << " threads" << endl;
+	try {
+		PosterRenderer::writePng(m_options.posterFile, view.width, view.height, rgb);
+		cout << "Poster written to " << m_options.posterFile << endl;
+	} catch (const Exception & e) {
+		cout << e.what() << endl;
+	}
 }
 
 //----------------------------------------------------------------------------------------
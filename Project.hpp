@@ -6,15 +6,36 @@
 #include "framework/OpenGLImport.hpp"
 #include "framework/ShaderProgram.hpp"
 #include "framework/MeshConsolidator.hpp"
+#include "framework/AssetPack.hpp"
+#include "framework/UniformBuffer.hpp"
 
 #include "SceneNode.hpp"
+#include "SceneArena.hpp"
+#include "SceneCache.hpp"
+#include "StaticGeometry.hpp"
+#include "CullingGrid.hpp"
+#include "Crowd.hpp"
+#include "Simulation.hpp"
+#include "VoiceManager.hpp"
+#include "AudioCache.hpp"
+#include "Benchmark.hpp"
+#include "CityBlock.hpp"
+#include "ChunkStreamer.hpp"
+#include "TriangleBvh.hpp"
+#include "TextureLoader.hpp"
+#include "CityRandom.hpp"
+#include "CitySnapshot.hpp"
+#include "MaterialTable.hpp"
+#include "SceneRegistry.hpp"
 #include "GeometryNode.hpp"
 #include "Building.hpp"
 #include "Person.hpp"
 
 #include <glm/glm.hpp>
+#include <ctime>
+#include <map>
 #include <memory>
-#include <stack>
+#include <utility>
 #include <vector>
 #include <irrKlang.h>
 using namespace irrklang;
@@ -38,12 +59,202 @@ struct SpotLight {
 	glm::vec4 dir;
 };
 
+// std140 mirror of the FrameUniforms block declared by the shaders.
+struct FrameUniforms {
+	glm::mat4 perspective;
+	glm::mat4 view;
+	glm::vec4 lightPosition;
+	glm::vec4 lightDir;
+	glm::vec4 lightRgbIntensity;
+	glm::vec4 ambientIntensity;
+	float lightCosCutOff;
+	GLint infrared;
+	GLint useTextureArray;
+	GLint texturesEnabled;
+};
+
+// std140 mirror of one entry of the MaterialUniforms block, which holds MAX_MATERIALS.
+struct MaterialUniform {
+	glm::vec4 kd;
+	glm::vec4 ksShininess;
+};
+
+// Uniform buffer binding points shared by every shader program.
+const GLuint FRAME_UNIFORMS_BINDING = 0;
+const GLuint MATERIAL_UNIFORMS_BINDING = 1;
+
+// Material table indices of a GeometryNode, in normal and in infrared mode.
+struct NodeMaterials {
+	unsigned int normal;
+	unsigned int infrared;
+};
+
+// Per-instance data streamed to InstancedVertexShader.vs, one entry per GeometryNode.
+struct InstanceData {
+	glm::mat4 model;
+	GLint materialIndex;
+	float texLayer;
+};
+
+// Directory the assets are loaded from, and the pack AssetCook builds out of it.
+const char * const ASSET_ROOT = "Assets";
+const char * const ASSET_PACK_FILE = "Assets.pack";
+
+// Paths traced per pixel of a poster unless --poster-samples says otherwise.
+const unsigned int DEFAULT_POSTER_SAMPLES = 16;
+
+// Command line switches, see Main.cpp.
+struct ProjectOptions {
+	ProjectOptions()
+		: bakeStatic(true),
+		  textureArray(true),
+		  packedVertices(true),
+		  bench(false),
+		  benchFrames(1000),
+		  seed((unsigned int)time(nullptr)),
+		  threads(0),
+		  crowdDensity(1),
+		  maxVoices(DEFAULT_MAX_VOICES),
+		  assetPack(ASSET_PACK_FILE),
+		  streamRadius(0),
+		  posterSamples(DEFAULT_POSTER_SAMPLES) { }
+
+	// Fold buildings and billboards into StaticGeometry instead of SceneNodes.
+	bool bakeStatic;
+
+	// Pack every texture into one GL_TEXTURE_2D_ARRAY so draws that differ only in
+	// texture can be merged.
+	bool textureArray;
+
+	// Upload mesh vertices as one interleaved PackedVertex stream instead of three
+	// float streams.
+	bool packedVertices;
+
+	// Fly a scripted camera path offscreen with vsync off for benchFrames frames,
+	// then report frame timings instead of running interactively.
+	bool bench;
+	unsigned int benchFrames;
+	// File the JSON report is also written to, if not empty.
+	std::string benchJson;
+
+	// Seeds the city layout streams and rand(), which drives the helicopter and crowd.
+	unsigned int seed;
+
+	// Threads generating the city, 0 for one per hardware thread.  The city only
+	// depends on the seed, never on this.
+	unsigned int threads;
+
+	// People placed per 200 unit ground cells, at most 200.
+	unsigned int crowdDensity;
+
+	// Sound emitters mixed as real irrKlang voices at once; the rest stay virtual.
+	unsigned int maxVoices;
+
+	// Pack the assets are read from, see AssetPack.  Loose files are read when it is
+	// empty or missing.
+	std::string assetPack;
+
+	// Snapshot the city is restored from when it matches the seed and options, and
+	// saved to otherwise.  Empty to always generate.
+	std::string citySnapshot;
+
+	// Blocks kept around the camera by a ChunkStreamer instead of generating the fixed
+	// 250x250 city up front, which lets the camera fly on forever.  0 to not stream.
+	unsigned int streamRadius;
+
+	// PNG the starting view is path traced into on the CPU, without a window or GL
+	// context, after which the program exits.  Empty to run interactively.
+	std::string posterFile;
+	unsigned int posterSamples;
+};
+
+// People closer than this to where the spotlight meets the ground get nervous.
+const float SPOTLIGHT_RADIUS = 4.0f;
+// The spotlight only meets the ground below this height; above, it lands on a rooftop
+// or a facade and nobody is lit.
+const float SPOTLIGHT_GROUND_HEIGHT = 2.0f;
+// Light every surface receives even outside the spotlight.
+const float AMBIENT_INTENSITY = 0.1f;
+
+// Size of a --poster image, and the diffuse bounces its paths take.
+const unsigned int POSTER_WIDTH = 1920;
+const unsigned int POSTER_HEIGHT = 1080;
+const unsigned int POSTER_BOUNCES = 3;
+
+// Frames rendered before benchmark samples count, and GL_TIME_ELAPSED queries in flight.
+const unsigned int BENCH_WARMUP_FRAMES = 10;
+const unsigned int BENCH_QUERY_COUNT = 4;
+
+// Bytes per baked static vertex: position, normal, uv and texture layer as floats.
+const size_t STATIC_VERTEX_STRIDE = 3 * sizeof(float) + 3 * sizeof(float) + 2 * sizeof(float) + sizeof(float);
+
+// Edge length, in texels, of every layer of the texture array.
+const int TEXTURE_ARRAY_SIZE = 512;
+
+// Bytes of decoded textures uploaded per frame while they load, though always at least
+// one texture, and the pixel buffer objects the uploads take turns in.
+const size_t TEXTURE_UPLOAD_BYTES_PER_FRAME = 1024 * 1024;
+const unsigned int TEXTURE_PBO_COUNT = 3;
+// Bytes of one RGB layer of the texture array, the size each pixel buffer starts at.
+const size_t TEXTURE_LAYER_BYTES = TEXTURE_ARRAY_SIZE * TEXTURE_ARRAY_SIZE * 3;
+// Nanoseconds to wait for GL to finish reading a pixel buffer before mapping it anyway.
+const GLuint64 TEXTURE_PBO_WAIT_NS = 1000000000;
+// Grey every texture shows until its image is uploaded.
+const unsigned char TEXTURE_PLACEHOLDER_GREY = 128;
+
+// Streamed blocks taken into the scene, and bytes of their baked vertices uploaded, at
+// most per frame, so flying into new blocks never stalls a frame for long.
+const unsigned int STREAM_BLOCKS_PER_FRAME = 1;
+const size_t STREAM_UPLOAD_BYTES_PER_FRAME = 1024 * 1024;
+
+// Buffers of a streamed block: positions, normals, uvs, texture layers, then indices.
+const unsigned int STREAMED_BUFFERS = 5;
+const unsigned int STREAMED_INDEX_BUFFER = 4;
+
+// One block of the streamed city, from when it leaves the ChunkStreamer until it is
+// evicted.
+struct StreamedBlock {
+	StreamedBlock()
+		: node(nullptr),
+		  vao(0),
+		  uploadedBytes(0),
+		  drawable(false)
+	{
+		for (unsigned int i = 0; i < STREAMED_BUFFERS; ++i) {
+			buffers[i] = 0;
+		}
+	}
+
+	// Owns the block's nodes, and its baked vertices until they are uploaded.
+	std::unique_ptr<CityBlockResult> result;
+	// The one child of the root that every node of the block hangs from.
+	SceneNode * node;
+	std::vector<unsigned int> agents;
+	std::vector<VoiceHandle> voices;
+	std::vector<StaticBatch> batches;
+	std::vector<unsigned int> batchMaterials;
+	GLuint vao;
+	GLuint buffers[STREAMED_BUFFERS];
+	// Bytes copied so far, through the buffers in order.
+	size_t uploadedBytes;
+	// Set once every byte is uploaded.
+	bool drawable;
+};
+
+// Instances sharing a mesh and a texture can be issued with a single instanced draw.
+// Indexed by Project::instanceGroup(mesh, textureIndex).
+typedef std::vector<std::vector<InstanceData>> InstanceGroups;
+
 
 class Project : public Window {
 public:
-	Project(const std::string & luaSceneFile);
+	Project(const std::string & luaSceneFile, const ProjectOptions & options = ProjectOptions());
 	virtual ~Project();
 
+	// Builds the scene and path traces options.posterFile without opening a window.
+	// Called instead of Window::launch().
+	void makePoster();
+
 protected:
 	virtual void init() override;
 	virtual void appLogic() override;
@@ -63,22 +274,75 @@ protected:
 	void processLuaSceneFile(const std::string & filename);
 	void createShaderProgram();
 	void enableVertexShaderInputSlots();
+	void enableInstancedInputSlots();
 	void uploadVertexDataToVbos(const MeshConsolidator & meshConsolidator);
 	void mapVboDataToVertexShaderInputLocations();
+	void setMeshAttribPointers(GLint positionLocation, GLint normalLocation, GLint texLocation);
 	void initViewMatrix();
 	void initLightSources();
-	void updateShaderUniforms(const ShaderProgram & shader, const GeometryNode & node, const glm::mat4 & viewMatrix);
+	void updateShaderUniforms(const GeometryNode & node, const glm::mat4 & modelMatrix, unsigned int materialIndex);
 	void initModels();
+	void initMaterials();
+	unsigned char * loadImage(const std::string & file, int & width, int & height, int & nChannels,
+			int desiredChannels) const;
+	void initTextures(const std::vector<std::string> & texturePaths);
+	void initTextureArray(const std::vector<std::string> & texturePaths);
+	void decodeTexture(size_t index, DecodedImage & image) const;
+	void uploadTextures();
+	void uploadTexture(size_t index, const DecodedImage & image);
+	void * mapTexturePbo(size_t bytes);
+	void fenceTexturePbo();
 	void initAudio();
+	void initSoundPaths();
 	void initPerspectiveMatrix();
 	void uploadCommonSceneUniforms();
+	void initMeshBounds(const MeshConsolidator & meshConsolidator);
+	void updateSceneCache(SceneNode &root);
+	void cullScene();
+	void resolveSceneMaterials();
+	void uploadMaterialTable();
 	void renderSceneGraph(SceneNode &node);
-	void traverse(SceneNode &curr);
-	void fillStreet(float startx, const float startz, int leftoverSpace, const char axis = 'x', const char facing = 'S');
-	void placePeople(int startx, int endx, int startz, int endz);
+	void drawGeometryNode(const GeometryNode &node, const glm::mat4 &modelMatrix, unsigned int materialIndex);
+	const GLvoid * meshIndexOffset(const BatchInfo & batchInfo) const;
+	void renderSceneGraphInstanced(SceneNode &node);
+	void collectInstances();
+	unsigned int numInstanceTextureSlots() const;
+	unsigned int instanceGroup(MeshHandle mesh, int textureIndex) const;
+	void setInstanceAttribOffset(size_t byteOffset);
+	CitySnapshotKey citySnapshotKey() const;
+	std::unique_ptr<MeshConsolidator> loadScene();
+	void buildScene(const MeshConsolidator & meshConsolidator);
+	bool openCitySnapshot();
+	void saveCitySnapshot();
+	void buildCity();
+	void generateCity();
+	void generateBlocks(int firstX, int firstZ, int blocksPerSide);
+	void generateCityBlock(int blockX, int blockZ, CityBlockResult & result) const;
+	void addBlockStreets(int blockX, int blockZ, CityBlockResult & result) const;
+	void createPersonNodes(CityBlockResult & result) const;
+	void startStreaming();
+	void streamCity(const glm::vec2 & camera, bool unbudgeted);
+	void activateStreamedBlock(std::unique_ptr<CityBlockResult> result, StreamedBlock & block);
+	size_t uploadStreamedBlock(StreamedBlock & block, size_t budget);
+	void evictStreamedBlock(StreamedBlock & block);
+	void renderStreamedGeometry();
+	void mergeCityBlock(CityBlockResult & result);
+	VoiceHandle playSound(int soundIndex, const glm::vec3 & position, float minDistance);
+	void fillStreet(CityRandom & random, CityBlockResult & result, float startx, const float startz, int leftoverSpace, const char axis = 'x', const char facing = 'S') const;
+	void placePeople(CityRandom & random, CityBlockResult & result, int startx, int endx, int startz, int endz) const;
+	void addStaticSubtree(SceneNode *node);
+	unsigned int addPerson(SceneNode *node, float x, float z, float heading, VoiceHandle audio = NO_VOICE, VoiceHandle panicAudio = NO_VOICE);
+	void uploadStaticGeometry();
+	void buildStaticBvh();
+	void renderStaticGeometry();
+	void simulate(const SimInput & input, SimSnapshot & snapshot, std::vector<unsigned int> & crowdMoved);
+	void initBenchFramebuffer();
+	void updateBenchCamera();
+	void collectGpuTiming(unsigned int query);
+	void reportBenchmark();
+	void renderPoster();
 
 	glm::mat4 m_perpsective;
-	glm::mat4 m_model;
 	glm::mat4 m_view;
 
 	SpotLight m_light;
@@ -88,27 +352,148 @@ protected:
 	GLuint m_vbo_vertexPositions;
 	GLuint m_vbo_vertexNormals;
 	GLuint m_vbo_vertexUVs;
+	GLuint m_vbo_vertexInterleaved;
+	// Bytes fetched per mesh vertex, for the vertex traffic statistics.
+	size_t m_meshVertexStride;
+	GLuint m_ibo_meshIndices;
+	GLenum m_meshIndexType;
+	size_t m_meshIndexSize;
 	GLint m_positionAttribLocation;
 	GLint m_normalAttribLocation;
 	GLint m_texAttribLocation;
+	GLint m_texLayerAttribLocation;
+	GLint m_modelUniformLocation;
+	GLint m_materialIndexUniformLocation;
 	ShaderProgram m_shader;
 
-	// BatchInfoMap is an associative container that maps a unique MeshId to a BatchInfo
-	// object. Each BatchInfo object contains an index offset and the number of indices
-	// required to render the mesh with identifier MeshId.
-	BatchInfoMap m_batchInfoMap;
+	//-- Uniform buffers shared by both shader programs:
+	UniformBuffer m_frameUniforms;
+	UniformBuffer m_materialUniforms;
+	MaterialTable m_materialTable;
+	unsigned int m_uploadedMaterialVersion;
+	// Material table indices by material handle, resolved the first time a node uses it.
+	std::vector<NodeMaterials> m_handleMaterials;
+
+	//-- GL resources for the instanced render path:
+	GLuint m_vao_instanced;
+	GLuint m_vbo_instanceData;
+	GLint m_instanceModelAttribLocation;
+	GLint m_instanceMaterialAttribLocation;
+	GLint m_instanceLayerAttribLocation;
+	ShaderProgram m_instancedShader;
+	InstanceGroups m_instanceGroups;
+	std::vector<InstanceData> m_instanceData;
+
+	// Index offset, number of indices and base vertex of every mesh, by mesh handle.
+	// Meshes that were not loaded have no indices.
+	std::vector<BatchInfo> m_meshBatches;
 
 	std::string m_luaSceneFile;
+	ProjectOptions m_options;
+
+	// Textures, meshes, sounds and the scene, when packed.  Outlives the sound engine.
+	AssetPack m_assets;
 
+	// Owns every node built at startup: the Lua scene, the city and its people.
+	SceneArena m_sceneArena;
+	// Freed with m_sceneArena, never deleted node by node.
 	std::shared_ptr<SceneNode> m_rootNode;
 
-	std::stack<glm::mat4> matStack;
-	bool isPerson, infraredMode, lookMode, freeMode, textureMode, wPressed, aPressed, sPressed, dPressed, ePressed, qPressed;
+	// Flattened scene with cached world transforms, refreshed once per frame.
+	SceneCache m_sceneCache;
+	// Parallel to m_sceneCache.geometryNodes(), resolved whenever the cache is rebuilt.
+	std::vector<NodeMaterials> m_geometryMaterials;
+
+	// Frustum culling of the scene and the static batches, refreshed once per frame.
+	CullingGrid m_cullingGrid;
+	// Positions within m_sceneCache.geometryNodes() that survived culling.
+	std::vector<unsigned int> m_visibleGeometry;
+	std::vector<unsigned int> m_visibleStaticBatches;
+
+	// Wall clock time and threads taken by generateBlocks().
+	double m_cityGenerationMs;
+	unsigned int m_cityGenerationThreads;
+	// Wall clock time taken to run Lua and build the city, or to restore it.
+	double m_cityBuildMs;
+	// The --city snapshot, open if it held this city.  Its baked vertices back
+	// m_staticGeometry.
+	CitySnapshot m_citySnapshot;
+
+	// Buildings and billboards pre-transformed into world space, when bakeStatic is set.
+	StaticGeometry m_staticGeometry;
+	// Over m_staticGeometry, for where the spotlight lands, and the time its build took.
+	TriangleBvh m_staticBvh;
+	double m_bvhBuildMs;
+	GLuint m_vao_staticData;
+	GLuint m_vbo_staticPositions;
+	GLuint m_vbo_staticNormals;
+	GLuint m_vbo_staticUVs;
+	GLuint m_vbo_staticLayers;
+	GLuint m_ibo_staticIndices;
+	std::vector<unsigned int> m_staticBatchMaterials;
+
+	// All textures as layers of one array texture, when textureArray is set.
+	GLuint m_textureArray;
+
+	// Every sound file, loaded once at startup.
+	AudioCache m_audioCache;
+
+	//-- Benchmark mode:
+	Benchmark m_benchmark;
+	GLuint m_benchFramebuffer;
+	GLuint m_benchColorBuffer;
+	GLuint m_benchDepthBuffer;
+	GLuint m_gpuTimerQueries[BENCH_QUERY_COUNT];
+	// Benchmark frame each query measured, 0 once its result has been collected.
+	unsigned int m_gpuQueryFrames[BENCH_QUERY_COUNT];
+	unsigned int m_drawCalls;
+	double m_vertexBytes;
+
+	bool infraredMode, instancedMode, cullingMode, lookMode, freeMode, textureMode, wPressed, aPressed, sPressed, dPressed, ePressed, qPressed;
+	// Simulation thread state, see simulate().
 	double yaw, pitch;
 	glm::vec3 velocity, camUp, camPos, m_dir, light_intersect, ground1, ground2, ground3, light_dir_model, light_pos_model;
 	std::vector<unsigned int> textures;
-	std::vector<Person *> people;
-	std::vector<Material> materials;
+	// Image files of textures, by texture index.
+	std::vector<std::string> m_texturePaths;
+	// Decodes m_texturePaths while the first frames already run.  Until its image is
+	// uploaded, a texture shows m_placeholderTexture or, in the array, a grey layer.
+	TextureLoader m_textureLoader;
+	GLuint m_placeholderTexture;
+	// A ring of pixel buffers allocated once, each fenced off from reuse until GL has
+	// read the last texture copied through it.
+	GLuint m_texturePbos[TEXTURE_PBO_COUNT];
+	size_t m_texturePboBytes[TEXTURE_PBO_COUNT];
+	GLsync m_texturePboFences[TEXTURE_PBO_COUNT];
+	unsigned int m_nextTexturePbo;
+	Benchmark::Clock::time_point m_textureLoadStart;
+	// Wall clock time from init() until the last texture was uploaded.
+	double m_textureLoadMs;
+	// Every looping 3D sound, of which only the nearest play.
+	VoiceManager m_voices;
+	Crowd m_crowd;
+	std::vector<MaterialHandle> materials;
 	std::vector<std::string> soundPaths;
 	ISound *background;
+
+	//-- Streamed city, when streamRadius is set:
+	// Copied by every block generation job: knows the source meshes, has baked nothing.
+	StaticGeometry m_blockGeometry;
+	MaterialHandle m_groundMaterial;
+	MaterialHandle m_roadMaterial;
+	std::map<ChunkKey, std::unique_ptr<StreamedBlock>> m_streamedBlocks;
+	std::vector<ChunkKey> m_evictedBlocks;
+	double m_streamedBytes;
+	// The resident blocks' BVHs, which simulate() casts the spotlight against too.  Only
+	// changed within m_simulation.edit().
+	std::vector<const TriangleBvh *> m_streamedBvhs;
+	// Generates blocks from the members above; declared after them, so it stops first.
+	ChunkStreamer m_streamer;
+
+	// Ticks simulate(); declared after everything it touches, so it stops first.
+	Simulation m_simulation;
+	// The two latest ticks, interpolated between every frame.
+	SimSnapshot m_previousSnapshot;
+	SimSnapshot m_currentSnapshot;
+	std::vector<unsigned int> m_crowdMoved;
 };
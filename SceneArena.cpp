@@ -0,0 +1,111 @@
+#include "SceneArena.hpp"
+
+#include <algorithm>
+#include <new>
+using namespace std;
+
+namespace {
+
+// Large enough for a few hundred nodes, so a building rarely spans two chunks.
+const size_t CHUNK_SIZE = 64 * 1024;
+const size_t ALIGNMENT = 16;
+
+thread_local SceneArena * currentArena = nullptr;
+
+} // namespace
+
+//---------------------------------------------------------------------------------------
+SceneArena::SceneArena()
+	: m_cursor(nullptr),
+	  m_end(nullptr),
+	  m_bytesAllocated(0)
+{
+
+}
+
+//---------------------------------------------------------------------------------------
+SceneArena::~SceneArena() {
+	release();
+}
+
+//---------------------------------------------------------------------------------------
+void * SceneArena::allocate(size_t bytes) {
+	bytes = (bytes + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+	if (bytes > (size_t)(m_end - m_cursor)) {
+		// ::operator new aligns for any fundamental type, which covers ALIGNMENT.
+		size_t chunkSize = std::max(bytes, CHUNK_SIZE);
+		char * chunk = static_cast<char *>(::operator new(chunkSize));
+		m_chunks.push_back(chunk);
+		m_cursor = chunk;
+		m_end = chunk + chunkSize;
+	}
+	void * allocation = m_cursor;
+	m_cursor += bytes;
+	m_bytesAllocated += bytes;
+	return allocation;
+}
+
+//---------------------------------------------------------------------------------------
+void SceneArena::release() {
+	for (char * chunk : m_chunks) {
+		::operator delete(chunk);
+	}
+	m_chunks.clear();
+	m_cursor = nullptr;
+	m_end = nullptr;
+	m_bytesAllocated = 0;
+}
+
+//---------------------------------------------------------------------------------------
+void SceneArena::rewind() {
+	if (m_chunks.empty()) {
+		return;
+	}
+	for (size_t i = 1; i < m_chunks.size(); ++i) {
+		::operator delete(m_chunks[i]);
+	}
+	m_chunks.resize(1);
+	// The first chunk holds at least CHUNK_SIZE bytes, whatever it was made for.
+	m_cursor = m_chunks[0];
+	m_end = m_chunks[0] + CHUNK_SIZE;
+	m_bytesAllocated = 0;
+}
+
+//---------------------------------------------------------------------------------------
+// Allocation continues in this arena's own last chunk; other's is left as it is.
+void SceneArena::adopt(SceneArena & other) {
+	if (m_chunks.empty()) {
+		m_cursor = other.m_cursor;
+		m_end = other.m_end;
+		m_chunks.swap(other.m_chunks);
+	} else {
+		m_chunks.insert(m_chunks.begin(), other.m_chunks.begin(), other.m_chunks.end());
+		other.m_chunks.clear();
+	}
+	m_bytesAllocated += other.m_bytesAllocated;
+	other.m_cursor = nullptr;
+	other.m_end = nullptr;
+	other.m_bytesAllocated = 0;
+}
+
+//---------------------------------------------------------------------------------------
+size_t SceneArena::bytesAllocated() const {
+	return m_bytesAllocated;
+}
+
+//---------------------------------------------------------------------------------------
+SceneArena * SceneArena::current() {
+	return currentArena;
+}
+
+//---------------------------------------------------------------------------------------
+SceneArena::Scope::Scope(SceneArena & arena)
+	: m_previous(currentArena)
+{
+	currentArena = &arena;
+}
+
+//---------------------------------------------------------------------------------------
+SceneArena::Scope::~Scope() {
+	currentArena = m_previous;
+}
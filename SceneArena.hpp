@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/*
+ * Bump allocator for scene nodes.  Nodes built together land next to each other,
+ * and a whole scene is freed at once by release() instead of node by node.
+ *
+ * SceneNode's operator new allocates from the calling thread's current arena, set
+ * with a SceneArena::Scope, and falls back to the heap when there is none.
+ */
+class SceneArena {
+public:
+	SceneArena();
+
+	// Releases everything still allocated.
+	~SceneArena();
+
+	// 16 byte aligned, never nullptr.
+	void * allocate(size_t bytes);
+
+	// Frees every allocation at once without running destructors.  Nothing allocated
+	// from this arena may be used afterwards.
+	void release();
+
+	// Like release(), but keeps the first chunk to allocate from again, for an arena
+	// that holds one short lived scene after another.
+	void rewind();
+
+	// Takes over everything other has allocated, leaving other empty.
+	void adopt(SceneArena & other);
+
+	size_t bytesAllocated() const;
+
+	// The calling thread's current arena, nullptr if none.
+	static SceneArena * current();
+
+	// Makes an arena the calling thread's current one for the lifetime of the Scope.
+	class Scope {
+	public:
+		explicit Scope(SceneArena & arena);
+		~Scope();
+
+	private:
+		Scope(const Scope &) = delete;
+		Scope & operator = (const Scope &) = delete;
+
+		SceneArena * m_previous;
+	};
+
+private:
+	SceneArena(const SceneArena &) = delete;
+	SceneArena & operator = (const SceneArena &) = delete;
+
+	std::vector<char *> m_chunks;
+	char * m_cursor;
+	char * m_end;
+	size_t m_bytesAllocated;
+};
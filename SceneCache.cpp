@@ -0,0 +1,287 @@
+#include "SceneCache.hpp"
+#include "GeometryNode.hpp"
+
+#include <algorithm>
+#include <functional>
+using namespace std;
+using namespace glm;
+
+//---------------------------------------------------------------------------------------
+SceneCache::SceneCache()
+	: m_root(nullptr),
+	  m_structureVersion(0),
+	  m_numRecomputed(0),
+	  m_patched(false)
+{
+
+}
+
+//---------------------------------------------------------------------------------------
+void SceneCache::setMeshBounds(const std::vector<AABB> & meshBounds) {
+	m_meshBounds = meshBounds;
+}
+
+//---------------------------------------------------------------------------------------
+bool SceneCache::update(SceneNode & root) {
+	if (&root != m_root || SceneNode::structureVersion != m_structureVersion) {
+		rebuild(root);
+		return true;
+	}
+
+	bool patched = m_patched;
+	m_patched = false;
+	m_numRecomputed = 0;
+	m_movedChildren.clear();
+	if (SceneNode::dirtyNodes.empty()) {
+		return patched;
+	}
+
+	m_dirtyIndices.clear();
+	for (SceneNode * node : SceneNode::dirtyNodes) {
+		node->m_dirty = false;
+		// Nodes detached since the last rebuild may still carry a stale index.
+		int index = node->m_flatIndex;
+		if (index >= 0 && index < (int)m_nodes.size() && m_nodes[index].node == node) {
+			m_dirtyIndices.push_back(index);
+		}
+	}
+	SceneNode::dirtyNodes.clear();
+
+	// Sorted depth-first indices let a dirty ancestor's range swallow its dirty descendants.
+	sort(m_dirtyIndices.begin(), m_dirtyIndices.end());
+	unsigned int covered = 0;
+	m_staleAncestors.clear();
+	for (unsigned int index : m_dirtyIndices) {
+		if (index < covered) {
+			continue;
+		}
+		covered = m_nodes[index].end;
+		recompute(index, covered);
+		unsigned int child = index;
+		for (int parent = m_nodes[index].parent; parent >= 0; parent = m_nodes[parent].parent) {
+			m_staleAncestors.push_back(parent);
+			if (parent > 0) {
+				child = parent;
+			}
+		}
+		if (index == 0) {
+			// The root moved everything.
+			for (child = 1; child < m_nodes[0].end; child = m_nodes[child].end) {
+				m_movedChildren.push_back(child);
+			}
+		} else if (m_movedChildren.empty() || m_movedChildren.back() != child) {
+			m_movedChildren.push_back(child);
+		}
+	}
+	refitAncestors();
+	return patched;
+}
+
+//---------------------------------------------------------------------------------------
+// True if the only structural change since the cache was last brought up to date is
+// the one the caller is patching, so the arrays still match the rest of the tree.
+bool SceneCache::isPatchable() const {
+	return m_root && SceneNode::structureVersion == m_structureVersion + 1;
+}
+
+//---------------------------------------------------------------------------------------
+bool SceneCache::isFlattened(const SceneNode & node) const {
+	int index = node.m_flatIndex;
+	return index >= 0 && index < (int)m_nodes.size() && m_nodes[index].node == &node;
+}
+
+//---------------------------------------------------------------------------------------
+void SceneCache::refitParents(int parent) {
+	m_staleAncestors.clear();
+	for (; parent >= 0; parent = m_nodes[parent].parent) {
+		m_staleAncestors.push_back(parent);
+	}
+	refitAncestors();
+}
+
+//---------------------------------------------------------------------------------------
+void SceneCache::attach(SceneNode & node) {
+	if (!isPatchable() || !node.parent || !isFlattened(*node.parent)) {
+		return;
+	}
+	int parent = node.parent->m_flatIndex;
+	unsigned int begin = m_nodes.size();
+	if (m_nodes[parent].end != begin) {
+		return;
+	}
+
+	flatten(node, parent, m_nodes[parent].isPerson);
+	unsigned int end = m_nodes.size();
+	// The parent's subtree ends the arrays, so every ancestor's does too.
+	for (int ancestor = parent; ancestor >= 0; ancestor = m_nodes[ancestor].parent) {
+		m_nodes[ancestor].end = end;
+	}
+	m_world.resize(end);
+	m_bounds.resize(end);
+	m_meshBounds.resize(SceneRegistry::numMeshes());
+	recompute(begin, end);
+	refitParents(parent);
+
+	++m_structureVersion;
+	m_patched = true;
+}
+
+//---------------------------------------------------------------------------------------
+void SceneCache::detach(SceneNode & node) {
+	if (!isPatchable() || node.parent || !isFlattened(node)) {
+		return;
+	}
+	unsigned int begin = node.m_flatIndex;
+	unsigned int end = m_nodes[begin].end;
+	unsigned int count = end - begin;
+	int parent = m_nodes[begin].parent;
+	for (unsigned int i = begin; i < end; ++i) {
+		m_nodes[i].node->m_flatIndex = -1;
+	}
+
+	m_nodes.erase(m_nodes.begin() + begin, m_nodes.begin() + end);
+	m_world.erase(m_world.begin() + begin, m_world.begin() + end);
+	m_bounds.erase(m_bounds.begin() + begin, m_bounds.begin() + end);
+	for (unsigned int i = begin; i < m_nodes.size(); ++i) {
+		FlatNode & flatNode = m_nodes[i];
+		// Parents before begin are ancestors of the detached node or precede it.
+		if (flatNode.parent >= (int)end) {
+			flatNode.parent -= count;
+		}
+		flatNode.end -= count;
+		flatNode.node->m_flatIndex = i;
+	}
+	for (int ancestor = parent; ancestor >= 0; ancestor = m_nodes[ancestor].parent) {
+		m_nodes[ancestor].end -= count;
+	}
+
+	// Geometry nodes are in traversal order, so the detached ones form one run.
+	auto first = lower_bound(m_geometryNodes.begin(), m_geometryNodes.end(), begin);
+	auto last = lower_bound(first, m_geometryNodes.end(), end);
+	for (auto it = last; it != m_geometryNodes.end(); ++it) {
+		*it -= count;
+	}
+	m_geometryNodes.erase(first, last);
+	refitParents(parent);
+
+	++m_structureVersion;
+	m_patched = true;
+}
+
+//---------------------------------------------------------------------------------------
+void SceneCache::rebuild(SceneNode & root) {
+	m_nodes.clear();
+	m_geometryNodes.clear();
+
+	flatten(root, -1, false);
+	m_world.resize(m_nodes.size());
+	m_bounds.resize(m_nodes.size());
+	// Covers every handle the flattened nodes can hold, so refit() needs no range check.
+	m_meshBounds.resize(SceneRegistry::numMeshes());
+
+	for (SceneNode * node : SceneNode::dirtyNodes) {
+		node->m_dirty = false;
+	}
+	SceneNode::dirtyNodes.clear();
+
+	m_numRecomputed = 0;
+	m_movedChildren.clear();
+	m_patched = false;
+	recompute(0, m_nodes.size());
+
+	m_root = &root;
+	m_structureVersion = SceneNode::structureVersion;
+}
+
+//---------------------------------------------------------------------------------------
+void SceneCache::flatten(SceneNode & node, int parent, bool isPerson) {
+	//person flag for infraredMode
+	static const NodeName torso("torso");
+	isPerson = isPerson || node.m_name == torso;
+
+	unsigned int index = m_nodes.size();
+	node.m_flatIndex = index;
+	m_nodes.push_back(FlatNode{&node, parent, 0, isPerson});
+	if (node.m_nodeType == NodeType::GeometryNode) {
+		m_geometryNodes.push_back(index);
+	}
+
+	for (SceneNode * child : node.children) {
+		flatten(*child, index, isPerson);
+	}
+	m_nodes[index].end = m_nodes.size();
+}
+
+//---------------------------------------------------------------------------------------
+// Parents precede their children, so a single forward pass suffices for transforms
+// and a single backward pass for bounds.
+void SceneCache::recompute(unsigned int begin, unsigned int end) {
+	for (unsigned int i = begin; i < end; ++i) {
+		const FlatNode & flatNode = m_nodes[i];
+		if (flatNode.parent < 0) {
+			m_world[i] = flatNode.node->get_transform();
+		} else {
+			m_world[i] = m_world[flatNode.parent] * flatNode.node->get_transform();
+		}
+	}
+	for (unsigned int i = end; i-- > begin; ) {
+		refit(i);
+	}
+	m_numRecomputed += end - begin;
+}
+
+//---------------------------------------------------------------------------------------
+// Rebuilds a node's subtree bounds from its own mesh and its children's bounds.
+void SceneCache::refit(unsigned int index) {
+	const FlatNode & flatNode = m_nodes[index];
+	AABB bounds;
+	if (flatNode.node->m_nodeType == NodeType::GeometryNode) {
+		const GeometryNode & geometryNode = static_cast<const GeometryNode &>(*flatNode.node);
+		bounds = transformAABB(m_meshBounds[geometryNode.mesh], m_world[index]);
+	}
+	for (unsigned int child = index + 1; child < flatNode.end; child = m_nodes[child].end) {
+		bounds.expand(m_bounds[child]);
+	}
+	m_bounds[index] = bounds;
+}
+
+//---------------------------------------------------------------------------------------
+// Ancestors follow their descendants in descending index order, so each is refitted
+// once, after all of its recomputed children.
+void SceneCache::refitAncestors() {
+	sort(m_staleAncestors.begin(), m_staleAncestors.end(), greater<unsigned int>());
+	m_staleAncestors.erase(unique(m_staleAncestors.begin(), m_staleAncestors.end()), m_staleAncestors.end());
+	for (unsigned int index : m_staleAncestors) {
+		refit(index);
+	}
+}
+
+//---------------------------------------------------------------------------------------
+const std::vector<FlatNode> & SceneCache::nodes() const {
+	return m_nodes;
+}
+
+//---------------------------------------------------------------------------------------
+const std::vector<glm::mat4> & SceneCache::worldTransforms() const {
+	return m_world;
+}
+
+//---------------------------------------------------------------------------------------
+const std::vector<AABB> & SceneCache::worldBounds() const {
+	return m_bounds;
+}
+
+//---------------------------------------------------------------------------------------
+const std::vector<unsigned int> & SceneCache::geometryNodes() const {
+	return m_geometryNodes;
+}
+
+//---------------------------------------------------------------------------------------
+unsigned int SceneCache::numRecomputed() const {
+	return m_numRecomputed;
+}
+
+//---------------------------------------------------------------------------------------
+const std::vector<unsigned int> & SceneCache::movedChildren() const {
+	return m_movedChildren;
+}
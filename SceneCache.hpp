@@ -0,0 +1,86 @@
+#pragma once
+
+#include "SceneNode.hpp"
+#include "AABB.hpp"
+
+#include <glm/glm.hpp>
+#include <vector>
+
+// One SceneNode in depth-first order. A node's subtree occupies the entries
+// [its own index, end).
+struct FlatNode {
+	SceneNode *node;
+	int parent;
+	unsigned int end;
+	// True for nodes below a Person's "torso", used by infrared mode.
+	bool isPerson;
+};
+
+/*
+ * Flattens a SceneNode tree into contiguous arrays and caches every node's world
+ * transform. After the first update only subtrees whose transforms were touched
+ * through SceneNode::markDirty() are recomputed.  Each node also carries the
+ * world-space bounds of its whole subtree, refitted along with its transform.
+ */
+class SceneCache {
+public:
+	SceneCache();
+
+	// Model-space bounds of every mesh, indexed by mesh handle.  Set before the first
+	// update().  Meshes past the end have empty bounds.
+	void setMeshBounds(const std::vector<AABB> & meshBounds);
+
+	// Returns true if the arrays were rebuilt or patched by attach() or detach() since
+	// the last call, which invalidates flat indices.
+	bool update(SceneNode & root);
+
+	// Flattens node right after it was added as the last child of a flattened node
+	// whose subtree ends the arrays, such as the root, without rebuilding the rest.
+	// Anything else leaves the cache to be rebuilt by the next update().
+	void attach(SceneNode & node);
+
+	// Drops node's subtree right after it was removed from its flattened parent,
+	// shifting the nodes behind it into place instead of rebuilding.
+	void detach(SceneNode & node);
+
+	const std::vector<FlatNode> & nodes() const;
+
+	const std::vector<glm::mat4> & worldTransforms() const;
+
+	// World-space bounds of each node's subtree, parallel to nodes().
+	const std::vector<AABB> & worldBounds() const;
+
+	// Flat indices of every GeometryNode, in traversal order.
+	const std::vector<unsigned int> & geometryNodes() const;
+
+	// Number of world transforms recomputed by the last call to update().
+	unsigned int numRecomputed() const;
+
+	// Flat indices of the root's children whose subtrees the last call to update()
+	// recomputed without rebuilding, in traversal order.
+	const std::vector<unsigned int> & movedChildren() const;
+
+private:
+	void rebuild(SceneNode & root);
+	bool isPatchable() const;
+	bool isFlattened(const SceneNode & node) const;
+	void refitParents(int parent);
+	void flatten(SceneNode & node, int parent, bool isPerson);
+	void recompute(unsigned int begin, unsigned int end);
+	void refit(unsigned int index);
+	void refitAncestors();
+
+	std::vector<FlatNode> m_nodes;
+	std::vector<glm::mat4> m_world;
+	std::vector<AABB> m_bounds;
+	std::vector<AABB> m_meshBounds;
+	std::vector<unsigned int> m_geometryNodes;
+	std::vector<unsigned int> m_dirtyIndices;
+	std::vector<unsigned int> m_staleAncestors;
+	std::vector<unsigned int> m_movedChildren;
+
+	SceneNode *m_root;
+	unsigned int m_structureVersion;
+	unsigned int m_numRecomputed;
+	bool m_patched;
+};
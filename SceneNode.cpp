@@ -1,10 +1,13 @@
 //  
 
 #include "SceneNode.hpp"
+#include "SceneArena.hpp"
 
 #include "framework/MathUtils.hpp"
 
+#include <algorithm>
 #include <iostream>
+#include <iterator>
 #include <sstream>
 using namespace std;
 
@@ -14,17 +17,33 @@ using namespace std;
 using namespace glm;
 
 
+namespace {
+
+// Every node is preceded by this many bytes recording where it was allocated, which
+// keeps the node itself 16 byte aligned.
+const size_t ALLOCATION_HEADER = 16;
+const unsigned char ALLOCATED_ON_HEAP = 0;
+const unsigned char ALLOCATED_IN_ARENA = 1;
+
+} // namespace
+
 // Static class variable
-unsigned int SceneNode::nodeInstanceCount = 0;
+std::atomic<unsigned int> SceneNode::nodeInstanceCount(0);
+std::vector<SceneNode*> SceneNode::dirtyNodes;
+std::atomic<unsigned int> SceneNode::structureVersion(0);
 
 
 //---------------------------------------------------------------------------------------
-SceneNode::SceneNode(const std::string& name)
-  : m_name(name),
+SceneNode::SceneNode(const NodeName & name)
+  : trans(mat4()),
+	parent(nullptr),
+	nextSibling(nullptr),
 	m_nodeType(NodeType::SceneNode),
-	trans(mat4()),
+	m_name(name),
+	m_nodeId(nodeInstanceCount++),
 	textureIndex(-1),
-	m_nodeId(nodeInstanceCount++)
+	m_flatIndex(-1),
+	m_dirty(false)
 {
 
 }
@@ -32,28 +51,68 @@ SceneNode::SceneNode(const std::string& name)
 //---------------------------------------------------------------------------------------
 // Deep copy
 SceneNode::SceneNode(const SceneNode & other)
-	: m_nodeType(other.m_nodeType),
+	: trans(other.trans),
+	  parent(nullptr),
+	  nextSibling(nullptr),
+	  m_nodeType(other.m_nodeType),
 	  m_name(other.m_name),
-	  trans(other.trans),
-	  invtrans(other.invtrans),
-	  m_nodeId(other.m_nodeId)
+	  m_nodeId(other.m_nodeId),
+	  textureIndex(other.textureIndex),
+	  m_flatIndex(-1),
+	  m_dirty(false)
 {
 	for(SceneNode * child : other.children) {
-		this->children.push_front(new SceneNode(*child));
+		SceneNode * copy = new SceneNode(*child);
+		copy->parent = this;
+		this->children.push_front(copy);
 	}
 }
 
 //---------------------------------------------------------------------------------------
 SceneNode::~SceneNode() {
-	for(SceneNode * child : children) {
+	// Step past each child before deleting it, its nextSibling goes with it.
+	for (ChildList::iterator it = children.begin(); it != children.end(); ) {
+		SceneNode * child = *it;
+		++it;
 		delete child;
 	}
+	if (m_dirty) {
+		// Freshly built subtrees are the usual victims, and they sit at the back.
+		auto it = std::find(dirtyNodes.rbegin(), dirtyNodes.rend(), this);
+		if (it != dirtyNodes.rend()) {
+			dirtyNodes.erase(std::next(it).base());
+		}
+	}
+	if (m_flatIndex >= 0) {
+		++structureVersion;
+	}
+}
+
+//---------------------------------------------------------------------------------------
+void * SceneNode::operator new(size_t size) {
+	SceneArena * arena = SceneArena::current();
+	unsigned char * block = static_cast<unsigned char *>(arena
+			? arena->allocate(size + ALLOCATION_HEADER)
+			: ::operator new(size + ALLOCATION_HEADER));
+	block[0] = arena ? ALLOCATED_IN_ARENA : ALLOCATED_ON_HEAP;
+	return block + ALLOCATION_HEADER;
+}
+
+//---------------------------------------------------------------------------------------
+void SceneNode::operator delete(void * pointer) {
+	if (!pointer) {
+		return;
+	}
+	unsigned char * block = static_cast<unsigned char *>(pointer) - ALLOCATION_HEADER;
+	if (block[0] == ALLOCATED_ON_HEAP) {
+		::operator delete(block);
+	}
 }
 
 //---------------------------------------------------------------------------------------
 void SceneNode::set_transform(const glm::mat4& m) {
 	trans = m;
-	invtrans = m;
+	markDirty();
 }
 
 //---------------------------------------------------------------------------------------
@@ -62,18 +121,26 @@ const glm::mat4& SceneNode::get_transform() const {
 }
 
 //---------------------------------------------------------------------------------------
-const glm::mat4& SceneNode::get_inverse() const {
-	return invtrans;
+glm::mat4 SceneNode::get_inverse() const {
+	return inverse(trans);
 }
 
 //---------------------------------------------------------------------------------------
 void SceneNode::add_child(SceneNode* child) {
 	children.push_back(child);
+	child->parent = this;
+	if (m_flatIndex >= 0) {
+		++structureVersion;
+	}
 }
 
 //---------------------------------------------------------------------------------------
 void SceneNode::remove_child(SceneNode* child) {
 	children.remove(child);
+	child->parent = nullptr;
+	if (m_flatIndex >= 0) {
+		++structureVersion;
+	}
 }
 
 //---------------------------------------------------------------------------------------
@@ -94,18 +161,71 @@ void SceneNode::rotate(char axis, float angle) {
 	}
 	mat4 rot_matrix = glm::rotate(degreesToRadians(angle), rot_axis);
 	trans = rot_matrix * trans;
+	markDirty();
 }
 
 //---------------------------------------------------------------------------------------
 void SceneNode::scale(const glm::vec3 & amount) {
 	trans = glm::scale(amount) * trans;
+	markDirty();
 }
 
 //---------------------------------------------------------------------------------------
 void SceneNode::translate(const glm::vec3& amount) {
 	trans = glm::translate(amount) * trans;
+	markDirty();
 }
 
+//---------------------------------------------------------------------------------------
+void SceneNode::markDirty() {
+	if (!m_dirty && m_flatIndex >= 0) {
+		m_dirty = true;
+		dirtyNodes.push_back(this);
+	}
+}
+
+
+//---------------------------------------------------------------------------------------
+void ChildList::push_back(SceneNode * child) {
+	child->nextSibling = nullptr;
+	if (m_last) {
+		m_last->nextSibling = child;
+	} else {
+		m_first = child;
+	}
+	m_last = child;
+	++m_size;
+}
+
+//---------------------------------------------------------------------------------------
+void ChildList::push_front(SceneNode * child) {
+	child->nextSibling = m_first;
+	m_first = child;
+	if (!m_last) {
+		m_last = child;
+	}
+	++m_size;
+}
+
+//---------------------------------------------------------------------------------------
+// Removes every occurrence of child, like std::list::remove.
+void ChildList::remove(SceneNode * child) {
+	SceneNode * previous = nullptr;
+	for (SceneNode * node = m_first; node; ) {
+		SceneNode * next = node->nextSibling;
+		if (node == child) {
+			(previous ? previous->nextSibling : m_first) = next;
+			if (m_last == node) {
+				m_last = previous;
+			}
+			node->nextSibling = nullptr;
+			--m_size;
+		} else {
+			previous = node;
+		}
+		node = next;
+	}
+}
 
 //---------------------------------------------------------------------------------------
 int SceneNode::totalSceneNodes() const {
@@ -3,11 +3,14 @@
 #pragma once
 
 #include "Material.hpp"
+#include "NodeName.hpp"
 
 #include <glm/glm.hpp>
 
-#include <list>
+#include <atomic>
+#include <cstddef>
 #include <string>
+#include <vector>
 #include <iostream>
 
 enum class NodeType {
@@ -15,18 +18,68 @@ enum class NodeType {
 	GeometryNode,
 };
 
+class SceneNode;
+
+/*
+ * A node's children, linked through SceneNode::nextSibling so adding a child never
+ * allocates.  Iterates like the std::list<SceneNode*> it replaced.
+ */
+class ChildList {
+public:
+	class iterator {
+	public:
+		explicit iterator(SceneNode * node) : m_node(node) { }
+		SceneNode * operator * () const { return m_node; }
+		iterator & operator ++ ();
+		iterator operator ++ (int) { iterator previous = *this; ++*this; return previous; }
+		bool operator == (const iterator & other) const { return m_node == other.m_node; }
+		bool operator != (const iterator & other) const { return m_node != other.m_node; }
+
+	private:
+		SceneNode * m_node;
+	};
+
+	ChildList() : m_first(nullptr), m_last(nullptr), m_size(0) { }
+
+	iterator begin() const { return iterator(m_first); }
+	iterator end() const { return iterator(nullptr); }
+	size_t size() const { return m_size; }
+	bool empty() const { return m_size == 0; }
+
+	void push_back(SceneNode * child);
+	void push_front(SceneNode * child);
+	void remove(SceneNode * child);
+
+private:
+	ChildList(const ChildList &) = delete;
+	ChildList & operator = (const ChildList &) = delete;
+
+	SceneNode * m_first;
+	SceneNode * m_last;
+	unsigned int m_size;
+};
+
+/*
+ * Nodes hold no owning std containers, so a scene built inside a SceneArena can be
+ * dropped with SceneArena::release() without visiting any node.
+ */
 class SceneNode {
 public:
-    SceneNode(const std::string & name);
+    SceneNode(const NodeName & name);
 
 	SceneNode(const SceneNode & other);
 
     virtual ~SceneNode();
+
+	// Allocates from SceneArena::current() if set, from the heap otherwise.  Deleting
+	// an arena node runs its destructor; the memory returns with the arena.
+	static void * operator new(size_t size);
+	static void operator delete(void * pointer);
     
 	int totalSceneNodes() const;
     
     const glm::mat4& get_transform() const;
-    const glm::mat4& get_inverse() const;
+    glm::mat4 get_inverse() const;
     
     void set_transform(const glm::mat4& m);
     
@@ -39,21 +92,46 @@ public:
     void scale(const glm::vec3& amount);
     void translate(const glm::vec3& amount);
 
+    // Flags this node's subtree for world transform recomputation by SceneCache.
+    // Nodes that were never flattened are skipped, so subtrees may be built on
+    // worker threads as long as they are not yet attached to a cached tree.
+    void markDirty();
+
 
 	friend std::ostream & operator << (std::ostream & os, const SceneNode & node);
     
     // Transformations
     glm::mat4 trans;
-    glm::mat4 invtrans;
     
-    std::list<SceneNode*> children;
+    ChildList children;
+    SceneNode *parent;
+    // Next child of parent, see ChildList.
+    SceneNode *nextSibling;
 
 	NodeType m_nodeType;
-	std::string m_name;
+	NodeName m_name;
 	unsigned int m_nodeId;
 	int textureIndex;
 
+	// Position of this node within SceneCache's flattened arrays, -1 if not flattened.
+	int m_flatIndex;
+	bool m_dirty;
+
+	// Nodes whose local transform changed since the last SceneCache::update().
+	static std::vector<SceneNode*> dirtyNodes;
+
+	// Bumped whenever a child is added to or removed from a flattened node, or a
+	// flattened node is destroyed.  Subtrees built elsewhere, such as on worker
+	// threads, leave it alone until they are attached.
+	static std::atomic<unsigned int> structureVersion;
+
 private:
 	// The number of SceneNode instances.
-	static unsigned int nodeInstanceCount;
+	static std::atomic<unsigned int> nodeInstanceCount;
 };
+
+//---------------------------------------------------------------------------------------
+inline ChildList::iterator & ChildList::iterator::operator ++ () {
+	m_node = m_node->nextSibling;
+	return *this;
+}
@@ -0,0 +1,151 @@
+#include "SceneRegistry.hpp"
+#include "NodeName.hpp"
+
+#include "framework/Exception.hpp"
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <tuple>
+#include <unordered_map>
+using namespace std;
+
+namespace {
+
+// Materials live in fixed blocks that are allocated on demand and never move, so a
+// reader can index them while another thread registers more.
+const unsigned int MATERIAL_BLOCK_SIZE = 256;
+const unsigned int NUM_MATERIAL_BLOCKS = MAX_MATERIAL_HANDLES / MATERIAL_BLOCK_SIZE;
+
+typedef tuple<float, float, float, float, float, float, float, float> MaterialKey;
+
+MaterialKey materialKey(const Material & material) {
+	return MaterialKey(material.kd.x, material.kd.y, material.kd.z, material.kd.w,
+			material.ks.x, material.ks.y, material.ks.z, material.shininess);
+}
+
+struct Registry {
+	Registry();
+
+	mutex registerMutex;
+
+	unordered_map<string, MeshHandle> meshHandles;
+	NodeName meshIds[MAX_MESH_HANDLES];
+	atomic<unsigned int> numMeshes;
+
+	map<MaterialKey, MaterialHandle> materialHandles;
+	Material * materialBlocks[NUM_MATERIAL_BLOCKS];
+	atomic<unsigned int> numMaterials;
+};
+
+//---------------------------------------------------------------------------------------
+Registry::Registry()
+	: numMeshes(0),
+	  numMaterials(0)
+{
+	for (Material * & block : materialBlocks) {
+		block = nullptr;
+	}
+	materialBlocks[0] = new Material[MATERIAL_BLOCK_SIZE];
+	materialHandles[materialKey(Material())] = DEFAULT_MATERIAL;
+	numMaterials = DEFAULT_MATERIAL + 1;
+}
+
+//---------------------------------------------------------------------------------------
+// Never destroyed, so handles stay valid while static destructors run.
+Registry & registry() {
+	static Registry * instance = new Registry();
+	return *instance;
+}
+
+//---------------------------------------------------------------------------------------
+void throwRegistryFull(const char * what, unsigned int capacity) {
+	stringstream errorMessage;
+	errorMessage << "Error within SceneRegistry: more than " << capacity << " distinct "
+		<< what << "\n";
+	throw Exception(errorMessage.str());
+}
+
+} // namespace
+
+//---------------------------------------------------------------------------------------
+MeshHandle SceneRegistry::meshHandle (
+		const std::string & meshId
+) {
+	Registry & r = registry();
+	lock_guard<mutex> lock(r.registerMutex);
+	auto it = r.meshHandles.find(meshId);
+	if (it != r.meshHandles.end()) {
+		return it->second;
+	}
+
+	unsigned int handle = r.numMeshes;
+	if (handle == MAX_MESH_HANDLES) {
+		throwRegistryFull("mesh ids", MAX_MESH_HANDLES);
+	}
+	r.meshIds[handle] = NodeName(meshId);
+	r.meshHandles[meshId] = handle;
+	r.numMeshes = handle + 1;
+	return handle;
+}
+
+//---------------------------------------------------------------------------------------
+MaterialHandle SceneRegistry::materialHandle (
+		const Material & material
+) {
+	MaterialKey key = materialKey(material);
+	Registry & r = registry();
+	lock_guard<mutex> lock(r.registerMutex);
+	auto it = r.materialHandles.find(key);
+	if (it != r.materialHandles.end()) {
+		return it->second;
+	}
+
+	unsigned int handle = r.numMaterials;
+	if (handle == MAX_MATERIAL_HANDLES) {
+		throwRegistryFull("materials", MAX_MATERIAL_HANDLES);
+	}
+	Material * & block = r.materialBlocks[handle / MATERIAL_BLOCK_SIZE];
+	if (!block) {
+		block = new Material[MATERIAL_BLOCK_SIZE];
+	}
+	block[handle % MATERIAL_BLOCK_SIZE] = material;
+	r.materialHandles[key] = handle;
+	r.numMaterials = handle + 1;
+	return handle;
+}
+
+//---------------------------------------------------------------------------------------
+const std::string & SceneRegistry::meshId(MeshHandle mesh) {
+	return registry().meshIds[mesh].str();
+}
+
+//---------------------------------------------------------------------------------------
+const Material & SceneRegistry::material(MaterialHandle material) {
+	return registry().materialBlocks[material / MATERIAL_BLOCK_SIZE][material % MATERIAL_BLOCK_SIZE];
+}
+
+//---------------------------------------------------------------------------------------
+unsigned int SceneRegistry::numMeshes() {
+	return registry().numMeshes;
+}
+
+//---------------------------------------------------------------------------------------
+unsigned int SceneRegistry::numMaterials() {
+	return registry().numMaterials;
+}
+
+//---------------------------------------------------------------------------------------
+std::vector<BatchInfo> SceneRegistry::batchInfos(const BatchInfoMap & batchInfoMap) {
+	vector<BatchInfo> byHandle;
+	for (const auto & entry : batchInfoMap) {
+		MeshHandle mesh = meshHandle(entry.first);
+		if (mesh >= byHandle.size()) {
+			byHandle.resize(mesh + 1, BatchInfo());
+		}
+		byHandle[mesh] = entry.second;
+	}
+	byHandle.resize(numMeshes(), BatchInfo());
+	return byHandle;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "Material.hpp"
+#include "framework/MeshConsolidator.hpp"
+
+#include <string>
+#include <vector>
+
+// Small integer names for meshes and materials, dense from 0 in registration order.
+typedef unsigned short MeshHandle;
+typedef unsigned short MaterialHandle;
+
+const unsigned int MAX_MESH_HANDLES = 1024;
+const unsigned int MAX_MATERIAL_HANDLES = 65536;
+
+// Handle of a default constructed Material, registered up front.
+const MaterialHandle DEFAULT_MATERIAL = 0;
+
+/*
+ * Resolves mesh ids and materials to handles once, when nodes are built, so nothing
+ * that runs per frame hashes a string or compares a Material; it indexes arrays by
+ * handle instead.
+ *
+ * Registering is safe from any thread.  Looking a handle up takes no lock: entries
+ * never move or change once registered.
+ */
+class SceneRegistry {
+public:
+	// Throws Exception once MAX_MESH_HANDLES distinct ids are registered.
+	static MeshHandle meshHandle(const std::string & meshId);
+
+	// Equal materials share a handle.  Throws Exception once MAX_MATERIAL_HANDLES
+	// distinct materials are registered.
+	static MaterialHandle materialHandle(const Material & material);
+
+	static const std::string & meshId(MeshHandle mesh);
+	static const Material & material(MaterialHandle material);
+
+	// Handles registered so far are [0, numMeshes()) and [0, numMaterials()).
+	static unsigned int numMeshes();
+	static unsigned int numMaterials();
+
+	// The entries of batchInfoMap indexed by mesh handle, registering every id it
+	// holds.  Handles of meshes that were not loaded get a BatchInfo with no indices.
+	static std::vector<BatchInfo> batchInfos(const BatchInfoMap & batchInfoMap);
+};
@@ -0,0 +1,163 @@
+#include "Simulation.hpp"
+
+#include <algorithm>
+using namespace std;
+using namespace std::chrono;
+
+//---------------------------------------------------------------------------------------
+Simulation::Simulation()
+	: m_threaded(false),
+	  m_stopping(false),
+	  m_crowdMovedOverflow(false),
+	  m_numDroppedTicks(0)
+{
+
+}
+
+//---------------------------------------------------------------------------------------
+Simulation::~Simulation() {
+	stop();
+}
+
+//---------------------------------------------------------------------------------------
+void Simulation::start (
+		const Step & step,
+		bool threaded
+) {
+	m_step = step;
+	m_threaded = threaded;
+	Clock::time_point now = Clock::now();
+	runTick(now);
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_previous = m_current;
+	}
+	if (threaded) {
+		m_thread = thread(&Simulation::threadLoop, this, now);
+	}
+}
+
+//---------------------------------------------------------------------------------------
+void Simulation::stop() {
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_wake.notify_all();
+	if (m_thread.joinable()) {
+		m_thread.join();
+	}
+}
+
+//---------------------------------------------------------------------------------------
+void Simulation::setInput(const SimInput & input) {
+	lock_guard<mutex> lock(m_mutex);
+	m_input = input;
+}
+
+//---------------------------------------------------------------------------------------
+void Simulation::tick() {
+	runTick(Clock::now());
+}
+
+//---------------------------------------------------------------------------------------
+void Simulation::edit(const std::function<void()> & change) {
+	lock_guard<mutex> lock(m_stepMutex);
+	change();
+}
+
+//---------------------------------------------------------------------------------------
+float Simulation::latest (
+		SimSnapshot & previous,
+		SimSnapshot & current,
+		std::vector<unsigned int> & crowdMoved
+) {
+	lock_guard<mutex> lock(m_mutex);
+	previous = m_previous;
+	current = m_current;
+	if (m_crowdMovedOverflow) {
+		for (unsigned int agent = 0; agent < m_current.crowd.x.size(); ++agent) {
+			crowdMoved.push_back(agent);
+		}
+		m_crowdMovedOverflow = false;
+	} else {
+		crowdMoved.insert(crowdMoved.end(), m_crowdMoved.begin(), m_crowdMoved.end());
+	}
+	m_crowdMoved.clear();
+
+	if (!m_threaded) {
+		return 1.0f;
+	}
+	double alpha = duration<double>(Clock::now() - m_current.time).count() / SIM_TIMESTEP;
+	return (float)std::min(std::max(alpha, 0.0), 1.0);
+}
+
+//---------------------------------------------------------------------------------------
+unsigned long long Simulation::numTicks() const {
+	lock_guard<mutex> lock(m_mutex);
+	return m_current.tick;
+}
+
+//---------------------------------------------------------------------------------------
+unsigned long long Simulation::numDroppedTicks() const {
+	lock_guard<mutex> lock(m_mutex);
+	return m_numDroppedTicks;
+}
+
+//---------------------------------------------------------------------------------------
+/*
+ * Ticks are due every SIM_TIMESTEP after the first.  A tick that comes due while the
+ * previous one still runs starts right after it, up to SIM_MAX_CATCH_UP_TICKS late;
+ * past that the clock skips ahead instead.
+ */
+void Simulation::threadLoop(Clock::time_point due) {
+	const Clock::duration timestep = duration_cast<Clock::duration>(duration<double>(SIM_TIMESTEP));
+	for (;;) {
+		due += timestep;
+		{
+			unique_lock<mutex> lock(m_mutex);
+			if (m_wake.wait_until(lock, due, [this] { return m_stopping; })) {
+				return;
+			}
+		}
+
+		runTick(due);
+
+		Clock::duration behind = Clock::now() - due;
+		if (behind > SIM_MAX_CATCH_UP_TICKS * timestep) {
+			unsigned long long dropped = behind / timestep;
+			due += dropped * timestep;
+			lock_guard<mutex> lock(m_mutex);
+			m_numDroppedTicks += dropped;
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------
+// m_current is only ever written here, so the ticking thread may read it unlocked.
+void Simulation::runTick(Clock::time_point time) {
+	SimInput input;
+	{
+		lock_guard<mutex> lock(m_mutex);
+		input = m_input;
+	}
+	m_back.tick = m_current.tick + 1;
+	m_back.time = time;
+	{
+		lock_guard<mutex> stepLock(m_stepMutex);
+		m_step(input, m_back, m_backCrowdMoved);
+	}
+
+	lock_guard<mutex> lock(m_mutex);
+	swap(m_previous, m_current);
+	swap(m_current, m_back);
+	// Nobody collected in a while, e.g. while the window is paused: rather than
+	// growing without bound, have the next collector take everyone.
+	if (m_crowdMovedOverflow || m_crowdMoved.size() + m_backCrowdMoved.size() > m_current.crowd.x.size()) {
+		m_crowdMovedOverflow = true;
+		m_crowdMoved.clear();
+	} else {
+		m_crowdMoved.insert(m_crowdMoved.end(), m_backCrowdMoved.begin(), m_backCrowdMoved.end());
+	}
+	m_backCrowdMoved.clear();
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include "Crowd.hpp"
+
+#include <glm/glm.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Rate the simulation ticks at, whatever the frame rate.  Camera and crowd constants
+// are per tick; they were tuned when they ran once per frame at 60 frames per second.
+const unsigned int SIM_TICKS_PER_SECOND = 60;
+const double SIM_TIMESTEP = 1.0 / SIM_TICKS_PER_SECOND;
+// Ticks run back to back to catch up after a stall.  Time beyond that is dropped
+// rather than simulated in a burst.
+const unsigned int SIM_MAX_CATCH_UP_TICKS = 8;
+
+// Controls sampled on the render thread, read at the start of every tick.
+struct SimInput {
+	SimInput()
+		: forward(false),
+		  backward(false),
+		  left(false),
+		  right(false),
+		  ascend(false),
+		  descend(false),
+		  look(false),
+		  freeFly(false),
+		  cursor(0.0f) { }
+
+	bool forward, backward, left, right, ascend, descend;
+	// The movement keys turn the camera instead of moving it.
+	bool look;
+	// Lifts the altitude limits.
+	bool freeFly;
+	// Cursor in normalized device coordinates; the spotlight points through it.
+	glm::vec2 cursor;
+};
+
+// Everything the renderer needs from one tick.
+struct SimSnapshot {
+	SimSnapshot()
+		: tick(0),
+		  crowdRunning(0),
+		  realVoices(0),
+		  virtualVoices(0),
+		  spotlightMs(0.0) { }
+
+	unsigned long long tick;
+	// When the tick was due.
+	std::chrono::steady_clock::time_point time;
+
+	glm::vec3 camPos;
+	glm::vec3 camDir;
+	glm::vec3 camUp;
+	// Spotlight direction in view space.
+	glm::vec4 lightDir;
+
+	CrowdPositions crowd;
+	unsigned int crowdRunning;
+	unsigned int realVoices;
+	unsigned int virtualVoices;
+	// Time the spotlight ray took against the BVHs.
+	double spotlightMs;
+};
+
+/*
+ * Fixed timestep clock for everything that moves: one call of the step function
+ * per SIM_TIMESTEP of wall time, on a thread of its own, so a slow frame never slows
+ * the simulation down.
+ *
+ * Each tick fills a back snapshot, which is then swapped in as the current one,
+ * the current one becoming the previous.  The renderer copies out both and draws the
+ * state alpha of the way between them, so it runs at most one tick behind.
+ */
+class Simulation {
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	// Fills snapshot with the state after one tick.  Appends the agent id of every
+	// person who moved to crowdMoved.
+	typedef std::function<void(const SimInput & input, SimSnapshot & snapshot,
+			std::vector<unsigned int> & crowdMoved)> Step;
+
+	Simulation();
+	~Simulation();
+
+	// Runs the first tick on the calling thread, so a snapshot is available at once.
+	// Without a thread, further ticks only happen through tick().
+	void start(const Step & step, bool threaded);
+
+	// Joins the thread.  Nothing the step function touches may be destroyed before.
+	void stop();
+
+	void setInput(const SimInput & input);
+
+	// Runs one tick on the calling thread, for the deterministic benchmark path.
+	void tick();
+
+	// Runs change on the calling thread between two ticks, holding the next one off
+	// until it returns, so it may touch whatever the step function touches.
+	void edit(const std::function<void()> & change);
+
+	// Copies out the two latest snapshots and appends the agents that moved since the
+	// last call to crowdMoved.  Returns how far between previous and current to draw,
+	// in [0, 1]; always 1 without a thread.
+	float latest(SimSnapshot & previous, SimSnapshot & current, std::vector<unsigned int> & crowdMoved);
+
+	unsigned long long numTicks() const;
+	unsigned long long numDroppedTicks() const;
+
+private:
+	Simulation(const Simulation &) = delete;
+	Simulation & operator = (const Simulation &) = delete;
+
+	void threadLoop(Clock::time_point due);
+	void runTick(Clock::time_point time);
+
+	Step m_step;
+	std::thread m_thread;
+	bool m_threaded;
+	// Held for the whole of every tick, and by edit().
+	std::mutex m_stepMutex;
+
+	// Guards everything below.
+	mutable std::mutex m_mutex;
+	std::condition_variable m_wake;
+	bool m_stopping;
+	SimInput m_input;
+	SimSnapshot m_previous;
+	SimSnapshot m_current;
+	std::vector<unsigned int> m_crowdMoved;
+	// m_crowdMoved outgrew the crowd and was dropped in favour of everyone.
+	bool m_crowdMovedOverflow;
+	unsigned long long m_numDroppedTicks;
+
+	// Only touched by the ticking thread.
+	SimSnapshot m_back;
+	std::vector<unsigned int> m_backCrowdMoved;
+};
@@ -0,0 +1,237 @@
+#include "StaticGeometry.hpp"
+#include "GeometryNode.hpp"
+#include "CityGrid.hpp"
+
+#include <tuple>
+#include <utility>
+using namespace std;
+using namespace glm;
+
+//---------------------------------------------------------------------------------------
+StaticGeometry::StaticGeometry()
+	: m_useExternal(false),
+	  m_numBakedNodes(0),
+	  m_mergeTextures(false)
+{
+
+}
+
+//---------------------------------------------------------------------------------------
+bool StaticGeometry::BatchKey::operator < (
+		const BatchKey & other
+) const {
+	return tie(blockX, blockZ, textureIndex, material)
+		< tie(other.blockX, other.blockZ, other.textureIndex, other.material);
+}
+
+//---------------------------------------------------------------------------------------
+void StaticGeometry::setSourceMeshes (
+		const MeshConsolidator & meshConsolidator
+) {
+	const vec3 * positions = (const vec3 *)meshConsolidator.getVertexPositionDataPtr();
+	const vec3 * normals = (const vec3 *)meshConsolidator.getVertexNormalDataPtr();
+	const vec2 * uvCoords = (const vec2 *)meshConsolidator.getVertexUVPtr();
+	shared_ptr<SourceMeshes> source = make_shared<SourceMeshes>();
+	source->positions.assign(positions, positions + meshConsolidator.getNumVertexPositionBytes() / sizeof(vec3));
+	source->normals.assign(normals, normals + meshConsolidator.getNumVertexNormalBytes() / sizeof(vec3));
+	source->uvCoords.assign(uvCoords, uvCoords + meshConsolidator.getNumVertexUVBytes() / sizeof(vec2));
+	source->indices = meshConsolidator.getIndices();
+	BatchInfoMap batchInfoMap;
+	meshConsolidator.getBatchInfoMap(batchInfoMap);
+	source->batchInfos = SceneRegistry::batchInfos(batchInfoMap);
+	m_source = source;
+}
+
+//---------------------------------------------------------------------------------------
+void StaticGeometry::setMergeTextures (
+		bool mergeTextures
+) {
+	m_mergeTextures = mergeTextures;
+}
+
+//---------------------------------------------------------------------------------------
+void StaticGeometry::bake (
+		const SceneNode & root,
+		const glm::mat4 & parentTransform
+) {
+	// The whole subtree lands in the block containing its root's origin.
+	vec4 origin = parentTransform * root.get_transform() * vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	bakeNode(root, parentTransform, cityBlockIndex(origin.x), cityBlockIndex(origin.z));
+}
+
+//---------------------------------------------------------------------------------------
+void StaticGeometry::bakeNode (
+		const SceneNode & node,
+		const glm::mat4 & parentTransform,
+		int blockX,
+		int blockZ
+) {
+	mat4 world = parentTransform * node.get_transform();
+
+	if (node.m_nodeType == NodeType::GeometryNode) {
+		const GeometryNode & geometryNode = static_cast<const GeometryNode &>(node);
+		const SourceMeshes & source = *m_source;
+		if (geometryNode.mesh < source.batchInfos.size() && source.batchInfos[geometryNode.mesh].numIndices > 0) {
+			int textureIndex = m_mergeTextures ? MIXED_TEXTURE_INDEX : geometryNode.textureIndex;
+			BatchKey key = {blockX, blockZ, textureIndex, geometryNode.material};
+			BatchVertices & vertices = m_staging[key];
+			mat3 normalMatrix = transpose(inverse(mat3(world)));
+
+			// The node's copy of the mesh keeps the mesh's welded vertices and indices.
+			const BatchInfo & mesh = source.batchInfos[geometryNode.mesh];
+			unsigned int base = vertices.positions.size();
+			for (unsigned int i = mesh.baseVertex; i < mesh.baseVertex + mesh.numVertices; ++i) {
+				vertices.positions.push_back(vec3(world * vec4(source.positions[i], 1.0f)));
+				vertices.normals.push_back(normalize(normalMatrix * source.normals[i]));
+				vertices.uvCoords.push_back(i < source.uvCoords.size() ? source.uvCoords[i] : vec2(0.0f));
+				vertices.layers.push_back(geometryNode.textureIndex);
+			}
+			for (unsigned int i = mesh.startIndex; i < mesh.startIndex + mesh.numIndices; ++i) {
+				vertices.indices.push_back(base + source.indices[i]);
+			}
+			++m_numBakedNodes;
+		}
+	}
+
+	for (const SceneNode * child : node.children) {
+		bakeNode(*child, world, blockX, blockZ);
+	}
+}
+
+//---------------------------------------------------------------------------------------
+void StaticGeometry::append (
+		StaticGeometry & other
+) {
+	for (auto & entry : other.m_staging) {
+		BatchVertices & vertices = m_staging[entry.first];
+		BatchVertices & appended = entry.second;
+		if (vertices.positions.empty()) {
+			swap(vertices, appended);
+			continue;
+		}
+		unsigned int base = vertices.positions.size();
+		vertices.positions.insert(vertices.positions.end(), appended.positions.begin(), appended.positions.end());
+		vertices.normals.insert(vertices.normals.end(), appended.normals.begin(), appended.normals.end());
+		vertices.uvCoords.insert(vertices.uvCoords.end(), appended.uvCoords.begin(), appended.uvCoords.end());
+		vertices.layers.insert(vertices.layers.end(), appended.layers.begin(), appended.layers.end());
+		for (unsigned int index : appended.indices) {
+			vertices.indices.push_back(base + index);
+		}
+	}
+	m_numBakedNodes += other.m_numBakedNodes;
+	other.m_staging.clear();
+	other.m_numBakedNodes = 0;
+}
+
+//---------------------------------------------------------------------------------------
+void StaticGeometry::consolidate() {
+	size_t numVertices = 0;
+	size_t numIndices = 0;
+	for (const auto & entry : m_staging) {
+		numVertices += entry.second.positions.size();
+		numIndices += entry.second.indices.size();
+	}
+	m_indexData.reserve(numIndices);
+	m_vertexPositionData.reserve(numVertices);
+	m_vertexNormalData.reserve(numVertices);
+	m_vertexUV.reserve(numVertices);
+	m_vertexLayer.reserve(numVertices);
+
+	for (const auto & entry : m_staging) {
+		const BatchKey & key = entry.first;
+		const BatchVertices & vertices = entry.second;
+
+		StaticBatch batch;
+		batch.blockX = key.blockX;
+		batch.blockZ = key.blockZ;
+		batch.textureIndex = key.textureIndex;
+		batch.material = key.material;
+		batch.startIndex = m_indexData.size();
+		batch.numIndices = vertices.indices.size();
+		batch.baseVertex = m_vertexPositionData.size();
+		for (const vec3 & position : vertices.positions) {
+			batch.bounds.expand(position);
+		}
+		m_batches.push_back(batch);
+
+		m_vertexPositionData.insert(m_vertexPositionData.end(), vertices.positions.begin(), vertices.positions.end());
+		m_vertexNormalData.insert(m_vertexNormalData.end(), vertices.normals.begin(), vertices.normals.end());
+		m_vertexUV.insert(m_vertexUV.end(), vertices.uvCoords.begin(), vertices.uvCoords.end());
+		m_vertexLayer.insert(m_vertexLayer.end(), vertices.layers.begin(), vertices.layers.end());
+		m_indexData.insert(m_indexData.end(), vertices.indices.begin(), vertices.indices.end());
+	}
+	m_staging.clear();
+}
+
+//---------------------------------------------------------------------------------------
+void StaticGeometry::useConsolidated (
+		const StaticVertexArrays & arrays,
+		std::vector<StaticBatch> batches,
+		size_t numBakedNodes
+) {
+	m_staging.clear();
+	m_external = arrays;
+	m_useExternal = true;
+	m_batches = std::move(batches);
+	m_numBakedNodes = numBakedNodes;
+}
+
+//---------------------------------------------------------------------------------------
+const float * StaticGeometry::getVertexPositionDataPtr() const {
+	return reinterpret_cast<const float *>(m_useExternal ? m_external.positions : m_vertexPositionData.data());
+}
+
+//---------------------------------------------------------------------------------------
+const float * StaticGeometry::getVertexNormalDataPtr() const {
+	return reinterpret_cast<const float *>(m_useExternal ? m_external.normals : m_vertexNormalData.data());
+}
+
+//---------------------------------------------------------------------------------------
+const float * StaticGeometry::getVertexUVPtr() const {
+	return reinterpret_cast<const float *>(m_useExternal ? m_external.uvCoords : m_vertexUV.data());
+}
+
+//---------------------------------------------------------------------------------------
+const float * StaticGeometry::getVertexLayerPtr() const {
+	return m_useExternal ? m_external.layers : m_vertexLayer.data();
+}
+
+//---------------------------------------------------------------------------------------
+const unsigned int * StaticGeometry::getIndexDataPtr() const {
+	return m_useExternal ? m_external.indices : m_indexData.data();
+}
+
+//---------------------------------------------------------------------------------------
+size_t StaticGeometry::getNumVertexPositionBytes() const {
+	return (m_useExternal ? m_external.numVertices : m_vertexPositionData.size()) * sizeof(vec3);
+}
+
+//---------------------------------------------------------------------------------------
+size_t StaticGeometry::getNumVertexNormalBytes() const {
+	return (m_useExternal ? m_external.numVertices : m_vertexNormalData.size()) * sizeof(vec3);
+}
+
+//---------------------------------------------------------------------------------------
+size_t StaticGeometry::getNumVertexUVBytes() const {
+	return (m_useExternal ? m_external.numVertices : m_vertexUV.size()) * sizeof(vec2);
+}
+
+//---------------------------------------------------------------------------------------
+size_t StaticGeometry::getNumVertexLayerBytes() const {
+	return (m_useExternal ? m_external.numVertices : m_vertexLayer.size()) * sizeof(float);
+}
+
+//---------------------------------------------------------------------------------------
+size_t StaticGeometry::getNumIndexBytes() const {
+	return (m_useExternal ? m_external.numIndices : m_indexData.size()) * sizeof(unsigned int);
+}
+
+//---------------------------------------------------------------------------------------
+const std::vector<StaticBatch> & StaticGeometry::getBatches() const {
+	return m_batches;
+}
+
+//---------------------------------------------------------------------------------------
+size_t StaticGeometry::getNumBakedNodes() const {
+	return m_numBakedNodes;
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include "SceneNode.hpp"
+#include "SceneRegistry.hpp"
+#include "Material.hpp"
+#include "AABB.hpp"
+#include "framework/MeshConsolidator.hpp"
+
+#include <glm/glm.hpp>
+#include <map>
+#include <memory>
+#include <vector>
+
+// Texture index of a batch whose vertices carry their own texture array layer.
+const int MIXED_TEXTURE_INDEX = -2;
+
+// A contiguous range of pre-transformed, indexed vertices sharing a city block, a
+// texture and a material, drawn with a single glDrawElementsBaseVertex.
+struct StaticBatch {
+	int blockX;
+	int blockZ;
+	int textureIndex;
+	MaterialHandle material;
+	unsigned int startIndex;
+	unsigned int numIndices;
+	unsigned int baseVertex;
+	// World-space bounds of the batch's vertices.
+	AABB bounds;
+};
+
+// Consolidated vertex data held elsewhere, laid out as consolidate() lays it out.
+struct StaticVertexArrays {
+	const glm::vec3 * positions;
+	const glm::vec3 * normals;
+	const glm::vec2 * uvCoords;
+	const float * layers;
+	size_t numVertices;
+	const unsigned int * indices;
+	size_t numIndices;
+};
+
+/*
+ * Bakes subtrees that never move after creation (buildings, billboards) into
+ * world-space vertex data grouped per city block, texture and material, so they
+ * can be drawn without walking their SceneNodes every frame.
+ */
+class StaticGeometry {
+public:
+	StaticGeometry();
+
+	// Copies the source mesh vertices that GeometryNodes reference by mesh handle.  Copies
+	// of this object made afterwards share them.
+	void setSourceMeshes(const MeshConsolidator & meshConsolidator);
+
+	// When set, batches are no longer split by texture; every vertex records its
+	// texture index as a texture array layer instead.  Must precede bake().
+	void setMergeTextures(bool mergeTextures);
+
+	// Appends every GeometryNode below root, transformed to world space.  Distinct
+	// StaticGeometry objects may bake on different threads at once.
+	void bake(const SceneNode & root, const glm::mat4 & parentTransform = glm::mat4());
+
+	// Moves everything other has baked so far behind what this one has baked, as if
+	// other's bake() calls had been made on this object.
+	void append(StaticGeometry & other);
+
+	// Lays all baked vertices out contiguously and builds the batch list.
+	// Call once after the last bake().
+	void consolidate();
+
+	// Instead of baking and consolidating, takes over geometry baked earlier, e.g. by
+	// a CitySnapshot.  The arrays are used in place and must outlive every use of the
+	// vertex data getters.
+	void useConsolidated(const StaticVertexArrays & arrays, std::vector<StaticBatch> batches,
+			size_t numBakedNodes);
+
+	// Each of these may be nullptr while there is no static geometry.
+	const float * getVertexPositionDataPtr() const;
+
+	const float * getVertexNormalDataPtr() const;
+
+	const float * getVertexUVPtr() const;
+
+	const float * getVertexLayerPtr() const;
+
+	// 32 bit indices relative to each batch's baseVertex.
+	const unsigned int * getIndexDataPtr() const;
+
+	size_t getNumVertexPositionBytes() const;
+
+	size_t getNumVertexNormalBytes() const;
+
+	size_t getNumVertexUVBytes() const;
+
+	size_t getNumVertexLayerBytes() const;
+
+	size_t getNumIndexBytes() const;
+
+	const std::vector<StaticBatch> & getBatches() const;
+
+	size_t getNumBakedNodes() const;
+
+private:
+	struct BatchKey {
+		int blockX;
+		int blockZ;
+		int textureIndex;
+		MaterialHandle material;
+
+		bool operator < (const BatchKey & other) const;
+	};
+
+	struct BatchVertices {
+		std::vector<glm::vec3> positions;
+		std::vector<glm::vec3> normals;
+		std::vector<glm::vec2> uvCoords;
+		std::vector<float> layers;
+		std::vector<unsigned int> indices;
+	};
+
+	struct SourceMeshes {
+		std::vector<glm::vec3> positions;
+		std::vector<glm::vec3> normals;
+		std::vector<glm::vec2> uvCoords;
+		std::vector<unsigned int> indices;
+		// By mesh handle.
+		std::vector<BatchInfo> batchInfos;
+	};
+
+	void bakeNode(const SceneNode & node, const glm::mat4 & parentTransform, int blockX, int blockZ);
+
+	std::shared_ptr<const SourceMeshes> m_source;
+
+	std::map<BatchKey, BatchVertices> m_staging;
+
+	std::vector<glm::vec3> m_vertexPositionData;
+	std::vector<glm::vec3> m_vertexNormalData;
+	std::vector<glm::vec2> m_vertexUV;
+	std::vector<float> m_vertexLayer;
+	std::vector<unsigned int> m_indexData;
+	std::vector<StaticBatch> m_batches;
+	// Set by useConsolidated(), in place of the vectors above.
+	StaticVertexArrays m_external;
+	bool m_useExternal;
+	size_t m_numBakedNodes;
+	bool m_mergeTextures;
+};
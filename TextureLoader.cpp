@@ -0,0 +1,97 @@
+#include "TextureLoader.hpp"
+#include "WorkerPool.hpp"
+
+using namespace std;
+
+//---------------------------------------------------------------------------------------
+TextureLoader::TextureLoader()
+	: m_count(0),
+	  m_taken(0),
+	  m_stopping(false),
+	  m_numDecoded(0)
+{
+
+}
+
+//---------------------------------------------------------------------------------------
+TextureLoader::~TextureLoader() {
+	stop();
+}
+
+//---------------------------------------------------------------------------------------
+void TextureLoader::start (
+		size_t count,
+		const Decode & decode,
+		unsigned int numThreads
+) {
+	m_decode = decode;
+	m_count = count;
+	m_taken = 0;
+	m_numDecoded = 0;
+	m_stopping = false;
+	m_thread = thread(&TextureLoader::decodeAll, this, numThreads);
+}
+
+//---------------------------------------------------------------------------------------
+void TextureLoader::stop() {
+	if (!m_thread.joinable()) {
+		return;
+	}
+	m_stopping = true;
+	m_thread.join();
+	lock_guard<mutex> lock(m_mutex);
+	m_decoded.clear();
+}
+
+//---------------------------------------------------------------------------------------
+bool TextureLoader::isStarted() const {
+	return m_thread.joinable();
+}
+
+//---------------------------------------------------------------------------------------
+bool TextureLoader::takeDecoded (
+		size_t & index,
+		DecodedImage & image
+) {
+	lock_guard<mutex> lock(m_mutex);
+	if (m_decoded.empty()) {
+		return false;
+	}
+	index = m_decoded.front().first;
+	image = std::move(m_decoded.front().second);
+	m_decoded.pop_front();
+	++m_taken;
+	return true;
+}
+
+//---------------------------------------------------------------------------------------
+void TextureLoader::finish() {
+	unique_lock<mutex> lock(m_mutex);
+	m_decodedOne.wait(lock, [this] { return m_numDecoded == m_count; });
+}
+
+//---------------------------------------------------------------------------------------
+size_t TextureLoader::numImages() const {
+	return m_count;
+}
+
+//---------------------------------------------------------------------------------------
+size_t TextureLoader::numPending() const {
+	return m_count - m_taken;
+}
+
+//---------------------------------------------------------------------------------------
+// The background thread, which takes part in the decoding as the pool's calling thread.
+void TextureLoader::decodeAll(unsigned int numThreads) {
+	WorkerPool pool(numThreads);
+	pool.parallelFor(m_count, [this](size_t index) {
+		DecodedImage image;
+		if (!m_stopping) {
+			m_decode(index, image);
+		}
+		lock_guard<mutex> lock(m_mutex);
+		m_decoded.push_back(make_pair(index, std::move(image)));
+		++m_numDecoded;
+		m_decodedOne.notify_all();
+	});
+}
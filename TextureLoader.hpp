@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// A decoded image, 8 bits a channel with rows from the bottom up as OpenGL takes them.
+// pixels is empty if the file could not be decoded.
+struct DecodedImage {
+	DecodedImage() : width(0), height(0), channels(0) { }
+
+	int width;
+	int height;
+	int channels;
+	std::vector<unsigned char> pixels;
+};
+
+/*
+ * Decodes a set of images in parallel without holding up the calling thread: a
+ * background thread of its own runs the decoding across a WorkerPool.  The caller
+ * collects the images with takeDecoded() in whatever order they finish, and may
+ * upload them a few at a time while the program already runs.
+ *
+ * Only takeDecoded(), finish() and the counts may be called, from one thread.
+ */
+class TextureLoader {
+public:
+	// Fills image with image index on a pool thread.  Called for different images at
+	// once.
+	typedef std::function<void(size_t index, DecodedImage & image)> Decode;
+
+	TextureLoader();
+	~TextureLoader();
+
+	// Decodes images [0, count) on numThreads threads, 0 for one per hardware thread.
+	void start(size_t count, const Decode & decode, unsigned int numThreads);
+
+	// Skips the images not yet begun, waits for the rest and drops those not taken.
+	void stop();
+
+	bool isStarted() const;
+
+	// Hands out a decoded image.  Returns false if none is ready.
+	bool takeDecoded(size_t & index, DecodedImage & image);
+
+	// Blocks until every image has been decoded.
+	void finish();
+
+	size_t numImages() const;
+	// Images not yet taken.
+	size_t numPending() const;
+
+private:
+	TextureLoader(const TextureLoader &) = delete;
+	TextureLoader & operator = (const TextureLoader &) = delete;
+
+	void decodeAll(unsigned int numThreads);
+
+	Decode m_decode;
+	size_t m_count;
+	size_t m_taken;
+	std::thread m_thread;
+	std::atomic<bool> m_stopping;
+
+	// Guards everything below.
+	mutable std::mutex m_mutex;
+	std::condition_variable m_decodedOne;
+	std::deque<std::pair<size_t, DecodedImage>> m_decoded;
+	size_t m_numDecoded;
+};
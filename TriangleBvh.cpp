@@ -0,0 +1,638 @@
+#include "TriangleBvh.hpp"
+#include "WorkerPool.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <numeric>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+using namespace std;
+using namespace glm;
+
+namespace {
+
+// Centroid bins the surface area heuristic weighs splits between.
+const unsigned int SAH_BINS = 16;
+// Cost of visiting a node, relative to intersecting one triangle.
+const float SAH_TRAVERSAL_COST = 1.0f;
+// Below this depth every split is a median split, which bounds the depth of any tree,
+// and so the traversal stack, whatever the triangles.
+const unsigned int MEDIAN_SPLIT_DEPTH = 48;
+// Deep enough for MEDIAN_SPLIT_DEPTH plus 32 median levels, at three entries a level.
+const unsigned int TRAVERSAL_STACK_SIZE = 256;
+// Triangles per parallelFor iteration while taking bounds.
+const size_t BOUNDS_CHUNK = 4096;
+
+//---------------------------------------------------------------------------------------
+float surfaceArea(const AABB & box) {
+	vec3 size = box.max - box.min;
+	return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+//---------------------------------------------------------------------------------------
+// Orders the (at most four) children by near, farthest first.  std::sort over the
+// fixed array trips -Warray-bounds at -O2.
+void sortFarthestFirst(unsigned int (&children)[4], unsigned int count, const float (&near)[4]) {
+	for (unsigned int i = 1; i < count && i < 4; ++i) {
+		unsigned int child = children[i];
+		unsigned int j = i;
+		for (; j > 0 && near[children[j - 1]] < near[child]; --j) {
+			children[j] = children[j - 1];
+		}
+		children[j] = child;
+	}
+}
+
+//---------------------------------------------------------------------------------------
+// Zero components would turn a ray starting on a box face into NaNs.
+vec3 inverseOf(const vec3 & direction) {
+	vec3 inverse;
+	for (int axis = 0; axis < 3; ++axis) {
+		float component = direction[axis];
+		inverse[axis] = 1.0f / (std::abs(component) > 1e-20f ? component : (component < 0.0f ? -1e-20f : 1e-20f));
+	}
+	return inverse;
+}
+
+} // namespace
+
+//---------------------------------------------------------------------------------------
+TriangleBvh::TriangleBvh() {
+
+}
+
+//---------------------------------------------------------------------------------------
+void TriangleBvh::addTriangles (
+		const glm::vec3 * positions,
+		const unsigned int * indices,
+		size_t numIndices
+) {
+	for (size_t i = 0; i + 2 < numIndices; i += 3) {
+		m_corners.push_back(positions[indices[i]]);
+		m_corners.push_back(positions[indices[i + 1]]);
+		m_corners.push_back(positions[indices[i + 2]]);
+	}
+}
+
+//---------------------------------------------------------------------------------------
+/*
+ * The first levels are split on the calling thread until every remaining range is
+ * small enough to be a task of its own.  Each worker builds its subtree into its own
+ * node array, and those are appended behind the first levels afterwards, the root of
+ * each taking the place its task left for it.
+ */
+void TriangleBvh::build(WorkerPool * pool) {
+	unsigned int numTriangles = m_corners.size() / 3;
+	if (numTriangles == 0) {
+		return;
+	}
+	m_triangleBounds.resize(numTriangles);
+	m_centroids.resize(numTriangles);
+	auto takeBounds = [this, numTriangles](size_t chunk) {
+		size_t end = std::min((chunk + 1) * BOUNDS_CHUNK, (size_t)numTriangles);
+		for (size_t i = chunk * BOUNDS_CHUNK; i < end; ++i) {
+			AABB bounds;
+			bounds.expand(m_corners[3 * i]);
+			bounds.expand(m_corners[3 * i + 1]);
+			bounds.expand(m_corners[3 * i + 2]);
+			m_triangleBounds[i] = bounds;
+			m_centroids[i] = bounds.center();
+		}
+	};
+	size_t numChunks = (numTriangles + BOUNDS_CHUNK - 1) / BOUNDS_CHUNK;
+	if (pool) {
+		pool->parallelFor(numChunks, takeBounds);
+	} else {
+		for (size_t chunk = 0; chunk < numChunks; ++chunk) {
+			takeBounds(chunk);
+		}
+	}
+	m_order.resize(numTriangles);
+	iota(m_order.begin(), m_order.end(), 0u);
+
+	vector<BuildNode> nodes;
+	unsigned int numThreads = pool ? pool->numThreads() : 1;
+	if (numThreads > 1) {
+		vector<BuildTask> tasks;
+		unsigned int taskSize = std::max(numTriangles / (numThreads * 8), 1024u);
+		buildNode(nodes, 0, numTriangles, 0, &tasks, taskSize);
+		vector<vector<BuildNode>> subtrees(tasks.size());
+		pool->parallelFor(tasks.size(), [&](size_t i) {
+			const BuildTask & task = tasks[i];
+			buildNode(subtrees[i], task.first, task.count, task.depth, nullptr, 0);
+		});
+		for (size_t i = 0; i < tasks.size(); ++i) {
+			// Local node j > 0 lands at offset + j; the local root is never a child.
+			unsigned int offset = nodes.size() - 1;
+			for (size_t j = 0; j < subtrees[i].size(); ++j) {
+				BuildNode node = subtrees[i][j];
+				if (node.count == 0) {
+					node.left += offset;
+					node.right += offset;
+				}
+				if (j == 0) {
+					nodes[tasks[i].node] = node;
+				} else {
+					nodes.push_back(node);
+				}
+			}
+		}
+	} else {
+		buildNode(nodes, 0, numTriangles, 0, nullptr, 0);
+	}
+
+	m_nodes.reserve(nodes.size() / 2 + 1);
+	m_triangles.reserve(numTriangles);
+	m_triangleIds.reserve(numTriangles);
+	collapse(nodes, 0);
+	m_bounds = nodes[0].bounds;
+
+	// Only the collapsed tree is needed from here on.
+	vector<vec3>().swap(m_corners);
+	vector<AABB>().swap(m_triangleBounds);
+	vector<vec3>().swap(m_centroids);
+	vector<unsigned int>().swap(m_order);
+}
+
+//---------------------------------------------------------------------------------------
+/*
+ * Appends the subtree over m_order[first, first + count) to nodes and returns the
+ * index of its root.  With tasks, ranges of at most taskSize triangles are left for
+ * later: their node is pushed with nothing below it, and the range to tasks.
+ */
+unsigned int TriangleBvh::buildNode (
+		std::vector<BuildNode> & nodes,
+		unsigned int first,
+		unsigned int count,
+		unsigned int depth,
+		std::vector<BuildTask> * tasks,
+		unsigned int taskSize
+) {
+	unsigned int index = nodes.size();
+	nodes.push_back(BuildNode());
+	AABB bounds;
+	for (unsigned int i = first; i < first + count; ++i) {
+		bounds.expand(m_triangleBounds[m_order[i]]);
+	}
+	nodes[index].bounds = bounds;
+	nodes[index].left = 0;
+	nodes[index].right = 0;
+	nodes[index].first = first;
+	nodes[index].count = 0;
+
+	if (tasks && count <= taskSize) {
+		BuildTask task = {index, first, count, depth};
+		tasks->push_back(task);
+		return index;
+	}
+	unsigned int middle;
+	if (!split(bounds, first, count, depth, middle)) {
+		nodes[index].count = count;
+		return index;
+	}
+	unsigned int left = buildNode(nodes, first, middle - first, depth + 1, tasks, taskSize);
+	unsigned int right = buildNode(nodes, middle, first + count - middle, depth + 1, tasks, taskSize);
+	nodes[index].left = left;
+	nodes[index].right = right;
+	return index;
+}
+
+//---------------------------------------------------------------------------------------
+/*
+ * Partitions m_order[first, first + count) along the widest axis of the centroids
+ * and sets middle to the first triangle of the upper half.  Returns false if the
+ * range is better off as a leaf.  Only touches its own range, so workers may split
+ * disjoint ranges at once.
+ */
+bool TriangleBvh::split (
+		const AABB & bounds,
+		unsigned int first,
+		unsigned int count,
+		unsigned int depth,
+		unsigned int & middle
+) {
+	AABB centroidBounds;
+	for (unsigned int i = first; i < first + count; ++i) {
+		centroidBounds.expand(m_centroids[m_order[i]]);
+	}
+	vec3 extent = centroidBounds.max - centroidBounds.min;
+	int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+	vector<unsigned int>::iterator begin = m_order.begin() + first;
+	vector<unsigned int>::iterator end = begin + count;
+
+	if (!(extent[axis] > 0.0f) || depth >= MEDIAN_SPLIT_DEPTH) {
+		if (count <= BVH_MAX_LEAF_TRIANGLES) {
+			return false;
+		}
+		// Coincident centroids leave nothing to weigh, and deep trees get no deeper.
+		middle = first + count / 2;
+		nth_element(begin, begin + count / 2, end, [&](unsigned int a, unsigned int b) {
+			return m_centroids[a][axis] < m_centroids[b][axis];
+		});
+		return true;
+	}
+
+	float binScale = SAH_BINS / extent[axis];
+	float binOrigin = centroidBounds.min[axis];
+	auto binOf = [&](unsigned int triangle) {
+		unsigned int bin = (unsigned int)((m_centroids[triangle][axis] - binOrigin) * binScale);
+		return std::min(bin, SAH_BINS - 1);
+	};
+	AABB binBounds[SAH_BINS];
+	unsigned int binCounts[SAH_BINS] = {};
+	for (vector<unsigned int>::iterator it = begin; it != end; ++it) {
+		unsigned int bin = binOf(*it);
+		binBounds[bin].expand(m_triangleBounds[*it]);
+		++binCounts[bin];
+	}
+
+	// Cost of everything from each bin up, then of every split from the bottom.
+	float aboveCost[SAH_BINS];
+	AABB above;
+	unsigned int numAbove = 0;
+	for (unsigned int bin = SAH_BINS - 1; bin > 0; --bin) {
+		above.expand(binBounds[bin]);
+		numAbove += binCounts[bin];
+		aboveCost[bin] = numAbove > 0 ? surfaceArea(above) * numAbove : 0.0f;
+	}
+	AABB below;
+	unsigned int numBelow = 0;
+	unsigned int bestBin = 0;
+	float bestCost = FLT_MAX;
+	for (unsigned int bin = 1; bin < SAH_BINS; ++bin) {
+		below.expand(binBounds[bin - 1]);
+		numBelow += binCounts[bin - 1];
+		if (numBelow == 0 || numBelow == count) {
+			continue;
+		}
+		float cost = surfaceArea(below) * numBelow + aboveCost[bin];
+		if (cost < bestCost) {
+			bestCost = cost;
+			bestBin = bin;
+		}
+	}
+	float area = surfaceArea(bounds);
+	if (bestBin == 0 || (count <= BVH_MAX_LEAF_TRIANGLES && SAH_TRAVERSAL_COST * area + bestCost >= area * count)) {
+		return false;
+	}
+	middle = first + (partition(begin, end, [&](unsigned int triangle) {
+		return binOf(triangle) < bestBin;
+	}) - begin);
+	return true;
+}
+
+//---------------------------------------------------------------------------------------
+/*
+ * Appends the four wide node standing for nodes[index], which gathers the up to four
+ * descendants left after opening its largest inner children, and returns its index.
+ * Leaves copy their triangles to m_triangles in visiting order.
+ */
+unsigned int TriangleBvh::collapse(const std::vector<BuildNode> & nodes, unsigned int index) {
+	unsigned int children[4];
+	unsigned int numChildren = 0;
+	if (nodes[index].count > 0) {
+		// A root that is a leaf.
+		children[numChildren++] = index;
+	} else {
+		children[numChildren++] = nodes[index].left;
+		children[numChildren++] = nodes[index].right;
+		while (numChildren < 4) {
+			int largest = -1;
+			float largestArea = -1.0f;
+			for (unsigned int i = 0; i < numChildren; ++i) {
+				const BuildNode & child = nodes[children[i]];
+				if (child.count == 0 && surfaceArea(child.bounds) > largestArea) {
+					largest = i;
+					largestArea = surfaceArea(child.bounds);
+				}
+			}
+			if (largest < 0) {
+				break;
+			}
+			const BuildNode & opened = nodes[children[largest]];
+			children[largest] = opened.left;
+			children[numChildren++] = opened.right;
+		}
+	}
+
+	unsigned int slot = m_nodes.size();
+	m_nodes.push_back(Node());
+	for (unsigned int i = 0; i < 4; ++i) {
+		AABB bounds(vec3(FLT_MAX), vec3(FLT_MAX));
+		unsigned int child = 0;
+		unsigned int count = EMPTY_CHILD;
+		if (i < numChildren) {
+			const BuildNode & built = nodes[children[i]];
+			// Padded, so that a ray running exactly along a face still enters the box.
+			vec3 pad = vec3(1e-5f) + 1e-6f * glm::max(abs(built.bounds.min), abs(built.bounds.max));
+			bounds = AABB(built.bounds.min - pad, built.bounds.max + pad);
+			count = built.count;
+			if (count > 0) {
+				child = m_triangles.size();
+				for (unsigned int j = built.first; j < built.first + count; ++j) {
+					const vec3 * corners = &m_corners[3 * m_order[j]];
+					Triangle triangle = {corners[0], corners[1] - corners[0], corners[2] - corners[0]};
+					m_triangles.push_back(triangle);
+					m_triangleIds.push_back(m_order[j]);
+				}
+			} else {
+				child = collapse(nodes, children[i]);
+			}
+		}
+		// collapse() may have moved the nodes.
+		Node & node = m_nodes[slot];
+		node.minX[i] = bounds.min.x;
+		node.minY[i] = bounds.min.y;
+		node.minZ[i] = bounds.min.z;
+		node.maxX[i] = bounds.max.x;
+		node.maxY[i] = bounds.max.y;
+		node.maxZ[i] = bounds.max.z;
+		node.child[i] = child;
+		node.count[i] = count;
+	}
+	return slot;
+}
+
+//---------------------------------------------------------------------------------------
+bool TriangleBvh::intersect (
+		const glm::vec3 & origin,
+		const glm::vec3 & direction,
+		float & distance
+) const {
+	return traverse(origin, direction, distance, nullptr);
+}
+
+//---------------------------------------------------------------------------------------
+bool TriangleBvh::intersect (
+		const glm::vec3 & origin,
+		const glm::vec3 & direction,
+		float & distance,
+		TriangleHit & hit
+) const {
+	return traverse(origin, direction, distance, &hit);
+}
+
+//---------------------------------------------------------------------------------------
+/*
+ * Visits the nodes nearest first, by where the ray enters their boxes, so that once
+ * a triangle is hit every box behind it is skipped.
+ */
+bool TriangleBvh::traverse (
+		const glm::vec3 & origin,
+		const glm::vec3 & direction,
+		float & distance,
+		TriangleHit * hitTriangle
+) const {
+	if (m_nodes.empty()) {
+		return false;
+	}
+	vec3 inverseDirection = inverseOf(direction);
+	bool hit = false;
+	unsigned int stack[TRAVERSAL_STACK_SIZE];
+	unsigned int stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0) {
+		const Node & node = m_nodes[stack[--stackSize]];
+		float near[4];
+		int mask = hitChildren(node, origin, inverseDirection, distance, near);
+		// Leaves first, so that their hits cut the nodes short.
+		unsigned int inner[4];
+		unsigned int numInner = 0;
+		for (unsigned int i = 0; i < 4; ++i) {
+			if (!(mask & (1 << i)) || node.count[i] == EMPTY_CHILD) {
+				continue;
+			}
+			if (node.count[i] > 0) {
+				intersectLeaf(node.child[i], node.count[i], origin, direction, distance, hitTriangle, hit);
+			} else {
+				inner[numInner++] = i;
+			}
+		}
+		// Pushed farthest first, so the nearest is visited next.
+		sortFarthestFirst(inner, numInner, near);
+		for (unsigned int i = 0; i < numInner; ++i) {
+			if (near[inner[i]] < distance) {
+				stack[stackSize++] = node.child[inner[i]];
+			}
+		}
+	}
+	return hit;
+}
+
+//---------------------------------------------------------------------------------------
+/*
+ * Like traverse(), but a child is entered if any ray of the packet enters its box,
+ * and its leaves are tested against those rays only.  Children are visited nearest
+ * first by the nearest ray.
+ */
+int TriangleBvh::intersectPacket(RayPacket & packet) const {
+	if (m_nodes.empty()) {
+		return 0;
+	}
+	PacketRays rays;
+	for (unsigned int ray = 0; ray < BVH_PACKET_SIZE; ++ray) {
+		vec3 inverseDirection = inverseOf(packet.direction[ray]);
+		rays.originX[ray] = packet.origin[ray].x;
+		rays.originY[ray] = packet.origin[ray].y;
+		rays.originZ[ray] = packet.origin[ray].z;
+		rays.inverseX[ray] = inverseDirection.x;
+		rays.inverseY[ray] = inverseDirection.y;
+		rays.inverseZ[ray] = inverseDirection.z;
+	}
+	int hitRays = 0;
+	unsigned int stack[TRAVERSAL_STACK_SIZE];
+	unsigned int stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0) {
+		const Node & node = m_nodes[stack[--stackSize]];
+		float near[4];
+		unsigned int inner[4];
+		unsigned int numInner = 0;
+		for (unsigned int i = 0; i < 4; ++i) {
+			if (node.count[i] == EMPTY_CHILD) {
+				continue;
+			}
+			int mask = hitPacket(node, i, rays, packet.distance, near[i]);
+			if (mask == 0) {
+				continue;
+			}
+			if (node.count[i] > 0) {
+				for (unsigned int ray = 0; ray < BVH_PACKET_SIZE; ++ray) {
+					bool hit = false;
+					if (mask & (1 << ray)) {
+						intersectLeaf(node.child[i], node.count[i], packet.origin[ray], packet.direction[ray],
+								packet.distance[ray], &packet.hit[ray], hit);
+					}
+					hitRays |= hit ? 1 << ray : 0;
+				}
+			} else {
+				inner[numInner++] = i;
+			}
+		}
+		sortFarthestFirst(inner, numInner, near);
+		for (unsigned int i = 0; i < numInner; ++i) {
+			stack[stackSize++] = node.child[inner[i]];
+		}
+	}
+	return hitRays;
+}
+
+//---------------------------------------------------------------------------------------
+// Slab test of the ray against the four boxes of node, up to distance.  Returns the
+// boxes hit as a bit mask and writes where the ray enters each to near.
+int TriangleBvh::hitChildren (
+		const Node & node,
+		const glm::vec3 & origin,
+		const glm::vec3 & inverseDirection,
+		float distance,
+		float * near
+) {
+#if defined(__SSE__)
+	__m128 originX = _mm_set1_ps(origin.x);
+	__m128 originY = _mm_set1_ps(origin.y);
+	__m128 originZ = _mm_set1_ps(origin.z);
+	__m128 inverseX = _mm_set1_ps(inverseDirection.x);
+	__m128 inverseY = _mm_set1_ps(inverseDirection.y);
+	__m128 inverseZ = _mm_set1_ps(inverseDirection.z);
+	__m128 x0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minX), originX), inverseX);
+	__m128 x1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxX), originX), inverseX);
+	__m128 y0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minY), originY), inverseY);
+	__m128 y1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxY), originY), inverseY);
+	__m128 z0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minZ), originZ), inverseZ);
+	__m128 z1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxZ), originZ), inverseZ);
+	__m128 enter = _mm_max_ps(_mm_max_ps(_mm_min_ps(x0, x1), _mm_min_ps(y0, y1)),
+			_mm_max_ps(_mm_min_ps(z0, z1), _mm_setzero_ps()));
+	__m128 leave = _mm_min_ps(_mm_min_ps(_mm_max_ps(x0, x1), _mm_max_ps(y0, y1)),
+			_mm_min_ps(_mm_max_ps(z0, z1), _mm_set1_ps(distance)));
+	_mm_storeu_ps(near, enter);
+	return _mm_movemask_ps(_mm_cmple_ps(enter, leave));
+#else
+	int mask = 0;
+	for (int i = 0; i < 4; ++i) {
+		float x0 = (node.minX[i] - origin.x) * inverseDirection.x;
+		float x1 = (node.maxX[i] - origin.x) * inverseDirection.x;
+		float y0 = (node.minY[i] - origin.y) * inverseDirection.y;
+		float y1 = (node.maxY[i] - origin.y) * inverseDirection.y;
+		float z0 = (node.minZ[i] - origin.z) * inverseDirection.z;
+		float z1 = (node.maxZ[i] - origin.z) * inverseDirection.z;
+		float enter = std::max(std::max(std::min(x0, x1), std::min(y0, y1)), std::max(std::min(z0, z1), 0.0f));
+		float leave = std::min(std::min(std::max(x0, x1), std::max(y0, y1)), std::min(std::max(z0, z1), distance));
+		near[i] = enter;
+		mask |= enter <= leave ? 1 << i : 0;
+	}
+	return mask;
+#endif
+}
+
+//---------------------------------------------------------------------------------------
+// Slab test of every ray of rays, each up to its own distance, against one box of
+// node.  Returns the rays that enter it as a bit mask, and sets near to where the
+// first of them does.
+int TriangleBvh::hitPacket (
+		const Node & node,
+		unsigned int child,
+		const PacketRays & rays,
+		const float * distance,
+		float & near
+) {
+	float enters[BVH_PACKET_SIZE];
+	int mask = 0;
+#if defined(__SSE__)
+	__m128 originX = _mm_loadu_ps(rays.originX);
+	__m128 originY = _mm_loadu_ps(rays.originY);
+	__m128 originZ = _mm_loadu_ps(rays.originZ);
+	__m128 x0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.minX[child]), originX), _mm_loadu_ps(rays.inverseX));
+	__m128 x1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.maxX[child]), originX), _mm_loadu_ps(rays.inverseX));
+	__m128 y0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.minY[child]), originY), _mm_loadu_ps(rays.inverseY));
+	__m128 y1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.maxY[child]), originY), _mm_loadu_ps(rays.inverseY));
+	__m128 z0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.minZ[child]), originZ), _mm_loadu_ps(rays.inverseZ));
+	__m128 z1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.maxZ[child]), originZ), _mm_loadu_ps(rays.inverseZ));
+	__m128 enter = _mm_max_ps(_mm_max_ps(_mm_min_ps(x0, x1), _mm_min_ps(y0, y1)),
+			_mm_max_ps(_mm_min_ps(z0, z1), _mm_setzero_ps()));
+	__m128 leave = _mm_min_ps(_mm_min_ps(_mm_max_ps(x0, x1), _mm_max_ps(y0, y1)),
+			_mm_min_ps(_mm_max_ps(z0, z1), _mm_loadu_ps(distance)));
+	_mm_storeu_ps(enters, enter);
+	mask = _mm_movemask_ps(_mm_cmple_ps(enter, leave));
+#else
+	for (unsigned int ray = 0; ray < BVH_PACKET_SIZE; ++ray) {
+		float x0 = (node.minX[child] - rays.originX[ray]) * rays.inverseX[ray];
+		float x1 = (node.maxX[child] - rays.originX[ray]) * rays.inverseX[ray];
+		float y0 = (node.minY[child] - rays.originY[ray]) * rays.inverseY[ray];
+		float y1 = (node.maxY[child] - rays.originY[ray]) * rays.inverseY[ray];
+		float z0 = (node.minZ[child] - rays.originZ[ray]) * rays.inverseZ[ray];
+		float z1 = (node.maxZ[child] - rays.originZ[ray]) * rays.inverseZ[ray];
+		float enter = std::max(std::max(std::min(x0, x1), std::min(y0, y1)), std::max(std::min(z0, z1), 0.0f));
+		float leave = std::min(std::min(std::max(x0, x1), std::max(y0, y1)), std::min(std::max(z0, z1), distance[ray]));
+		enters[ray] = enter;
+		mask |= enter <= leave ? 1 << ray : 0;
+	}
+#endif
+	near = FLT_MAX;
+	for (unsigned int ray = 0; ray < BVH_PACKET_SIZE; ++ray) {
+		if (mask & (1 << ray)) {
+			near = std::min(near, enters[ray]);
+		}
+	}
+	return mask;
+}
+
+//---------------------------------------------------------------------------------------
+// Moller-Trumbore against m_triangles[first, first + count), two sided.
+void TriangleBvh::intersectLeaf (
+		unsigned int first,
+		unsigned int count,
+		const glm::vec3 & origin,
+		const glm::vec3 & direction,
+		float & distance,
+		TriangleHit * hitTriangle,
+		bool & hit
+) const {
+	for (unsigned int i = first; i < first + count; ++i) {
+		const Triangle & triangle = m_triangles[i];
+		vec3 p = cross(direction, triangle.edge2);
+		float determinant = dot(triangle.edge1, p);
+		if (determinant == 0.0f) {
+			continue;
+		}
+		float inverseDeterminant = 1.0f / determinant;
+		vec3 s = origin - triangle.v0;
+		float u = dot(s, p) * inverseDeterminant;
+		if (u < 0.0f || u > 1.0f) {
+			continue;
+		}
+		vec3 q = cross(s, triangle.edge1);
+		float v = dot(direction, q) * inverseDeterminant;
+		if (v < 0.0f || u + v > 1.0f) {
+			continue;
+		}
+		float t = dot(triangle.edge2, q) * inverseDeterminant;
+		if (t > 0.0f && t < distance) {
+			distance = t;
+			hit = true;
+			if (hitTriangle) {
+				hitTriangle->triangle = m_triangleIds[i];
+				hitTriangle->u = u;
+				hitTriangle->v = v;
+			}
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------
+size_t TriangleBvh::numTriangles() const {
+	return m_triangles.size();
+}
+
+//---------------------------------------------------------------------------------------
+size_t TriangleBvh::numNodes() const {
+	return m_nodes.size();
+}
+
+//---------------------------------------------------------------------------------------
+const AABB & TriangleBvh::bounds() const {
+	return m_bounds;
+}
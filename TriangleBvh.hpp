@@ -0,0 +1,157 @@
+#pragma once
+
+#include "AABB.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <vector>
+
+class WorkerPool;
+
+// Triangles a TriangleBvh leaf holds at most, and splits that are cheaper than a leaf
+// of the same triangles are taken even below it.
+const unsigned int BVH_MAX_LEAF_TRIANGLES = 4;
+
+// Rays TriangleBvh::intersectPacket() traces together.
+const unsigned int BVH_PACKET_SIZE = 4;
+
+// Which triangle a ray hit, numbered in the order addTriangles() added them, and
+// where: the hit is (1 - u - v) * corner 0 + u * corner 1 + v * corner 2.
+struct TriangleHit {
+	unsigned int triangle;
+	float u;
+	float v;
+};
+
+// Rays that start and point close together, such as the camera rays through a 2x2
+// block of pixels, and so mostly visit the same nodes.
+struct RayPacket {
+	glm::vec3 origin[BVH_PACKET_SIZE];
+	glm::vec3 direction[BVH_PACKET_SIZE];
+	// How far each ray reaches; set to the t of its nearest hit.
+	float distance[BVH_PACKET_SIZE];
+	TriangleHit hit[BVH_PACKET_SIZE];
+};
+
+/*
+ * Bounding volume hierarchy over a triangle soup, for the first hit along a ray, such
+ * as where the spotlight lands on a rooftop or a facade instead of the ground.
+ *
+ * build() splits with the surface area heuristic over binned centroids, handing the
+ * subtrees below the first few levels to a WorkerPool.  The binary tree is then
+ * collapsed into nodes of four children whose boxes are stored axis by axis, so
+ * intersect() tests a ray against all four at once with SSE.  intersectPacket() turns
+ * that around and tests four rays against one box at once.
+ *
+ * addTriangles() copies the triangles, so their source may go away right after.
+ * build() is called once, after the last of them.
+ */
+class TriangleBvh {
+public:
+	TriangleBvh();
+
+	// Adds the triangles positions[indices[0..2]], positions[indices[3..5]], ...
+	void addTriangles(const glm::vec3 * positions, const unsigned int * indices, size_t numIndices);
+
+	// Builds the tree over every triangle added, on the pool's threads or, with none,
+	// on the calling thread.
+	void build(WorkerPool * pool = nullptr);
+
+	// Looks for a triangle, from either side, hit at origin + t * direction for
+	// 0 < t < distance.  Returns false if there is none; otherwise sets distance to
+	// the t of the nearest.  Safe to call from several threads at once.
+	bool intersect(const glm::vec3 & origin, const glm::vec3 & direction, float & distance) const;
+	// As above, also telling which triangle was hit.
+	bool intersect(const glm::vec3 & origin, const glm::vec3 & direction, float & distance,
+			TriangleHit & hit) const;
+
+	// intersect() for every ray of packet, sharing the walk through the tree.  Returns
+	// the rays that hit something as a bit mask.
+	int intersectPacket(RayPacket & packet) const;
+
+	size_t numTriangles() const;
+	size_t numNodes() const;
+	// Bounds of every triangle, empty before the first build().
+	const AABB & bounds() const;
+
+private:
+	// A triangle as one corner and the edges leaving it, as the intersection test
+	// wants them.
+	struct Triangle {
+		glm::vec3 v0;
+		glm::vec3 edge1;
+		glm::vec3 edge2;
+	};
+
+	// Four children, each either another node or a leaf run of m_triangles.
+	struct Node {
+		float minX[4];
+		float minY[4];
+		float minZ[4];
+		float maxX[4];
+		float maxY[4];
+		float maxZ[4];
+		// Node index, or first triangle of a leaf.
+		unsigned int child[4];
+		// Triangles of a leaf; 0 for a node, and EMPTY_CHILD for an unused slot.
+		unsigned int count[4];
+	};
+
+	// Binary tree build() splits into before collapsing it.
+	struct BuildNode {
+		AABB bounds;
+		// Children of an inner node; the triangle range of a leaf.
+		unsigned int left;
+		unsigned int right;
+		unsigned int first;
+		unsigned int count;
+	};
+
+	// The rays of a RayPacket axis by axis, as the SSE box test loads them.
+	struct PacketRays {
+		float originX[BVH_PACKET_SIZE];
+		float originY[BVH_PACKET_SIZE];
+		float originZ[BVH_PACKET_SIZE];
+		float inverseX[BVH_PACKET_SIZE];
+		float inverseY[BVH_PACKET_SIZE];
+		float inverseZ[BVH_PACKET_SIZE];
+	};
+
+	// A range of m_order left for a worker, and the node that will hold its root.
+	struct BuildTask {
+		unsigned int node;
+		unsigned int first;
+		unsigned int count;
+		unsigned int depth;
+	};
+
+	static const unsigned int EMPTY_CHILD = ~0u;
+
+	unsigned int buildNode(std::vector<BuildNode> & nodes, unsigned int first, unsigned int count,
+			unsigned int depth, std::vector<BuildTask> * tasks, unsigned int taskSize);
+	bool split(const AABB & bounds, unsigned int first, unsigned int count, unsigned int depth,
+			unsigned int & middle);
+	unsigned int collapse(const std::vector<BuildNode> & nodes, unsigned int index);
+	bool traverse(const glm::vec3 & origin, const glm::vec3 & direction, float & distance,
+			TriangleHit * hit) const;
+	static int hitChildren(const Node & node, const glm::vec3 & origin, const glm::vec3 & inverseDirection,
+			float distance, float * near);
+	static int hitPacket(const Node & node, unsigned int child, const PacketRays & rays,
+			const float * distance, float & near);
+	void intersectLeaf(unsigned int first, unsigned int count, const glm::vec3 & origin,
+			const glm::vec3 & direction, float & distance, TriangleHit * hitTriangle, bool & hit) const;
+
+	// Added triangles, then their bounds and centroids while building.
+	std::vector<glm::vec3> m_corners;
+	std::vector<AABB> m_triangleBounds;
+	std::vector<glm::vec3> m_centroids;
+	// Triangle ids in leaf order while building.
+	std::vector<unsigned int> m_order;
+
+	std::vector<Node> m_nodes;
+	std::vector<Triangle> m_triangles;
+	// What addTriangles() numbered each of m_triangles.
+	std::vector<unsigned int> m_triangleIds;
+	AABB m_bounds;
+};
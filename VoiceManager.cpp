@@ -0,0 +1,251 @@
+#include "VoiceManager.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+using namespace std;
+using namespace glm;
+using namespace irrklang;
+
+namespace {
+
+// What irrKlang reports for a play length or position it does not know.
+const ik_u32 UNKNOWN_MILLISECONDS = (ik_u32)-1;
+
+} // namespace
+
+//---------------------------------------------------------------------------------------
+VoiceManager::VoiceManager(unsigned int maxVoices)
+	: m_engine(nullptr),
+	  m_maxVoices(maxVoices),
+	  m_numReal(0),
+	  m_numVirtual(0)
+{
+
+}
+
+//---------------------------------------------------------------------------------------
+VoiceManager::~VoiceManager() {
+	stopAll();
+}
+
+//---------------------------------------------------------------------------------------
+void VoiceManager::setEngine(irrklang::ISoundEngine * engine) {
+	m_engine = engine;
+}
+
+//---------------------------------------------------------------------------------------
+VoiceHandle VoiceManager::add (
+		const std::string & file,
+		const glm::vec3 & position,
+		float minDistance,
+		bool paused
+) {
+	auto inserted = m_fileIndices.insert(make_pair(file, (unsigned int)m_files.size()));
+	if (inserted.second) {
+		m_files.push_back(File{file, nullptr, false, 0.0, false});
+	}
+	Emitter emitter;
+	emitter.file = inserted.first->second;
+	emitter.position = position;
+	emitter.minDistance = minDistance;
+	emitter.paused = paused;
+	emitter.wanted = false;
+	emitter.sound = nullptr;
+	emitter.gain = 0.0f;
+	emitter.playSeconds = 0.0;
+	if (!paused) {
+		++m_numVirtual;
+	}
+	if (!m_freeEmitters.empty()) {
+		VoiceHandle voice = m_freeEmitters.back();
+		m_freeEmitters.pop_back();
+		m_emitters[voice] = emitter;
+		return voice;
+	}
+	m_emitters.push_back(emitter);
+	return m_emitters.size() - 1;
+}
+
+//---------------------------------------------------------------------------------------
+void VoiceManager::remove(VoiceHandle voice) {
+	setPaused(voice, true);
+	m_freeEmitters.push_back(voice);
+}
+
+//---------------------------------------------------------------------------------------
+void VoiceManager::setPosition(VoiceHandle voice, const glm::vec3 & position) {
+	Emitter & emitter = m_emitters[voice];
+	emitter.position = position;
+	if (emitter.sound) {
+		emitter.sound->setPosition(vec3df(position.x, position.y, position.z));
+	}
+}
+
+//---------------------------------------------------------------------------------------
+void VoiceManager::setPaused(VoiceHandle voice, bool paused) {
+	Emitter & emitter = m_emitters[voice];
+	if (emitter.paused == paused) {
+		return;
+	}
+	emitter.paused = paused;
+	if (paused) {
+		if (emitter.sound) {
+			makeVirtual(emitter);
+			--m_numReal;
+		} else {
+			--m_numVirtual;
+		}
+	} else {
+		++m_numVirtual;
+	}
+	emitter.wanted = false;
+}
+
+//---------------------------------------------------------------------------------------
+/*
+ * Picking the loudest is a partial sort of the playing emitters.  A new real voice
+ * starts silent and fades in; a dropped one fades out and only then releases its
+ * irrKlang voice.
+ */
+void VoiceManager::update(const glm::vec3 & listener, float seconds) {
+	m_candidates.clear();
+	for (unsigned int i = 0; i < m_emitters.size(); ++i) {
+		Emitter & emitter = m_emitters[i];
+		if (emitter.paused || m_files[emitter.file].unplayable) {
+			continue;
+		}
+		float loudness = emitter.minDistance / std::max(distance(emitter.position, listener), emitter.minDistance);
+		if (emitter.sound && emitter.wanted) {
+			loudness *= VOICE_HYSTERESIS;
+		}
+		m_candidates.push_back(make_pair(loudness, i));
+	}
+	size_t numWanted = m_engine ? std::min<size_t>(m_maxVoices, m_candidates.size()) : 0;
+	nth_element(m_candidates.begin(), m_candidates.begin() + numWanted, m_candidates.end(),
+			greater<pair<float, unsigned int>>());
+	for (size_t i = 0; i < m_candidates.size(); ++i) {
+		m_emitters[m_candidates[i].second].wanted = i < numWanted;
+	}
+
+	float fadeStep = seconds / VOICE_FADE_SECONDS;
+	m_numReal = 0;
+	m_numVirtual = 0;
+	for (Emitter & emitter : m_emitters) {
+		if (emitter.paused) {
+			continue;
+		}
+		if (emitter.sound) {
+			if (emitter.wanted) {
+				emitter.gain = std::min(emitter.gain + fadeStep, 1.0f);
+			} else {
+				emitter.gain -= fadeStep;
+			}
+			if (emitter.gain > 0.0f) {
+				emitter.sound->setVolume(emitter.gain);
+			} else {
+				makeVirtual(emitter);
+			}
+		} else if (emitter.wanted) {
+			makeReal(emitter);
+		}
+
+		if (emitter.sound) {
+			++m_numReal;
+			continue;
+		}
+		++m_numVirtual;
+		double length = m_files[emitter.file].length;
+		emitter.playSeconds += seconds;
+		if (length > 0.0) {
+			emitter.playSeconds = fmod(emitter.playSeconds, length);
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------
+void VoiceManager::stopAll() {
+	for (Emitter & emitter : m_emitters) {
+		if (emitter.sound) {
+			makeVirtual(emitter);
+		}
+	}
+	m_numVirtual += m_numReal;
+	m_numReal = 0;
+}
+
+//---------------------------------------------------------------------------------------
+const std::string & VoiceManager::file(VoiceHandle voice) const {
+	return m_files[m_emitters[voice].file].path;
+}
+
+//---------------------------------------------------------------------------------------
+const glm::vec3 & VoiceManager::position(VoiceHandle voice) const {
+	return m_emitters[voice].position;
+}
+
+//---------------------------------------------------------------------------------------
+float VoiceManager::minDistance(VoiceHandle voice) const {
+	return m_emitters[voice].minDistance;
+}
+
+//---------------------------------------------------------------------------------------
+bool VoiceManager::isPaused(VoiceHandle voice) const {
+	return m_emitters[voice].paused;
+}
+
+//---------------------------------------------------------------------------------------
+unsigned int VoiceManager::size() const {
+	return m_emitters.size();
+}
+
+//---------------------------------------------------------------------------------------
+unsigned int VoiceManager::numReal() const {
+	return m_numReal;
+}
+
+//---------------------------------------------------------------------------------------
+unsigned int VoiceManager::numVirtual() const {
+	return m_numVirtual;
+}
+
+//---------------------------------------------------------------------------------------
+// Starts paused so the voice can be moved to where the virtual loop got to first.
+void VoiceManager::makeReal(Emitter & emitter) {
+	File & file = m_files[emitter.file];
+	if (!file.resolved) {
+		file.source = m_engine->getSoundSource(file.path.c_str(), false);
+		file.resolved = true;
+	}
+	vec3df position(emitter.position.x, emitter.position.y, emitter.position.z);
+	ISound * sound = file.source ? m_engine->play3D(file.source, position, true, true, true)
+			: m_engine->play3D(file.path.c_str(), position, true, true, true);
+	if (!sound) {
+		file.unplayable = true;
+		return;
+	}
+	sound->setMinDistance(emitter.minDistance);
+	ik_u32 playLength = sound->getPlayLength();
+	if (file.length == 0.0 && playLength != UNKNOWN_MILLISECONDS && playLength > 0) {
+		file.length = playLength / 1000.0;
+	}
+	if (file.length > 0.0) {
+		sound->setPlayPosition((ik_u32)(fmod(emitter.playSeconds, file.length) * 1000.0));
+	}
+	sound->setVolume(0.0f);
+	sound->setIsPaused(false);
+	emitter.sound = sound;
+	emitter.gain = 0.0f;
+}
+
+//---------------------------------------------------------------------------------------
+void VoiceManager::makeVirtual(Emitter & emitter) {
+	ik_u32 playPosition = emitter.sound->getPlayPosition();
+	if (playPosition != UNKNOWN_MILLISECONDS) {
+		emitter.playSeconds = playPosition / 1000.0;
+	}
+	emitter.sound->stop();
+	emitter.sound->drop();
+	emitter.sound = nullptr;
+	emitter.gain = 0.0f;
+}
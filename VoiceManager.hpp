@@ -0,0 +1,118 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <irrKlang.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Identifies a sound emitter registered with a VoiceManager.
+typedef unsigned int VoiceHandle;
+const VoiceHandle NO_VOICE = ~0u;
+
+// Real irrKlang voices mixed at once unless --voices says otherwise.
+const unsigned int DEFAULT_MAX_VOICES = 32;
+// Seconds a voice takes to fade in or out when it is swapped.
+const float VOICE_FADE_SECONDS = 0.5f;
+// A real voice keeps its place until a virtual one is this much louder, so emitters
+// near the cut-off do not swap back and forth.
+const float VOICE_HYSTERESIS = 1.5f;
+
+/*
+ * Looping 3D sound emitters.  Only the maxVoices loudest at the listener play as
+ * real irrKlang voices, each decoding and mixing its own stream.  The others are
+ * virtual: they keep their position and their place in the loop and cost nothing.
+ * When one becomes loud enough again it fades in where it would have been.
+ *
+ * Loudness is estimated with irrKlang's default rolloff, minDistance / distance.
+ * Nothing here is thread safe.  Once the simulation runs, only its thread uses it.
+ */
+class VoiceManager {
+public:
+	explicit VoiceManager(unsigned int maxVoices = DEFAULT_MAX_VOICES);
+	~VoiceManager();
+
+	// Without an engine every emitter stays virtual.
+	void setEngine(irrklang::ISoundEngine * engine);
+
+	// Registers an emitter looping file, playing unless paused.  It becomes audible
+	// at the next update().
+	VoiceHandle add(const std::string & file, const glm::vec3 & position, float minDistance, bool paused = false);
+
+	// Stops and forgets an emitter.  Its handle is reused by a later add().
+	void remove(VoiceHandle voice);
+
+	void setPosition(VoiceHandle voice, const glm::vec3 & position);
+
+	// Pausing silences a real voice at once and hands its place to the next loudest.
+	void setPaused(VoiceHandle voice, bool paused);
+
+	// Picks the real voices for the listener at listener and advances fades and
+	// virtual loops by seconds.
+	void update(const glm::vec3 & listener, float seconds);
+
+	// Stops every real voice.  Must happen before the engine is dropped.
+	void stopAll();
+
+	// As given to add(), and paused as last set.  Handles are dense from 0 in the
+	// order the emitters were added, as long as none was removed.
+	const std::string & file(VoiceHandle voice) const;
+	const glm::vec3 & position(VoiceHandle voice) const;
+	float minDistance(VoiceHandle voice) const;
+	bool isPaused(VoiceHandle voice) const;
+
+	unsigned int size() const;
+	unsigned int numReal() const;
+	// Emitters that are playing but not real.
+	unsigned int numVirtual() const;
+
+private:
+	VoiceManager(const VoiceManager &) = delete;
+	VoiceManager & operator = (const VoiceManager &) = delete;
+
+	struct File {
+		std::string path;
+		// The engine's shared source for the file, looked up on first play.  Null to
+		// have irrKlang load the file by name.
+		irrklang::ISoundSource * source;
+		bool resolved;
+		// Loop length in seconds, 0 until the source or a real voice reported it.
+		double length;
+		// The engine could not play it, e.g. the null driver of benchmarks.  Its
+		// emitters stay virtual rather than retry every update().
+		bool unplayable;
+	};
+
+	struct Emitter {
+		unsigned int file;
+		glm::vec3 position;
+		float minDistance;
+		bool paused;
+		// Among the loudest at the last update().
+		bool wanted;
+		// The real voice, or null while virtual.
+		irrklang::ISound * sound;
+		float gain;
+		// Where in the loop the emitter is, while virtual.
+		double playSeconds;
+	};
+
+	void makeReal(Emitter & emitter);
+	void makeVirtual(Emitter & emitter);
+
+	irrklang::ISoundEngine * m_engine;
+	unsigned int m_maxVoices;
+
+	std::vector<File> m_files;
+	std::unordered_map<std::string, unsigned int> m_fileIndices;
+	std::vector<Emitter> m_emitters;
+	// Handles of removed emitters, which stay paused until reused.
+	std::vector<VoiceHandle> m_freeEmitters;
+
+	// Loudness and emitter index of every playing emitter, rebuilt by update().
+	std::vector<std::pair<float, unsigned int>> m_candidates;
+
+	unsigned int m_numReal;
+	unsigned int m_numVirtual;
+};
@@ -0,0 +1,102 @@
+#include "WorkerPool.hpp"
+
+#include <algorithm>
+using namespace std;
+
+//---------------------------------------------------------------------------------------
+WorkerPool::WorkerPool(unsigned int numThreads)
+	: m_job(nullptr),
+	  m_count(0),
+	  m_nextIteration(0),
+	  m_generation(0),
+	  m_activeWorkers(0),
+	  m_stopping(false)
+{
+	if (numThreads == 0) {
+		numThreads = std::max(thread::hardware_concurrency(), 1u);
+	}
+	for (unsigned int i = 1; i < numThreads; ++i) {
+		m_threads.push_back(thread(&WorkerPool::workerLoop, this));
+	}
+}
+
+//---------------------------------------------------------------------------------------
+WorkerPool::~WorkerPool() {
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_wake.notify_all();
+	for (thread & worker : m_threads) {
+		worker.join();
+	}
+}
+
+//---------------------------------------------------------------------------------------
+unsigned int WorkerPool::numThreads() const {
+	return m_threads.size() + 1;
+}
+
+//---------------------------------------------------------------------------------------
+void WorkerPool::parallelFor (
+		size_t count,
+		const std::function<void(size_t)> & job
+) {
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_job = &job;
+		m_count = count;
+		m_nextIteration = 0;
+		m_activeWorkers = m_threads.size();
+		m_error = nullptr;
+		++m_generation;
+	}
+	m_wake.notify_all();
+
+	runIterations();
+
+	unique_lock<mutex> lock(m_mutex);
+	m_finished.wait(lock, [this] { return m_activeWorkers == 0; });
+	m_job = nullptr;
+	if (m_error) {
+		exception_ptr error = m_error;
+		m_error = nullptr;
+		rethrow_exception(error);
+	}
+}
+
+//---------------------------------------------------------------------------------------
+void WorkerPool::workerLoop() {
+	unsigned int seenGeneration = 0;
+	for (;;) {
+		{
+			unique_lock<mutex> lock(m_mutex);
+			m_wake.wait(lock, [&] { return m_stopping || m_generation != seenGeneration; });
+			if (m_stopping) {
+				return;
+			}
+			seenGeneration = m_generation;
+		}
+
+		runIterations();
+
+		lock_guard<mutex> lock(m_mutex);
+		if (--m_activeWorkers == 0) {
+			m_finished.notify_one();
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------
+void WorkerPool::runIterations() {
+	for (size_t i = m_nextIteration++; i < m_count; i = m_nextIteration++) {
+		try {
+			(*m_job)(i);
+		} catch (...) {
+			lock_guard<mutex> lock(m_mutex);
+			if (!m_error) {
+				m_error = current_exception();
+			}
+		}
+	}
+}
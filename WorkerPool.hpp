@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Fixed set of threads that run the iterations of parallelFor().  The calling thread
+ * works alongside them, so a pool of one thread runs everything inline.
+ */
+class WorkerPool {
+public:
+	// numThreads counts the calling thread; 0 means one per hardware thread.
+	explicit WorkerPool(unsigned int numThreads = 0);
+
+	~WorkerPool();
+
+	unsigned int numThreads() const;
+
+	// Calls job(i) for every i in [0, count) and returns once all calls finished.
+	// Iterations may run in any order and on any thread.  The first exception thrown
+	// by a job is rethrown here, after the remaining iterations completed.
+	void parallelFor(size_t count, const std::function<void(size_t)> & job);
+
+private:
+	WorkerPool(const WorkerPool &) = delete;
+	WorkerPool & operator = (const WorkerPool &) = delete;
+
+	void workerLoop();
+	void runIterations();
+
+	std::vector<std::thread> m_threads;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_finished;
+
+	const std::function<void(size_t)> * m_job;
+	size_t m_count;
+	std::atomic<size_t> m_nextIteration;
+	// Bumped by every parallelFor() so sleeping workers can tell a new batch arrived.
+	unsigned int m_generation;
+	unsigned int m_activeWorkers;
+	bool m_stopping;
+	std::exception_ptr m_error;
+};
@@ -0,0 +1,298 @@
+// Times building a city from Assets/scene.lua and the street generator against
+// restoring it from a CitySnapshot, at crowd densities up to the largest the
+// program accepts, and checks that the restored city matches the generated one.
+//
+// The generator here is a serial copy of Project's street and crowd placement with
+// static geometry baked, which is all a snapshot replaces.
+//
+// Usage: ./CitySnapshotBench [snapshot file]
+
+#include "Building.hpp"
+#include "CityGrid.hpp"
+#include "CityRandom.hpp"
+#include "CitySnapshot.hpp"
+#include "Crowd.hpp"
+#include "GeometryNode.hpp"
+#include "Person.hpp"
+#include "SceneArena.hpp"
+#include "SceneRegistry.hpp"
+#include "StaticGeometry.hpp"
+#include "VoiceManager.hpp"
+#include "scene_lua.hpp"
+
+#include "framework/AssetPack.hpp"
+#include "framework/MappedFile.hpp"
+#include "framework/MeshConsolidator.hpp"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <initializer_list>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+using namespace glm;
+using namespace std;
+
+namespace {
+
+const char * SCENE_FILE = "Assets/scene.lua";
+const unsigned int SEED = 1;
+
+struct City {
+	City() : crowd(&voices), root(nullptr) { }
+
+	SceneArena arena;
+	StaticGeometry staticGeometry;
+	VoiceManager voices;
+	Crowd crowd;
+	SceneNode * root;
+};
+
+//---------------------------------------------------------------------------------------
+bool isResidentialBlock(int blockX, int blockZ) {
+	return blockX >= 0 && blockZ >= 0 && (blockZ < 3 ? blockX < 4 : blockZ == 3 && blockX < 2);
+}
+
+//---------------------------------------------------------------------------------------
+void fillStreet(CityRandom & random, City & city, float startx, float startz, int leftoverSpace,
+		char axis, int rotate) {
+	SceneArena scratch;
+	while (leftoverSpace != 0) {
+		int space = clamp((random.nextInt(leftoverSpace) / 2 + 1) * 2, 2, 8);
+		leftoverSpace -= space;
+		if (random.nextInt(100) < 50) {
+			(axis == 'x' ? startx += space : startz -= space);
+			continue;
+		}
+		int width = clamp(space - 2, 2, 6);
+		int delta = random.nextInt(space - width + 1);
+		int doorI = random.nextInt(9) + 15;
+		int windowI = random.nextInt(10) + 24;
+		int roofI = random.nextInt(10) + 34;
+		bool apartment = random.nextInt(100) < 5;
+		int height = apartment ? random.nextInt(5) + 10 : random.nextInt(3) + 3;
+		int perturb = random.nextInt(2) * (rotate == 180 || rotate == 270 ? -1 : 1);
+		vec3 corner = axis == 'x' ? vec3(startx + delta, 0.0f, startz - perturb)
+				: vec3(startx - perturb, 0.0f, startz - delta);
+		unique_ptr<Building> building;
+		if (apartment) {
+			building.reset(new Apartment(width, height, height, corner, doorI, windowI, roofI, rotate));
+		} else {
+			building.reset(new Store(width, height, height, corner, doorI, windowI, roofI, rotate));
+			if (random.nextInt(100) < 2) {
+				city.voices.add("Assets/sounds/store.wav", corner, 0.5f);
+			}
+		}
+		(axis == 'x' ? startx += space : startz -= space);
+		building->grow(random);
+		SceneArena::Scope scratchScope(scratch);
+		city.staticGeometry.bake(*building->create());
+		scratch.rewind();
+	}
+}
+
+//---------------------------------------------------------------------------------------
+void placePeople(CityRandom & random, City & city, const vector<MaterialHandle> & materials,
+		unsigned int density, int startx, int endx, int startz, int endz) {
+	for (int x = startx; x < endx; ++x) {
+		for (int z = startz; z > endz; --z) {
+			if (random.nextInt(200) >= (int)density) {
+				continue;
+			}
+			float heading = random.nextInt(359);
+			SceneNode * node = createPerson(materials[random.nextInt(9)], materials[random.nextInt(9)],
+					materials[random.nextInt(9)], materials[random.nextInt(4) + 9]);
+			VoiceHandle audio = NO_VOICE;
+			VoiceHandle panicAudio = NO_VOICE;
+			if (random.nextInt(100) < 5) {
+				audio = city.voices.add("Assets/sounds/talk.wav", vec3(x, 0, z), 0.3f);
+				panicAudio = city.voices.add("Assets/sounds/scream.wav", vec3(x, 0, z), 0.5f);
+			}
+			city.root->add_child(node);
+			city.crowd.add(node, x, z, heading, audio, panicAudio);
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------
+double millisecondsSince(chrono::steady_clock::time_point start) {
+	return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+//---------------------------------------------------------------------------------------
+double generate(City & city, const MeshConsolidator & meshes, const vector<MaterialHandle> & materials,
+		unsigned int density) {
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	SceneArena::Scope arenaScope(city.arena);
+	city.root = import_lua(SCENE_FILE);
+	city.staticGeometry.setSourceMeshes(meshes);
+	int firstBlock = cityBlockIndex(-CITY_HALF_EXTENT);
+	int lastBlock = cityBlockIndex(CITY_HALF_EXTENT - 1.0f);
+	int halfExtent = CITY_HALF_EXTENT;
+	for (int blockZ = firstBlock; blockZ <= lastBlock; ++blockZ) {
+		for (int blockX = firstBlock; blockX <= lastBlock; ++blockX) {
+			int minX = CITY_BLOCK_ORIGIN + blockX * CITY_BLOCK_SIZE;
+			int minZ = CITY_BLOCK_ORIGIN + blockZ * CITY_BLOCK_SIZE;
+			CityRandom peopleRandom(SEED, blockX, blockZ, CityStream::People);
+			placePeople(peopleRandom, city, materials, density, std::max(minX, -halfExtent),
+					std::min(minX + (int)CITY_BLOCK_SIZE, halfExtent),
+					std::min(minZ + (int)CITY_BLOCK_SIZE, halfExtent), std::max(minZ, -halfExtent));
+			if (isResidentialBlock(blockX, blockZ)) {
+				CityRandom random(SEED, blockX, blockZ, CityStream::Buildings);
+				int x = minX + 3;
+				int z = minZ + 47;
+				fillStreet(random, city, x, z, 44, 'x', 0);
+				fillStreet(random, city, x + 38, z - 7, 36, 'z', 90);
+				fillStreet(random, city, x, z - 38, 36, 'x', 180);
+				fillStreet(random, city, x, z - 7, 30, 'z', 270);
+			}
+		}
+	}
+	city.staticGeometry.consolidate();
+	return millisecondsSince(start);
+}
+
+//---------------------------------------------------------------------------------------
+void collectNodes(const SceneNode & node, vector<const SceneNode *> & nodes) {
+	nodes.push_back(&node);
+	for (const SceneNode * child : node.children) {
+		collectNodes(*child, nodes);
+	}
+}
+
+//---------------------------------------------------------------------------------------
+bool sameBytes(const void * a, const void * b, size_t size) {
+	return size == 0 || memcmp(a, b, size) == 0;
+}
+
+//---------------------------------------------------------------------------------------
+bool sameCity(const City & a, const City & b) {
+	vector<const SceneNode *> nodesA, nodesB;
+	collectNodes(*a.root, nodesA);
+	collectNodes(*b.root, nodesB);
+	if (nodesA.size() != nodesB.size()) {
+		return false;
+	}
+	for (size_t i = 0; i < nodesA.size(); ++i) {
+		const SceneNode & nodeA = *nodesA[i];
+		const SceneNode & nodeB = *nodesB[i];
+		if (nodeA.m_name.str() != nodeB.m_name.str() || nodeA.m_nodeType != nodeB.m_nodeType
+				|| nodeA.textureIndex != nodeB.textureIndex) {
+			return false;
+		}
+		for (int column = 0; column < 4; ++column) {
+			if (distance(nodeA.get_transform()[column], nodeB.get_transform()[column]) > 1.0e-4f) {
+				return false;
+			}
+		}
+		if (nodeA.m_nodeType == NodeType::GeometryNode) {
+			const GeometryNode & geometryA = static_cast<const GeometryNode &>(nodeA);
+			const GeometryNode & geometryB = static_cast<const GeometryNode &>(nodeB);
+			if (geometryA.mesh != geometryB.mesh || geometryA.material != geometryB.material) {
+				return false;
+			}
+		}
+	}
+
+	if (a.crowd.size() != b.crowd.size() || a.voices.size() != b.voices.size()) {
+		return false;
+	}
+	for (unsigned int agent = 0; agent < a.crowd.size(); ++agent) {
+		if (a.crowd.positionsX()[agent] != b.crowd.positionsX()[agent]
+				|| a.crowd.positionsZ()[agent] != b.crowd.positionsZ()[agent]
+				|| a.crowd.audio(agent) != b.crowd.audio(agent)
+				|| a.crowd.follower(agent) != b.crowd.follower(agent)) {
+			return false;
+		}
+	}
+
+	const StaticGeometry & staticA = a.staticGeometry;
+	const StaticGeometry & staticB = b.staticGeometry;
+	size_t positionBytes = staticA.getNumVertexPositionBytes();
+	size_t indexBytes = staticA.getNumIndexBytes();
+	return positionBytes == staticB.getNumVertexPositionBytes() && indexBytes == staticB.getNumIndexBytes()
+		&& staticA.getBatches().size() == staticB.getBatches().size()
+		&& staticA.getNumBakedNodes() == staticB.getNumBakedNodes()
+		&& sameBytes(staticA.getVertexPositionDataPtr(), staticB.getVertexPositionDataPtr(), positionBytes)
+		&& sameBytes(staticA.getVertexNormalDataPtr(), staticB.getVertexNormalDataPtr(), positionBytes)
+		&& sameBytes(staticA.getIndexDataPtr(), staticB.getIndexDataPtr(), indexBytes);
+}
+
+} // namespace
+
+//---------------------------------------------------------------------------------------
+int main(int argc, char ** argv) {
+	string path = argc > 1 ? argv[1] : "CitySnapshotBench.city";
+
+	AssetPack looseAssets("Assets");
+	const initializer_list<ObjFilePath> meshFiles = {"cube.obj", "scube.obj", "sphere.obj", "cone.obj",
+			"cylinder.obj"};
+	MeshConsolidator meshes(looseAssets, meshFiles);
+	uint64_t meshHash = CitySnapshotKey::hashBytes(nullptr, 0);
+	for (const ObjFilePath & meshFile : meshFiles) {
+		MappedFile mesh(looseAssets.looseFilePath(meshFile).c_str());
+		meshHash = CitySnapshotKey::hashBytes(mesh.data(), mesh.size(), meshHash);
+	}
+	vector<MaterialHandle> materials;
+	for (int i = 0; i < 13; ++i) {
+		float shade = i / 13.0f;
+		materials.push_back(SceneRegistry::materialHandle(Material(vec4(shade, 1.0f - shade, 0.5f, 1.0f),
+				vec3(0.1f, 0.1f, 0.1f), 10.0f)));
+	}
+	MappedFile scene(SCENE_FILE);
+
+	cout << "     density      nodes     people   snapshot MB   generate ms   load ms   speedup\n";
+	for (unsigned int density : {1u, 10u, 50u, 200u}) {
+		CitySnapshotKey key = {SEED, density, 1, 0, CitySnapshotKey::hashBytes(scene.data(), scene.size()),
+				meshHash};
+		City generated;
+		double generateMs = generate(generated, meshes, materials, density);
+		CitySnapshot::write(path, key, *generated.root, generated.staticGeometry, generated.voices,
+				generated.crowd);
+
+		// Each run starts from a freshly mapped file, as a new process would.
+		City loaded;
+		CitySnapshot snapshot;
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		if (!snapshot.open(path, key)) {
+			cerr << "Snapshot rejected its own key" << endl;
+			return 1;
+		}
+		{
+			SceneArena::Scope arenaScope(loaded.arena);
+			loaded.root = snapshot.restore(loaded.staticGeometry, loaded.voices, loaded.crowd);
+		}
+		double loadMs = millisecondsSince(start);
+
+		if (!sameCity(generated, loaded)) {
+			cerr << "Restored city differs at density " << density << endl;
+			return 1;
+		}
+		CitySnapshotKey staleKey = key;
+		++staleKey.seed;
+		CitySnapshot stale;
+		if (stale.open(path, staleKey)) {
+			cerr << "Snapshot accepted another seed" << endl;
+			return 1;
+		}
+
+		MappedFile written(path.c_str());
+		cout << fixed << setprecision(1)
+			<< setw(12) << density
+			<< setw(11) << snapshot.numNodes()
+			<< setw(11) << snapshot.numPeople()
+			<< setw(14) << written.size() / 1.0e6
+			<< setw(14) << generateMs
+			<< setw(10) << loadMs
+			<< setw(9) << generateMs / loadMs << "x\n";
+	}
+	remove(path.c_str());
+	return 0;
+}
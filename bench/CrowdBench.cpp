@@ -0,0 +1,215 @@
+// Times one frame of a panicking crowd: Crowd::update against the per-Person objects
+// it replaced, at 1k, 10k and 100k people, everyone running.  Checks that both move
+// everyone to the same place.
+//
+// Usage: ./CrowdBench [frames]
+
+#include "CityRandom.hpp"
+#include "Crowd.hpp"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <vector>
+using namespace glm;
+using namespace irrklang;
+using namespace std;
+
+namespace {
+
+const float SPOTLIGHT_RADIUS = 4.0f;
+
+//---------------------------------------------------------------------------------------
+// Person before Crowd, kept verbatim as the baseline apart from building its nodes.
+struct Pair;
+
+class LegacyPerson {
+public:
+    LegacyPerson(SceneNode *node, const float posx, const float posz, const float rotated);
+    void move(const float posx, const float posz);
+    void trigger();
+    void run(glm::vec3 light);
+    ISound *audio;
+    ISound *panicAudio;
+    Pair *pairing;
+    bool react, paranoid;
+    SceneNode *node;
+    vec3 pos;
+    float rotated;
+    double secondsPassed;
+    clock_t startTime;
+};
+
+struct Pair {
+	LegacyPerson *leader;
+	LegacyPerson *follower;
+};
+
+LegacyPerson::LegacyPerson(SceneNode *node, const float posx, const float posz, const float rotated) {
+	pos = vec3(0.0f, 0.0f, 0.0f);
+	this->rotated = rotated;
+	this->pairing = NULL;
+	this->node = node;
+	node->rotate('y', rotated);
+	audio = NULL;
+	panicAudio = NULL;
+	move(posx, posz);
+	react = false;
+	paranoid = false;
+}
+
+void LegacyPerson::move(const float dposx, const float dposz) {
+	vec3 temp = vec3(dposx, 0.0, dposz);
+	pos += temp;
+	node->translate(temp);
+	if (audio != NULL) audio->setPosition(vec3df(pos.x, pos.y, pos.z));
+	if (panicAudio != NULL) panicAudio->setPosition(vec3df(pos.x, pos.y, pos.z));
+}
+
+void LegacyPerson::trigger() {
+	if (react || (pairing != NULL && pairing->follower == this)) return; //no need to keep track of time when person AI already freaking out, plus now we can use startTime to track freaking out
+	if (paranoid) {
+		secondsPassed = (clock() - startTime) / CLOCKS_PER_SEC;
+	} else {
+		paranoid = true;
+		startTime = clock();
+	}
+	if (secondsPassed > 20) {
+		startTime = clock();
+		if (audio != NULL) audio->setIsPaused(true);
+		if (panicAudio != NULL) panicAudio->setIsPaused(false);
+		react = true;
+	}
+}
+
+void LegacyPerson::run(glm::vec3 light) {
+	//a person who is assigned follower role will never have react to be set to true from trigger
+	if (react) {
+		secondsPassed = (clock() - startTime) / CLOCKS_PER_SEC;
+		//vector representing opposite direction of light to person
+		glm::vec3 dir = normalize(pos-light);
+		if (pairing != NULL && (pairing->leader == this)) {
+			pairing->follower->move(0.2f*dir.x, 0.2f*dir.z);
+		}
+		move(0.2f*dir.x, 0.2f*dir.z);
+		if (secondsPassed > 20) {
+			if (audio != NULL) audio->setIsPaused(false);
+			if (panicAudio != NULL) panicAudio->setIsPaused(true);
+			secondsPassed = 0;
+			paranoid = false;
+			react = false;
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------
+struct Spawn {
+	float x, z, heading;
+};
+
+vector<Spawn> scatter(unsigned int numPeople) {
+	CityRandom random(1, numPeople, 0, CityStream::People);
+	vector<Spawn> spawns(numPeople);
+	for (Spawn & spawn : spawns) {
+		spawn.x = random.nextInt(25000) / 100.0f - CITY_HALF_EXTENT;
+		spawn.z = random.nextInt(25000) / 100.0f - CITY_HALF_EXTENT;
+		spawn.heading = random.nextInt(359);
+	}
+	return spawns;
+}
+
+//---------------------------------------------------------------------------------------
+// The loop Project::appLogic ran over every person.  Returns milliseconds.
+double timeLegacy(const vector<Spawn> & spawns, const vec3 & light, int frames, vector<vec2> & positions) {
+	vector<unique_ptr<SceneNode>> nodes;
+	vector<unique_ptr<LegacyPerson>> people;
+	for (const Spawn & spawn : spawns) {
+		nodes.emplace_back(new SceneNode("torso"));
+		people.emplace_back(new LegacyPerson(nodes.back().get(), spawn.x, spawn.z, spawn.heading));
+		people.back()->react = true;
+		people.back()->startTime = clock();
+	}
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (int frame = 0; frame < frames; ++frame) {
+		for (auto it = people.begin(); it!=people.end(); ++it) {
+			float dx = (*it)->pos.x - light.x;
+			float dz = (*it)->pos.z - light.z;
+			float distance = sqrt(dx * dx + dz * dz);
+			if (distance < 4) (*it)->trigger();
+			(*it)->run(light);
+		}
+	}
+	double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+	positions.clear();
+	for (const auto & person : people) {
+		positions.push_back(vec2(person->node->get_transform()[3].x, person->node->get_transform()[3].z));
+	}
+	return ms;
+}
+
+//---------------------------------------------------------------------------------------
+double timeCrowd(const vector<Spawn> & spawns, const vec3 & light, int frames, vector<vec2> & positions) {
+	vector<unique_ptr<SceneNode>> nodes;
+	Crowd crowd;
+	for (const Spawn & spawn : spawns) {
+		nodes.emplace_back(new SceneNode("torso"));
+		crowd.panic(crowd.add(nodes.back().get(), spawn.x, spawn.z, spawn.heading));
+	}
+
+	// A simulation tick and the frame drawing it, with nothing to interpolate.
+	CrowdPositions positionsNow;
+	vector<unsigned int> moved;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (int frame = 0; frame < frames; ++frame) {
+		crowd.update(light, SPOTLIGHT_RADIUS, frame / 60.0);
+		crowd.publish(positionsNow, moved);
+		crowd.place(moved, positionsNow, positionsNow, 1.0f);
+		moved.clear();
+	}
+	double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+	positions.clear();
+	for (const auto & node : nodes) {
+		positions.push_back(vec2(node->get_transform()[3].x, node->get_transform()[3].z));
+	}
+	return ms;
+}
+
+} // namespace
+
+//---------------------------------------------------------------------------------------
+int main(int argc, char ** argv) {
+	int frames = argc > 1 ? std::max(atoi(argv[1]), 1) : 100;
+	vec3 light(10.0f, 0.0f, -20.0f);
+
+	cout << frames << " frames, everyone running\n"
+		<< "   people   Person ns/agent   Crowd ns/agent   speedup\n";
+	for (unsigned int numPeople : {1000u, 10000u, 100000u}) {
+		vector<Spawn> spawns = scatter(numPeople);
+		vector<vec2> legacyPositions, crowdPositions;
+		double legacyMs = timeLegacy(spawns, light, frames, legacyPositions);
+		double crowdMs = timeCrowd(spawns, light, frames, crowdPositions);
+		for (size_t i = 0; i < spawns.size(); ++i) {
+			if (distance(legacyPositions[i], crowdPositions[i]) > 1.0e-3f) {
+				cerr << "Mismatch for person " << i << " of " << numPeople << endl;
+				return 1;
+			}
+		}
+		double agentFrames = (double)numPeople * frames;
+		cout << fixed << setprecision(1)
+			<< setw(9) << numPeople
+			<< setw(18) << 1.0e6 * legacyMs / agentFrames
+			<< setw(17) << 1.0e6 * crowdMs / agentFrames
+			<< setw(9) << legacyMs / crowdMs << "x\n";
+	}
+	return 0;
+}
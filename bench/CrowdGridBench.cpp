@@ -0,0 +1,171 @@
+// Times the per-frame spotlight query over crowds of 1k, 10k and 100k people: the
+// CrowdGrid query Project::updateCrowd runs against the scan over every person it
+// replaced.  Checks that both find the same people, and moves the people found the
+// way running people move, so the grid is rebinned as it would be in the app.
+//
+// The scan grows with the crowd.  The grid's query always visits the same 3 x 3 cells
+// but tests everyone in them, so its time per frame grows with the density around the
+// spotlight: here the crowds share one ground plane, so with the crowd too.  The time
+// is also printed per cell visited or person tested, which stays flat.
+//
+// Usage: ./CrowdGridBench [frames]
+
+#include "CrowdGrid.hpp"
+#include "CityRandom.hpp"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+using namespace glm;
+using namespace std;
+
+namespace {
+
+const float SPOTLIGHT_RADIUS = 4.0f;
+// Distance a running person covers per frame, as in Person::run.
+const float RUN_STEP = 0.2f;
+
+//---------------------------------------------------------------------------------------
+// Where the spotlight meets the ground on a given frame: a slow sweep over the city.
+vec2 spotlight(int frame) {
+	float t = frame * 0.01f;
+	return vec2(100.0f * sin(t), 100.0f * cos(0.7f * t));
+}
+
+//---------------------------------------------------------------------------------------
+vector<vec2> scatter(unsigned int numPeople) {
+	CityRandom random(1, numPeople, 0, CityStream::People);
+	vector<vec2> positions(numPeople);
+	for (vec2 & position : positions) {
+		position.x = random.nextInt(25000) / 100.0f - CITY_HALF_EXTENT;
+		position.y = random.nextInt(25000) / 100.0f - CITY_HALF_EXTENT;
+	}
+	return positions;
+}
+
+struct Result {
+	double ms;
+	size_t hits;
+};
+
+// What the grid queries look at, as counted by countGridWork().
+struct GridWork {
+	size_t cells;
+	size_t tested;
+};
+
+//---------------------------------------------------------------------------------------
+// The loop Project::appLogic ran over every person.
+Result timeScan(vector<vec2> positions, int frames) {
+	Result result = {0.0, 0};
+	vector<unsigned int> found;
+	for (int frame = 0; frame < frames; ++frame) {
+		vec2 light = spotlight(frame);
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		found.clear();
+		for (unsigned int i = 0; i < positions.size(); ++i) {
+			float dx = positions[i].x - light.x;
+			float dz = positions[i].y - light.y;
+			if (sqrt(dx * dx + dz * dz) < SPOTLIGHT_RADIUS) {
+				found.push_back(i);
+			}
+		}
+		result.ms += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+		result.hits += found.size();
+		for (unsigned int i : found) {
+			positions[i] += RUN_STEP * normalize(positions[i] - light);
+		}
+	}
+	return result;
+}
+
+//---------------------------------------------------------------------------------------
+// The query and the rebinning of the people it moves are both timed, over all frames at
+// once, since a sparse crowd's query takes about as long as reading the clock.
+Result timeGrid(const vector<vec2> & positions, int frames) {
+	CrowdGrid grid;
+	for (const vec2 & position : positions) {
+		grid.insert(position);
+	}
+	Result result = {0.0, 0};
+	vector<unsigned int> found;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (int frame = 0; frame < frames; ++frame) {
+		vec2 light = spotlight(frame);
+		found.clear();
+		grid.query(light, SPOTLIGHT_RADIUS, [&](unsigned int agent) {
+			found.push_back(agent);
+		});
+		for (unsigned int agent : found) {
+			grid.move(agent, grid.position(agent) + RUN_STEP * normalize(grid.position(agent) - light));
+		}
+		result.hits += found.size();
+	}
+	result.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	return result;
+}
+
+//---------------------------------------------------------------------------------------
+// Replays timeGrid() counting the cells each query visits and the people in them.  The
+// spotlight stays on the ground plane, where the grid does not repeat.
+GridWork countGridWork(vector<vec2> positions, int frames) {
+	GridWork work = {0, 0};
+	vector<unsigned int> found;
+	for (int frame = 0; frame < frames; ++frame) {
+		vec2 light = spotlight(frame);
+		ivec2 minCell(floor((light - SPOTLIGHT_RADIUS + CITY_HALF_EXTENT) / CROWD_CELL_SIZE));
+		ivec2 maxCell(floor((light + SPOTLIGHT_RADIUS + CITY_HALF_EXTENT) / CROWD_CELL_SIZE));
+		work.cells += (maxCell.x - minCell.x + 1) * (maxCell.y - minCell.y + 1);
+		found.clear();
+		for (unsigned int i = 0; i < positions.size(); ++i) {
+			ivec2 cell(floor((positions[i] + CITY_HALF_EXTENT) / CROWD_CELL_SIZE));
+			if (all(greaterThanEqual(cell, minCell)) && all(lessThanEqual(cell, maxCell))) {
+				++work.tested;
+				if (distance(positions[i], light) < SPOTLIGHT_RADIUS) {
+					found.push_back(i);
+				}
+			}
+		}
+		for (unsigned int i : found) {
+			positions[i] += RUN_STEP * normalize(positions[i] - light);
+		}
+	}
+	return work;
+}
+
+} // namespace
+
+//---------------------------------------------------------------------------------------
+int main(int argc, char ** argv) {
+	int frames = argc > 1 ? std::max(atoi(argv[1]), 1) : 1000;
+
+	cout << frames << " frames, spotlight radius " << SPOTLIGHT_RADIUS << "\n"
+		<< "   people   scan us/frame   grid us/frame   found/frame   cells/frame   tested/frame"
+		"   grid ns/item\n";
+	for (unsigned int numPeople : {1000u, 10000u, 100000u}) {
+		vector<vec2> positions = scatter(numPeople);
+		Result scan = timeScan(positions, frames);
+		Result grid = timeGrid(positions, frames);
+		GridWork work = countGridWork(positions, frames);
+		if (scan.hits != grid.hits) {
+			cerr << "Mismatch for " << numPeople << " people: scan found " << scan.hits
+				<< ", grid found " << grid.hits << endl;
+			return 1;
+		}
+		cout << fixed << setprecision(2)
+			<< setw(9) << numPeople
+			<< setw(16) << 1000.0 * scan.ms / frames
+			<< setw(16) << 1000.0 * grid.ms / frames
+			<< setw(14) << (double)grid.hits / frames
+			<< setw(14) << (double)work.cells / frames
+			<< setw(15) << (double)work.tested / frames
+			<< setw(15) << 1.0e6 * grid.ms / (work.cells + work.tested) << "\n";
+	}
+	return 0;
+}
@@ -0,0 +1,457 @@
+// Times Building::grow and Building::create, which run a memoized FacadeProgram,
+// against the string rewriting they replaced, and checks that both build the same
+// scene nodes from the same random streams.
+//
+// Usage: ./FacadeGrammarBench [iterations]
+
+#include "Building.hpp"
+#include "GeometryNode.hpp"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+namespace {
+
+const int brokenWindowIndex = 1;
+
+//---------------------------------------------------------------------------------------
+// The string rewriting Building used before FacadeGrammar, kept verbatim as the
+// baseline.
+
+class LegacyBuilding {
+public:
+    LegacyBuilding(const float width, const float height, int levels, glm::vec3 corner, int doorI = -1, int windowI = -1, int roofI = -1, const float rotate = 0.0f, ISound *sound = NULL);
+
+    virtual ~LegacyBuilding();  
+    virtual void grow(CityRandom &random);
+    virtual SceneNode *create();
+    BuildType m_type;
+    Block block;
+    string encoding;
+    int windowI, doorI, roofI, soundI;
+    float rotate;
+    ISound *audio;
+    unordered_map<char, string> rewriteRule;
+};
+
+
+class LegacySkyscraper : public LegacyBuilding {
+public:
+	LegacySkyscraper(const float width, const float height, int levels, glm::vec3 corner, int doorI, int windowI, int roofI, const float rotate = 0.0f, ISound *sound = NULL);
+	virtual ~LegacySkyscraper();
+	void grow(CityRandom &random);
+};
+
+class LegacyStore : public LegacyBuilding {
+public:
+	LegacyStore(const float width, const float height, int levels, glm::vec3 corner, int doorI, int windowI, int roofI, const float rotate = 0.0f, ISound *sound = NULL);
+	virtual ~LegacyStore();
+};
+
+class LegacyApartment : public LegacyBuilding {
+public:
+	LegacyApartment(const float width, const float height, int levels, glm::vec3 corner, int doorI, int windowI, int roofI, const float rotate = 0.0f, ISound *sound = NULL);
+	virtual ~LegacyApartment();
+	void grow(CityRandom &random);
+};
+
+LegacyBuilding::LegacyBuilding(const float width, const float height, int levels, glm::vec3 corner, int doorI, int windowI, int roofI, const float rotate, ISound *sound) {
+	this->doorI = doorI;
+	this->windowI = windowI;
+	this->roofI = roofI;
+	this->audio = sound;
+	this->rotate = rotate;
+	block.width = width;
+	block.height = height;
+	block.depth = 0.5;
+	block.levels = levels;
+	block.corner = glm::vec3(corner);
+	//w is window, i is intermediate floor, d is door, t is overwritten depending on inherited building class
+	encoding = "B";
+	rewriteRule['B'] = "GIT";
+	rewriteRule['I'] = "FI";
+	rewriteRule['F'] = "W|W|W|W|/";
+	rewriteRule['W'] = "[2 r]w";
+	rewriteRule['G'] = "D|W|W|W|/";
+	rewriteRule['D'] = "[2 r]d";
+	//2 r means repeat width of 2, may implement [int x] later, meaning create terminal symbol mesh width int, x number of times
+} 
+
+LegacyBuilding::~LegacyBuilding() {
+}
+
+LegacyStore::~LegacyStore(){}
+
+LegacyApartment::~LegacyApartment(){}
+
+LegacySkyscraper::~LegacySkyscraper(){}
+
+LegacyStore::LegacyStore(const float width, const float height, int levels, glm::vec3 corner, int doorI, int windowI, int roofI, const float rotate, ISound *sound)
+	:LegacyBuilding(width, height, levels, corner, doorI, windowI, roofI, rotate, sound)
+{	
+	rewriteRule['T'] = "c/";
+	m_type = BuildType::Store;
+}
+
+LegacyApartment::LegacyApartment(const float width, const float height, int levels, glm::vec3 corner, int doorI, int windowI, int roofI, const float rotate, ISound *sound) 
+        :LegacyBuilding(width, height, levels, corner, doorI, windowI, roofI, rotate, sound)
+{
+	rewriteRule['T'] = "f/"; //flat roof
+	m_type = BuildType::Apartment;	
+}
+
+LegacySkyscraper::LegacySkyscraper(const float width, const float height, int levels, glm::vec3 corner, int doorI, int windowI, int roofI, const float rotate, ISound *sound)
+        :LegacyBuilding(width, height, levels, corner, doorI, windowI, roofI, rotate, sound)
+{
+        rewriteRule['T'] = "f/"; //flat roof, grow() may swap in a sphere
+	//rewriteRule['W'] = "[1 r]w";
+        m_type = BuildType::Skyscraper;
+}
+
+void LegacySkyscraper::grow(CityRandom &random)
+{
+        int chance = random.nextInt(100);
+        if (chance < 30) {
+		rewriteRule['T'] = "s/"; //sphere roof
+	}
+        LegacyBuilding::grow(random);
+}
+
+void LegacyBuilding::grow(CityRandom &)
+{
+	unsigned int e = 0;
+	size_t terminal = 0;
+	while (terminal != encoding.size())
+	{
+		terminal = 0;
+		string rewrite = "";
+		for (size_t i = 0; i < encoding.size(); i++)
+		{
+			char ch = encoding[i];
+			if (ch == 'I' || ch == 'T' || ch == 'G') {
+				if (e < block.levels) {
+					e++;
+				} else {
+					continue;
+				}
+			}
+			if (rewriteRule.find(ch) != rewriteRule.end())
+			{
+				rewrite += rewriteRule[ch];
+			}
+			else
+			{
+				terminal++;
+				rewrite += ch;
+			}
+			
+		}
+		// Assign expansion to next iteration
+		encoding = rewrite;
+	}
+}
+
+void LegacyApartment::grow(CityRandom &random){
+	//overloaded method since we want chance of broken windows
+	unsigned int e = 0;
+        size_t terminal = 0;
+        while (terminal != encoding.size())
+        {
+                terminal = 0;
+                string rewrite = "";
+                for (size_t i = 0; i < encoding.size(); i++)
+                {
+                        char ch = encoding[i];
+                        if (ch == 'I' || ch == 'T' || ch == 'G') {
+                                if (e < block.levels) {
+                                        e++;
+                                } else {
+                                        continue;
+                                }
+                        }
+                        if (rewriteRule.find(ch) != rewriteRule.end())
+                        {
+				if (ch == 'W') {
+					int chance = random.nextInt(100);
+					if (chance < 10) {
+						//broken window
+						rewrite += "[2 r]b";
+					} else {
+						rewrite += rewriteRule[ch];
+					}
+				} else {
+                        	        rewrite += rewriteRule[ch];
+				}
+                        }
+                        else
+                        {
+                                terminal++;
+                                rewrite += ch;
+                        }
+                }
+                // Assign expansion to next iteration
+                encoding = rewrite;
+        }
+}
+
+SceneNode *LegacyBuilding::create() {
+	SceneNode *root = new SceneNode("building");
+	root->rotate('y', rotate);
+	root->translate(block.corner + glm::vec3(block.width/2, 0.0, -block.width/2));
+	size_t c = count(encoding.begin(), encoding.end(), '/') - 1;
+	if (c < 1) return root;
+	float incY = block.height / c;
+	//faces offset for cube
+	glm::vec3 faces[4]={glm::vec3(0.0, 0.0, block.width/2 - block.depth/2), glm::vec3(-block.width/2 + block.depth/2, 0.0, 0.0), 
+			glm::vec3(0.0, 0.0, -block.width/2 + block.depth/2),
+			glm::vec3(block.width/2 - block.depth/2, 0.0, 0.0)};
+	string temp = encoding;
+	//corner is always lowerLeft
+	while (temp.length() != 0) {
+		string delimiter = "/";
+		string token = temp.substr(0, temp.find(delimiter));
+		temp = temp.substr(temp.find(delimiter)+1, string::npos);
+
+		if (token[0] == '[') {
+			delimiter = "|";
+			int i = 0;
+			while (token.length() != 0) {
+				//each floor
+				string token2 = token.substr(0, token.find(delimiter));
+				token = token.substr(token.find(delimiter)+1, string::npos);
+				bool door = (token2.back() == 'd');
+				double center = 0.0; //want door to be further back than windows
+				float x = 0.0;
+				float incX = (token2[1] - '0');
+				int blocks = floor(block.width / incX);
+				int c = 0;
+				if (door) {
+					center = (float)(blocks-1)/2.0f;
+				}
+				while (c < blocks) {
+					Material mat = Material();
+					mat.kd = glm::vec4(0.3, 0.3, 0.3, 0.2);
+					GeometryNode *window = new GeometryNode(SceneRegistry::meshHandle("cube"), "window");
+					window->textureIndex = windowI;
+					if (door && m_type == BuildType::Skyscraper) {
+						window->m_name = "door";
+						window->textureIndex = doorI;
+					}
+					if (token2.back() == 'b') {
+						window->m_name = "broken";
+						window->textureIndex = brokenWindowIndex;
+					}
+					if (i % 2 == 0) {
+						//face along x axis
+						window->scale(glm::vec3(incX, incY, block.depth));
+						window->translate(faces[i] + glm::vec3(x - block.width/2 + incX/2, incY/2, 0.0));
+						if (door && (c == floor(center) || c == ceil(center)) && m_type != BuildType::Skyscraper) {
+							window->translate(glm::vec3(0.0, 0.0, -block.depth/2.0f));
+							window->m_name = "door";
+							window->textureIndex = doorI;
+						}
+					} else {
+						window->scale(glm::vec3(block.depth+0.01, incY, incX-0.01));
+						//the -0.01 is to prevent flickering since these walls perfectly overlaps x axis walls without it
+						window->translate(faces[i] + glm::vec3(0.0, incY/2, -x + block.width/2 - incX/2));
+						if (door && (c == floor(center) || c == ceil(center)) && m_type != BuildType::Skyscraper) {
+							window->translate(glm::vec3(block.depth/2.0f, 0.0, 0.0));
+							window->m_name = "door";
+							window->textureIndex = doorI;
+						}
+					}
+					window->material = SceneRegistry::materialHandle(mat);
+					root->add_child(window);
+					x += incX;
+					++c;
+				}
+				++i;
+			}
+			faces[0] = faces[0] + glm::vec3(0.0, incY, 0.0);
+			faces[1] = faces[1] + glm::vec3(0.0, incY, 0.0);
+			faces[2] = faces[2] + glm::vec3(0.0, incY, 0.0);
+			faces[3] = faces[3] + glm::vec3(0.0, incY, 0.0);
+		} else {
+			Material mat = Material();
+			mat.kd = glm::vec4(0.3, 0.3, 0.3, 0.2);
+			if (token[0] == 'c') {
+				GeometryNode *roof = new GeometryNode(SceneRegistry::meshHandle("cylinder"), "roof");
+				roof->material = SceneRegistry::materialHandle(mat);
+				roof->rotate('x', 90.0);
+				roof->scale(glm::vec3(block.width/2 - 0.05, block.height/3, block.width/2 - 0.05));
+				roof->translate(glm::vec3(0, faces[0].y, 0));
+				roof->textureIndex = roofI;
+				root->add_child(roof);
+			} else if (token[0] == 's') {
+                                GeometryNode *roof = new GeometryNode(SceneRegistry::meshHandle("sphere"), "roof");
+				roof->material = SceneRegistry::materialHandle(mat);
+                                roof->scale(glm::vec3(block.width/2 - 0.05, 5.0, block.width/2 - 0.05));
+                                roof->translate(glm::vec3(0, faces[0].y-2.5, 0));
+                                roof->textureIndex = roofI;
+                                root->add_child(roof);
+				roof = new GeometryNode(SceneRegistry::meshHandle("cube"), "roof");
+				roof->material = SceneRegistry::materialHandle(mat);
+                                roof->scale(glm::vec3(block.width - 0.05, 0.5, block.width - 0.05));
+                                roof->translate(glm::vec3(0, faces[0].y, 0));
+                                roof->textureIndex = roofI;
+                                root->add_child(roof);
+			} else if (token[0] == 'f') {
+                                GeometryNode *roof = new GeometryNode(SceneRegistry::meshHandle("cube"), "roof");
+				roof->material = SceneRegistry::materialHandle(mat);
+                                roof->scale(glm::vec3(block.width - 0.05, 0.5, block.width - 0.05));
+                                roof->translate(glm::vec3(0, faces[0].y, 0));
+                                roof->textureIndex = roofI;
+                                root->add_child(roof);
+                        }
+		}
+	}
+	return root;
+}
+
+//---------------------------------------------------------------------------------------
+struct BuildingSpec {
+	BuildType type;
+	float width;
+	float height;
+	int levels;
+};
+
+//---------------------------------------------------------------------------------------
+// What fillStreet builds, plus skyscrapers far taller than the hand placed ones.
+vector<BuildingSpec> cityWorkload() {
+	vector<BuildingSpec> specs;
+	for (int width = 2; width <= 6; ++width) {
+		for (int levels = 3; levels <= 5; ++levels) {
+			BuildingSpec store = {BuildType::Store, (float)width, (float)levels, levels};
+			specs.push_back(store);
+		}
+		for (int levels = 10; levels <= 14; ++levels) {
+			BuildingSpec apartment = {BuildType::Apartment, (float)width, (float)levels, levels};
+			specs.push_back(apartment);
+		}
+	}
+	for (int levels = 10; levels <= 80; levels += 10) {
+		BuildingSpec skyscraper = {BuildType::Skyscraper, 6.0f, levels * 1.4f, levels};
+		specs.push_back(skyscraper);
+	}
+	return specs;
+}
+
+//---------------------------------------------------------------------------------------
+template <typename SkyscraperType, typename ApartmentType, typename StoreType>
+SceneNode * build(const BuildingSpec & spec, CityRandom & random) {
+	glm::vec3 corner(1.0f, 0.0f, -2.0f);
+	if (spec.type == BuildType::Skyscraper) {
+		SkyscraperType building(spec.width, spec.height, spec.levels, corner, 3, 7, 11, 90);
+		building.grow(random);
+		return building.create();
+	} else if (spec.type == BuildType::Apartment) {
+		ApartmentType building(spec.width, spec.height, spec.levels, corner, 16, 25, 35, 180);
+		building.grow(random);
+		return building.create();
+	}
+	StoreType building(spec.width, spec.height, spec.levels, corner, 16, 25, 35, 270);
+	building.grow(random);
+	return building.create();
+}
+
+//---------------------------------------------------------------------------------------
+bool sameTree(const SceneNode & a, const SceneNode & b) {
+	if (a.m_name != b.m_name || a.textureIndex != b.textureIndex || a.trans != b.trans
+			|| a.children.size() != b.children.size()) {
+		return false;
+	}
+	auto child = b.children.begin();
+	for (const SceneNode * node : a.children) {
+		if (!sameTree(*node, **child++)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+//---------------------------------------------------------------------------------------
+// Builds every spec of the workload once per iteration and returns milliseconds.
+template <typename SkyscraperType, typename ApartmentType, typename StoreType>
+double timeWorkload(const vector<BuildingSpec> & specs, int iterations, size_t & numNodes) {
+	numNodes = 0;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (int i = 0; i < iterations; ++i) {
+		for (size_t j = 0; j < specs.size(); ++j) {
+			CityRandom random(1, i, j, CityStream::Buildings);
+			SceneNode * node = build<SkyscraperType, ApartmentType, StoreType>(specs[j], random);
+			numNodes += node->children.size();
+			delete node;
+		}
+	}
+	return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+//---------------------------------------------------------------------------------------
+// Only expands the grammar, without creating any nodes.
+template <typename SkyscraperType, typename ApartmentType, typename StoreType>
+double timeGrow(const vector<BuildingSpec> & specs, int iterations) {
+	glm::vec3 corner(1.0f, 0.0f, -2.0f);
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (int i = 0; i < iterations; ++i) {
+		for (size_t j = 0; j < specs.size(); ++j) {
+			CityRandom random(1, i, j, CityStream::Buildings);
+			const BuildingSpec & spec = specs[j];
+			if (spec.type == BuildType::Skyscraper) {
+				SkyscraperType(spec.width, spec.height, spec.levels, corner, 3, 7, 11).grow(random);
+			} else if (spec.type == BuildType::Apartment) {
+				ApartmentType(spec.width, spec.height, spec.levels, corner, 16, 25, 35).grow(random);
+			} else {
+				StoreType(spec.width, spec.height, spec.levels, corner, 16, 25, 35).grow(random);
+			}
+		}
+	}
+	return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+//---------------------------------------------------------------------------------------
+int main(int argc, char ** argv) {
+	int iterations = argc > 1 ? max(atoi(argv[1]), 1) : 20;
+	vector<BuildingSpec> specs = cityWorkload();
+
+	for (size_t j = 0; j < specs.size(); ++j) {
+		for (int seed = 0; seed < 8; ++seed) {
+			CityRandom legacyRandom(seed, j, 0, CityStream::Buildings);
+			CityRandom random(seed, j, 0, CityStream::Buildings);
+			unique_ptr<SceneNode> legacy(build<LegacySkyscraper, LegacyApartment, LegacyStore>(specs[j], legacyRandom));
+			unique_ptr<SceneNode> compiled(build<Skyscraper, Apartment, Store>(specs[j], random));
+			if (!sameTree(*legacy, *compiled)) {
+				cerr << "Mismatch for building type " << (int)specs[j].type << " with " << specs[j].levels
+					<< " levels, width " << specs[j].width << ", seed " << seed << endl;
+				return 1;
+			}
+		}
+	}
+
+	size_t legacyNodes, compiledNodes;
+	double legacyMs = timeWorkload<LegacySkyscraper, LegacyApartment, LegacyStore>(specs, iterations, legacyNodes);
+	double compiledMs = timeWorkload<Skyscraper, Apartment, Store>(specs, iterations, compiledNodes);
+	double legacyGrowMs = timeGrow<LegacySkyscraper, LegacyApartment, LegacyStore>(specs, iterations);
+	double compiledGrowMs = timeGrow<Skyscraper, Apartment, Store>(specs, iterations);
+	cout << specs.size() << " buildings x " << iterations << " iterations, " << legacyNodes << " tiles\n"
+		<< fixed << setprecision(2)
+		<< "  grow + create, string rewriting " << setw(9) << legacyMs << " ms\n"
+		<< "  grow + create, facade program   " << setw(9) << compiledMs << " ms  ("
+			<< legacyMs / compiledMs << "x)\n"
+		<< "  grow only,     string rewriting " << setw(9) << legacyGrowMs << " ms\n"
+		<< "  grow only,     facade program   " << setw(9) << compiledGrowMs << " ms  ("
+			<< legacyGrowMs / compiledGrowMs << "x)\n";
+	return 0;
+}
@@ -0,0 +1,246 @@
+// Times ObjFileDecoder::decode against the line based decoder it replaced, and checks
+// that both produce the same vertices.
+//
+// Usage: ./ObjDecodeBench [iterations] [file.obj ...]
+// With no files the meshes in Assets/ are used.
+
+#include "framework/ObjFileDecoder.hpp"
+#include "framework/Exception.hpp"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace glm;
+using namespace std;
+
+//---------------------------------------------------------------------------------------
+// The getline / istringstream / sscanf decoder ObjFileDecoder used before it switched to
+// memory mapping, kept verbatim as the baseline.
+static void legacyDecode(
+		const char * objFilePath,
+		std::string & objectName,
+        std::vector<vec3> & positions,
+        std::vector<vec3> & normals,
+        std::vector<vec2> & uvCoords
+) {
+
+	// Empty containers, and start fresh before inserting data from .obj file
+	positions.clear();
+	normals.clear();
+	uvCoords.clear();
+
+    ifstream in(objFilePath, std::ios::in);
+    in.exceptions(std::ifstream::badbit);
+
+    if (!in) {
+        stringstream errorMessage;
+        errorMessage << "Unable to open .obj file " << objFilePath
+            << " within legacyDecode" << endl;
+
+        throw Exception(errorMessage.str().c_str());
+    }
+
+    string currentLine;
+    int positionIndexA, positionIndexB, positionIndexC;
+    int normalIndexA, normalIndexB, normalIndexC;
+    int uvCoordIndexA, uvCoordIndexB, uvCoordIndexC;
+    vector<vec3> temp_positions;
+    vector<vec3> temp_normals;
+    vector<vec2> temp_uvCoords;
+
+	objectName = "";
+
+    while (!in.eof()) {
+        try {
+            getline(in, currentLine);
+        } catch (const ifstream::failure &e) {
+            in.close();
+            stringstream errorMessage;
+            errorMessage << "Error calling getline() -- " << e.what() << endl;
+            throw Exception(errorMessage.str());
+        }
+	    if (currentLine.substr(0, 2) == "o ") {
+		    // Get entire line excluding first 2 chars.
+		    istringstream s(currentLine.substr(2));
+		    s >> objectName;
+
+
+	    } else if (currentLine.substr(0, 2) == "v ") {
+            // Vertex data on this line.
+            // Get entire line excluding first 2 chars.
+            istringstream s(currentLine.substr(2));
+            glm::vec3 vertex;
+            s >> vertex.x;
+            s >> vertex.y;
+            s >> vertex.z;
+            temp_positions.push_back(vertex);
+
+        } else if (currentLine.substr(0, 3) == "vn ") {
+            // Normal data on this line.
+            // Get entire line excluding first 2 chars.
+            istringstream s(currentLine.substr(2));
+            vec3 normal;
+            s >> normal.x;
+            s >> normal.y;
+            s >> normal.z;
+            temp_normals.push_back(normal);
+
+        } else if (currentLine.substr(0, 3) == "vt ") {
+            // Texture coordinate data on this line.
+            // Get entire line excluding first 2 chars.
+            istringstream s(currentLine.substr(2));
+            vec2 textureCoord;
+            s >> textureCoord.s;
+            s >> textureCoord.t;
+            temp_uvCoords.push_back(textureCoord);
+
+        } else if (currentLine.substr(0, 2) == "f ") {
+            // Face index data on this line.
+
+            int index;
+
+            // sscanf will return the number of matched index values it found
+            // from the pattern.
+            int numberOfIndexMatches = sscanf(currentLine.c_str(), "f %d/%d/%d",
+                                              &index, &index, &index);
+
+            if (numberOfIndexMatches == 3) {
+                // Line contains indices of the pattern vertex/uv-cord/normal.
+                sscanf(currentLine.c_str(), "f %d/%d/%d %d/%d/%d %d/%d/%d",
+                       &positionIndexA, &uvCoordIndexA, &normalIndexA,
+                       &positionIndexB, &uvCoordIndexB, &normalIndexB,
+                       &positionIndexC, &uvCoordIndexC, &normalIndexC);
+
+                // .obj file uses indices that start at 1, so subtract 1 so they start at 0.
+                uvCoordIndexA--;
+                uvCoordIndexB--;
+                uvCoordIndexC--;
+
+                uvCoords.push_back(temp_uvCoords[uvCoordIndexA]);
+                uvCoords.push_back(temp_uvCoords[uvCoordIndexB]);
+                uvCoords.push_back(temp_uvCoords[uvCoordIndexC]);
+
+            } else {
+                // Line contains indices of the pattern vertex//normal.
+                sscanf(currentLine.c_str(), "f %d//%d %d//%d %d//%d",
+		               &positionIndexA, &normalIndexA,
+                       &positionIndexB, &normalIndexB,
+                       &positionIndexC, &normalIndexC);
+            }
+
+            positionIndexA--;
+            positionIndexB--;
+            positionIndexC--;
+            normalIndexA--;
+            normalIndexB--;
+            normalIndexC--;
+
+            positions.push_back(temp_positions[positionIndexA]);
+            positions.push_back(temp_positions[positionIndexB]);
+            positions.push_back(temp_positions[positionIndexC]);
+
+            normals.push_back(temp_normals[normalIndexA]);
+            normals.push_back(temp_normals[normalIndexB]);
+            normals.push_back(temp_normals[normalIndexC]);
+        }
+    }
+
+    in.close();
+
+	if (objectName.compare("") == 0) {
+		// No 'o' object name tag defined in .obj file, so use the file name
+		// minus the '.obj' ending as the objectName.
+		const char * ptr = strrchr(objFilePath, '/');
+		objectName.assign(ptr+1);
+		size_t pos = objectName.find('.');
+		objectName.resize(pos);
+	}
+}
+
+//---------------------------------------------------------------------------------------
+template <typename T>
+static float maxDifference(const std::vector<T> & a, const std::vector<T> & b) {
+	float difference = 0.0f;
+	for (size_t i = 0; i < a.size() && i < b.size(); ++i) {
+		T delta = abs(a[i] - b[i]);
+		for (int c = 0; c < delta.length(); ++c) {
+			difference = std::max(difference, delta[c]);
+		}
+	}
+	return difference;
+}
+
+//---------------------------------------------------------------------------------------
+// Returns the fastest of iterations runs of decode(path, ...), in milliseconds.
+template <typename Decoder>
+static double timeDecoder(Decoder decode, const char * path, int iterations) {
+	std::string name;
+	std::vector<vec3> positions, normals;
+	std::vector<vec2> uvCoords;
+	double best = 1e30;
+	for (int i = 0; i < iterations; ++i) {
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		decode(path, name, positions, normals, uvCoords);
+		double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+		best = std::min(best, ms);
+	}
+	return best;
+}
+
+//---------------------------------------------------------------------------------------
+int main(int argc, char **argv) {
+	int iterations = argc > 1 ? atoi(argv[1]) : 50;
+	std::vector<std::string> files;
+	for (int i = 2; i < argc; ++i) {
+		files.push_back(argv[i]);
+	}
+	if (files.empty()) {
+		files = {"Assets/cube.obj", "Assets/scube.obj", "Assets/sphere.obj",
+			"Assets/cone.obj", "Assets/cylinder.obj"};
+	}
+
+	int status = 0;
+	cout << left << setw(24) << "file" << right << setw(10) << "vertices"
+		<< setw(14) << "legacy ms" << setw(14) << "mmap ms" << setw(10) << "speedup" << endl;
+	for (const std::string & file : files) {
+		try {
+			std::string legacyName, name;
+			std::vector<vec3> legacyPositions, legacyNormals, positions, normals;
+			std::vector<vec2> legacyUVs, uvCoords;
+			legacyDecode(file.c_str(), legacyName, legacyPositions, legacyNormals, legacyUVs);
+			ObjFileDecoder::decode(file.c_str(), name, positions, normals, uvCoords);
+
+			float difference = std::max(maxDifference(legacyPositions, positions),
+					std::max(maxDifference(legacyNormals, normals), maxDifference(legacyUVs, uvCoords)));
+			if (legacyName != name || legacyPositions.size() != positions.size()
+					|| legacyNormals.size() != normals.size() || legacyUVs.size() != uvCoords.size()
+					|| difference > 1e-6f) {
+				cout << file << ": decoders disagree (max difference " << difference << ")" << endl;
+				status = 1;
+			}
+
+			double legacyMs = timeDecoder(legacyDecode, file.c_str(), iterations);
+			double mappedMs = timeDecoder(
+					static_cast<void (*)(const char *, std::string &, std::vector<vec3> &,
+							std::vector<vec3> &, std::vector<vec2> &)>(ObjFileDecoder::decode),
+					file.c_str(), iterations);
+			cout << left << setw(24) << file << right << setw(10) << positions.size()
+				<< fixed << setprecision(3) << setw(14) << legacyMs << setw(14) << mappedMs
+				<< setprecision(1) << setw(9) << legacyMs / mappedMs << "x" << endl;
+		} catch (const std::exception & e) {
+			cout << file << ": " << e.what() << endl;
+			status = 1;
+		}
+	}
+	return status;
+}
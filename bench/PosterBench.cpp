@@ -0,0 +1,195 @@
+// Times the path traced poster of a city of box buildings on one thread and on every
+// power of two up to all of them, for how close to linearly it scales, and checks that
+// every thread count renders the very same image.
+//
+// Usage: ./PosterBench [samples per pixel] [poster.png]
+
+#include "PosterRenderer.hpp"
+#include "SceneRegistry.hpp"
+#include "StaticGeometry.hpp"
+#include "WorkerPool.hpp"
+#include "CityRandom.hpp"
+
+#include <glm/glm.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace glm;
+using namespace std;
+
+namespace {
+
+const unsigned int NUM_BUILDINGS = 2500;
+const unsigned int WIDTH = 480;
+const unsigned int HEIGHT = 270;
+const unsigned int CHECKER_SIZE = 64;
+
+struct City {
+	vector<vec3> positions;
+	vector<vec3> normals;
+	vector<vec2> uvCoords;
+	vector<float> layers;
+	vector<unsigned int> indices;
+	vector<StaticBatch> batches;
+};
+
+//---------------------------------------------------------------------------------------
+// One face of a box as a quad with its own vertices, so its normal stays flat.
+void addQuad(City & city, const vec3 & corner, const vec3 & side1, const vec3 & side2, float layer) {
+	unsigned int base = city.positions.size();
+	vec3 normal = normalize(cross(side1, side2));
+	const vec2 uvCoords[4] = {vec2(0.0f, 0.0f), vec2(1.0f, 0.0f), vec2(1.0f, 1.0f), vec2(0.0f, 1.0f)};
+	const vec3 corners[4] = {corner, corner + side1, corner + side1 + side2, corner + side2};
+	for (unsigned int i = 0; i < 4; ++i) {
+		city.positions.push_back(corners[i]);
+		city.normals.push_back(normal);
+		city.uvCoords.push_back(uvCoords[i] * vec2(length(side1), length(side2)) * 0.25f);
+		city.layers.push_back(layer);
+	}
+	for (unsigned int index : {0u, 1u, 2u, 0u, 2u, 3u}) {
+		city.indices.push_back(base + index);
+	}
+}
+
+//---------------------------------------------------------------------------------------
+// A batch over the vertices added since the last one.
+void closeBatch(City & city, MaterialHandle material, int textureIndex) {
+	unsigned int startIndex = city.batches.empty() ? 0 : city.batches.back().startIndex + city.batches.back().numIndices;
+	unsigned int baseVertex = city.batches.empty() ? 0 : city.batches.back().baseVertex
+			+ (city.batches.back().numIndices / 6) * 4;
+	StaticBatch batch;
+	batch.blockX = 0;
+	batch.blockZ = 0;
+	batch.textureIndex = textureIndex;
+	batch.material = material;
+	batch.startIndex = startIndex;
+	batch.numIndices = city.indices.size() - startIndex;
+	batch.baseVertex = baseVertex;
+	// Indices are relative to the batch's first vertex.
+	for (unsigned int i = startIndex; i < city.indices.size(); ++i) {
+		city.indices[i] -= baseVertex;
+	}
+	city.batches.push_back(batch);
+}
+
+//---------------------------------------------------------------------------------------
+// A textured ground and box buildings of three colours on a square of streets.
+City makeCity() {
+	City city;
+	float halfExtent = 0.5f * std::ceil(std::sqrt((float)NUM_BUILDINGS)) * 8.0f;
+	addQuad(city, vec3(-halfExtent, 0.0f, halfExtent), vec3(2.0f * halfExtent, 0.0f, 0.0f),
+			vec3(0.0f, 0.0f, -2.0f * halfExtent), 0.0f);
+	closeBatch(city, SceneRegistry::materialHandle(Material(vec4(0.5f, 0.5f, 0.5f, 1.0f), vec3(0.1f), 10.0f)), 0);
+
+	const vec4 colours[3] = {vec4(0.584f, 0.184f, 0.157f, 1.0f), vec4(0.46f, 0.67f, 0.76f, 1.0f),
+			vec4(1.0f, 0.86f, 0.7f, 1.0f)};
+	CityRandom random(1, NUM_BUILDINGS, 0, CityStream::Buildings);
+	unsigned int perSide = (unsigned int)std::ceil(std::sqrt((float)NUM_BUILDINGS));
+	for (unsigned int colour = 0; colour < 3; ++colour) {
+		for (unsigned int i = colour; i < NUM_BUILDINGS; i += 3) {
+			vec3 min((i % perSide) * 8.0f - halfExtent, 0.0f, (i / perSide) * 8.0f - halfExtent);
+			vec3 size(2 + random.nextInt(5), 3 + random.nextInt(23), 2 + random.nextInt(5));
+			vec3 x(size.x, 0.0f, 0.0f), y(0.0f, size.y, 0.0f), z(0.0f, 0.0f, size.z);
+			addQuad(city, min, z, y, -1.0f);
+			addQuad(city, min + x, y, z, -1.0f);
+			addQuad(city, min, y, x, -1.0f);
+			addQuad(city, min + z, x, y, -1.0f);
+			addQuad(city, min + y, z, x, -1.0f);
+		}
+		closeBatch(city, SceneRegistry::materialHandle(Material(colours[colour], vec3(0.1f), 10.0f)), -1);
+	}
+	return city;
+}
+
+//---------------------------------------------------------------------------------------
+PosterTexture makeChecker() {
+	PosterTexture texture;
+	texture.width = CHECKER_SIZE;
+	texture.height = CHECKER_SIZE;
+	for (unsigned int y = 0; y < CHECKER_SIZE; ++y) {
+		for (unsigned int x = 0; x < CHECKER_SIZE; ++x) {
+			unsigned char value = ((x / 8 + y / 8) % 2) ? 200 : 90;
+			texture.pixels.insert(texture.pixels.end(), {value, value, value});
+		}
+	}
+	return texture;
+}
+
+//---------------------------------------------------------------------------------------
+double millisecondsSince(const chrono::steady_clock::time_point & start) {
+	return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+int main(int argc, char ** argv) {
+	unsigned int samples = argc > 1 ? strtoul(argv[1], nullptr, 10) : 4;
+	string pngFile = argc > 2 ? argv[2] : "";
+
+	City city = makeCity();
+	StaticVertexArrays arrays = {city.positions.data(), city.normals.data(), city.uvCoords.data(),
+			city.layers.data(), city.positions.size(), city.indices.data(), city.indices.size()};
+	StaticGeometry geometry;
+	geometry.useConsolidated(arrays, city.batches, NUM_BUILDINGS);
+
+	PosterRenderer poster;
+	poster.addGeometry(geometry);
+	vector<PosterTexture> textures;
+	textures.push_back(makeChecker());
+	poster.setTextures(std::move(textures));
+	{
+		WorkerPool pool;
+		poster.build(pool);
+	}
+
+	PosterView view;
+	view.eye = vec3(0.0f, 50.0f, 60.0f);
+	view.direction = normalize(vec3(0.0f, -0.6f, -1.0f));
+	view.up = vec3(0.0f, 1.0f, 0.0f);
+	view.fovy = radians(60.0f);
+	view.lightPosition = view.eye - vec3(0.0f, 1.0f, 0.0f);
+	view.lightDirection = normalize(vec3(0.1f, -1.0f, -0.8f));
+	view.lightCosCutOff = std::cos(radians(10.0f));
+	view.lightRgbIntensity = vec3(1.0f);
+	view.ambientIntensity = vec3(0.1f);
+	view.width = WIDTH;
+	view.height = HEIGHT;
+	view.samplesPerPixel = samples;
+	view.maxBounces = 3;
+	view.seed = 1;
+
+	unsigned int maxThreads = std::max(thread::hardware_concurrency(), 1u);
+	cout << "Poster of " << poster.numTriangles() << " triangles, " << WIDTH << "x" << HEIGHT << " at "
+		<< samples << " samples per pixel\n\n"
+		<< "  threads   render ms   speedup   same image\n";
+	vector<unsigned char> first;
+	double firstMs = 0.0;
+	for (unsigned int threads = 1; ; threads = std::min(threads * 2, maxThreads)) {
+		WorkerPool pool(threads);
+		vector<unsigned char> rgb;
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		poster.render(view, pool, rgb);
+		double ms = millisecondsSince(start);
+		if (threads == 1) {
+			first = rgb;
+			firstMs = ms;
+		}
+		cout << setw(9) << threads << fixed << setprecision(1) << setw(12) << ms
+			<< setprecision(2) << setw(10) << firstMs / ms << setw(13) << (rgb == first ? "yes" : "NO") << "\n";
+		if (threads == maxThreads) {
+			break;
+		}
+	}
+
+	if (!pngFile.empty()) {
+		PosterRenderer::writePng(pngFile, WIDTH, HEIGHT, first);
+		cout << "\nWrote " << pngFile << "\n";
+	}
+	return 0;
+}
@@ -0,0 +1,169 @@
+// Times building a TriangleBvh over a city of box buildings, on one thread and on a
+// WorkerPool, and the spotlight ray query Project::simulate runs against it every
+// tick.  Checks a sample of the rays against a scan over every triangle.
+//
+// The cities hold 12k to 1.2M triangles, from a tenth of the generated city to ten
+// times it; the query should stay in microseconds throughout.
+//
+// Usage: ./TriangleBvhBench [rays]
+
+#include "TriangleBvh.hpp"
+#include "WorkerPool.hpp"
+#include "CityRandom.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+using namespace glm;
+using namespace std;
+
+namespace {
+
+// Rays checked against the scan over every triangle, per city.
+const unsigned int CHECKED_RAYS = 200;
+
+struct City {
+	vector<vec3> positions;
+	vector<unsigned int> indices;
+};
+
+//---------------------------------------------------------------------------------------
+// A box from min to max as 12 triangles.
+void addBox(City & city, const vec3 & min, const vec3 & max) {
+	static const unsigned int faces[36] = {
+		0, 1, 3, 0, 3, 2,  4, 6, 7, 4, 7, 5,  0, 4, 5, 0, 5, 1,
+		2, 3, 7, 2, 7, 6,  0, 2, 6, 0, 6, 4,  1, 5, 7, 1, 7, 3
+	};
+	unsigned int base = city.positions.size();
+	for (unsigned int corner = 0; corner < 8; ++corner) {
+		city.positions.push_back(vec3(corner & 4 ? max.x : min.x, corner & 2 ? max.y : min.y,
+				corner & 1 ? max.z : min.z));
+	}
+	for (unsigned int index : faces) {
+		city.indices.push_back(base + index);
+	}
+}
+
+//---------------------------------------------------------------------------------------
+// Buildings of 2 to 6 units on a side and 3 to 25 high on a square of streets, as
+// dense as the generated city and as large as numBuildings takes.
+City makeCity(unsigned int numBuildings) {
+	CityRandom random(1, numBuildings, 0, CityStream::Buildings);
+	City city;
+	unsigned int perSide = (unsigned int)std::ceil(std::sqrt((float)numBuildings));
+	float spacing = 8.0f;
+	float halfExtent = 0.5f * perSide * spacing;
+	for (unsigned int i = 0; i < numBuildings; ++i) {
+		float x = (i % perSide) * spacing - halfExtent;
+		float z = (i / perSide) * spacing - halfExtent;
+		float width = 2 + random.nextInt(5);
+		float depth = 2 + random.nextInt(5);
+		float height = 3 + random.nextInt(23);
+		addBox(city, vec3(x, 0.0f, z), vec3(x + width, height, z + depth));
+	}
+	return city;
+}
+
+//---------------------------------------------------------------------------------------
+// A spotlight ray from helicopter height down into the city, as the mouse sweeps it.
+void spotlightRay(unsigned int ray, float halfExtent, vec3 & origin, vec3 & direction) {
+	float t = ray * 0.01f;
+	origin = vec3(halfExtent * 0.8f * sin(0.3f * t), 50.0f, halfExtent * 0.8f * cos(0.2f * t));
+	direction = normalize(vec3(sin(t), -1.5f, cos(1.3f * t)));
+}
+
+//---------------------------------------------------------------------------------------
+// The nearest hit by brute force.
+float scan(const City & city, const vec3 & origin, const vec3 & direction) {
+	float nearest = FLT_MAX;
+	for (size_t i = 0; i < city.indices.size(); i += 3) {
+		vec3 v0 = city.positions[city.indices[i]];
+		vec3 edge1 = city.positions[city.indices[i + 1]] - v0;
+		vec3 edge2 = city.positions[city.indices[i + 2]] - v0;
+		vec3 p = cross(direction, edge2);
+		float determinant = dot(edge1, p);
+		if (determinant == 0.0f) {
+			continue;
+		}
+		vec3 s = origin - v0;
+		float u = dot(s, p) / determinant;
+		vec3 q = cross(s, edge1);
+		float v = dot(direction, q) / determinant;
+		float t = dot(edge2, q) / determinant;
+		if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && t > 0.0f && t < nearest) {
+			nearest = t;
+		}
+	}
+	return nearest;
+}
+
+//---------------------------------------------------------------------------------------
+double millisecondsSince(const chrono::steady_clock::time_point & start) {
+	return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+int main(int argc, char ** argv) {
+	unsigned int numRays = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+	WorkerPool pool;
+
+	cout << "Spotlight rays against a TriangleBvh, " << numRays << " rays per city, "
+		<< pool.numThreads() << " build threads\n\n"
+		<< "  triangles   build ms   parallel ms   nodes   us/ray   hits   mismatches\n";
+	for (unsigned int numBuildings : {1000u, 10000u, 100000u}) {
+		City city = makeCity(numBuildings);
+		float halfExtent = 4.0f * std::ceil(std::sqrt((float)numBuildings));
+
+		TriangleBvh serial;
+		serial.addTriangles(city.positions.data(), city.indices.data(), city.indices.size());
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		serial.build();
+		double serialMs = millisecondsSince(start);
+
+		TriangleBvh bvh;
+		bvh.addTriangles(city.positions.data(), city.indices.data(), city.indices.size());
+		start = chrono::steady_clock::now();
+		bvh.build(&pool);
+		double parallelMs = millisecondsSince(start);
+
+		unsigned int hits = 0;
+		start = chrono::steady_clock::now();
+		for (unsigned int ray = 0; ray < numRays; ++ray) {
+			vec3 origin, direction;
+			spotlightRay(ray, halfExtent, origin, direction);
+			float distance = FLT_MAX;
+			if (bvh.intersect(origin, direction, distance)) {
+				++hits;
+			}
+		}
+		double rayUs = 1000.0 * millisecondsSince(start) / numRays;
+
+		unsigned int mismatches = 0;
+		for (unsigned int ray = 0; ray < CHECKED_RAYS; ++ray) {
+			vec3 origin, direction;
+			spotlightRay(ray * (numRays / CHECKED_RAYS + 1), halfExtent, origin, direction);
+			float expected = scan(city, origin, direction);
+			float distance = FLT_MAX;
+			float serialDistance = FLT_MAX;
+			bvh.intersect(origin, direction, distance);
+			serial.intersect(origin, direction, serialDistance);
+			if (std::abs(distance - expected) > 1e-3f * std::max(expected, 1.0f) || distance != serialDistance) {
+				++mismatches;
+			}
+		}
+
+		cout << setw(11) << bvh.numTriangles()
+			<< fixed << setprecision(1) << setw(11) << serialMs << setw(14) << parallelMs
+			<< setw(8) << bvh.numNodes()
+			<< setprecision(2) << setw(9) << rayUs
+			<< setw(7) << hits << setw(13) << mismatches << "\n";
+	}
+	return 0;
+}
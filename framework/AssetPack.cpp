@@ -0,0 +1,177 @@
+#include "AssetPack.hpp"
+
+#include "framework/Exception.hpp"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+using namespace std;
+
+//---------------------------------------------------------------------------------------
+static void throwPackError(const std::string & packPath, const char * problem) {
+	stringstream errorMessage;
+	errorMessage << "Unable to read asset pack " << packPath << ": " << problem;
+	throw Exception(errorMessage.str());
+}
+
+//---------------------------------------------------------------------------------------
+static uint64_t alignOffset(uint64_t offset) {
+	return (offset + ASSET_PACK_ALIGNMENT - 1) / ASSET_PACK_ALIGNMENT * ASSET_PACK_ALIGNMENT;
+}
+
+//---------------------------------------------------------------------------------------
+AssetPack::AssetPack(const std::string & looseRoot)
+	: m_looseRoot(looseRoot),
+	  m_entries(nullptr),
+	  m_numEntries(0)
+{
+
+}
+
+//---------------------------------------------------------------------------------------
+/*
+ * Everything the index says is checked against the file size here, so find() can
+ * trust it.  The whole pack is then prefetched, since startup reads nearly all of it.
+ */
+bool AssetPack::open(const std::string & packPath) {
+	struct stat status;
+	if (stat(packPath.c_str(), &status) != 0 && errno == ENOENT) {
+		return false;
+	}
+	unique_ptr<MappedFile> file(new MappedFile(packPath.c_str()));
+	const char * data = file->data();
+	uint64_t fileSize = file->size();
+
+	AssetPackHeader header;
+	if (fileSize < sizeof(header)) {
+		throwPackError(packPath, "truncated header");
+	}
+	memcpy(&header, data, sizeof(header));
+	if (memcmp(header.magic, ASSET_PACK_MAGIC, sizeof(header.magic)) != 0) {
+		throwPackError(packPath, "not an asset pack");
+	}
+	if (header.version != ASSET_PACK_VERSION) {
+		throwPackError(packPath, "unsupported version");
+	}
+	if ((fileSize - sizeof(header)) / sizeof(AssetPackEntry) < header.numEntries) {
+		throwPackError(packPath, "truncated index");
+	}
+
+	const AssetPackEntry * entries = reinterpret_cast<const AssetPackEntry *>(data + sizeof(header));
+	for (unsigned int i = 0; i < header.numEntries; ++i) {
+		const AssetPackEntry & entry = entries[i];
+		if (entry.nameOffset > fileSize || entry.nameSize > fileSize - entry.nameOffset
+				|| entry.offset > fileSize || entry.size > fileSize - entry.offset) {
+			throwPackError(packPath, "entry out of bounds");
+		}
+	}
+
+	file->prefetch();
+	m_file = std::move(file);
+	m_entries = entries;
+	m_numEntries = header.numEntries;
+	return true;
+}
+
+//---------------------------------------------------------------------------------------
+bool AssetPack::isOpen() const {
+	return m_file != nullptr;
+}
+
+//---------------------------------------------------------------------------------------
+unsigned int AssetPack::size() const {
+	return m_numEntries;
+}
+
+//---------------------------------------------------------------------------------------
+bool AssetPack::find (
+		const std::string & name,
+		const char * & data,
+		size_t & size
+) const {
+	if (!m_file) {
+		return false;
+	}
+	const char * base = m_file->data();
+	const AssetPackEntry * end = m_entries + m_numEntries;
+	const AssetPackEntry * found = lower_bound(m_entries, end, name,
+			[base](const AssetPackEntry & entry, const std::string & key) {
+				return key.compare(0, key.size(), base + entry.nameOffset, entry.nameSize) > 0;
+			});
+	if (found == end || name.compare(0, name.size(), base + found->nameOffset, found->nameSize) != 0) {
+		return false;
+	}
+	data = base + found->offset;
+	size = found->size;
+	return true;
+}
+
+//---------------------------------------------------------------------------------------
+std::string AssetPack::nameOf(const std::string & path) const {
+	if (path.size() <= m_looseRoot.size() + 1 || path.compare(0, m_looseRoot.size(), m_looseRoot) != 0
+			|| path[m_looseRoot.size()] != '/') {
+		return "";
+	}
+	return path.substr(m_looseRoot.size() + 1);
+}
+
+//---------------------------------------------------------------------------------------
+std::string AssetPack::looseFilePath(const std::string & name) const {
+	return m_looseRoot + "/" + name;
+}
+
+//---------------------------------------------------------------------------------------
+void AssetPack::write (
+		const std::string & packPath,
+		const std::string & looseRoot,
+		std::vector<std::string> names
+) {
+	sort(names.begin(), names.end());
+	names.erase(unique(names.begin(), names.end()), names.end());
+
+	AssetPackHeader header;
+	memcpy(header.magic, ASSET_PACK_MAGIC, sizeof(header.magic));
+	header.version = ASSET_PACK_VERSION;
+	header.numEntries = names.size();
+
+	// Lay out the index and names first; blob sizes are only known once each file is
+	// mapped, so their offsets are patched in as they are written.
+	vector<AssetPackEntry> entries(names.size());
+	uint64_t offset = sizeof(header) + entries.size() * sizeof(AssetPackEntry);
+	for (size_t i = 0; i < names.size(); ++i) {
+		entries[i].nameOffset = offset;
+		entries[i].nameSize = names[i].size();
+		offset += names[i].size();
+	}
+
+	ofstream pack(packPath.c_str(), ios::binary | ios::trunc);
+	if (!pack) {
+		throw Exception("Unable to create asset pack " + packPath);
+	}
+	const vector<char> padding(ASSET_PACK_ALIGNMENT, 0);
+	pack.seekp(offset);
+	for (size_t i = 0; i < names.size(); ++i) {
+		MappedFile file((looseRoot + "/" + names[i]).c_str());
+		uint64_t blobOffset = alignOffset(offset);
+		pack.write(padding.data(), blobOffset - offset);
+		pack.write(file.data(), file.size());
+		entries[i].offset = blobOffset;
+		entries[i].size = file.size();
+		offset = blobOffset + file.size();
+	}
+
+	pack.seekp(0);
+	pack.write(reinterpret_cast<const char *>(&header), sizeof(header));
+	pack.write(reinterpret_cast<const char *>(entries.data()), entries.size() * sizeof(AssetPackEntry));
+	for (const string & name : names) {
+		pack.write(name.data(), name.size());
+	}
+	pack.close();
+	if (!pack) {
+		throw Exception("Unable to write asset pack " + packPath);
+	}
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "framework/MappedFile.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Every blob starts on a page boundary of its own within the pack.
+const size_t ASSET_PACK_ALIGNMENT = 4096;
+
+const char ASSET_PACK_MAGIC[8] = {'C', 'I', 'T', 'Y', 'P', 'A', 'C', 'K'};
+const uint32_t ASSET_PACK_VERSION = 1;
+
+/*
+ * Pack file layout, in the byte order of the machine that cooked it:
+ *   AssetPackHeader
+ *   AssetPackEntry[numEntries], sorted by name
+ *   the names, not terminated
+ *   the blobs, each at a multiple of ASSET_PACK_ALIGNMENT
+ * Offsets are from the start of the file.
+ */
+struct AssetPackHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t numEntries;
+};
+
+struct AssetPackEntry {
+	uint64_t offset;
+	uint64_t size;
+	uint32_t nameOffset;
+	uint32_t nameSize;
+};
+
+/*
+ * Read-only archive of the files under an asset directory, mapped into memory as a
+ * whole.  Assets are named by their path relative to that directory, e.g.
+ * "images/road.jpg", and find() hands out pointers into the mapping, so loaders can
+ * decode straight from it without opening or copying anything.
+ *
+ * Without a pack, or for a name it does not hold, callers load the loose file at
+ * looseFilePath() instead.  Nothing changes once open() returns, so any thread may
+ * read.
+ */
+class AssetPack {
+public:
+	// looseRoot is the directory the assets are named relative to, e.g. "Assets".
+	explicit AssetPack(const std::string & looseRoot);
+
+	// Maps packPath.  Returns false if there is no such file, and throws Exception if
+	// it is not a pack this version can read.
+	bool open(const std::string & packPath);
+
+	bool isOpen() const;
+
+	// Number of packed assets.
+	unsigned int size() const;
+
+	// Points data at the packed bytes of name and returns true, or returns false if
+	// name is not packed.
+	bool find(const std::string & name, const char * & data, size_t & size) const;
+
+	// The name of the asset at path, or "" if path is not under the loose root.
+	std::string nameOf(const std::string & path) const;
+
+	// Where the loose file for name is.
+	std::string looseFilePath(const std::string & name) const;
+
+	// Cooks the loose files called names under looseRoot into a pack at packPath.
+	// Throws Exception if a file cannot be read or the pack cannot be written.
+	static void write(const std::string & packPath, const std::string & looseRoot,
+			std::vector<std::string> names);
+
+private:
+	AssetPack(const AssetPack &) = delete;
+	AssetPack & operator = (const AssetPack &) = delete;
+
+	std::string m_looseRoot;
+	std::unique_ptr<MappedFile> m_file;
+	const AssetPackEntry * m_entries;
+	unsigned int m_numEntries;
+};
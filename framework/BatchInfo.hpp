@@ -1,18 +1,23 @@
 #pragma once
 
-// Class for encapsulating index offset and number of indices to be rendered
-// for a batch of vertices.  It is assumed that there is a vertex buffer
-// setup so that all batch vertices are contiguous in memory and can be rendered
-// all at once given a start index offset into the vertex buffer, and a number
-// of indices to be rendered.
+// Class for encapsulating the range of a batch within an associated index buffer.
+// It is assumed that there is a vertex buffer setup so that all batch vertices are
+// contiguous in memory, and that the batch's indices are relative to its first
+// vertex, so the batch can be rendered all at once with glDrawElementsBaseVertex.
 struct BatchInfo {
 
-	// Starting index within an associated vertex buffer denoting the start
-	// of this batch's vertex data.
+	// Starting index within an associated index buffer denoting the start
+	// of this batch's index data.
 	unsigned int startIndex;
 
 	// Number of indices to be rendered for this batch.
 	unsigned int numIndices;
 
-};
+	// Position of this batch's first vertex within the vertex buffer, added to
+	// every one of its indices.
+	unsigned int baseVertex;
+
+	// Number of unique vertices the batch's indices refer to.
+	unsigned int numVertices;
 
+};
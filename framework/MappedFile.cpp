@@ -0,0 +1,74 @@
+#include "MappedFile.hpp"
+
+#include "framework/Exception.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+using namespace std;
+
+//---------------------------------------------------------------------------------------
+static void throwMappingError(const char * filePath, const char * operation) {
+	stringstream errorMessage;
+	errorMessage << "Unable to " << operation << " " << filePath << ": " << strerror(errno);
+	throw Exception(errorMessage.str());
+}
+
+//---------------------------------------------------------------------------------------
+MappedFile::MappedFile(const char * filePath)
+	: m_data(nullptr),
+	  m_size(0)
+{
+	int fd = open(filePath, O_RDONLY);
+	if (fd < 0) {
+		throwMappingError(filePath, "open");
+	}
+
+	struct stat status;
+	if (fstat(fd, &status) != 0) {
+		close(fd);
+		throwMappingError(filePath, "stat");
+	}
+	m_size = status.st_size;
+
+	// mmap rejects zero length mappings; an empty file simply has no data.
+	if (m_size > 0) {
+		m_data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (m_data == MAP_FAILED) {
+			m_data = nullptr;
+			close(fd);
+			throwMappingError(filePath, "map");
+		}
+		madvise(m_data, m_size, MADV_SEQUENTIAL);
+	}
+	close(fd);
+}
+
+//---------------------------------------------------------------------------------------
+MappedFile::~MappedFile() {
+	if (m_data) {
+		munmap(m_data, m_size);
+	}
+}
+
+//---------------------------------------------------------------------------------------
+const char * MappedFile::data() const {
+	return static_cast<const char *>(m_data);
+}
+
+//---------------------------------------------------------------------------------------
+size_t MappedFile::size() const {
+	return m_size;
+}
+
+//---------------------------------------------------------------------------------------
+void MappedFile::prefetch() const {
+	if (m_data) {
+		madvise(m_data, m_size, MADV_WILLNEED);
+	}
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+
+/*
+ * Read-only memory mapping of a whole file, released on destruction.
+ */
+class MappedFile {
+public:
+	// Throws Exception if the file cannot be opened or mapped.
+	explicit MappedFile(const char * filePath);
+
+	~MappedFile();
+
+	// First byte of the file, nullptr for an empty file.
+	const char * data() const;
+
+	size_t size() const;
+
+	// Asks the kernel to start reading the whole file in, ahead of the first access.
+	void prefetch() const;
+
+private:
+	MappedFile(const MappedFile &) = delete;
+	MappedFile & operator = (const MappedFile &) = delete;
+
+	void * m_data;
+	size_t m_size;
+};
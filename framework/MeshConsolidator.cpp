@@ -5,6 +5,9 @@ using namespace std;
 #include "framework/Exception.hpp"
 #include "framework/ObjFileDecoder.hpp"
 
+#include <algorithm>
+#include <cstring>
+
 
 //----------------------------------------------------------------------------------------
 // Default constructor
@@ -33,40 +36,132 @@ static void appendVector (
 }
 
 
+//----------------------------------------------------------------------------------------
+namespace {
+
+// A de-indexed face corner, compared and hashed bit for bit.
+struct WeldKey {
+	vec3 position;
+	vec3 normal;
+	vec2 uvCoord;
+
+	bool operator == (const WeldKey & other) const {
+		return memcmp(this, &other, sizeof(WeldKey)) == 0;
+	}
+};
+
+struct WeldKeyHash {
+	size_t operator () (const WeldKey & key) const {
+		// FNV-1a over the raw bytes.
+		const unsigned char * bytes = reinterpret_cast<const unsigned char *>(&key);
+		size_t hash = 2166136261u;
+		for (size_t i = 0; i < sizeof(WeldKey); ++i) {
+			hash = (hash ^ bytes[i]) * 16777619u;
+		}
+		return hash;
+	}
+};
+
+} // namespace
+
+//----------------------------------------------------------------------------------------
+/*
+ * Collapses identical corners of the decoded triangle soup, appending the unique
+ * vertices to the consolidated arrays and one mesh relative index per corner.
+ * Meshes without texture coordinates get (0, 0) so the arrays stay parallel.
+ */
+static void weldVertices (
+		const std::vector<vec3> & positions,
+		const std::vector<vec3> & normals,
+		const std::vector<vec2> & uvCoords,
+		std::vector<vec3> & uniquePositions,
+		std::vector<vec3> & uniqueNormals,
+		std::vector<vec2> & uniqueUVs,
+		std::vector<unsigned int> & indices
+) {
+	unordered_map<WeldKey, unsigned int, WeldKeyHash> uniqueIndices;
+	uniqueIndices.reserve(positions.size());
+	bool hasUVCoords = uvCoords.size() == positions.size();
+	unsigned int numUnique = 0;
+
+	for (size_t i = 0; i < positions.size(); ++i) {
+		WeldKey key = {};
+		key.position = positions[i];
+		key.normal = normals[i];
+		key.uvCoord = hasUVCoords ? uvCoords[i] : vec2(0.0f);
+
+		auto inserted = uniqueIndices.insert(make_pair(key, numUnique));
+		if (inserted.second) {
+			uniquePositions.push_back(key.position);
+			uniqueNormals.push_back(key.normal);
+			uniqueUVs.push_back(key.uvCoord);
+			++numUnique;
+		}
+		indices.push_back(inserted.first->second);
+	}
+}
+
 //----------------------------------------------------------------------------------------
 MeshConsolidator::MeshConsolidator(
 		std::initializer_list<ObjFilePath> objFileList
 ) {
+	consolidate(nullptr, objFileList);
+}
+
+//----------------------------------------------------------------------------------------
+MeshConsolidator::MeshConsolidator(
+		const AssetPack & assets,
+		std::initializer_list<ObjFilePath> objFileList
+) {
+	consolidate(&assets, objFileList);
+}
+
+//----------------------------------------------------------------------------------------
+void MeshConsolidator::consolidate(
+		const AssetPack * assets,
+		std::initializer_list<ObjFilePath> objFileList
+) {
 
 	MeshId meshId;
 	vector<vec3> positions;
 	vector<vec3> normals;
 	vector<vec2> uvCoords;
 	BatchInfo batchInfo;
-	unsigned long indexOffset(0);
+	unsigned int maxVerticesPerMesh(0);
 
     for(const ObjFilePath & objFile : objFileList) {
-	    ObjFileDecoder::decode(objFile.c_str(), meshId, positions, normals, uvCoords);
-
-	    uint numIndices = positions.size();
+	    const char * data;
+	    size_t size;
+	    if (!assets) {
+		    ObjFileDecoder::decode(objFile.c_str(), meshId, positions, normals, uvCoords);
+	    } else if (assets->find(objFile, data, size)) {
+		    ObjFileDecoder::decode(data, size, objFile.c_str(), meshId, positions, normals, uvCoords);
+	    } else {
+		    ObjFileDecoder::decode(assets->looseFilePath(objFile).c_str(), meshId, positions, normals, uvCoords);
+	    }
 
-	    if (numIndices != normals.size()) {
+	    if (positions.size() != normals.size()) {
 		    throw Exception("Error within MeshConsolidator: "
 					"positions.size() != normals.size()\n");
 	    }
 
-	    batchInfo.startIndex = indexOffset;
-	    batchInfo.numIndices = numIndices;
+	    batchInfo.startIndex = m_indexData.size();
+	    batchInfo.numIndices = positions.size();
+	    batchInfo.baseVertex = m_vertexPositionData.size();
 
-	    m_batchInfoMap[meshId] = batchInfo;
+	    weldVertices(positions, normals, uvCoords,
+			    m_vertexPositionData, m_vertexNormalData, m_vertexUV, m_indexData);
 
-	    appendVector(m_vertexPositionData, positions);
-	    appendVector(m_vertexNormalData, normals);
-		appendVector(m_vertexUV, uvCoords);
+	    batchInfo.numVertices = m_vertexPositionData.size() - batchInfo.baseVertex;
+	    maxVerticesPerMesh = std::max(maxVerticesPerMesh, batchInfo.numVertices);
 
-	    indexOffset += numIndices;
+	    m_batchInfoMap[meshId] = batchInfo;
     }
 
+	// Indices are mesh relative, so the 16 bit limit applies per mesh.
+	if (maxVerticesPerMesh <= 0xFFFF) {
+		m_shortIndexData.assign(m_indexData.begin(), m_indexData.end());
+	}
 }
 
 //----------------------------------------------------------------------------------------
@@ -107,3 +202,36 @@ size_t MeshConsolidator::getNumVertexNormalBytes() const {
 size_t MeshConsolidator::getNumVertexUVBytes() const {
 	return m_vertexUV.size() * sizeof(vec2);
 }
+
+//----------------------------------------------------------------------------------------
+const void * MeshConsolidator::getIndexDataPtr() const {
+	if (!m_shortIndexData.empty()) {
+		return m_shortIndexData.data();
+	}
+	return m_indexData.data();
+}
+
+//----------------------------------------------------------------------------------------
+size_t MeshConsolidator::getNumIndexBytes() const {
+	return m_indexData.size() * getIndexSize();
+}
+
+//----------------------------------------------------------------------------------------
+size_t MeshConsolidator::getIndexSize() const {
+	return m_shortIndexData.empty() ? sizeof(unsigned int) : sizeof(unsigned short);
+}
+
+//----------------------------------------------------------------------------------------
+const std::vector<unsigned int> & MeshConsolidator::getIndices() const {
+	return m_indexData;
+}
+
+//----------------------------------------------------------------------------------------
+void MeshConsolidator::getPackedVertexData (
+		std::vector<PackedVertex> & vertices
+) const {
+	vertices.resize(m_vertexPositionData.size());
+	for (size_t i = 0; i < vertices.size(); ++i) {
+		vertices[i] = packVertex(m_vertexPositionData[i], m_vertexNormalData[i], m_vertexUV[i]);
+	}
+}
@@ -1,6 +1,8 @@
 #pragma once
 
+#include "framework/AssetPack.hpp"
 #include "framework/BatchInfo.hpp"
+#include "framework/PackedVertex.hpp"
 
 #include <glm/glm.hpp>
 
@@ -19,13 +21,15 @@ typedef std::string ObjFilePath;
 
 
 // BatchInfoMap is an associative container that maps a unique MeshId to a BatchInfo
-// object. Each BatchInfo object contains an index offset and the number of indices
-// required to render the mesh with identifier MeshId.
+// object. Each BatchInfo object contains an index offset, the number of indices
+// and the base vertex required to render the mesh with identifier MeshId.
 typedef std::unordered_map<MeshId, BatchInfo>  BatchInfoMap;
 
 
 /*
 * Class for consolidating all vertex data within a list of .obj files.
+* Identical (position, normal, uv) corners are welded into one vertex, and each
+* mesh is described by a range of an index buffer.
 */
 class MeshConsolidator {
 public:
@@ -33,6 +37,10 @@ public:
 
 	MeshConsolidator(std::initializer_list<ObjFilePath>  objFileList);
 
+	// Here the files are asset names, decoded in place from assets when packed and
+	// from the loose files otherwise.
+	MeshConsolidator(const AssetPack & assets, std::initializer_list<ObjFilePath>  objFileList);
+
 	~MeshConsolidator();
 
 	const float * getVertexPositionDataPtr() const;
@@ -47,13 +55,31 @@ public:
 
 	size_t getNumVertexUVBytes() const;
 
+	// The same vertices as one interleaved PackedVertex stream, built on request.
+	void getPackedVertexData(std::vector<PackedVertex> & vertices) const;
+
+	// Mesh relative indices, 16 bit when every mesh has fewer than 65536 vertices.
+	const void * getIndexDataPtr() const;
+
+	size_t getNumIndexBytes() const;
+
+	// Size of one index in bytes, 2 or 4.
+	size_t getIndexSize() const;
+
+	// The same indices, always 32 bit, for CPU side consumers.
+	const std::vector<unsigned int> & getIndices() const;
+
 	void getBatchInfoMap(BatchInfoMap & batchInfoMap) const;
 
 
 private:
+	void consolidate(const AssetPack * assets, std::initializer_list<ObjFilePath> objFileList);
+
 	std::vector<glm::vec3> m_vertexPositionData;
 	std::vector<glm::vec3> m_vertexNormalData;
 	std::vector<glm::vec2> m_vertexUV;
+	std::vector<unsigned int> m_indexData;
+	std::vector<unsigned short> m_shortIndexData;
 	BatchInfoMap m_batchInfoMap;
 };
 
@@ -1,17 +1,240 @@
 #include "ObjFileDecoder.hpp"
 using namespace glm;
 
-#include <fstream>
-#include <sstream>
-#include <iostream>
+#include <cmath>
+#include <cstdint>
 #include <cstring>
+#include <sstream>
 using namespace std;
 
 #include "framework/Exception.hpp"
+#include "framework/MappedFile.hpp"
+
+namespace {
+
+// One corner of a face, as 0 based indices into the temporary attribute arrays.
+// Missing attributes are -1.
+struct FaceCorner {
+	int position;
+	int uvCoord;
+	int normal;
+};
+
+/*
+ * Cursor over the file contents.  Every read stops at the end of the current line,
+ * so a malformed line can never run into the next one.
+ */
+struct ObjScanner {
+	const char * cur;
+	const char * end;
+	const char * filePath;
+	unsigned int line;
+
+	bool atEnd() const {
+		return cur >= end;
+	}
+
+	bool atLineEnd() const {
+		return cur >= end || *cur == '\n';
+	}
+
+	void skipSpaces() {
+		while (cur < end && (*cur == ' ' || *cur == '\t' || *cur == '\r')) {
+			++cur;
+		}
+	}
+
+	void nextLine() {
+		const char * newline = static_cast<const char *>(memchr(cur, '\n', end - cur));
+		cur = newline ? newline + 1 : end;
+		++line;
+	}
+
+	// Returns true and consumes c if it is the next character.
+	bool accept(char c) {
+		if (cur < end && *cur == c) {
+			++cur;
+			return true;
+		}
+		return false;
+	}
+
+	bool parseFloat(float & value);
+	bool parseInt(int & value);
+	void fail(const char * what) const;
+};
+
+//---------------------------------------------------------------------------------------
+// Powers of ten that are exactly representable as doubles.
+const double exactPowersOfTen[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+	1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+//---------------------------------------------------------------------------------------
+double powerOfTen(int exponent) {
+	if (exponent >= 0 && exponent <= 22) {
+		return exactPowersOfTen[exponent];
+	}
+	return pow(10.0, exponent);
+}
+
+//---------------------------------------------------------------------------------------
+// Parses [+-]digits[.digits][(e|E)[+-]digits] without touching the locale.  The first
+// 19 significant digits are kept exactly, which is far beyond float precision.
+bool ObjScanner::parseFloat(float & value) {
+	skipSpaces();
+	const char * start = cur;
+	bool negative = false;
+	if (cur < end && (*cur == '-' || *cur == '+')) {
+		negative = *cur == '-';
+		++cur;
+	}
+
+	uint64_t mantissa = 0;
+	int significantDigits = 0;
+	int exponent = 0;
+	bool anyDigits = false;
+	while (cur < end && *cur >= '0' && *cur <= '9') {
+		if (significantDigits < 19) {
+			mantissa = mantissa * 10 + (*cur - '0');
+			significantDigits += mantissa != 0;
+		} else {
+			++exponent;
+		}
+		anyDigits = true;
+		++cur;
+	}
+	if (accept('.')) {
+		while (cur < end && *cur >= '0' && *cur <= '9') {
+			if (significantDigits < 19) {
+				mantissa = mantissa * 10 + (*cur - '0');
+				significantDigits += mantissa != 0;
+				--exponent;
+			}
+			anyDigits = true;
+			++cur;
+		}
+	}
+	if (!anyDigits) {
+		cur = start;
+		return false;
+	}
+	if (cur < end && (*cur == 'e' || *cur == 'E')) {
+		++cur;
+		bool negativeExponent = false;
+		if (cur < end && (*cur == '-' || *cur == '+')) {
+			negativeExponent = *cur == '-';
+			++cur;
+		}
+		int explicitExponent = 0;
+		while (cur < end && *cur >= '0' && *cur <= '9') {
+			explicitExponent = std::min(explicitExponent * 10 + (*cur - '0'), 10000);
+			++cur;
+		}
+		exponent += negativeExponent ? -explicitExponent : explicitExponent;
+	}
+
+	double result = (double)mantissa;
+	if (exponent < 0) {
+		result /= powerOfTen(-exponent);
+	} else if (exponent > 0) {
+		result *= powerOfTen(exponent);
+	}
+	value = (float)(negative ? -result : result);
+	return true;
+}
+
+//---------------------------------------------------------------------------------------
+bool ObjScanner::parseInt(int & value) {
+	const char * start = cur;
+	bool negative = accept('-');
+	if (cur >= end || *cur < '0' || *cur > '9') {
+		cur = start;
+		return false;
+	}
+	int result = 0;
+	while (cur < end && *cur >= '0' && *cur <= '9') {
+		result = result * 10 + (*cur - '0');
+		++cur;
+	}
+	value = negative ? -result : result;
+	return true;
+}
+
+//---------------------------------------------------------------------------------------
+void ObjScanner::fail(const char * what) const {
+	stringstream errorMessage;
+	errorMessage << what << " on line " << line << " of .obj file " << filePath
+		<< " within method ObjFileDecoder::decode" << endl;
+	throw Exception(errorMessage.str());
+}
+
+//---------------------------------------------------------------------------------------
+// Converts a 1 based, or negative relative, .obj index into a 0 based one.
+int resolveIndex(const ObjScanner & scanner, int index, size_t count) {
+	int resolved = index > 0 ? index - 1 : (int)count + index;
+	if (index == 0 || resolved < 0 || resolved >= (int)count) {
+		scanner.fail("Face index out of range");
+	}
+	return resolved;
+}
 
+//---------------------------------------------------------------------------------------
+// Parses v, v/t, v//n or v/t/n.
+bool parseFaceCorner (
+		ObjScanner & scanner,
+		size_t numPositions,
+		size_t numUVCoords,
+		size_t numNormals,
+		FaceCorner & corner
+) {
+	scanner.skipSpaces();
+	int index;
+	if (!scanner.parseInt(index)) {
+		return false;
+	}
+	corner.position = resolveIndex(scanner, index, numPositions);
+	corner.uvCoord = -1;
+	corner.normal = -1;
+	if (scanner.accept('/')) {
+		if (scanner.parseInt(index)) {
+			corner.uvCoord = resolveIndex(scanner, index, numUVCoords);
+		}
+		if (scanner.accept('/')) {
+			if (!scanner.parseInt(index)) {
+				scanner.fail("Missing normal index");
+			}
+			corner.normal = resolveIndex(scanner, index, numNormals);
+		}
+	}
+	return true;
+}
+
+} // namespace
+
+//---------------------------------------------------------------------------------------
+void ObjFileDecoder::decode(
+		const char * objFilePath,
+		std::string & objectName,
+        std::vector<vec3> & positions,
+        std::vector<vec3> & normals,
+        std::vector<vec2> & uvCoords
+) {
+	MappedFile file(objFilePath);
+	decode(file.data(), file.size(), objFilePath, objectName, positions, normals, uvCoords);
+}
 
 //---------------------------------------------------------------------------------------
+/*
+ * Scans the buffer in place: no per line strings or streams are built.  Faces with
+ * more than three corners are triangulated as fans, and faces without normals get
+ * their flat face normal.  Faces without texture coordinates get (0, 0) in a file
+ * where other faces have them, so uvCoords is either empty or as long as positions.
+ */
 void ObjFileDecoder::decode(
+		const char * data,
+		size_t size,
 		const char * objFilePath,
 		std::string & objectName,
         std::vector<vec3> & positions,
@@ -24,131 +247,103 @@ void ObjFileDecoder::decode(
 	normals.clear();
 	uvCoords.clear();
 
-    ifstream in(objFilePath, std::ios::in);
-    in.exceptions(std::ifstream::badbit);
-
-    if (!in) {
-        stringstream errorMessage;
-        errorMessage << "Unable to open .obj file " << objFilePath
-            << " within method ObjFileDecoder::decode" << endl;
-
-        throw Exception(errorMessage.str().c_str());
-    }
+	ObjScanner scanner = {data, data + size, objFilePath, 1};
 
-    string currentLine;
-    int positionIndexA, positionIndexB, positionIndexC;
-    int normalIndexA, normalIndexB, normalIndexC;
-    int uvCoordIndexA, uvCoordIndexB, uvCoordIndexC;
     vector<vec3> temp_positions;
     vector<vec3> temp_normals;
     vector<vec2> temp_uvCoords;
+	vector<FaceCorner> corners;
+	bool anyUVCoords = false;
 
 	objectName = "";
 
-    while (!in.eof()) {
-        try {
-            getline(in, currentLine);
-        } catch (const ifstream::failure &e) {
-            in.close();
-            stringstream errorMessage;
-            errorMessage << "Error calling getline() -- " << e.what() << endl;
-            throw Exception(errorMessage.str());
-        }
-	    if (currentLine.substr(0, 2) == "o ") {
-		    // Get entire line excluding first 2 chars.
-		    istringstream s(currentLine.substr(2));
-		    s >> objectName;
-
-
-	    } else if (currentLine.substr(0, 2) == "v ") {
-            // Vertex data on this line.
-            // Get entire line excluding first 2 chars.
-            istringstream s(currentLine.substr(2));
-            glm::vec3 vertex;
-            s >> vertex.x;
-            s >> vertex.y;
-            s >> vertex.z;
-            temp_positions.push_back(vertex);
-
-        } else if (currentLine.substr(0, 3) == "vn ") {
-            // Normal data on this line.
-            // Get entire line excluding first 2 chars.
-            istringstream s(currentLine.substr(2));
-            vec3 normal;
-            s >> normal.x;
-            s >> normal.y;
-            s >> normal.z;
-            temp_normals.push_back(normal);
-
-        } else if (currentLine.substr(0, 3) == "vt ") {
-            // Texture coordinate data on this line.
-            // Get entire line excluding first 2 chars.
-            istringstream s(currentLine.substr(2));
-            vec2 textureCoord;
-            s >> textureCoord.s;
-            s >> textureCoord.t;
-            temp_uvCoords.push_back(textureCoord);
-
-        } else if (currentLine.substr(0, 2) == "f ") {
-            // Face index data on this line.
-
-            int index;
-
-            // sscanf will return the number of matched index values it found
-            // from the pattern.
-            int numberOfIndexMatches = sscanf(currentLine.c_str(), "f %d/%d/%d",
-                                              &index, &index, &index);
-
-            if (numberOfIndexMatches == 3) {
-                // Line contains indices of the pattern vertex/uv-cord/normal.
-                sscanf(currentLine.c_str(), "f %d/%d/%d %d/%d/%d %d/%d/%d",
-                       &positionIndexA, &uvCoordIndexA, &normalIndexA,
-                       &positionIndexB, &uvCoordIndexB, &normalIndexB,
-                       &positionIndexC, &uvCoordIndexC, &normalIndexC);
-
-                // .obj file uses indices that start at 1, so subtract 1 so they start at 0.
-                uvCoordIndexA--;
-                uvCoordIndexB--;
-                uvCoordIndexC--;
-
-                uvCoords.push_back(temp_uvCoords[uvCoordIndexA]);
-                uvCoords.push_back(temp_uvCoords[uvCoordIndexB]);
-                uvCoords.push_back(temp_uvCoords[uvCoordIndexC]);
-
-            } else {
-                // Line contains indices of the pattern vertex//normal.
-                sscanf(currentLine.c_str(), "f %d//%d %d//%d %d//%d",
-		               &positionIndexA, &normalIndexA,
-                       &positionIndexB, &normalIndexB,
-                       &positionIndexC, &normalIndexC);
-            }
-
-            positionIndexA--;
-            positionIndexB--;
-            positionIndexC--;
-            normalIndexA--;
-            normalIndexB--;
-            normalIndexC--;
-
-            positions.push_back(temp_positions[positionIndexA]);
-            positions.push_back(temp_positions[positionIndexB]);
-            positions.push_back(temp_positions[positionIndexC]);
-
-            normals.push_back(temp_normals[normalIndexA]);
-            normals.push_back(temp_normals[normalIndexB]);
-            normals.push_back(temp_normals[normalIndexC]);
-        }
-    }
-
-    in.close();
+	for (; !scanner.atEnd(); scanner.nextLine()) {
+		scanner.skipSpaces();
+		if (scanner.atLineEnd()) {
+			continue;
+		}
+		char tag = *scanner.cur++;
+		char subTag = scanner.atLineEnd() ? '\n' : *scanner.cur;
+
+		if (tag == 'o' && (subTag == ' ' || subTag == '\t')) {
+			scanner.skipSpaces();
+			const char * nameStart = scanner.cur;
+			while (!scanner.atLineEnd() && *scanner.cur != ' ' && *scanner.cur != '\t' && *scanner.cur != '\r') {
+				++scanner.cur;
+			}
+			objectName.assign(nameStart, scanner.cur);
+
+		} else if (tag == 'v' && (subTag == ' ' || subTag == '\t')) {
+			vec3 vertex;
+			if (!scanner.parseFloat(vertex.x) || !scanner.parseFloat(vertex.y) || !scanner.parseFloat(vertex.z)) {
+				scanner.fail("Malformed vertex");
+			}
+			temp_positions.push_back(vertex);
+
+		} else if (tag == 'v' && subTag == 'n') {
+			++scanner.cur;
+			vec3 normal;
+			if (!scanner.parseFloat(normal.x) || !scanner.parseFloat(normal.y) || !scanner.parseFloat(normal.z)) {
+				scanner.fail("Malformed normal");
+			}
+			temp_normals.push_back(normal);
+
+		} else if (tag == 'v' && subTag == 't') {
+			++scanner.cur;
+			vec2 textureCoord;
+			if (!scanner.parseFloat(textureCoord.s) || !scanner.parseFloat(textureCoord.t)) {
+				scanner.fail("Malformed texture coordinate");
+			}
+			temp_uvCoords.push_back(textureCoord);
+
+		} else if (tag == 'f' && (subTag == ' ' || subTag == '\t')) {
+			corners.clear();
+			FaceCorner corner;
+			while (parseFaceCorner(scanner, temp_positions.size(), temp_uvCoords.size(),
+					temp_normals.size(), corner)) {
+				corners.push_back(corner);
+			}
+			if (corners.size() < 3) {
+				scanner.fail("Face with fewer than three corners");
+			}
+
+			bool hasUVCoords = true;
+			bool hasNormals = true;
+			for (const FaceCorner & c : corners) {
+				hasUVCoords = hasUVCoords && c.uvCoord >= 0;
+				hasNormals = hasNormals && c.normal >= 0;
+			}
+			anyUVCoords = anyUVCoords || hasUVCoords;
+			vec3 faceNormal;
+			if (!hasNormals) {
+				const vec3 & a = temp_positions[corners[0].position];
+				faceNormal = normalize(cross(temp_positions[corners[1].position] - a,
+						temp_positions[corners[2].position] - a));
+			}
+
+			for (size_t i = 1; i + 1 < corners.size(); ++i) {
+				const FaceCorner * triangle[3] = {&corners[0], &corners[i], &corners[i + 1]};
+				for (const FaceCorner * c : triangle) {
+					positions.push_back(temp_positions[c->position]);
+					normals.push_back(hasNormals ? temp_normals[c->normal] : faceNormal);
+					uvCoords.push_back(hasUVCoords ? temp_uvCoords[c->uvCoord] : vec2(0.0f));
+				}
+			}
+		}
+	}
+	if (!anyUVCoords) {
+		uvCoords.clear();
+	}
 
 	if (objectName.compare("") == 0) {
 		// No 'o' object name tag defined in .obj file, so use the file name
 		// minus the '.obj' ending as the objectName.
 		const char * ptr = strrchr(objFilePath, '/');
-		objectName.assign(ptr+1);
+		objectName.assign(ptr ? ptr + 1 : objFilePath);
 		size_t pos = objectName.find('.');
-		objectName.resize(pos);
+		if (pos != string::npos) {
+			objectName.resize(pos);
+		}
 	}
 }
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <glm/glm.hpp>
+#include <cstddef>
 #include <vector>
 #include <string>
 
@@ -11,6 +12,8 @@ public:
 	* Extracts vertex data from a Wavefront .obj file
 	* If an object name parameter is present in the .obj file, objectName is set to that,
 	* otherwise objectName is set to the name of the .obj file.
+	* Faces may have any number of corners and use negative (relative) indices; they are
+	* triangulated as fans.  Throws Exception on malformed data.
 	*
 	* [in] objFilePath - path to .obj file
 	* [out] objectName - name given to object.
@@ -26,6 +29,24 @@ public:
             std::vector<glm::vec2> & uvCoords
     );
 
+	/**
+	* As above, for the contents of a .obj file already in memory, e.g. in an AssetPack.
+	* Nothing is copied out of data.
+	*
+	* [in] data, size - contents of the .obj file.
+	* [in] objFilePath - name of the .obj file, for error messages and the default
+	*      objectName.
+	*/
+    static void decode(
+		    const char * data,
+		    size_t size,
+		    const char * objFilePath,
+			std::string & objectName,
+            std::vector<glm::vec3> & positions,
+            std::vector<glm::vec3> & normals,
+            std::vector<glm::vec2> & uvCoords
+    );
+
 
 	/**
 	* Extracts vertex data from a Wavefront .obj file
@@ -0,0 +1,28 @@
+#include "PackedVertex.hpp"
+
+#include <cmath>
+using namespace glm;
+
+namespace {
+
+//---------------------------------------------------------------------------------------
+// One 10 bit signed normalized field of GL_INT_2_10_10_10_REV.  Packed here rather
+// than with glm/gtc/packing.hpp, whose header trips -Wstrict-aliasing.
+uint32 packSnorm10(float v) {
+	return uint32((int)std::round(clamp(v, -1.0f, 1.0f) * 511.0f)) & 0x3FFu;
+}
+
+} // namespace
+
+//---------------------------------------------------------------------------------------
+PackedVertex packVertex (
+		const glm::vec3 & position,
+		const glm::vec3 & normal,
+		const glm::vec2 & uvCoord
+) {
+	PackedVertex vertex;
+	vertex.position = position;
+	vertex.normal = packSnorm10(normal.x) | packSnorm10(normal.y) << 10 | packSnorm10(normal.z) << 20;
+	vertex.uvCoord = packHalf2x16(uvCoord);
+	return vertex;
+}
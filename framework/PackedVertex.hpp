@@ -0,0 +1,20 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+// Interleaved, compact vertex layout: 20 bytes instead of 32 for three float streams.
+//   position - 3 x float
+//   normal   - GL_INT_2_10_10_10_REV, signed normalized, w unused
+//   uvCoord  - 2 x GL_HALF_FLOAT
+struct PackedVertex {
+	glm::vec3 position;
+	glm::uint32 normal;
+	glm::uint32 uvCoord;
+};
+
+//---------------------------------------------------------------------------------------
+PackedVertex packVertex (
+		const glm::vec3 & position,
+		const glm::vec3 & normal,
+		const glm::vec2 & uvCoord
+);
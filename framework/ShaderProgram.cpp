@@ -133,13 +133,17 @@ void ShaderProgram::link() {
 
     glLinkProgram(programObject);
     checkLinkStatus();
+    uniformLocations.clear();
 
     CHECK_GL_ERRORS;
 }
 
 //------------------------------------------------------------------------------------
 ShaderProgram::~ShaderProgram() {
-    deleteShaders();
+    // Never generated, e.g. for a poster traced without a GL context.
+    if (programObject != 0) {
+        deleteShaders();
+    }
 }
 
 //------------------------------------------------------------------------------------
@@ -240,10 +244,16 @@ GLuint ShaderProgram::getProgramObject() const {
 //------------------------------------------------------------------------------------
 /*
  * Returns the location value of a uniform variable within the shader program.
+ * Locations are cached after the first query.
  */
 GLint ShaderProgram::getUniformLocation (
 		const char * uniformName
 ) const {
+    auto cached = uniformLocations.find(uniformName);
+    if (cached != uniformLocations.end()) {
+        return cached->second;
+    }
+
     GLint result = glGetUniformLocation(programObject, (const GLchar *)uniformName);
 
     if (result == -1) {
@@ -252,9 +262,31 @@ GLint ShaderProgram::getUniformLocation (
         throw ShaderException(errorMessage.str());
     }
 
+    uniformLocations[uniformName] = result;
     return result;
 }
 
+//------------------------------------------------------------------------------------
+/*
+ * Connects the named uniform block of the shader program to a uniform buffer
+ * binding point.
+ */
+void ShaderProgram::bindUniformBlock (
+		const char * blockName,
+		GLuint bindingPoint
+) const {
+    GLuint blockIndex = glGetUniformBlockIndex(programObject, (const GLchar *)blockName);
+
+    if (blockIndex == GL_INVALID_INDEX) {
+        stringstream errorMessage;
+        errorMessage << "Error obtaining uniform block index: " << blockName;
+        throw ShaderException(errorMessage.str());
+    }
+
+    glUniformBlockBinding(programObject, blockIndex, bindingPoint);
+    CHECK_GL_ERRORS;
+}
+
 //------------------------------------------------------------------------------------
 /*
  * Returns the location value of an attribute variable within the shader program.
@@ -7,6 +7,7 @@
 #include "OpenGLImport.hpp"
 
 #include <string>
+#include <unordered_map>
 
 
 class ShaderProgram {
@@ -35,6 +36,8 @@ public:
 
     GLint getUniformLocation(const char * uniformName) const;
 
+    void bindUniformBlock(const char * blockName, GLuint bindingPoint) const;
+
     GLint getAttribLocation(const char * attributeName) const;
 
 
@@ -54,6 +57,9 @@ private:
     GLuint prevProgramObject;
     GLuint activeProgram;
 
+    // Uniform locations already queried from GL, cleared on every link().
+    mutable std::unordered_map<std::string, GLint> uniformLocations;
+
     void extractSourceCode(std::string & shaderSource, const std::string & filePath);
     
     void extractSourceCodeAndCompile(const Shader &shader);
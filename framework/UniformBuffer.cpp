@@ -0,0 +1,57 @@
+#include "UniformBuffer.hpp"
+#include "GlErrorCheck.hpp"
+#include "Exception.hpp"
+
+//------------------------------------------------------------------------------------
+UniformBuffer::UniformBuffer()
+    : bufferObject(0),
+      size(0)
+{
+
+}
+
+//------------------------------------------------------------------------------------
+UniformBuffer::~UniformBuffer() {
+    if (bufferObject != 0) {
+        glDeleteBuffers(1, &bufferObject);
+    }
+}
+
+//------------------------------------------------------------------------------------
+void UniformBuffer::create (
+		size_t sizeInBytes,
+		GLuint bindingPoint
+) {
+    if (bufferObject == 0) {
+        glGenBuffers(1, &bufferObject);
+    }
+    size = sizeInBytes;
+
+    glBindBuffer(GL_UNIFORM_BUFFER, bufferObject);
+    glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    glBindBufferBase(GL_UNIFORM_BUFFER, bindingPoint, bufferObject);
+    CHECK_GL_ERRORS;
+}
+
+//------------------------------------------------------------------------------------
+void UniformBuffer::update (
+		const void * data,
+		size_t sizeInBytes,
+		size_t offset
+) const {
+    if (offset + sizeInBytes > size) {
+        throw Exception("Error within UniformBuffer::update: write past end of buffer\n");
+    }
+
+    glBindBuffer(GL_UNIFORM_BUFFER, bufferObject);
+    glBufferSubData(GL_UNIFORM_BUFFER, offset, sizeInBytes, data);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    CHECK_GL_ERRORS;
+}
+
+//------------------------------------------------------------------------------------
+GLuint UniformBuffer::getBufferObject() const {
+    return bufferObject;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "OpenGLImport.hpp"
+
+#include <cstddef>
+
+/*
+ * Owns a GL uniform buffer object attached to a fixed binding point.  The layout
+ * of the data written is up to the caller and must match a std140 block.
+ */
+class UniformBuffer {
+public:
+    UniformBuffer();
+
+    ~UniformBuffer();
+
+    // Allocates sizeInBytes of storage and attaches it to bindingPoint.
+    void create(size_t sizeInBytes, GLuint bindingPoint);
+
+    void update(const void * data, size_t sizeInBytes, size_t offset = 0) const;
+
+    GLuint getBufferObject() const;
+
+private:
+    GLuint bufferObject;
+    size_t size;
+};
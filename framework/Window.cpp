@@ -36,7 +36,9 @@ Window::Window()
    m_framebufferWidth(0),
    m_framebufferHeight(0),
    m_paused(false),
-   m_fullScreen(false)
+   m_fullScreen(false),
+   m_visible(true),
+   m_swapInterval(1)
 {
 
 }
@@ -340,7 +342,7 @@ void Window::run (
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    glfwWindowHint(GLFW_VISIBLE, GL_TRUE);
+    glfwWindowHint(GLFW_VISIBLE, m_visible ? GL_TRUE : GL_FALSE);
     glfwWindowHint(GLFW_SAMPLES, 0);
     glfwWindowHint(GLFW_RED_BITS, 8);
     glfwWindowHint(GLFW_GREEN_BITS, 8);
@@ -348,7 +350,7 @@ void Window::run (
     glfwWindowHint(GLFW_ALPHA_BITS, 8);
 
     m_monitor = glfwGetPrimaryMonitor();
-    if (m_monitor == NULL) {
+    if (m_monitor == NULL && m_visible) {
         glfwTerminate();
         fprintf(stderr, "Error retrieving primary monitor.\n");
         std::abort();
@@ -365,7 +367,9 @@ void Window::run (
     // displays.
     glfwGetFramebufferSize(m_window, &m_framebufferWidth, &m_framebufferHeight);
 
-    centerWindow();
+    if (m_visible) {
+        centerWindow();
+    }
     glfwMakeContextCurrent(m_window);
 	gl3wInit();
     
@@ -386,8 +390,8 @@ void Window::run (
 
     try {
         // Wait until m_monitor refreshes before swapping front and back buffers.
-        // To prevent tearing artifacts.
-        glfwSwapInterval(1);
+        // To prevent tearing artifacts.  Benchmarks turn this off.
+        glfwSwapInterval(m_swapInterval);
 
 		// Call client-defined startup code.
         init();
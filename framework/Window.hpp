@@ -56,6 +56,11 @@ protected:
 	bool m_paused;
 	bool m_fullScreen;
 
+	// May be changed by derived constructors before launch() creates the window.
+	// A hidden window renders offscreen and needs no monitor.
+	bool m_visible;
+	int m_swapInterval;
+
 private:
 	static std::shared_ptr<Window> m_instance;
 
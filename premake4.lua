@@ -21,6 +21,7 @@ if PLATFORM == "macosx" then
     linkLibs = {
         "framework",
         "imgui",
+        "lodepng",
         "glfw3",
         "lua"
     }
@@ -56,6 +57,7 @@ if PLATFORM == "linux" then
     linkLibs = {
         "framework",
         "imgui",
+        "lodepng",
         "glfw3",
 	"IrrKlang",
         "lua",
@@ -141,6 +143,156 @@ solution "survey-neo"
         includedirs (includeDirList)
         files { "*.cpp" }
 
+    -- Packs Assets/ into Assets.pack for Project to map at startup
+    project "AssetCook"
+        kind "ConsoleApp"
+        language "C++"
+        location "build"
+        objdir "build/tools"
+        targetdir "."
+        buildoptions (buildOptions)
+        libdirs (libDirectories)
+        links { "framework" }
+        includedirs (includeDirList)
+        files { "tools/AssetCook.cpp" }
+
+    -- Compares ObjFileDecoder against the line based decoder it replaced
+    project "ObjDecodeBench"
+        kind "ConsoleApp"
+        language "C++"
+        location "build"
+        objdir "build/bench"
+        targetdir "."
+        buildoptions (buildOptions)
+        libdirs (libDirectories)
+        links { "framework" }
+        includedirs (includeDirList)
+        files { "bench/ObjDecodeBench.cpp" }
+
+    -- Compares the compiled facade grammar against the string rewriting it replaced
+    project "FacadeGrammarBench"
+        kind "ConsoleApp"
+        language "C++"
+        location "build"
+        objdir "build/bench"
+        targetdir "."
+        buildoptions (buildOptions)
+        links { "pthread" }
+        includedirs (includeDirList)
+        files {
+            "bench/FacadeGrammarBench.cpp",
+            "Building.cpp",
+            "FacadeGrammar.cpp",
+            "GeometryNode.cpp",
+            "NodeName.cpp",
+            "SceneArena.cpp",
+            "SceneNode.cpp",
+            "SceneRegistry.cpp"
+        }
+
+    -- Times the crowd grid spotlight query against scanning every person
+    project "CrowdGridBench"
+        kind "ConsoleApp"
+        language "C++"
+        location "build"
+        objdir "build/bench"
+        targetdir "."
+        buildoptions (buildOptions)
+        includedirs (includeDirList)
+        files {
+            "bench/CrowdGridBench.cpp",
+            "CrowdGrid.cpp"
+        }
+
+    -- Compares the data-oriented crowd update against the per-Person objects it replaced
+    project "CrowdBench"
+        kind "ConsoleApp"
+        language "C++"
+        location "build"
+        objdir "build/bench"
+        targetdir "."
+        buildoptions (buildOptions)
+        links { "pthread" }
+        includedirs (includeDirList)
+        files {
+            "bench/CrowdBench.cpp",
+            "Crowd.cpp",
+            "CrowdGrid.cpp",
+            "NodeName.cpp",
+            "SceneArena.cpp",
+            "SceneNode.cpp",
+            "VoiceManager.cpp"
+        }
+
+    -- Times generating the city against restoring it from a snapshot
+    project "CitySnapshotBench"
+        kind "ConsoleApp"
+        language "C++"
+        location "build"
+        objdir "build/bench"
+        targetdir "."
+        buildoptions (buildOptions)
+        libdirs (libDirectories)
+        links { "framework", "lua", "dl", "pthread" }
+        includedirs (includeDirList)
+        files {
+            "bench/CitySnapshotBench.cpp",
+            "Building.cpp",
+            "CitySnapshot.cpp",
+            "Crowd.cpp",
+            "CrowdGrid.cpp",
+            "FacadeGrammar.cpp",
+            "GeometryNode.cpp",
+            "NodeName.cpp",
+            "Person.cpp",
+            "SceneArena.cpp",
+            "SceneNode.cpp",
+            "SceneRegistry.cpp",
+            "StaticGeometry.cpp",
+            "VoiceManager.cpp",
+            "scene_lua.cpp"
+        }
+
+    -- Times building the spotlight BVH and casting rays against it, up to ten times the city
+    project "TriangleBvhBench"
+        kind "ConsoleApp"
+        language "C++"
+        location "build"
+        objdir "build/bench"
+        targetdir "."
+        buildoptions (buildOptions)
+        links { "pthread" }
+        includedirs (includeDirList)
+        files {
+            "bench/TriangleBvhBench.cpp",
+            "TriangleBvh.cpp",
+            "WorkerPool.cpp"
+        }
+
+    -- Times the path traced poster on one thread up to all of them
+    project "PosterBench"
+        kind "ConsoleApp"
+        language "C++"
+        location "build"
+        objdir "build/bench"
+        targetdir "."
+        buildoptions (buildOptions)
+        libdirs (libDirectories)
+        links { "framework", "lodepng", "pthread" }
+        includedirs (includeDirList)
+        files {
+            "bench/PosterBench.cpp",
+            "GeometryNode.cpp",
+            "NodeName.cpp",
+            "PosterRenderer.cpp",
+            "SceneArena.cpp",
+            "SceneNode.cpp",
+            "SceneRegistry.cpp",
+            "StaticGeometry.cpp",
+            "TriangleBvh.cpp",
+            "WorkerPool.cpp"
+        }
+
     configuration "Debug"
         defines { "DEBUG" }
         flags { "Symbols" }
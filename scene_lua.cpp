@@ -40,7 +40,7 @@ struct gr_node_ud {
 // The "userdata" type for a material. Objects of this type will be
 // allocated by Lua to represent materials.
 struct gr_material_ud {
-  Material* material;
+  MaterialHandle material;
 };
 
 // Create a node
@@ -71,7 +71,7 @@ int gr_mesh_cmd(lua_State* L)
 
 	const char* meshId = luaL_checkstring(L, 1);
 	const char* name = luaL_checkstring(L, 2);
-	data->node = new GeometryNode(meshId, name);
+	data->node = new GeometryNode(SceneRegistry::meshHandle(meshId), name);
 
 	luaL_getmetatable(L, "gr.node");
 	lua_setmetatable(L, -2);
@@ -87,7 +87,7 @@ int gr_material_cmd(lua_State* L)
   GRLUA_DEBUG_CALL;
   
   gr_material_ud* data = (gr_material_ud*)lua_newuserdata(L, sizeof(gr_material_ud));
-  data->material = 0;
+  data->material = DEFAULT_MATERIAL;
   
   luaL_checktype(L, 1, LUA_TTABLE);
 
@@ -112,13 +112,14 @@ int gr_material_cmd(lua_State* L)
   lua_pop(L, 1);
   double shininess = luaL_checknumber(L, 3);
 
-	data->material = new Material();
+	Material material;
 	for(int i(0); i < 3; ++i) {
-		data->material->kd[i] = kd[i];
-		data->material->ks[i] = ks[i];
+		material.kd[i] = kd[i];
+		material.ks[i] = ks[i];
 	}
-	data->material->kd[3] = kd[3];
-	data->material->shininess = shininess;
+	material.kd[3] = kd[3];
+	material.shininess = shininess;
+	data->material = SceneRegistry::materialHandle(material);
 
   luaL_newmetatable(L, "gr.material");
   lua_setmetatable(L, -2);
@@ -163,10 +164,7 @@ int gr_node_set_material_cmd(lua_State* L)
   gr_material_ud* matdata = (gr_material_ud*)luaL_checkudata(L, 2, "gr.material");
   luaL_argcheck(L, matdata != 0, 2, "Material expected");
 
-	Material * material = matdata->material;
-	self->material.kd = material->kd;
-	self->material.ks = material->ks;
-	self->material.shininess = material->shininess;
+	self->material = matdata->material;
 
   return 0;
 }
@@ -313,8 +311,9 @@ static const luaL_Reg grlib_node_methods[] = {
   {0, 0}
 };
 
-// This function calls the lua interpreter to do the actual importing
-SceneNode* import_lua(const std::string& filename)
+// This function calls the lua interpreter to do the actual importing.
+// The scene is read from filename, or from buffer if it is not null.
+static SceneNode* import_lua_chunk(const std::string& filename, const char* buffer, size_t size)
 {
   GRLUA_DEBUG("Importing scene from " << filename);
   
@@ -345,7 +344,9 @@ SceneNode* import_lua(const std::string& filename)
 
   GRLUA_DEBUG("Parsing the scene");
   // Now parse the actual scene
-  if (luaL_loadfile(L, filename.c_str()) || lua_pcall(L, 0, 1, 0)) {
+  int loadError = buffer ? luaL_loadbuffer(L, buffer, size, ("@" + filename).c_str())
+                       : luaL_loadfile(L, filename.c_str());
+  if (loadError || lua_pcall(L, 0, 1, 0)) {
     std::cerr << "Error loading " << filename << ": " << lua_tostring(L, -1) << std::endl;
     return 0;
   }
@@ -370,3 +371,13 @@ SceneNode* import_lua(const std::string& filename)
   // And return the node
   return node;
 }
+
+SceneNode* import_lua(const std::string& filename)
+{
+  return import_lua_chunk(filename, 0, 0);
+}
+
+SceneNode* import_lua(const char* data, size_t size, const std::string& filename)
+{
+  return import_lua_chunk(filename, data, size);
+}
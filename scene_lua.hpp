@@ -2,8 +2,13 @@
 
 #pragma once
 
+#include <cstddef>
 #include <string>
 #include "SceneNode.hpp"
 
 SceneNode * import_lua(const std::string & filename);
 
+// The scene script already in memory, e.g. in an AssetPack; filename names it in
+// error messages.
+SceneNode * import_lua(const char * data, size_t size, const std::string & filename);
+
@@ -0,0 +1,73 @@
+// Cooks every file under an asset directory into one AssetPack, so Project maps a
+// single file at startup instead of opening each texture, mesh, sound and scene.
+// Editor backups ending in '~' and hidden files are left out.
+//
+// Rerun it whenever an asset changes: a pack shadows the loose files it holds.
+//
+// Usage: ./AssetCook [asset directory [pack file]]    (default Assets Assets.pack)
+
+#include "framework/AssetPack.hpp"
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+namespace {
+
+//---------------------------------------------------------------------------------------
+// Appends the names, relative to root, of the files under directory.
+void listFiles(const string & root, const string & directory, vector<string> & names) {
+	string path = directory.empty() ? root : root + "/" + directory;
+	DIR * dir = opendir(path.c_str());
+	if (!dir) {
+		cerr << "Cannot read " << path << endl;
+		exit(EXIT_FAILURE);
+	}
+	while (dirent * entry = readdir(dir)) {
+		string file(entry->d_name);
+		if (file[0] == '.' || file[file.size() - 1] == '~') {
+			continue;
+		}
+		string name = directory.empty() ? file : directory + "/" + file;
+		struct stat status;
+		if (stat((root + "/" + name).c_str(), &status) != 0) {
+			continue;
+		}
+		if (S_ISDIR(status.st_mode)) {
+			listFiles(root, name, names);
+		} else if (S_ISREG(status.st_mode)) {
+			names.push_back(name);
+		}
+	}
+	closedir(dir);
+}
+
+} // namespace
+
+int main(int argc, char ** argv) {
+	string root = argc > 1 ? argv[1] : "Assets";
+	string packPath = argc > 2 ? argv[2] : "Assets.pack";
+
+	vector<string> names;
+	listFiles(root, "", names);
+	try {
+		AssetPack::write(packPath, root, names);
+
+		// Read it back the way Project will.
+		AssetPack pack(root);
+		pack.open(packPath);
+		struct stat status;
+		stat(packPath.c_str(), &status);
+		cout << "Packed " << pack.size() << " files from " << root << " into " << packPath
+			<< " (" << status.st_size / 1024 << " KiB)" << endl;
+	} catch (const exception & e) {
+		cerr << e.what() << endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}